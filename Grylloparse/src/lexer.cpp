@@ -43,6 +43,7 @@ class LexerImpl : public BaseLexer
 public:
     const static size_t DEFAULT_BUFFSIZE  = 4096; // 4 kB
     const static int    DEFAULT_VERBOSITY = 0;
+    const static int    MAX_VERBOSITY     = 3;
     // UDR - Use Dedicated Runner. By default, no.
     const static bool   DEFAULT_UDR       = false;
 
@@ -100,32 +101,49 @@ private:
     void throwError( std::string message );
     inline void updateLineStats( char c );
 
-    bool updateBuffer( size_t start = 0 );
+    template< int V > bool updateBuffer( size_t start = 0 );
 
     // Dynamically assigned tokenizer and iterative loop tokenizer implementations
     std::function< int(LexerImpl&, LexicToken&) > getNextTokenPriv; 
     std::function< void( LexerImpl& ) > runnerPriv; 
 
+    /*! Tokenizers are templated on the verbosity level V, so all the logging 
+     *  checks are resolved at compile time, and release instantiation (V = 0)
+     *  has no logging branches at all.
+     *  - The instantiation is chosen here, by the verbosity passed on construction.
+     */ 
+    template< int V > 
     void setFunctions(){
         // Set single-token tokenizer.
         if( !getNextTokenPriv ){
             if( lexics.regexed )
-                getNextTokenPriv = getNextTokenPriv_Regexed ;
+                getNextTokenPriv = getNextTokenPriv_Regexed< V >;
             else
-                getNextTokenPriv = getNextTokenPriv_SimpleDelim;
+                getNextTokenPriv = getNextTokenPriv_SimpleDelim< V >;
         }
 
         // Set iterative runner tokenizer.
         if( useDedicatedLoopyTokenizer )
-            runnerPriv = runner_dedicatedIteration;
+            runnerPriv = runner_dedicatedIteration< V >;
         else
             runnerPriv = runner_usingTokenGetter;
     }
 
-    static int getNextTokenPriv_SimpleDelim( LexerImpl& lex, LexicToken& tok );
-    static int getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok );
+    void setFunctions(){
+        if( verbosity <= 0 )
+            setFunctions< 0 >();
+        else if( verbosity == 1 )
+            setFunctions< 1 >();
+        else if( verbosity == 2 )
+            setFunctions< 2 >();
+        else
+            setFunctions< MAX_VERBOSITY >();
+    }
+
+    template< int V > static int getNextTokenPriv_SimpleDelim( LexerImpl& lex, LexicToken& tok );
+    template< int V > static int getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok );
 
-    static void runner_dedicatedIteration( LexerImpl& lex );
+    template< int V > static void runner_dedicatedIteration( LexerImpl& lex );
     static void runner_usingTokenGetter( LexerImpl& lex );
 
 public:
@@ -181,6 +199,7 @@ void LexerImpl::throwError( std::string message ){
  *  @param start - the offset from buffer's beginning, to which to write data.
  *  @return true, if read some data, false if no data was read.
  */ 
+template< int V >
 bool LexerImpl::updateBuffer( size_t start ){
     if( endOfStream )
         return false;
@@ -194,7 +213,7 @@ bool LexerImpl::updateBuffer( size_t start ){
         rdr.read( &buffer[0] + start, buffer.size() - start );
         size_t count = rdr.gcount();
 
-        if( verbosity > 0 )
+        if( V > 0 )
             std::cout <<"[LexerImpl::updateBuffer()]: Updating buffer. ("<< count <<" chars).\n";
 
         // Check for EOF. If yes, mark end of stream.
@@ -204,7 +223,7 @@ bool LexerImpl::updateBuffer( size_t start ){
 
         // No chars were read - stream has ended. No more data can be got.
         if( count == 0 ){
-            if( verbosity > 0 )
+            if( V > 0 )
                 std::cout <<" Stream has ENDED ! \n\n";
             return false;
         }
@@ -213,7 +232,7 @@ bool LexerImpl::updateBuffer( size_t start ){
         bufferEnd = &buffer[0] + start + count;
         bufferPointer = &buffer[0] + start;
 
-        if( verbosity > 0 )
+        if( V > 0 )
             std::cout <<"\n";
     }
     // Buffer is not exhausted - data still avairabru.
@@ -239,8 +258,9 @@ inline void LexerImpl::updateLineStats( char c ){
  *  - Iterates the buffer, searching for the delimiters, and at the same time 
  *    updates the statistics (line count, etc).
  */ 
+template< int V >
 int LexerImpl::getNextTokenPriv_SimpleDelim( LexerImpl& lex, LexicToken& tok ){
-    if( lex.verbosity > 0 )
+    if( V > 0 )
         std::cout <<"[LexerImpl::getNextTokenPriv_SimpleDelim()]: This is Shit!\n";
     return TOKEN_INVALID_CONFIGURATION;
 }
@@ -260,18 +280,19 @@ int LexerImpl::getNextTokenPriv_SimpleDelim( LexerImpl& lex, LexicToken& tok ){
  *  - CAUTION: No checking is done on the RegLex data. 
  *             The user must provide the valid above sections.
  */ 
+template< int V >
 int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
-    if( lex.verbosity > 0 )
+    if( V > 0 )
         std::cout <<"[LexerImpl::getNextTokenPriv_Regexed()]: Using the Full Language Regex.\n";
 
     // Updating buffer, and check if we can read something.
-    if( !lex.updateBuffer() && (lex.bufferPointer >= lex.bufferEnd) ){
-        if( lex.verbosity > 0 )
+    if( !lex.updateBuffer< V >() && (lex.bufferPointer >= lex.bufferEnd) ){
+        if( V > 0 )
             std::cout <<" No data to read!\n\n";
         return TOKEN_END_OF_FILE;
     }
 
-    if( lex.verbosity > 1 ){
+    if( V > 1 ){
         std::cout <<" Buffpos: "<< (int)(lex.bufferPointer - &(lex.buffer[0])) <<
                     ", Bufflen: "<< (int)(lex.bufferEnd - &(lex.buffer[0])) <<
                     ", Streampos: "<< lex.rdr.tellg() <<"\n";
@@ -307,10 +328,10 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
             // Start from 1st submatch, because 0th is the whole regex match.
             for (size_t i = 1; i < m.size(); i++){
                 if( m[i].length() > 0 ){
-                    if( lex.verbosity > 1 )
+                    if( V > 1 )
                         std::cout << " Regex Group #"<< i - 1 <<" was matched, at pos: " \
                                   << m.position() << " from ptr.\n" ;
-                    if( lex.verbosity > 2 && lex.buffer.size() < 40 )
+                    if( V > 2 && lex.buffer.size() < 40 )
                         std::cout << " Buffer from Pointer: \""<< lex.bufferPointer << "\"\n\n";
 
                     // Check if it's a whitespace. If so, match next token.
@@ -336,7 +357,7 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
                     {
                         // TODO: Find out line position.
 
-                        if( lex.verbosity > 0 )
+                        if( V > 0 )
                             std::cout<<" ERROR! Token \""<< m[i] << "\" matched the Error Group!\n";
                         lex.bufferPointer = tokEnd;
                         lex.throwError( "Invalid token." );
@@ -351,7 +372,7 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
                     // So, std::move the data from the buffer to token's data,
                     // and then reset the buffer.
                     if( bufferWasExtended ){
-                        if( lex.verbosity > 2 ){
+                        if( V > 2 ){
                             std::cout<<" Buffer was extended. std::move buffer to token data.\n";
                             if( lex.buffer.size() < 50) std::cout<<" Buffer: "<<lex.buffer<<"\n";
                         }
@@ -378,7 +399,7 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
                         lex.bufferPointer = &(lex.buffer[0]);
                         lex.bufferEnd = lex.bufferPointer + remLen;
 
-                        if( lex.verbosity > 2 ){
+                        if( V > 2 ){
                             std::cout<<" BuffSize after std::moving: "<<lex.buffer.size()<<"\n";
                             if(lex.buffer.size() < 50) std::cout<<" Buffer: "<<lex.buffer<<"\n";
                         }
@@ -391,7 +412,7 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
                         lex.bufferPointer = tokEnd; 
                     }
 
-                    if( lex.verbosity > 0 ){
+                    if( V > 0 ){
                         std::cout<<" Token Matched! "<< "ID: "<< tok.id << ", data: " <<
                             ( tok.data.size() < 30 ? tok.data : 
                               "("+std::to_string( tok.data.size() )+")" ) << "\n\n";
@@ -413,7 +434,7 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
          *    be shorter than BUFFER_SIZE, so it fits.
          */
         if( reBufferNeeded ){
-            if( lex.verbosity > 2 ){
+            if( V > 2 ){
                 std::cout<<" Token ends at buffer end. ReBuffering needed.\n";
                 if( lex.buffer.size() < 50 ) std::cout<< " Buffer Before: "<<lex.buffer<<"\n";
             }
@@ -422,7 +443,7 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
 
             // If token is longer than half of BUFFER_SIZE, extend the buffer.
             if( (size_t)(m.length()) > (size_t)(lex.buffer.size() - lex.BUFFER_SIZE/2) ){
-                if( lex.verbosity > 2 )
+                if( V > 2 )
                     std::cout<< " Extending Buffer.\n";
 
                 // Move memory to the resized buffer, if the token starts later.
@@ -450,7 +471,7 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
             // Fetch data to this place.
             fetchOffset = m.length();
 
-            if( lex.verbosity > 2 ){
+            if( V > 2 ){
                 std::cout << " After ReBuffering: New BufLen: "<< lex.buffer.size()
                           << ", token length: "<< m.length() <<"\n";  
                 if( lex.buffer.size() < 50 ) std::cout<< " Buffer After: "<<lex.buffer<<"\n";
@@ -458,7 +479,7 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
         }
 
         // Fetch the new data from stream. All pointers will automatically be assigned.
-        if( !lex.updateBuffer( fetchOffset ) ){
+        if( !lex.updateBuffer< V >( fetchOffset ) ){
             if( !bufferWasExtended )
                 return TOKEN_END_OF_FILE;
 
@@ -483,13 +504,14 @@ int LexerImpl::getNextTokenPriv_Regexed( LexerImpl& lex, LexicToken& tok ){
  *  every time.
  *  - For calling conditions, look on public interface method.
  */ 
+template< int V >
 void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
-    if( lex.verbosity > 0 )
+    if( V > 0 )
         std::cout << "[LexerImpl::runner_dedicatedIteration()]: Starting the Harvesting!\n"; 
 
     // Perform an initial buffer update.
-    if( !lex.updateBuffer() ){
-        if( lex.verbosity > 0 )
+    if( !lex.updateBuffer< V >() ){
+        if( V > 0 )
             std::cout << " No more data to read!\n\n";
         return;
     }
@@ -509,7 +531,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
         const char* tokEnd = lex.bufferPointer;
         size_t fetchOffset = 0;
 
-        if( lex.verbosity > 1 ){
+        if( V > 1 ){
             std::cout << "\nBUFFER UPDATED "<< bufferUpdates <<" time.\n" 
                       << " bufferWasExtended: "<< bufferWasExtended <<"\n";
         }
@@ -527,7 +549,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
             // Current match.
             auto&& m = *it;
 
-            if( lex.verbosity > 1 ){
+            if( V > 1 ){
                 std::cout << "\nMATCH FOUND: "; 
                 if( m.length() < 50 ) 
                     std::cout <<"\""<< m.str() <<"\"\n";
@@ -540,12 +562,12 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
             // Check which group was matched. By that set token's ID.
             for( size_t i = 1; i < m.size(); i++ ){
                 if( m[i].length() ) {
-                    if( lex.verbosity > 1 )
+                    if( V > 1 )
                         std::cout << ", Capture group index: " << i - 1 << "\n";
 
                     // Check if it's a whitespace. If so, match next token.
                     if( i - 1 == lex.lexics.spaceRuleIndex ){
-                        if( lex.verbosity > 2 )
+                        if( V > 2 )
                             std::cout << " Whitespace group was matched! Skipping...\n";
                         break;
                     }
@@ -554,7 +576,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
                     // If so, reBuffering is needed. Break the loop and fetch new data.
                     tokEnd = lex.bufferPointer + m.position() + m.length();
                     if( (tokEnd >= lex.bufferEnd) && !lex.endOfStream ){
-                        if( lex.verbosity > 2 )
+                        if( V > 2 )
                             std::cout << " Token match reached the end of the buffer." \
                                       << " ReBuffering is needed.\n";
                         // Set bufferPointer to token's start, for easier data moving.
@@ -572,7 +594,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
                     {
                         // TODO: Find out line position.
 
-                        if( lex.verbosity > 0 )
+                        if( V > 0 )
                             std::cout << " ERROR! Token \""<< m[i] \
                                       << "\" matched the Error Group!\n";
                         lex.throwError( "Invalid token." );
@@ -586,7 +608,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
                     // Reset the buffer when job is done, if was extended.
                     // If buffer was extended, the token starts AT BEGINNING OF THE BUFFER.
                     if( bufferWasExtended ){
-                        if( lex.verbosity > 2 )
+                        if( V > 2 )
                             std::cout<< " Buffer was extended. Shrinking and std::moving.";
 
                         // fetchOffset will hold remaining buffer length.
@@ -615,7 +637,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
                         reBufferNeeded = REFETCH_NEEDED;
                         bufferWasExtended = false;
 
-                        if( lex.verbosity > 2 )
+                        if( V > 2 )
                             std::cout<< " New length: "<< lex.buffer.size() <<"\n"; 
                     }
                     else{
@@ -638,7 +660,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
         // If ReBuffering is needed, then token start/end positions are already known.
         // Move token to the start of the buffer.
         if( reBufferNeeded == TOKEN_AT_THE_END ){
-            if( lex.verbosity > 2 ){
+            if( V > 2 ){
                 std::cout<<" ReBuffering.";
                 if( lex.buffer.size() < 50 ) std::cout<< " Buffer Before: "<<lex.buffer;
                 std::cout<<"\n";
@@ -649,7 +671,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
 
             // If token is longer than half of BUFFER_SIZE, extend the buffer.
             if( fetchOffset > (size_t)(lex.buffer.size() - lex.BUFFER_SIZE/2) ){
-                if( lex.verbosity > 2 )
+                if( V > 2 )
                     std::cout<< " Extending Buffer.\n";
 
                 // Move memory to the resized buffer, if the token starts later.
@@ -674,7 +696,7 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
             else if( fetchOffset > 0 )
                 std::memmove( &(lex.buffer[0]), lex.bufferPointer, fetchOffset );
 
-            if( lex.verbosity > 2 ){
+            if( V > 2 ){
                 std::cout << " After ReBuffering: New BufLen: "<< lex.buffer.size()
                           << ", token length: "<< fetchOffset <<"\n";  
                 if( lex.buffer.size() < 50 ) std::cout<< " Buffer After: "<<lex.buffer<<"\n";
@@ -685,8 +707,8 @@ void LexerImpl::runner_dedicatedIteration( LexerImpl& lex ){
         lex.bufferPointer = lex.bufferEnd;
 
         // Fetch the new data from stream. All pointers will automatically be assigned.
-        if( !lex.updateBuffer( fetchOffset ) ){
-            if( lex.verbosity > 1 ){
+        if( !lex.updateBuffer< V >( fetchOffset ) ){
+            if( V > 1 ){
                 std::cout << "\nUpdating buffer reached END OF STREAM.\n"
                           << " bufferWasExtended: "<< bufferWasExtended <<"\n";
             }
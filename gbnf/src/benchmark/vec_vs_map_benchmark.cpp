@@ -4,12 +4,13 @@
 #include <ctime>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 const size_t arrSize = 3000000;
 const size_t findIters = 10000000;
 
 template<typename Callable, typename... Args>
-void functionExecTime( Callable func, Args&&... args ){
+double functionExecTime( Callable func, Args&&... args ){
     using namespace std::chrono;
     high_resolution_clock::time_point t1 = high_resolution_clock::now();
 
@@ -17,7 +18,8 @@ void functionExecTime( Callable func, Args&&... args ){
 
     high_resolution_clock::time_point t2 = high_resolution_clock::now();
     duration<double> time_span = duration_cast<duration<double>>(t2 - t1);
-    std::cout << "f() took " << time_span.count() << " ms\n";
+    std::cout << "f() took " << time_span.count() << " s\n";
+    return time_span.count();
 }
 
 void generateTestData( size_t dataSamples, size_t step,
@@ -35,39 +37,73 @@ void generateTestData( size_t dataSamples, size_t step,
                 ((double)dataSamples / (double)RAND_MAX)) % dataSamples;
         }
     } 
+    data.sort();
 }
 
-void testVector(){
-    // Benchmark vector-type container.
-    std::cout<<"\n------- Vector -------\n\nAllocating memory...\n" << std::flush;
+/*! Parser-like load: every rule body references tags by name, so tags are looked
+ *  up and inserted in between rule insertions, and the rules come in out of order.
+ */
+template< class Storage >
+void parseLikeInsert( gbnf::BasicGbnfData< Storage >& data, size_t ruleCount ){
+    for( size_t i = 0; i < ruleCount; i++ ){
+        size_t lhs = ( i * 7919 ) % ruleCount;
+        size_t id = data.getTagIDfromTable( "tag_" + std::to_string( lhs ), true );
+        size_t ref = data.getTagIDfromTable( "tag_" + std::to_string( (lhs + 1) % ruleCount ), true );
+
+        data.insertRule( gbnf::GrammarRule( id, {
+            gbnf::GrammarToken( gbnf::GrammarToken::ROOT_TOKEN, 0, "", {
+                gbnf::GrammarToken( gbnf::GrammarToken::TAG_ID, ref, "", {} ) } )
+        } ) );
+    }
+    data.sort();
+}
 
-    gbnf::GbnfData data;
+template< class Storage >
+void testPolicy( const char* name ){
+    std::cout<<"\n------- "<< name <<" -------\n\nInsert (parser-like), "<< arrSize <<" rules.\n" 
+             << std::flush;
+    {
+        gbnf::BasicGbnfData< Storage > parsed;
+        functionExecTime( [&](){ parseLikeInsert( parsed, arrSize ); } );
+    }
+
+    gbnf::BasicGbnfData< Storage > data;
     std::vector<size_t> randVals( arrSize );
 
-    // Fill array
+    // Fill array. Rule IDs have gaps, tag IDs don't.
     generateTestData( arrSize*2, 2, data, randVals );
 
     std::cout<<"Search Rule for "<< findIters <<" iterations.\n" << std::flush;
 
+    size_t found = 0;
     functionExecTime( [&](){
         for(size_t i=0; i < findIters; i++){
-            //if( !(i%50000) )
-            //    std::cout<<"["<< i <<"]: Search RULE at pos: "<< randVals[ i % arrSize ] <<"\n";
-
-            data.getRule( randVals[ i % arrSize ] );
+            if( data.getRule( randVals[ i % arrSize ] ) != data.grammarTableConst().end() )
+                found++;
         }
     } );
 
     std::cout<<"\n--------------\nSearch Tag for "<< findIters <<" iterations.\n" << std::flush;
     functionExecTime( [&](){
         for(size_t i=0; i < findIters; i++){      
-            //if( !(i%50000) )
-            //    std::cout<<"["<< i <<"]: Search TAG at pos: "<< randVals[ i % arrSize ] <<"\n"; 
-            data.getTag( randVals[ i % arrSize ] );
+            if( data.getTag( randVals[ i % arrSize ] ) != data.tagTableConst().end() )
+                found++;
+        }
+    } );
+
+    std::cout<<"\n--------------\nIterate Rules by ID, 10 passes.\n" << std::flush;
+    functionExecTime( [&](){
+        for( size_t pass = 0; pass < 10; pass++ ){
+            for( auto&& rule : data.grammarTableConst() ){
+                // Resolve referenced tags, as the converter does.
+                auto&& tag = data.getTag( rule.options[0].id / 2 + 1 );
+                if( tag != data.tagTableConst().end() )
+                    found += tag->data.size();
+            }
         }
     } );
 
-    std::this_thread::sleep_for( std::chrono::milliseconds(5000) );
+    std::cout<<"(checksum "<< found <<")\n";
 }
 
 /*void testMap(){
@@ -106,7 +142,9 @@ int main(){
     srand( time(0) );
     std::cout<<"Benchmarking GBNF lookup performance. Arr lenght: "<< arrSize <<"\n";
     
-    testVector();
+    testPolicy< gbnf::SortedVectorStorage >( "Sorted Vector" );
+    testPolicy< gbnf::DenseIndexStorage >( "Dense ID-indexed Vector" );
+    testPolicy< gbnf::FlatHashStorage >( "Open-addressing Flat Hash" );
     //testMap();
 
     return 0;
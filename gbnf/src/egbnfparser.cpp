@@ -6,50 +6,242 @@
  */ 
 
 #include <string>
+#include <vector>
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <cstdio>
-#include <cctype>
-#include <gryltools/stackreader.hpp>
+#include <cstring>
+#include <streambuf>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <functional>
 #include "gbnf.hpp"
 extern "C" {
     #include <gryltools/hlog.h>
 }
 
 namespace gbnf{
-    
-struct ParseState{
-    size_t line = 0;
+
+/*! Span of characters in the scanner's buffer.
+ */
+struct ScanSpan{
+    const char* str;
+    size_t len;
+};
+
+static inline bool isSpaceChar( char c ){
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool isNameChar( char c ){
+    return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || 
+           ( c >= '0' && c <= '9' ) || c == '_';
+}
+
+/*! Block-buffered input scanner.
+ *  - Input is read in big blocks, and scanned directly in the buffer.
+ *  - Whitespace and comments ('#' until the endline) are skipped in bulk.
+ *  - Names and strings are returned as spans into the buffer. Span is valid 
+ *    until the next call to the scanner.
+ *  - Line and column are computed only when needed, i.e. for error messages.
+ */
+class BlockScanner{
+private:
+    const static size_t BLOCK_SIZE = 65536;
+
+    std::istream& input;
+    std::vector< char > buffer;
     size_t pos = 0;
+    size_t end = 0;
+    bool eof = false;
+
+    // Line and column of buffer[0].
+    size_t baseLine = 1;
+    size_t baseColumn = 1;
+
+    bool fill( size_t keep );
+
+public:
+    BlockScanner( std::istream& is, size_t line = 1, size_t column = 1 ) 
+        : input( is ), baseLine( line ), baseColumn( column ) {}
+
+    /*! Skips whitespace and comments.
+     *  @return false if the end of input was reached.
+     */
+    bool skipSpace();
+
+    /*! @return the current character, or EOF.
+     */
+    inline int peek(){
+        if( pos == end && !fill( pos ) )
+            return EOF;
+        return (unsigned char)buffer[ pos ];
+    }
+    inline void advance(){ pos++; }
+
+    /*! Scans the name ([a-zA-Z0-9_]*) at current position.
+     */
+    ScanSpan scanName();
+
+    /*! Scans the string contents until the closing '"'. Escaped characters
+     *  are kept in the string. Position must be after the opening '"'.
+     *  @return false if string hasn't ended.
+     */
+    bool scanString( ScanSpan& span );
+
+    void getLocation( size_t& line, size_t& column ) const;
 };
 
+/*! Reads the next block. Data before "keep" is discarded.
+ *  @return false if no more data could be read.
+ */
+bool BlockScanner::fill( size_t keep ){
+    if( eof )
+        return false;
+
+    // Account for the lines in the discarded part.
+    for( size_t i = 0; i < keep; i++ ){
+        if( buffer[ i ] == '\n' ){
+            baseLine++;
+            baseColumn = 1;
+        }
+        else
+            baseColumn++;
+    }
+
+    if( keep ){
+        std::memmove( buffer.data(), buffer.data() + keep, end - keep );
+        pos -= keep;
+        end -= keep;
+    }
+
+    if( buffer.size() < end + BLOCK_SIZE )
+        buffer.resize( end + BLOCK_SIZE );
+
+    input.read( buffer.data() + end, BLOCK_SIZE );
+    size_t count = input.gcount();
+    end += count;
+
+    if( !count ){
+        eof = true;
+        return false;
+    }
+    return true;
+}
+
+bool BlockScanner::skipSpace(){
+    bool inComment = false;
+    while( true ){
+        for( ; pos < end; pos++ ){
+            char c = buffer[ pos ];
+            if( inComment ){
+                const char* nl = (const char*)std::memchr( buffer.data() + pos, '\n', end - pos );
+                if( !nl ){
+                    pos = end;
+                    break;
+                }
+                pos = nl - buffer.data();
+                inComment = false;
+            }
+            else if( c == '#' )
+                inComment = true;
+            else if( !isSpaceChar( c ) )
+                return true;
+        }
+        if( !fill( pos ) )
+            return false;
+    }
+}
+
+ScanSpan BlockScanner::scanName(){
+    size_t i = pos;
+    while( true ){
+        while( i < end && isNameChar( buffer[ i ] ) )
+            i++;
+
+        // Name may continue in the next block.
+        if( i < end || eof )
+            break;
+        size_t offset = i - pos;
+        if( !fill( pos ) )
+            break;
+        i = pos + offset;
+    }
+
+    ScanSpan span{ buffer.data() + pos, i - pos };
+    pos = i;
+    return span;
+}
+
+bool BlockScanner::scanString( ScanSpan& span ){
+    size_t i = pos;
+    while( true ){
+        for( ; i < end; i++ ){
+            if( buffer[ i ] == '\\' )
+                i++;
+            else if( buffer[ i ] == '\"' ){
+                span = ScanSpan{ buffer.data() + pos, i - pos };
+                pos = i + 1;
+                return true;
+            }
+        }
+
+        size_t offset = i - pos;
+        if( !fill( pos ) )
+            return false;
+        i = pos + offset;
+    }
+}
+
+void BlockScanner::getLocation( size_t& line, size_t& column ) const {
+    line = baseLine;
+    column = baseColumn;
+    for( size_t i = 0; i < pos && i < end; i++ ){
+        if( buffer[ i ] == '\n' ){
+            line++;
+            column = 1;
+        }
+        else
+            column++;
+    }
+}
+
+/*! EBNF parser.
+ *  - Templated on the verbosity level V. Logging checks are resolved at compile 
+ *    time, so the V = 0 instantiation carries no logging code at all.
+ */
+template< int V >
 class ParseInput{
 private:
-    int debugMode = 0;
-
-    gtools::StackReader reader;
+    BlockScanner scanner;
     GbnfData& data;
+    bool sortRules = true;
 
-    ParseState ps;
     std::string tempData;
 
-    template<typename... Args>
-    inline void logf( bool debug, int logPriority, const char* message, Args&&... args ) const;
+    template< int Priority, typename... Args >
+    inline void logf( const char* message, Args&&... args ) const;
 
     inline void throwError( const std::string& message ) const; 
-    inline void updateLineStats( const std::string& str );
-    inline void updateLineStats( char c );
 
-    //short getTagIDfromTable( const std::string& name, bool insertIfNotPresent );
-    void getTagName( std::string& str, bool startsWithLetter = true );
+    void getTagName( std::string& str );
+    void getActionName( std::string& str );
     int  parseGrammarToken( GrammarToken& tok, int recLevel = 1, char endChar = '}' );
     bool parseGrammarOption( GrammarToken& tok );
     void parseGrammarRule();
  
 public:
-    ParseInput( std::istream& is, GbnfData& dat, int debMode = 0 ) 
-        : debugMode( debMode ), reader( is ), data( dat )
+    ParseInput( std::istream& is, GbnfData& dat ) 
+        : scanner( is ), data( dat )
+    {}
+
+    /*! Parser of a part of the input, starting at the line and column.
+     *  - Rules are left in the order of input, so parts can be merged in order.
+     */
+    ParseInput( std::istream& is, GbnfData& dat, size_t line, size_t column ) 
+        : scanner( is, line, column ), data( dat ), sortRules( false )
     {}
 
     void convert();
@@ -57,201 +249,155 @@ public:
 
 /*! Function used to simplify the exception throwing.
  */ 
-inline void ParseInput::throwError( const std::string& message ) const {
+template< int V >
+inline void ParseInput< V >::throwError( const std::string& message ) const {
+    size_t line, column;
+    scanner.getLocation( line, column );
+
     std::stringstream ss;
-    ss <<"["<< std::to_string( ps.line ) <<":"<< std::to_string( ps.pos ) <<"] "<< message;
+    ss <<"["<< line <<":"<< column <<"] "<< message;
     throw std::runtime_error( ss.str() );
 }
 
 /*! Simplified logging mechanism.
  */ 
-template<typename... Args>
-inline void ParseInput::logf( bool dewit, int priority, 
-            const char* message, Args&&... args ) const {
-    if(!dewit || (priority > debugMode) )
-        return;
-    hlogf( message, std::forward<Args>( args )... );
+template< int V >
+template< int Priority, typename... Args >
+inline void ParseInput< V >::logf( const char* message, Args&&... args ) const {
+    if( Priority <= V )
+        hlogf( message, std::forward<Args>( args )... );
 }
 
-/*! Can be used to find NonTerminal tag's ID from it's name, 
- *  or to insert into a table a new NonTerminal with name = name. ID ass'd automatically.
- *  @return the ID of the tag got or inserted.
+/*! Gets the name of the tag at current position. 
+ *  - Scanner must be positioned at the '<' character.
+ *  - Tag names consist of [a-zA-Z0-9_] characters.
+ *  @param str - a buffer to which to write a tag.
  */ 
-size_t GbnfData::getTagIDfromTable( const std::string& name, bool insertIfNotPresent ){
-    // Search by iteration, because we can't search for string sorted.
-    for(const auto& t : tagTable){
-        if(t.data.compare( name ) == 0)
-            return t.getID();
-    }
-    // If reached this point, element not found. Insert new NonTerminal Tag if flag specified.
-    if(insertIfNotPresent)
-        return insertTag( name );
+template< int V >
+void ParseInput< V >::getTagName( std::string& str ){
+    scanner.advance(); // Skip the '<'.
 
-    return -1;
-}
+    ScanSpan name = scanner.scanName();
+    str.assign( name.str, name.len );
 
-inline void ParseInput::updateLineStats( const std::string& str ) {
-    size_t pos = 0, lastPos = 0;
-    while( (pos = str.find('\n', lastPos)) != std::string::npos ){
-        ps.line++;
-        lastPos = pos;
-    }
-    ps.pos += str.size()-1 - lastPos;
-}
+    int c = scanner.peek();
+    if( c == EOF )
+        throwError( "Tag hasn't ended!" );
+    if( c != '>' )
+        throwError( "Wrong character in a tag!" );
+    if( str.empty() )
+        throwError( "Tag is empty!" );
 
-inline void ParseInput::updateLineStats( char c ) {
-    if(c == '\n'){
-        ps.line++;
-        ps.pos = 0;
-    }
-    else
-        ps.pos++;
+    scanner.advance();
 }
 
-/*! Gets the name of the tag at current position. 
- *  @param str - a buffer to which to write a tag.
- *  @param startsWithLetter - if false, tag starts with a '<',
- *         if true - with a tag-compatibru letter.
+/*! Gets the name of the semantic action at current position.
+ *  - Scanner must be positioned right after the '@' character.
+ *  - Action names consist of [a-zA-Z0-9_] characters.
+ *  @param str - a buffer to which to write an action name.
  */ 
-void ParseInput::getTagName( std::string& str, bool startsWithLetter ){
-    char c = 0;
-
-    if( reader.peekChar() == '<' ) // Starts with a '<' - skip it.
-        reader.getChar( c );
-
-    while( reader.getChar( c ) ){
-        updateLineStats( c );
+template< int V >
+void ParseInput< V >::getActionName( std::string& str ){
+    ScanSpan name = scanner.scanName();
+    str.assign( name.str, name.len );
 
-        if( c == '>' ){ // End
-            if( str.empty() )
-                throwError( "Tag is empty!" );
-            break; // if string is not empty, break and return good.    
-        }
-        // Tag chars: [a-zA-Z_]
-        else if( !std::isalnum( static_cast<unsigned char>(c) ) && c != '_' ){
-            throwError( "Wrong character in a tag!" );
-        }
-        str.push_back( c );
-    }
-    
-    if( c != '>' )
-        throwError( "Tag hasn't ended!" );
+    if( str.empty() )
+        throwError( "Semantic action name is empty!" );
 }
 
 /*! Gets next grammar Token. It's recursive.
- *  - When called, the Reader position must be at first token's character.
+ *  - When called, the Scanner position must be before the token's first character.
  */ 
-int ParseInput::parseGrammarToken( GrammarToken& tok, int recLevel, char endChar ){
-    const bool dbg = true;
-
+template< int V >
+int ParseInput< V >::parseGrammarToken( GrammarToken& tok, int recLevel, char endChar ){
     const static int END_OF_STREAM             = 2;
     const static int RECURSIVE_ENDCHAR_REACHED = 1;
     //const static int NORMAL_SUCCESS            = 0;
 
-    std::string recs( recLevel, ' ' );
-    logf(dbg, 2, "%s[parseGrammarToken(_,_,\'%c\']\n", recs.c_str(), endChar);
-
-    // Check if token start character.
-    char c;
-    std::string buff;
+    // Indentation of the debug output.
+    const char* recs = "";
+    std::string recsBuff;
+    if( V >= 2 ){
+        recsBuff.assign( recLevel, ' ' );
+        recs = recsBuff.c_str();
+    }
+    logf< 2 >("%s[parseGrammarToken(_,_,\'%c\']\n", recs, endChar);
 
-    // Get the next character, skipping any whitespaces.
-    if( !reader.getChar( c, gtools::StackReader::SKIPMODE_SKIPWS, ps.line, ps.pos ) )
+    // Get the next character, skipping any whitespaces and comments.
+    if( !scanner.skipSpace() )
         return END_OF_STREAM;
+    char c = scanner.peek();
 
     // Check all valid token start characters.
     // Non-Terminal 
     if( c == '<' ){
-        logf(dbg, 2, "%sTag recognized... \n", recs.c_str());
+        logf< 2 >("%sTag recognized... \n", recs);
 
-        buff.reserve(32); // Reserve at least N chars for the upcoming tagname.
-        getTagName( buff, true );
+        getTagName( tempData );
 
-        logf(dbg, 2, "%sGot Name:%s\n", recs.c_str(), buff.c_str());
+        logf< 2 >("%sGot Name:%s\n", recs, tempData.c_str());
 
         tok.type = GrammarToken::TAG_ID;
-        tok.id = data.getTagIDfromTable( buff, true );
+        tok.id = data.getTagIDfromTable( tempData, true );
     }
     // Regex-String
     else if( c == '\"' ){
-        logf(dbg, 2, "%sString recognized... \n", recs.c_str());
+        logf< 2 >("%sString recognized... \n", recs);
 
+        scanner.advance();
         tok.type = GrammarToken::REGEX_STRING;
-        register bool afterEscape = false;
-
-        while( reader.getChar( c ) ){
-            updateLineStats( c );
-
-            if( c=='\"' && !afterEscape )
-                break; 
-
-            // If any character, add it to our string.
-            tok.data.push_back( c ); 
 
-            // Handle escapes
-            if( c == '\\' ){
-                afterEscape = true;
-                continue;
-            }
-
-            if(afterEscape)
-                afterEscape = false;
-        }
-        if( c != '\"' ) // Wrong end
+        ScanSpan str;
+        if( !scanner.scanString( str ) ) // Wrong end
             throwError( "String hasn't ended!" );
+        tok.data.assign( str.str, str.len );
 
-        logf(dbg, 2, "%sData: \"%s\"\n", recs.c_str(), tok.data.c_str());
+        logf< 2 >("%sData: \"%s\"\n", recs, tok.data.c_str());
     }
     // Group. Several repeat types included.
     else if( c == '{' ){
-        // Allocate a token.
-        GrammarToken temp;
-
-        logf(dbg, 2, "%sRecursive Group start recognized. Getting childs...\n", recs.c_str());
+        scanner.advance();
+        logf< 2 >("%sRecursive Group start recognized. Getting childs...\n", recs);
 
         // Start recursive iteration through tokens.
         // Loop while the return value is 0, i.e. full valid token has been extracted.
         // If return value is 1, end character has been reached (the '}' character).
-        while( !parseGrammarToken( temp, recLevel+1, '}' ) ){
-            tok.children.push_back( temp );
-            temp = GrammarToken(); // Allocate new token.
+        while( true ){
+            tok.children.push_back( GrammarToken() );
+            if( parseGrammarToken( tok.children.back(), recLevel+1, '}' ) ){
+                tok.children.pop_back();
+                break;
+            }
         }
 
         // Group ended. Now get the group's repeat-type character.
-        if( !reader.getChar( c, gtools::StackReader::SKIPMODE_SKIPWS, ps.line, ps.pos ) )
-            c = '1'; // Just a group.
+        int rep = ( scanner.skipSpace() ? scanner.peek() : EOF );
 
-        if( c == GrammarToken::GROUP_OPTIONAL    || 
-            c == GrammarToken::GROUP_REPEAT_NONE ||
-            c == GrammarToken::GROUP_REPEAT_ONE )
-            tok.type = c;
+        if( rep == GrammarToken::GROUP_OPTIONAL    || 
+            rep == GrammarToken::GROUP_REPEAT_NONE ||
+            rep == GrammarToken::GROUP_REPEAT_ONE ){
+            tok.type = rep;
+            scanner.advance();
+        }
         // If still group, but next char is not a repeat-type.
-        else{
+        else
             tok.type = GrammarToken::GROUP_ONE;
 
-            // Putback the char for next readings.
-            reader.putChar( c ); 
-        }
-
-        logf(dbg, 2, "%sGroup ended. Group type: [ %c ], Child Count: %d\n", 
-               recs.c_str(), tok.type, tok.children.size() );
+        logf< 2 >("%sGroup ended. Group type: [ %c ], Child Count: %d\n", 
+               recs, tok.type, (int)tok.children.size() );
     }
     // Check if current character is a recursive group end character. 
     else if( c == endChar ){
-        logf(dbg, 2, "%sRecursive Group ended. End char: \'%c\'\n\n", recs.c_str(), c );
+        scanner.advance();
+        logf< 2 >("%sRecursive Group ended. End char: \'%c\'\n\n", recs, c );
 
         return RECURSIVE_ENDCHAR_REACHED;  // Returned from a recursion.
     }
-    // Check if comment start - skip until da end.
-    else if( c == '#' ){
-        reader.skipUntilChar( '\n' );
-    }
     // Other character - just Throw an Error and be happy.
     else 
         throwError( "Wrong token start symbol: "+std::string(1, c) );
 
-    //logf(dbg,"%sSuccessfully extracted a token!\n", recs.c_str());
-    logf(dbg, 2, "\n");
+    logf< 2 >("\n");
     return 0; //NORMAL_SUCCESS; // Success.
 }
 
@@ -260,36 +406,43 @@ int ParseInput::parseGrammarToken( GrammarToken& tok, int recLevel, char endChar
  *  @param tok - a reference to a ready GrammarToken structure.
  *  @return - true if expecting more options, false if otherwise (rule ended or stream ended)
  */ 
-bool ParseInput::parseGrammarOption( GrammarToken& tok ){
-    const bool dbg = true;
-
+template< int V >
+bool ParseInput< V >::parseGrammarOption( GrammarToken& tok ){
     // Option is a ROOT Token, assign this type.
     tok.type = GrammarToken::ROOT_TOKEN;
-    char c;
 
-    logf(dbg, 2, "[parseGrammarOption(_)]\n");
+    logf< 2 >("[parseGrammarOption(_)]\n");
+
+    while( scanner.skipSpace() ){
+        char c = scanner.peek();
 
-    while( reader.getChar( c, gtools::StackReader::SKIPMODE_SKIPWS, ps.line, ps.pos ) ){
         // Check if option end (a pipe symbol) - just return true, and expect next option.
-        if( c == '|' )
+        if( c == '|' ){
+            scanner.advance();
             return true;
+        }
 
         // Whole rule end - return false, don't expect more options. 
-        else if( c == ';' )
+        else if( c == ';' ){
+            scanner.advance();
             return false;
+        }
 
-        // Check if comment start - skip until endline.
-        else if( c == '#' ){
-            reader.skipUntilChar('\n');
+        // Semantic action of this option. Stored as a data of the ROOT token.
+        else if( c == '@' ){
+            if( !tok.data.empty() )
+                throwError( "Option already has a semantic action: @"+tok.data );
+
+            scanner.advance();
+            getActionName( tok.data );
+            logf< 2 >("Got semantic action: @%s\n", tok.data.c_str());
             continue;
         }
 
-        // Other character means that token start occured. Put it back to stream.
-        reader.putChar( c );
-
+        // Other character means that token start occured.
         // Preload a child token, for easier memory management
         tok.children.push_back( GrammarToken() );
-        int ret = parseGrammarToken( tok.children[ tok.children.size() - 1 ] );
+        int ret = parseGrammarToken( tok.children.back() );
 
         // Non-Fatal error occured, recursive group ended,
         // or file end reached and token did not complete.
@@ -305,86 +458,69 @@ bool ParseInput::parseGrammarOption( GrammarToken& tok ){
  *  Must start reading at the position of Tag Start ('<').
  *  - Function parses the rule, and puts it directly into GbnfData structure.
  */ 
-void ParseInput::parseGrammarRule(){
-    const bool dbg = true;
-
-    std::string tmp;
-    tmp.reserve(256);
-
-    logf(dbg, 1, "[parseGrammarRule(_)]... ");
-    logf(dbg, 2, "\nGetting TagName... \n");
+template< int V >
+void ParseInput< V >::parseGrammarRule(){
+    logf< 1 >("[parseGrammarRule(_)]... ");
+    logf< 2 >("\nGetting TagName... \n");
     
     // Get the first tag (the NonTerminal this rule defines), and it's ID.
-    getTagName( tmp );
-    size_t rID = data.getTagIDfromTable( tmp, true ); // Add to table if not present.
+    getTagName( tempData );
+    size_t rID = data.getTagIDfromTable( tempData, true ); // Add to table if not present.
     
     // Create a new grammar rule, which we'll fill in next steps.
     GrammarRule rule( rID );
 
-    logf(dbg, 1, " TagName: %s, ID: %d \n", tmp.c_str(), rule.getID());
-    logf(dbg, 2, "Getting assignment OP...\n");
+    logf< 1 >(" TagName: %s, ID: %d \n", tempData.c_str(), (int)rule.getID());
+    logf< 2 >("Getting assignment OP...\n");
 
     // Get the definition-assignment operator (::==, ::=, :==, :=).
-    reader.getString( &tmp[0], 4, gtools::StackReader::SKIPMODE_SKIPWS, ps.line, ps.pos );
-
-    if( !strncmp(tmp.c_str(), "::==", 4) ) 
-        {}
-    else if( !strncmp(tmp.c_str(), "::=", 3) || !strncmp(tmp.c_str(), ":==", 3) )
-        reader.putChar( tmp[3] );
-    else if( !strncmp(tmp.c_str(), ":=", 2) )
-        reader.putString( tmp.c_str()+2, 2 );  
-    else
+    scanner.skipSpace();
+    if( scanner.peek() != ':' )
+        throwError("No Def-Assignment operator on a rule");
+    scanner.advance();
+
+    if( scanner.peek() == ':' )
+        scanner.advance();
+    if( scanner.peek() != '=' )
         throwError("No Def-Assignment operator on a rule");
+    scanner.advance();
+
+    if( scanner.peek() == '=' )
+        scanner.advance();
 
     // Get options (ROOT type tokens), one by one, in a loop
     bool areMore = true;
 
-    logf(dbg, 2, "Getting Options in a Loop...\n\n");
+    logf< 2 >("Getting Options in a Loop...\n\n");
 
     while( areMore ){
         rule.options.push_back( GrammarToken() );
-        GrammarToken& tok = rule.options[ rule.options.size()-1 ];
+        GrammarToken& tok = rule.options.back();
 
         areMore = parseGrammarOption( tok ); 
 
+        logf< 2 >("Got Option: Count of Childs: %d\n\n", (int)tok.children.size());
+
         // Accept only non-empty option tokens.
         if( tok.children.empty() )
             rule.options.pop_back();
-
-        logf(dbg, 2, "Got Option: Count of Childs: %d\n\n", tok.children.size());
     }
 
     // We've parsed a rule. All options are parsed.
-    logf(dbg, 1, " Option count: %d\n\n", rule.options.size());
-    logf(dbg, 2, "============================\n\n");
+    logf< 1 >(" Option count: %d\n\n", (int)rule.options.size());
+    logf< 2 >("============================\n\n");
 
     // Put the rule into the grammar table using move semantics.
     data.insertRule( std::move( rule ) ); // Best part: std::move :D
 }
 
 // Convert EBNF to GBNF.
-void ParseInput::convert(){
-    const bool dbg = true;
-
-    char c;
-    while( true ){
-        // Get first non-whitespace character.
-        if( !reader.getChar( c, gtools::StackReader::SKIPMODE_SKIPWS, ps.line, ps.pos ) ) 
-            break;
-
-        // Check possibilities: comment, rule.
-        if(c == '#'){ // Comment start
-            logf(dbg, 2, "Comment started. Skipping until \\n...");
-
-            // Ignore chars until the endline, or Over 9000 of them have been read.
-            if( !reader.skipUntilChar('\n') )
-                break; 
-            //ps.line++;
-        }
-        else if(c == '<'){ // Rule start. Get the rule and put into the table.
-            reader.putChar( c );
-            
-            logf(dbg, 2, "Grammar Rule started. Getting it...\n");
+template< int V >
+void ParseInput< V >::convert(){
+    // Get first non-whitespace character. Comments are skipped.
+    while( scanner.skipSpace() ){
+        if( scanner.peek() == '<' ){ // Rule start. Get the rule and put into the table.
+            logf< 2 >("Grammar Rule started. Getting it...\n");
 
             // Parse the next grammar rule, and put it direcly into GBNF Data structure.
             parseGrammarRule();
@@ -394,23 +530,13 @@ void ParseInput::convert(){
     }
 
     // At the end, sort the GBNF rules by their IDs.
-    data.sort();
+    if( sortRules )
+        data.sort();
 }
 
 /*! GBNF Structure Printers. 
  *  Prints the GBNF Data to stream passed.
  */
-void GbnfData::print( std::ostream& os, int mode, const std::string& ld ) const {
-    os << ld <<"GBNFData in 0x"<<this<<"\n"<<ld<<" Flags:"<<flags<<"\n"
-       << ld <<" TagTable ("<< tagTable.size() <<" entries):\n";
-    for(auto a : tagTable)
-        os<<ld<<" [ "<<a.getID()<<" ]: "<<a.data<<"\n";
-
-    os<<"\n"<<ld<<"GrammarTable: ("<<grammarTable.size()<<" entries):\n";
-    for(auto a : grammarTable)
-        a.print( os, mode, ld + " " );
-}
-
 void GrammarRule::print( std::ostream& os, int mode, const std::string& ld ) const {
     os <<"\n"<< ld << "[GrammarRule]: Defining NonTerminal ID: [ "<< ID <<" ]\n"
        << ld <<"Options ("<< options.size() <<" entries):\n\n";
@@ -443,15 +569,171 @@ std::string GrammarToken::getTypeString( char typ, bool codeMode ){
     return (codeMode ? "0" : "INVALID");
 }
 
+/*! Read-only stream buffer over a memory range. No data is copied.
+ */
+class MemoryStreamBuf : public std::streambuf{
+public:
+    MemoryStreamBuf( const char* str, size_t size ){
+        char* p = const_cast< char* >( str );
+        setg( p, p, p + size );
+    }
+};
+
+/*! Rule-aligned part of the input.
+ */
+struct InputPart{
+    size_t begin;
+    size_t end;
+    size_t line;   // Location of the part's first character.
+    size_t column;
+};
+
+/*! Splits the input into about "parts" parts, at the rule-ending ';' characters.
+ *  - Strings ("..." with escapes) and comments ('#' until the endline) are skipped,
+ *    so ';' characters inside them don't split the input.
+ */
+static std::vector< InputPart > splitAtRuleEnds( const char* str, size_t size, size_t parts ){
+    std::vector< InputPart > result;
+    const size_t target = size / parts;
+
+    InputPart current{ 0, 0, 1, 1 };
+    size_t line = 1, lineStart = 0;
+
+    for( size_t i = 0; i < size; i++ ){
+        char c = str[ i ];
+        if( c == '\n' ){
+            line++;
+            lineStart = i + 1;
+        }
+        else if( c == '#' ){
+            const char* nl = (const char*)std::memchr( str + i, '\n', size - i );
+            i = ( nl ? nl - str : size ) - 1;
+        }
+        else if( c == '\"' ){
+            for( i++; i < size && str[ i ] != '\"'; i++ ){
+                if( str[ i ] == '\\' )
+                    i++;
+                else if( str[ i ] == '\n' ){
+                    line++;
+                    lineStart = i + 1;
+                }
+            }
+        }
+        else if( c == ';' && i + 1 - current.begin >= target ){
+            current.end = i + 1;
+            result.push_back( current );
+            current = InputPart{ i + 1, 0, line, i + 1 - lineStart + 1 };
+        }
+    }
+
+    current.end = size;
+    if( current.end > current.begin || result.empty() )
+        result.push_back( current );
+    return result;
+}
+
+/*! Parses the input parts concurrently, with thread-private tag tables, and merges
+ *  them in order of input.
+ *  - Tags are re-inserted in order of their first appearance, and rules in order
+ *    of input, so the result is the same as of the serial parsing.
+ */
+static void convertInParallel( GbnfData& data, const char* str, 
+                               const std::vector< InputPart >& parts, size_t threadCount ){
+    std::vector< GbnfData > partData( parts.size() );
+    std::vector< std::exception_ptr > errors( parts.size() );
+    std::atomic< size_t > nextPart( 0 );
+
+    auto parseParts = [&](){
+        for( size_t i = nextPart++; i < parts.size(); i = nextPart++ ){
+            try{
+                MemoryStreamBuf buf( str + parts[ i ].begin, parts[ i ].end - parts[ i ].begin );
+                std::istream is( &buf );
+                ParseInput< 0 >( is, partData[ i ], parts[ i ].line, parts[ i ].column ).convert();
+            } catch( ... ){
+                errors[ i ] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector< std::thread > threads;
+    for( size_t t = 1; t < threadCount; t++ )
+        threads.push_back( std::thread( parseParts ) );
+    parseParts();
+    for( auto&& th : threads )
+        th.join();
+
+    // First error in the input is the one the serial parsing would throw.
+    for( auto&& err : errors ){
+        if( err )
+            std::rethrow_exception( err );
+    }
+
+    std::function< void( std::vector< GrammarToken >&, const std::vector< size_t >& ) > remap =
+        [ &remap ]( std::vector< GrammarToken >& toks, const std::vector< size_t >& ids ){
+            for( auto&& tok : toks ){
+                if( tok.type == GrammarToken::TAG_ID )
+                    tok.id = ids[ tok.id ];
+                remap( tok.children, ids );
+            }
+        };
+
+    for( auto&& part : partData ){
+        std::vector< size_t > ids( part.getLastTagID() + 1, 0 );
+        for( auto&& tag : part.tagTableConst() )
+            ids[ tag.getID() ] = data.getTagIDfromTable( tag.data, true );
+
+        for( auto&& rule : part.grammarTableConst() ){
+            remap( rule.options, ids );
+            data.insertRule( GrammarRule( ids[ rule.getID() ], std::move( rule.options ) ) );
+        }
+    }
+    data.sort();
+}
+
 /*! GBNF TOOLS. 
  * Public functions, called from outside o' this phile.
  */ 
-void convertToGbnf(GbnfData& data, std::istream& input, int debugMode){
+void convertToGbnf(GbnfData& data, std::istream& input, int debugMode, size_t threadCount){
     //hlogSetFile("grylogz.log", HLOG_MODE_APPEND);
-    hlogSetActive( debugMode ? true : false );
+    // Logger's state is global, so it's set only if logging is asked for. Parsers 
+    // without logging don't use it, and can run on several threads at once.
+    if( debugMode > 0 )
+        hlogSetActive( true );
+
+    // Logging runs in order of input, so it's done by the serial parser only.
+    if( threadCount != 1 && debugMode <= 0 ){
+        if( !threadCount )
+            threadCount = std::max< size_t >( 1, std::thread::hardware_concurrency() );
+
+        // Read the whole input.
+        std::string text;
+        std::vector< char > block( 1 << 20 );
+        while( input.read( block.data(), block.size() ) || input.gcount() )
+            text.append( block.data(), input.gcount() );
+
+        // Parts must be big enough to be worth a thread.
+        const size_t MIN_PART_SIZE = 65536;
+        size_t partCount = std::min( threadCount * 4, text.size() / MIN_PART_SIZE );
+        auto parts = splitAtRuleEnds( text.data(), text.size(), std::max< size_t >( partCount, 1 ) );
+
+        if( parts.size() > 1 && threadCount > 1 ){
+            convertInParallel( data, text.data(), parts, std::min( threadCount, parts.size() ) );
+            return;
+        }
 
-    ParseInput pi( input, data, debugMode );
-    pi.convert();
+        MemoryStreamBuf buf( text.data(), text.size() );
+        std::istream is( &buf );
+        ParseInput< 0 >( is, data ).convert();
+        return;
+    }
+
+    // Pick the parser instantiation for the verbosity level.
+    if( debugMode <= 0 )
+        ParseInput< 0 >( input, data ).convert();
+    else if( debugMode == 1 )
+        ParseInput< 1 >( input, data ).convert();
+    else
+        ParseInput< 2 >( input, data ).convert();
 }
 
 } // namespace gbnf end.
@@ -8,15 +8,18 @@
  *
  *  Files of size >500 kb are not recommended.
  *
+ *  - All multi-byte integers are little-endian.
+ *
  *  - Bytes 0-3: Magic Number "gBNF"
- *  - Byte  4:   Version number
+ *  - Byte  4:   Version number (currently 2)
  *
  *  - Bytes 5-6:   File property flags.
  *    - Bit 0: Tag table present
  *    - Bit 1: Grammar rule table present
+ *    - Bits 8-15: Grammar format flags (GbnfData::flags)
  *
- *  - Bytes 7-8: Tag table lenght in bytes.
- *  - Bytes 9-10: Grammar rule table lenght.
+ *  - Bytes 7-10: Tag table lenght in bytes.
+ *  - Bytes 11-14: Grammar rule table lenght.
  *    (More size bytes can be present if more tables are present) 
  *
  *  - Remaining bytes - Data payload. Present in this order:
@@ -24,43 +27,47 @@
  *    2. Grammar rule table
  *    3. Additional tables.
  *
- *  - Tag table structure (n is variable, rows are terminated by \0).
- *    |   0   |   1   |   2   |  . . . . . . .  |  n-1  |   n   |
- *    [2-byte Tag ID]  [String representation of a tag]    [\0]  
+ *  - All IDs, sizes and counts in the tables are varints (LEB128): 7 bits per byte,
+ *    low bits first, with the high bit set on every byte but the last. Values are
+ *    32-bit, so a varint takes 1 to 5 bytes, and values below 128 take one byte.
+ *
+ *  - Tag table structure (rows are terminated by \0, IDs are increasing).
+ *    [varint Tag ID]  [String representation of a tag]  [\0]  
  *
- *  - Grammar rule table structure:      
- *    |   0   |   1   |   2   |   3    |  4  | . . |  i  | . . .  |  j  | . . |  k  | k+1 |
- *    [2-byte Tag ID]  [No. of options]  [Option]   [\0]   . . .   [Option]    [\0]  [\0]
+ *  - Grammar rule table structure (rows are sorted by Tag ID):
+ *    [varint Tag ID]  [No. of options]  [Option size]  [Option]   . . .   
  *
- *    - [2-byte Tag ID]:  The ID of a tag this rule defines.
- *    - [No. of options]: The number of available definition options (in eBNF, separated by |).
- *    - [Option]:         gBNF-defined language option. Options are separated by \0.
+ *    - [varint Tag ID]:  The ID of a tag this rule defines.
+ *    - [No. of options]: varint number of definition options (in eBNF, separated by |).
+ *    - [Option size]:    varint size of the option in bytes.
+ *    - [Option]:         gBNF-defined language option.
  *
  *  - gBNF language option definition:
  *      Similar to eBNF, but format is different. Elements have their Types, which are represented as a
- *      single special ASCII character. These characters need to be escaped if used anywhere else.
+ *      single special ASCII character. Every element has a known size, so no escaping is needed, 
+ *      and strings can be used directly from the file's memory.
  *
- *      These characters are: ? * + " < \
+ *    - (@) Semantic action name. Optional, can only be the first element. Then follows
+ *      the varint size of the name, and the name, e.g.:
  *
- *    - (? * +) The Group repetition specifier. The wildcards are presented before the group.
- *      Then follows the 2-byte size of the group (number of elements): e.g.:
+ *      @8add    (8 is a one-byte varint, the value 3)
  *
- *      ?89...   (? is a wildcard, 89 are 2 bytes representing the number of elements, 
+ *    - (1 ? * +) The Group repetition specifier. The wildcards are presented before the group.
+ *      Then follows the varint size of the group (number of elements): e.g.:
+ *
+ *      ?8...    (? is a wildcard, 8 is a varint representing the number of elements, 
  *                  and then follows the elements)
  *
  *    - ( " ) The raw text to be matched in regex-like format. The size of the string is 
- *      a 2-byte word after the ", e.g.:
+ *      a varint after the ", e.g.:
  *
- *      "89[_a-zA-Z] 
+ *      "8[_a-zA-Z] 
  *
- *    - ( < ) The tag format: <[id-b1][id-b2][size-b1][size-b2][data...], e.g.:
+ *    - ( < ) The tag format: <[varint id], e.g.:
  *
- *      <8904nyaa  ('<' is a type, '89' is 2-byte ID, '04' is size of data string 
- *                  (4 is actually byte with value of 4), 'nyaa' is data associated with tag.).
+ *      <89  (8 and 9 are not numbers, but the bytes of a 2-byte varint).
  *
- *    - Some chars need to be escaped. That's why we use the \ to escape them.
- *      E.g. when ascii value of one of bytes representing size if equal to '\', it needs to 
- *      be escaped with another '\', so written like '\\'.
+ *  - Files are written and read by the tools in gbnffile.hpp.
  */
 
 #ifndef GBNF_H_INCLUDED
@@ -74,6 +81,10 @@
 #include <istream>
 #include <ostream>
 #include <memory>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <atomic>
 
 namespace gbnf{
 
@@ -90,9 +101,9 @@ public:
     // in std::set using a reference to this object.
     std::string data;
 
-    NonTerminal( int _ID, const std::string& _data = std::string() ) 
+    NonTerminal( size_t _ID, const std::string& _data = std::string() ) 
         : ID( _ID ), data( _data ) {}
-    NonTerminal( int _ID, std::string&& _data ) 
+    NonTerminal( size_t _ID, std::string&& _data ) 
         : ID( _ID ), data( std::move(_data) ) {} 
 
     inline size_t getID() const { return ID; }
@@ -109,6 +120,8 @@ public:
  *  - Token structure uses the tree format - with the root token being the option itself.
  *  - Child tokens must be sequentially matched with every incoming 
  *    token-to-match to match the rule.
+ *  - The "data" of a ROOT_TOKEN holds the name of the option's semantic action
+ *    (declared as "@name" in EBNF), or is empty if option has no action.
  */ 
 struct GrammarToken{
     const static char GROUP_ONE         = '1';
@@ -125,11 +138,11 @@ struct GrammarToken{
     std::vector<GrammarToken> children;
 
     GrammarToken(){}
-    GrammarToken( char _type, int _id, const std::string& _data, 
+    GrammarToken( char _type, size_t _id, const std::string& _data, 
                   std::initializer_list< GrammarToken >&& _children = {} )
         : type( _type ), id( _id ), data( _data ), children( std::move(_children) )
     {}
-    GrammarToken( char _type, int _id, const std::string& _data, 
+    GrammarToken( char _type, size_t _id, const std::string& _data, 
                   std::vector< GrammarToken >&& _children )
         : type( _type ), id( _id ), data( _data ), children( std::move(_children) )
     {}
@@ -155,11 +168,11 @@ private:
 public:
     mutable std::vector<GrammarToken> options; 
 
-    GrammarRule(int _ID) : ID( _ID ) {}
-    GrammarRule(int _ID, std::initializer_list< GrammarToken >&& _options)
+    GrammarRule(size_t _ID) : ID( _ID ) {}
+    GrammarRule(size_t _ID, std::initializer_list< GrammarToken >&& _options)
         : ID( _ID ), options( std::move( _options ) )
     {}
-    GrammarRule(int _ID, std::vector< GrammarToken >&& _options)
+    GrammarRule(size_t _ID, std::vector< GrammarToken >&& _options)
         : ID( _ID ), options( std::move( _options ) )
     {} 
 
@@ -247,20 +260,374 @@ public:
 };
 */
 
+/*! Symbol interning index.
+ *  - Maps tag names to tag IDs using a hash table.
+ *  - Names are interned into an arena-backed string pool, so hash table keys 
+ *    are plain pointers, and lookups by std::string don't allocate.
+ *  - Removed names stay in the arena until the index is cleared.
+ */ 
+class SymbolIndex{
+private:
+    struct StrRef{
+        const char* str;
+        size_t len;
+
+        bool operator== ( const StrRef& other ) const {
+            return len == other.len && !std::memcmp( str, other.str, len );
+        }
+    };
+
+    struct StrRefHash{
+        size_t operator() ( const StrRef& s ) const {
+            // FNV-1a.
+            size_t h = (size_t)14695981039346656037ULL;
+            for( size_t i = 0; i < s.len; i++ ){
+                h ^= (unsigned char)s.str[ i ];
+                h *= (size_t)1099511628211ULL;
+            }
+            return h;
+        }
+    };
+
+    const static size_t CHUNK_SIZE = 16384;
+
+    // String pool chunks. Chunks never move, so the pointers stay valid.
+    std::vector< std::unique_ptr< char[] > > chunks;
+    char* current = nullptr;
+    size_t chunkUsed = 0;
+
+    std::unordered_map< StrRef, size_t, StrRefHash > index;
+
+    const char* intern( const char* str, size_t len ){
+        char* dest;
+        if( len > CHUNK_SIZE / 4 ){ // Big strings get a chunk of their own.
+            chunks.push_back( std::unique_ptr< char[] >( new char[ len ] ) );
+            dest = chunks.back().get();
+        }
+        else{
+            if( !current || chunkUsed + len > CHUNK_SIZE ){
+                chunks.push_back( std::unique_ptr< char[] >( new char[ CHUNK_SIZE ] ) );
+                current = chunks.back().get();
+                chunkUsed = 0;
+            }
+            dest = current + chunkUsed;
+            chunkUsed += len;
+        }
+        std::memcpy( dest, str, len );
+        return dest;
+    }
+
+public:
+    const static size_t NOT_FOUND = (size_t)(-1);
+
+    SymbolIndex(){}
+    SymbolIndex( SymbolIndex&& other ){ *this = std::move( other ); }
+    SymbolIndex( const SymbolIndex& other ){ *this = other; }
+
+    SymbolIndex& operator= ( SymbolIndex&& other ){
+        chunks = std::move( other.chunks );
+        index = std::move( other.index );
+        current = other.current;
+        chunkUsed = other.chunkUsed;
+        other.clear();
+        return *this;
+    }
+    SymbolIndex& operator= ( const SymbolIndex& other ){
+        // Keys point into other's arena - re-intern them into ours.
+        if( this != &other ){
+            clear();
+            index.reserve( other.index.size() );
+            for( auto&& a : other.index )
+                index.insert( std::make_pair( 
+                    StrRef{ intern( a.first.str, a.first.len ), a.first.len }, a.second ) );
+        }
+        return *this;
+    }
+
+    /*! Inserts a name. If name is already present, keeps the old ID.
+     */ 
+    inline void insert( const std::string& name, size_t id ){
+        StrRef key{ name.c_str(), name.size() };
+        if( index.find( key ) == index.end() ){
+            key.str = intern( name.c_str(), name.size() );
+            index.insert( std::make_pair( key, id ) );
+        }
+    }
+
+    /*! Removes a name, if it's mapped to this ID.
+     */ 
+    inline void erase( const std::string& name, size_t id ){
+        auto it = index.find( StrRef{ name.c_str(), name.size() } );
+        if( it != index.end() && it->second == id )
+            index.erase( it );
+    }
+
+    /*! @return the ID of the name, or NOT_FOUND.
+     */ 
+    inline size_t find( const std::string& name ) const {
+        auto it = index.find( StrRef{ name.c_str(), name.size() } );
+        return ( it != index.end() ? it->second : NOT_FOUND );
+    }
+
+    inline size_t size() const { return index.size(); }
+    inline void reserve( size_t n ){ index.reserve( n ); }
+
+    inline void clear(){
+        index.clear();
+        chunks.clear();
+        current = nullptr;
+        chunkUsed = 0;
+    }
+};
+
+/*! Storage policies of GbnfData - how tags and rules are found by ID.
+ *  - Tables are sorted vectors with every policy, so iteration is the same. Policies
+ *    differ in the ID -> table position index kept alongside the tables:
+ *    - SortedVectorStorage: no index. Direct position if IDs have no gaps, otherwise
+ *      binary search. No extra memory, and nothing to maintain on insertion.
+ *    - DenseIndexStorage: array indexed by ID. O(1), but memory grows with the 
+ *      highest ID, so it suits the dense IDs given by the parser and converter.
+ *      If IDs get too sparse, falls back to binary search.
+ *    - FlatHashStorage: open-addressing hash table. O(1), memory grows with the 
+ *      number of entries, for any IDs.
+ *  - Index is appended to on tag insertion, and rebuilt when the rule table is 
+ *    sorted, or entries are removed. Rules inserted since the last sort are found 
+ *    by binary search, as with SortedVectorStorage.
+ *  - If an ID has more than one rule, the index holds the first one.
+ *  - Measured by benchmark/vec_vs_map_benchmark.cpp.
+ */
+const size_t STORAGE_NOT_FOUND = (size_t)(-1);
+const size_t STORAGE_UNINDEXED = (size_t)(-2); // Not known - use binary search.
+
+class SortedVectorStorage{
+public:
+    const static bool INDEXED = false;
+
+    inline void clear(){}
+    inline void reserve( size_t ){}
+    inline void add( size_t, size_t ){}
+    inline size_t find( size_t ) const { return STORAGE_UNINDEXED; }
+};
+
+class DenseIndexStorage{
+private:
+    const static uint32_t NONE = 0xFFFFFFFF;
+    const static size_t SLACK = 1024;
+
+    std::vector< uint32_t > positions;
+    size_t count = 0;
+    bool sparse = false; // IDs too sparse for an array - not indexed until cleared.
+
+public:
+    const static bool INDEXED = true;
+
+    inline void clear(){ 
+        positions.clear(); 
+        count = 0;
+        sparse = false;
+    }
+    inline void reserve( size_t n ){ positions.reserve( n + 1 ); }
+
+    inline void add( size_t id, size_t pos ){
+        if( sparse )
+            return;
+        if( id >= positions.size() ){
+            if( id > ( count + 1 ) * 4 + SLACK ){
+                sparse = true;
+                std::vector< uint32_t >().swap( positions );
+                return;
+            }
+            positions.resize( std::max( id + 1, positions.size() * 2 ), (uint32_t)NONE );
+        }
+        if( positions[ id ] == NONE ){
+            positions[ id ] = (uint32_t)pos;
+            count++;
+        }
+    }
+    inline size_t find( size_t id ) const {
+        if( sparse )
+            return STORAGE_UNINDEXED;
+        return ( id < positions.size() && positions[ id ] != NONE ? positions[ id ] 
+                                                                  : STORAGE_NOT_FOUND );
+    }
+};
+
+class FlatHashStorage{
+private:
+    // Slot keys are ID + 1, so zero marks an empty slot. Linear probing.
+    std::vector< std::pair< size_t, size_t > > slots;
+    size_t count = 0;
+
+    static inline size_t hash( size_t id ){
+        uint64_t h = id;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return (size_t)h;
+    }
+
+    void rehash( size_t capacity ){
+        std::vector< std::pair< size_t, size_t > > old( capacity );
+        old.swap( slots );
+        for( auto&& slot : old ){
+            if( slot.first ){
+                size_t i = hash( slot.first - 1 ) & ( slots.size() - 1 );
+                while( slots[ i ].first )
+                    i = ( i + 1 ) & ( slots.size() - 1 );
+                slots[ i ] = slot;
+            }
+        }
+    }
+
+public:
+    const static bool INDEXED = true;
+
+    inline void clear(){ 
+        std::fill( slots.begin(), slots.end(), std::pair< size_t, size_t >( 0, 0 ) );
+        count = 0; 
+    }
+    inline void reserve( size_t n ){
+        size_t capacity = 16;
+        while( capacity < n * 2 )
+            capacity *= 2;
+        if( capacity > slots.size() )
+            rehash( capacity );
+    }
+
+    inline void add( size_t id, size_t pos ){
+        if( ( count + 1 ) * 2 > slots.size() )
+            rehash( std::max< size_t >( 16, slots.size() * 2 ) );
+
+        size_t i = hash( id ) & ( slots.size() - 1 );
+        for( ; slots[ i ].first; i = ( i + 1 ) & ( slots.size() - 1 ) ){
+            if( slots[ i ].first == id + 1 )
+                return;
+        }
+        slots[ i ] = std::make_pair( id + 1, pos );
+        count++;
+    }
+    inline size_t find( size_t id ) const {
+        if( slots.empty() )
+            return STORAGE_NOT_FOUND;
+        size_t i = hash( id ) & ( slots.size() - 1 );
+        for( ; slots[ i ].first; i = ( i + 1 ) & ( slots.size() - 1 ) ){
+            if( slots[ i ].first == id + 1 )
+                return slots[ i ].second;
+        }
+        return STORAGE_NOT_FOUND;
+    }
+};
+
+/*! Generation of the grammar's contents.
+ *  - Every change gets a number unique in the process, so caches of data derived 
+ *    from a grammar can be validated in O(1), even across different grammar objects.
+ *  - Copies keep the generation (contents are equal), moved-from objects get a new one.
+ */
+class Generation{
+private:
+    uint64_t value;
+
+    static inline uint64_t next(){
+        static std::atomic< uint64_t > counter( 0 );
+        return ++counter;
+    }
+
+public:
+    Generation() : value( next() ) {}
+    Generation( const Generation& other ) = default;
+    Generation& operator= ( const Generation& other ) = default;
+    Generation( Generation&& other ) : value( other.value ) { other.bump(); }
+    Generation& operator= ( Generation&& other ){
+        value = other.value;
+        other.bump();
+        return *this;
+    }
+
+    inline void bump(){ value = next(); }
+    inline uint64_t get() const { return value; }
+};
+
+// Can be overridden by the build, i.e. -DGBNF_DEFAULT_STORAGE=gbnf::FlatHashStorage
+#ifndef GBNF_DEFAULT_STORAGE
+    #define GBNF_DEFAULT_STORAGE DenseIndexStorage
+#endif
+
 /*! Whole-File structure.  
  *  This is the structure which holds the whole grammar which is being worked with.
  *
- *  New model - use Sorted Vectors.
+ *  New model - use Sorted Vectors, with an ID index given by the storage policy.
  */ 
-class GbnfData{
+template< class Storage >
+class BasicGbnfData{
 private:
-    int lastTagID = 0;
-    int lastRuleID = 0;
+    size_t lastTagID = 0;
+    size_t lastRuleID = 0;
     bool sorted = false;
+    Generation generation;
 
     std::vector< NonTerminal > tagTable; 
     std::vector< GrammarRule > grammarTable;     
 
+    // Tag name -> Tag ID index. Kept in sync by insertTag/removeTag.
+    SymbolIndex tagIndex;
+
+    // Tag/Rule ID -> position indexes. Rule index is valid while the table is sorted.
+    Storage tagPositions;
+    Storage rulePositions;
+
+    inline void rebuildTagIndex(){
+        tagIndex.clear();
+        tagIndex.reserve( tagTable.size() );
+        for( auto&& t : tagTable ){
+            tagIndex.insert( t.data, t.getID() );
+            if( t.getID() > lastTagID )
+                lastTagID = t.getID();
+        }
+        rebuildTagPositions();
+    }
+
+    inline void rebuildTagPositions(){
+        if( !Storage::INDEXED )
+            return;
+        tagPositions.clear();
+        tagPositions.reserve( tagTable.size() );
+        for( size_t i = 0; i < tagTable.size(); i++ )
+            tagPositions.add( tagTable[ i ].getID(), i );
+    }
+
+    inline void rebuildRulePositions(){
+        if( !Storage::INDEXED || !sorted )
+            return;
+        rulePositions.clear();
+        rulePositions.reserve( grammarTable.size() );
+        for( size_t i = 0; i < grammarTable.size(); i++ )
+            rulePositions.add( grammarTable[ i ].getID(), i );
+    }
+
+    // Position of the tag/rule with the ID. If not present, the position of the
+    // next greater ID in binary search, or the table size if found in the index.
+    inline size_t findTag( size_t i ) const {
+        size_t pos = tagPositions.find( i );
+        if( pos != STORAGE_UNINDEXED )
+            return ( pos != STORAGE_NOT_FOUND ? pos : tagTable.size() );
+
+        if( i > 0 && i <= tagTable.size() && (tagTable[i-1].getID() == i) )
+            return i - 1;
+        return std::lower_bound( tagTable.begin(), tagTable.end(), NonTerminal( i ) ) -
+               tagTable.begin();
+    }
+
+    inline size_t findRule( size_t i ) const {
+        size_t pos = ( sorted ? rulePositions.find( i ) : STORAGE_UNINDEXED );
+        if( pos != STORAGE_UNINDEXED )
+            return ( pos != STORAGE_NOT_FOUND ? pos : grammarTable.size() );
+
+        if( i > 0 && i <= grammarTable.size() && ( grammarTable[i-1].getID() == i ) )
+            return i - 1;
+        return std::lower_bound( grammarTable.begin(), grammarTable.end(), GrammarRule( i ) ) -
+               grammarTable.begin();
+    }
+
 public:
     const static int FORMAT_EBNF     = 1;
     const static int FORMAT_BNF      = 2;
@@ -269,132 +636,330 @@ public:
 
     int flags = 0;
 
-    GbnfData(){}
-    GbnfData( int flag, std::initializer_list< NonTerminal >&& tagTbl, 
-                        std::initializer_list< GrammarRule >&& grammarTbl )
+    BasicGbnfData(){}
+    BasicGbnfData( int flag, std::initializer_list< NonTerminal >&& tagTbl, 
+                             std::initializer_list< GrammarRule >&& grammarTbl )
         : tagTable( std::move(tagTbl) ), grammarTable( std::move(grammarTbl) ), flags( flag )
-    { }
+    { rebuildTagIndex(); }
      
     // Last tag getters.
     void print( std::ostream& os, int mode=0, const std::string& leader="" ) const;
-    inline int getLastTagID() const { return lastTagID; }
-    inline int getLastRuleID() const { return lastRuleID; }
+    inline size_t getLastTagID() const { return lastTagID; }
+    inline size_t getLastRuleID() const { return lastRuleID; }
     inline bool isSorted() const { return sorted; }
 
+    /*! Generation of the contents. Changes on every mutation by the members.
+     *  - In-place changes through the tables or through the iterators of
+     *    getTag()/getRule() are not seen. Code making them must call touch().
+     *    The converters do.
+     */
+    inline uint64_t getGeneration() const { return generation.get(); }
+    inline void touch(){ generation.bump(); }
+
     // Get const references to tables.
     const auto& tagTableConst() const { return tagTable; }
     const auto& grammarTableConst() const { return grammarTable; }
 
-    // Get rules by index ( ID ).    
+    // Get tags by index ( ID ).    
+    // - IDs start at 1, so with no removed entries, tag with ID i is at position i-1.
     // Const and Non-Const Versions.
     // @return iterator.
     inline auto getTag( size_t i ) {
-        if( i < tagTable.size() && (tagTable[i].getID() == i) )
-            return tagTable.begin() + i;
-
-        return std::lower_bound( tagTable.begin(), tagTable.end(), 
-                                 NonTerminal( i ) ); 
-        //if( it != tagTable.end() )
-        //    return *it;
+        return tagTable.begin() + findTag( i );
     }
     inline auto getTag( size_t i ) const {
-        if( i < tagTable.size() && (tagTable[i].getID() == i) )
-            return tagTable.begin() + i;
-
-        return std::lower_bound( tagTable.begin(), tagTable.end(), 
-                                 NonTerminal( i ) ); 
+        return tagTable.cbegin() + findTag( i );
     }
 
-    // Get tags by index ( ID ).    
+    // Get rules by index ( ID ).    
     // Const and Non-Const Versions.
     // @return iterator.
     inline auto getRule( size_t i ) {
-        if( i < grammarTable.size() && ( grammarTable[i].getID() == i ) )
-            return grammarTable.begin() + i;
-
-        return std::lower_bound( grammarTable.begin(), grammarTable.end(), 
-                                 GrammarRule( i ) ); 
+        return grammarTable.begin() + findRule( i );
     }
     inline auto getRule( size_t i ) const {
-        if( i < grammarTable.size() && ( grammarTable[i].getID() == i ) )
-            return grammarTable.begin() + i;
-
-        return std::lower_bound( grammarTable.begin(), grammarTable.end(), 
-                                 GrammarRule( i ) ); 
+        return grammarTable.cbegin() + findRule( i );
     }
 
     // GrammarRule inserters. Support move semantics.
     inline void insertRule( GrammarRule&& rule ){
         grammarTable.push_back( std::move(rule) );
         sorted = false;
+        generation.bump();
     }
     inline void insertRule( const GrammarRule& rule ){
         grammarTable.push_back( rule );
         sorted = false;
+        generation.bump();
     }
  
     /* New Tag inserters.
      * - ID is assigned automatically, so the vector is always sorted. 
+     * - NOTE: Don't rename the tags in place - name index wouldn't be updated.
      * @return the ID of newly inserted tag.
      */
     inline size_t insertTag( const std::string& name ){
-        lastTagID++;
-        tagTable.push_back( NonTerminal( lastTagID, name ) );
-        return lastTagID;
+        return insertTag( std::string( name ) );
     }
     inline size_t insertTag( std::string&& name ){
         lastTagID++;
+        generation.bump();
         tagTable.push_back( NonTerminal( lastTagID, std::move(name) ) );
+        tagIndex.insert( tagTable.back().data, lastTagID );
+        tagPositions.add( lastTagID, tagTable.size() - 1 );
         return lastTagID;
     }
     inline size_t insertTag( const char* name ){
-        lastTagID++;
-        tagTable.push_back( NonTerminal( lastTagID, std::string(name) ) );
-        return lastTagID;
+        return insertTag( std::string(name) );
     }
 
-    size_t getTagIDfromTable( const std::string& name, bool insertIfNotPresent );
+    /* Tag inserter with an explicit ID. Used when restoring the tables.
+     * - ID must be greater than the last ID, to keep the vector sorted.
+     * @return the ID, or (size_t)-1 if ID is not greater than the last one.
+     */
+    inline size_t insertTag( size_t id, std::string&& name ){
+        if( id <= lastTagID )
+            return (size_t)(-1);
+        lastTagID = id;
+        generation.bump();
+        tagTable.push_back( NonTerminal( id, std::move(name) ) );
+        tagIndex.insert( tagTable.back().data, id );
+        tagPositions.add( id, tagTable.size() - 1 );
+        return id;
+    }
+
+    /*! Finds NonTerminal tag's ID by name in O(1), using the name index.
+     *  - If not found, and insertIfNotPresent is set, inserts a new tag. 
+     *  @return the ID, or (size_t)-1 if not found and insertIfNotPresent is false.
+     */ 
+    inline size_t getTagIDfromTable( const std::string& name, bool insertIfNotPresent ){
+        size_t id = tagIndex.find( name );
+        if( id != SymbolIndex::NOT_FOUND )
+            return id;
+        return ( insertIfNotPresent ? insertTag( name ) : (size_t)(-1) );
+    }
 
     /*! Removers. 
      *  - After removal the sorting order doesn't change.
      */
     inline void removeTag( size_t i ){
-        if( i < tagTable.size() && (tagTable[i].getID() == i) )
-            tagTable.erase( tagTable.begin() + i );
-        else{
-            auto&& it = std::lower_bound( tagTable.begin(), tagTable.end(), 
-                                          NonTerminal( i ) ); 
-            if( it != tagTable.end() )
-                tagTable.erase( it );
+        auto&& it = getTag( i );
+        if( it != tagTable.end() && it->getID() == i ){
+            tagIndex.erase( it->data, i );
+            tagTable.erase( it );
+            rebuildTagPositions();
+            generation.bump();
         }
     }
 
     inline void removeRule( size_t i ){
-        if( i < grammarTable.size() && ( grammarTable[i].getID() == i ) )
-            grammarTable.erase( grammarTable.begin() + i );
-        else{
-            auto&& it = std::lower_bound( grammarTable.begin(), grammarTable.end(), 
-                                          GrammarRule( i ) ); 
-            if( it != grammarTable.end() )
-                grammarTable.erase( it );
+        auto&& it = getRule( i );
+        if( it != grammarTable.end() && it->getID() == i ){
+            grammarTable.erase( it );
+            rebuildRulePositions();
+            generation.bump();
         }
     }
 
+    /*! Batch removers. Remove every rule/tag matching the predicate in one pass.
+     *  - After removal the sorting order doesn't change.
+     */
+    template< typename Pred >
+    inline void removeRulesIf( Pred&& pred ){
+        grammarTable.erase( std::remove_if( grammarTable.begin(), grammarTable.end(), pred ),
+                            grammarTable.end() );
+        rebuildRulePositions();
+        generation.bump();
+    }
+
+    template< typename Pred >
+    inline void removeTagsIf( Pred&& pred ){
+        auto it = std::remove_if( tagTable.begin(), tagTable.end(),
+            [ this, &pred ]( const NonTerminal& t ){
+                if( !pred( t ) )
+                    return false;
+                tagIndex.erase( t.data, t.getID() );
+                return true;
+            } );
+        tagTable.erase( it, tagTable.end() );
+        rebuildTagPositions();
+        generation.bump();
+    }
+
     /*! Sorter. Sorts the Grammar Rule Table by ID.
+     *  - Stable, so the entries of a split rule keep their order.
      */
     inline void sort(){
         if( sorted )
             return;
-        std::sort( grammarTable.begin(), grammarTable.end() );
+        std::stable_sort( grammarTable.begin(), grammarTable.end() );
         sorted = true;
+        rebuildRulePositions();
     }
+
+    /*! Batch of mutations, applied at once by commit().
+     *  - Inserted rules are queued. Removed rules and tags are only marked (tombstoned).
+     *  - commit() compacts the tables in one pass, and merges the queued rules into
+     *    the rule table with one merge pass, instead of an erase per removal and a
+     *    full sort after the insertions. Rule table is sorted after the commit.
+     *  - Removals refer to the rules present when the batch was started, not the
+     *    queued ones. Tags are inserted into the table directly, as they are appended.
+     *  - Rule table must not be changed directly while the batch is open.
+     *  - Uncommitted mutations are discarded.
+     */
+    class Batch{
+    private:
+        BasicGbnfData& data;
+        std::vector< GrammarRule > inserted;
+        std::vector< char > deadRules;
+        std::vector< char > deadTags;
+        size_t removedRules = 0;
+        size_t removedTags = 0;
+
+        void compactTags(){
+            deadTags.resize( data.tagTable.size(), 0 );
+            size_t out = 0;
+            for( size_t i = 0; i < data.tagTable.size(); i++ ){
+                if( deadTags[ i ] ){
+                    data.tagIndex.erase( data.tagTable[ i ].data, data.tagTable[ i ].getID() );
+                    continue;
+                }
+                if( out != i )
+                    data.tagTable[ out ] = std::move( data.tagTable[ i ] );
+                out++;
+            }
+            data.tagTable.erase( data.tagTable.begin() + out, data.tagTable.end() );
+            data.rebuildTagPositions();
+            data.generation.bump();
+        }
+
+        void mergeRules(){
+            // Stable, so the queued rules with equal IDs keep their order.
+            std::stable_sort( inserted.begin(), inserted.end() );
+
+            auto& table = data.grammarTable;
+            std::vector< GrammarRule > merged;
+            merged.reserve( table.size() - removedRules + inserted.size() );
+
+            // On equal IDs, present rules go first.
+            size_t i = 0, j = 0;
+            while( i < table.size() || j < inserted.size() ){
+                if( i < table.size() && deadRules.size() > i && deadRules[ i ] ){
+                    i++;
+                    continue;
+                }
+                if( j >= inserted.size() ||
+                    ( i < table.size() && !( inserted[ j ] < table[ i ] ) ) )
+                    merged.push_back( std::move( table[ i++ ] ) );
+                else
+                    merged.push_back( std::move( inserted[ j++ ] ) );
+            }
+
+            table.swap( merged );
+            data.sorted = true;
+            data.rebuildRulePositions();
+            data.generation.bump();
+        }
+
+    public:
+        explicit Batch( BasicGbnfData& dt ) : data( dt ) {
+            // Tombstones are positions, and found by ID, so table must be sorted.
+            data.sort();
+        }
+
+        inline BasicGbnfData& target(){ return data; }
+
+        inline void insertRule( GrammarRule&& rule ){
+            inserted.push_back( std::move( rule ) );
+        }
+        inline void insertRule( const GrammarRule& rule ){
+            inserted.push_back( rule );
+        }
+
+        // Tags are appended to the table at once. @return the ID of the new tag.
+        template< typename S >
+        inline size_t insertTag( S&& name ){
+            return data.insertTag( std::forward< S >( name ) );
+        }
+
+        /*! Marks all rules with the ID for removal.
+         */
+        void removeRule( size_t id ){
+            auto& table = data.grammarTable;
+            size_t pos = data.findRule( id );
+            while( pos > 0 && pos <= table.size() && table[ pos - 1 ].getID() == id )
+                pos--;
+            if( deadRules.empty() && pos < table.size() )
+                deadRules.resize( table.size(), 0 );
+
+            for( ; pos < table.size() && table[ pos ].getID() == id; pos++ ){
+                if( !deadRules[ pos ] ){
+                    deadRules[ pos ] = 1;
+                    removedRules++;
+                }
+            }
+        }
+
+        /*! Marks the tag for removal. Name index is updated at commit.
+         */
+        void removeTag( size_t id ){
+            size_t pos = data.findTag( id );
+            if( pos >= data.tagTable.size() || data.tagTable[ pos ].getID() != id )
+                return;
+            if( deadTags.size() <= pos )
+                deadTags.resize( data.tagTable.size(), 0 );
+            if( !deadTags[ pos ] ){
+                deadTags[ pos ] = 1;
+                removedTags++;
+            }
+        }
+
+        /*! Applies the mutations. Batch is empty afterwards, and can be reused.
+         */
+        void commit(){
+            if( removedTags )
+                compactTags();
+            if( removedRules || !inserted.empty() )
+                mergeRules();
+
+            inserted.clear();
+            deadRules.clear();
+            deadTags.clear();
+            removedRules = 0;
+            removedTags = 0;
+        }
+    };
+
+    inline Batch batch(){ return Batch( *this ); }
 };
 
-inline std::ostream& operator<< (std::ostream& os, const GbnfData& rule){
-    rule.print( os );
+/*! GBNF Structure Printer. 
+ *  Prints the GBNF Data to stream passed.
+ */
+template< class Storage >
+void BasicGbnfData< Storage >::print( std::ostream& os, int mode, const std::string& ld ) const {
+    os << ld <<"GBNFData in 0x"<<this<<"\n"<<ld<<" Flags:"<<flags<<"\n"
+       << ld <<" TagTable ("<< tagTable.size() <<" entries):\n";
+    for(auto a : tagTable)
+        os<<ld<<" [ "<<a.getID()<<" ]: "<<a.data<<"\n";
+
+    os<<"\n"<<ld<<"GrammarTable: ("<<grammarTable.size()<<" entries):\n";
+    for(auto a : grammarTable)
+        a.print( os, mode, ld + " " );
+}
+
+template< class Storage >
+inline std::ostream& operator<< (std::ostream& os, const BasicGbnfData< Storage >& data){
+    data.print( os );
     return os;
 }
 
+/*! The grammar type used by the tools.
+ *  - Default policy is DenseIndexStorage: fastest in all of the benchmark's 
+ *    measurements (parser-like insertion, random lookup, iteration with lookups).
+ */
+typedef BasicGbnfData< GBNF_DEFAULT_STORAGE > GbnfData;
+
 /*! Tools - Converters and Helpers
  *  Contains functions to use when converting to/from EBNF and parsing data.
  *  No matching is done there. Only conversion to/from the gBNF format.
@@ -412,6 +977,14 @@ public:
     virtual void generate(const GbnfData& gb, const std::string& vn ) = 0;
 };
 
+/*! Code generation modes.
+ *  - CODEGEN_CONSTRUCTION:  construction code of a const GbnfData.
+ *  - CODEGEN_STATIC_TABLES: constexpr POD tables of the flat grammar (see gbnfflat.hpp),
+ *    and a GrammarView over them. No code runs and nothing is allocated at startup.
+ */
+const int CODEGEN_CONSTRUCTION  = 0;
+const int CODEGEN_STATIC_TABLES = 1;
+
 /*!
  * Main public CodeGenerator class.
  * - Creates C++ files with construction code of the GBNF structures passed.
@@ -421,7 +994,7 @@ private:
     std::unique_ptr< CodeGenerator_impl > impl;
 
 public:
-    CodeGenerator(std::ostream& outp, const std::string& fname);
+    CodeGenerator(std::ostream& outp, const std::string& fname, int mode = CODEGEN_CONSTRUCTION);
 
     void outputStart();
     void outputEnd();
@@ -429,21 +1002,44 @@ public:
 };
 
 /*! Function uses the EBNF format input from the 'input' stream to fill up the 'data' structure. 
+ *  - Options can be followed by a semantic action name, e.g.
+ *    <sum> ::= <sum> "\+" <num> @add | <num> ;
  * @param data - the empty GBNF structure to fill up.
  * @param input - the input stream to read from.
+ * @param threadCount - if not 1, the whole input is read, split at the rule ends, 
+ *        and the parts are parsed concurrently. If 0, number of hardware threads 
+ *        is used. Result is the same as of the serial parsing.
+ * - Calls can run concurrently on different data, unless debugMode is set: 
+ *   the debug log is global, so it must be used by one thread at a time.
  * @throws runtime_error if fatal error occured.
  */ 
-void convertToGbnf(GbnfData& data, std::istream& input, int verbosity = 0);
+void convertToGbnf(GbnfData& data, std::istream& input, int verbosity = 0, 
+                   size_t threadCount = 1);
 
 /*! Function makes a C/C++ header file containing a const GbnfData structure which contains
  *  the gBNF data from the 'data' structure.
  *  @param data - the structure holding the data to move to the file
  *  @param variableName - the name of the const struct to use in that file.
  *  @param output - the output stream to write to. Most likely a file stream.
+ *  @param mode - code generation mode (CODEGEN_*).
  *  @throws runtime_error if fatal error occured.
  */ 
 void generateCode( const GbnfData& data, std::ostream& output, 
-                   const char* variableName, int verbosity = 0 ); 
+                   const char* variableName, int verbosity = 0, 
+                   int mode = CODEGEN_CONSTRUCTION ); 
+
+/*! Computes a structural fingerprint (stable 64-bit hash) of the grammar.
+ *  - Covers flags, tags, rules, options and tokens. Equal grammars always
+ *    get equal fingerprints, on every platform.
+ *  - Used to key the caches of data built from the grammar (see gbnfcache.hpp).
+ */
+uint64_t getFingerprint( const GbnfData& data );
+
+/*! Computes a structural fingerprint of one rule - its ID, options and tokens.
+ *  - Tags are hashed by ID, so a rule gets a new fingerprint if the IDs of the 
+ *    tags it references change.
+ */
+uint64_t getRuleFingerprint( const GrammarRule& rule );
 
 /*! GBNF Converters. Converts GBNF data to various formats.
  *  - Converts EBNF grammar to BNF, for easier parsing.
@@ -457,9 +1053,165 @@ const int NO_RECURSION_FIX = 0;
 const int FIX_LEFT_RECURSION = 1;
 const int FIX_RIGHT_RECURSION = 2;
 
-void convertToBNF( GbnfData& data, bool preferRightRecursion = false, int verbosity = 0 );
+/*! Converts EBNF grammar to BNF. Groups are replaced with generated rules.
+ *  @param threadCount - number of threads converting the rules. If 0, number of
+ *         hardware threads is used. Output is the same for any thread count.
+ */ 
+void convertToBNF( GbnfData& data, bool preferRightRecursion = false, int verbosity = 0,
+                   size_t threadCount = 1 );
+
+/*! Growth report of the recursion fix.
+ *  - One component for every recursive strongly connected component of the
+ *    "starts with" graph, which had to be rewritten.
+ *  - Sizes are counted on the component's rules, and the tail rules created for them.
+ */ 
+struct RecursionFixReport{
+    struct Component{
+        std::vector< size_t > rules; // IDs of the rules in the component.
+        size_t optionsBefore = 0;
+        size_t optionsAfter  = 0;
+        size_t symbolsBefore = 0;
+        size_t symbolsAfter  = 0;
+        size_t newRules      = 0;
+    };
+
+    std::vector< Component > components;
+};
+
+/*! Removes left (or right) recursion, direct and indirect.
+ *  - Works on the rule dependency graph: only the strongly connected components 
+ *    of the "starts with" ("ends with" for right) relation are rewritten, so 
+ *    grammar grows only where recursion actually is.
+ *  - Recursion through a nullable prefix (hidden recursion) is not removed.
+ *  - Rewriting changes the values the options' semantic actions would get, so
+ *    rules of the recursive components can't have actions.
+ *  @throws runtime_error if grammar is not BNF (contains groups), if some 
+ *          recursive rule has no non-recursive option, or has semantic actions.
+ *          Grammar is not modified if actions are found.
+ *  @param verbosity - unused, nothing is logged. The caller logs the report.
+ *  @return growth report of every rewritten component.
+ */ 
+RecursionFixReport fixRecursion( GbnfData& data, int recursionFixMode = FIX_LEFT_RECURSION, 
+                                 int verbosity = 0 );
 
-void fixRecursion( GbnfData& data, int recursionFixMode = FIX_LEFT_RECURSION, int verbosity = 0 );
+/*! Grammar optimization passes. Can be OR'ed together.
+ *  - OPTIMIZE_REMOVE_DEAD_RULES: removes unreachable and unproductive rules, and
+ *    the options using the unproductive ones.
+ *  - OPTIMIZE_INLINE_UNIT_RULES: replaces references to rules of form "A ::= X ;"
+ *    with X, and removes the rules.
+ *  - OPTIMIZE_LEFT_FACTOR:       options with a common prefix are merged into one
+ *    option - the prefix and a new rule holding the suffixes.
+ *  - OPTIMIZE_MERGE_DUPLICATES:  removes duplicate options, and merges structurally
+ *    equal rules into the one with the lowest ID.
+ *  Passes run in the order above.
+ */
+const int OPTIMIZE_REMOVE_DEAD_RULES = 1;
+const int OPTIMIZE_INLINE_UNIT_RULES = 2;
+const int OPTIMIZE_LEFT_FACTOR       = 4;
+const int OPTIMIZE_MERGE_DUPLICATES  = 8;
+const int OPTIMIZE_ALL               = 15;
+
+/*! Size report of the optimization. One entry for every pass which was run.
+ */
+struct OptimizationReport{
+    struct Pass{
+        int pass = 0;   // OPTIMIZE_* flag of the pass.
+        size_t rulesBefore   = 0;
+        size_t rulesAfter    = 0;
+        size_t optionsBefore = 0;
+        size_t optionsAfter  = 0;
+        size_t symbolsBefore = 0;
+        size_t symbolsAfter  = 0;
+    };
+
+    std::vector< Pass > passes;
+
+    static const char* getPassName( int pass );
+};
+
+/*! Runs the optimization passes on a BNF grammar.
+ *  - Start rule is the rule with the lowest ID. It's never removed.
+ *  - Tags without rules are treated as external (lexer) tokens.
+ *  - Options with semantic actions are never inlined into or factored.
+ *  @param passes - OPTIMIZE_* flags of the passes to run.
+ *  @param verbosity - unused, nothing is logged. The caller logs the report.
+ *  @throws runtime_error if grammar is not BNF (contains groups).
+ *  @return size report of every pass.
+ */
+OptimizationReport optimizeGrammar( GbnfData& data, int passes = OPTIMIZE_ALL,
+                                    int verbosity = 0 );
+
+/*! Incremental EBNF -> BNF build, for tools rebuilding a grammar after edits
+ *  (i.e. "gbnf --watch").
+ *  - Every source rule's conversion is cached by the rule's fingerprint, so only
+ *    new and changed rules are converted again. 
+ *  - The rest of the build is NOT incremental: tag allocation of the generated 
+ *    rules is replayed over all rules, and the converted options of all rules are 
+ *    copied into the new result, so it's O(grammar) - but it's only copying, so 
+ *    it's much cheaper than conversion. The result is the same as of the full 
+ *    build: convertToBNF, then fixRecursion and optimizeGrammar if set.
+ *  - Recursion fix and optimization run on the whole grammar whenever the BNF 
+ *    grammar changes. They're skipped only if it's unchanged - then the previous 
+ *    result is reused.
+ *  - Users of the result (code generators, table caches) can check the report's 
+ *    resultChanged to reuse their output, and the changed/affected rules to 
+ *    rebuild only their parts which depend on them.
+ */
+class IncrementalConverter{
+public:
+    /*! Rule-level diff of the last build against the previous one.
+     *  - Rules are identified by ID. If a tag is inserted in the middle of a grammar,
+     *    rules referencing the shifted tags are changed too.
+     */
+    struct Report{
+        std::vector< size_t > changed;  // IDs of the new and changed rules.
+        std::vector< size_t > removed;  // IDs of the rules not present anymore.
+        std::vector< size_t > affected; // Rules referencing changed or removed ones.
+        size_t convertedRules = 0;      // Source rules converted in this build.
+        bool resultChanged = true;      // False if the previous result was reused.
+    };
+
+    IncrementalConverter( bool preferRightRecursion = false, 
+                          int recursionFixMode = NO_RECURSION_FIX, int optimizationPasses = 0 );
+    ~IncrementalConverter();
+    IncrementalConverter( const IncrementalConverter& ) = delete;
+    IncrementalConverter& operator= ( const IncrementalConverter& ) = delete;
+
+    /*! Builds the grammar from the EBNF source. Source is not modified.
+     *  @return the result, valid until the next build.
+     *  @throws runtime_error if the recursion fix or optimization fails.
+     */
+    const GbnfData& build( const GbnfData& source, Report* report = nullptr );
+
+    const GbnfData& result() const;
+
+    // Drops the cache. Next build converts every rule.
+    void clear();
+
+private:
+    class Impl;
+    std::unique_ptr< Impl > impl;
+};
+
+/*! Conflict of the grammar merge - a tag defined by rules in more than one grammar.
+ */
+struct MergeConflict{
+    std::string tag;
+    size_t definedIn;   // Index of the grammar whose rule was kept.
+    size_t redefinedIn; // Index of the grammar whose rule was dropped.
+};
+
+/*! Merges grammars into one tag ID space.
+ *  - Tags are unified by name. IDs are given in order of the grammars, and of their 
+ *    tag tables, so the result doesn't depend on how the grammars were produced.
+ *  - If a tag is defined in more than one grammar, the rules of the first one
+ *    are kept. Rules of one grammar with the same tag are all kept, as a rule
+ *    can be split in one file ( <a> ::= "x" ; <a> ::= "y" ; ).
+ *  - Rules are moved out of the sources.
+ *  @param dest - the empty GBNF structure to fill up.
+ *  @return the conflicts, in order of the dropped rules.
+ */
+std::vector< MergeConflict > mergeGrammars( GbnfData& dest, std::vector< GbnfData >& sources );
 
 }
 
@@ -0,0 +1,181 @@
+#ifndef GBNFACTIONS_HPP_INCLUDED
+#define GBNFACTIONS_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <stdexcept>
+#include "gbnf.hpp"
+
+namespace gbnf{
+
+/*! Semantic action dispatcher.
+ *  - Rule options can declare a named semantic action ("@name" in EBNF).
+ *    The name is stored in the option's ROOT_TOKEN data.
+ *  - User registers a callback for each action name, and binds the dispatcher
+ *    to a BNF grammar. Binding resolves all names to IDs, so no string lookups
+ *    are done while parsing.
+ *  - Parser calls shift() for every matched terminal, and reduce() when
+ *    it has completed (exited) a rule option. Values are passed on a typed
+ *    value stack, so results are computed in one pass, without a parse tree.
+ *
+ *  - Every child token of an option is one value on the stack. The grammar
+ *    must be converted to BNF before binding (no groups are allowed).
+ *  - Options without an action use the default action: the first value
+ *    is passed through ( $$ = $1 ), or Value() if option has no values.
+ *  - A rule split into several entries with the same ID is one rule: its
+ *    options are indexed across the entries, in the order of the grammar table.
+ */
+template< typename Value >
+class SemanticActions{
+public:
+    /*! Action callback.
+     *  @param args - pointer to the first value of the option being reduced.
+     *  @param count - number of values (option's child count).
+     *  @return the value to push in place of the reduced ones.
+     */
+    using Action = std::function< Value( Value* args, size_t count ) >;
+
+    const static int NO_ACTION = -1;
+
+private:
+    // Registered actions, indexed by Action ID.
+    std::vector< Action > actions;
+    std::map< std::string, size_t > actionIDs;
+
+    // Bound productions. Production index is ruleOffsets[ ruleID ] + option index.
+    std::vector< size_t > ruleOffsets;
+    std::vector< size_t > ruleOptionCounts;
+    std::vector< int > productionActions;
+    std::vector< size_t > productionArity;
+
+    // The value stack.
+    std::vector< Value > values;
+
+public:
+    SemanticActions(){}
+
+    /*! Registers an action by name. Re-registering replaces the callback.
+     *  @return the Action ID.
+     */
+    size_t registerAction( const std::string& name, Action&& fn ){
+        auto it = actionIDs.find( name );
+        if( it != actionIDs.end() ){
+            actions[ it->second ] = std::move( fn );
+            return it->second;
+        }
+        actions.push_back( std::move( fn ) );
+        actionIDs.insert( std::make_pair( name, actions.size() - 1 ) );
+        return actions.size() - 1;
+    }
+
+    /*! @return ID of the action with the name, or NO_ACTION if not registered.
+     */
+    int getActionID( const std::string& name ) const {
+        auto it = actionIDs.find( name );
+        return ( it != actionIDs.end() ? (int)(it->second) : NO_ACTION );
+    }
+
+    /*! Resolves action names of all options of the grammar to action IDs.
+     *  @throws runtime_error if option names an unregistered action,
+     *          or grammar is not in BNF.
+     */
+    void bind( const GbnfData& data ){
+        ruleOffsets.clear();
+        ruleOptionCounts.clear();
+        productionActions.clear();
+        productionArity.clear();
+
+        // Count the options of every rule over all of its entries, so the
+        // productions of a split rule are contiguous.
+        for( auto&& rule : data.grammarTableConst() ){
+            if( rule.getID() >= ruleOffsets.size() ){
+                ruleOffsets.resize( rule.getID() + 1, (size_t)(-1) );
+                ruleOptionCounts.resize( rule.getID() + 1, 0 );
+            }
+            ruleOffsets[ rule.getID() ] = 0;
+            ruleOptionCounts[ rule.getID() ] += rule.options.size();
+        }
+
+        size_t total = 0;
+        for( size_t id = 0; id < ruleOffsets.size(); id++ ){
+            if( ruleOffsets[ id ] != (size_t)(-1) ){
+                ruleOffsets[ id ] = total;
+                total += ruleOptionCounts[ id ];
+            }
+        }
+        productionActions.assign( total, (int)NO_ACTION );
+        productionArity.assign( total, 0 );
+
+        std::vector< size_t > next( ruleOffsets );
+        for( auto&& rule : data.grammarTableConst() ){
+            for( auto&& opt : rule.options ){
+                for( auto&& tok : opt.children ){
+                    if( tok.type != GrammarToken::TAG_ID &&
+                        tok.type != GrammarToken::REGEX_STRING )
+                        throw std::runtime_error( "[SemanticActions::bind()]: "
+                            "Grammar must be converted to BNF." );
+                }
+
+                int actID = NO_ACTION;
+                if( !opt.data.empty() ){
+                    actID = getActionID( opt.data );
+                    if( actID == NO_ACTION )
+                        throw std::runtime_error( "[SemanticActions::bind()]: "
+                            "Action @" + opt.data + " is not registered." );
+                }
+                const size_t prod = next[ rule.getID() ]++;
+                productionActions[ prod ] = actID;
+                productionArity[ prod ] = opt.children.size();
+            }
+        }
+    }
+
+    // Value stack operations.
+    inline void shift( const Value& v ){ values.push_back( v ); }
+    inline void shift( Value&& v ){ values.push_back( std::move( v ) ); }
+
+    inline Value& top(){ return values.back(); }
+    inline Value pop(){
+        Value v = std::move( values.back() );
+        values.pop_back();
+        return v;
+    }
+    inline size_t stackSize() const { return values.size(); }
+    inline void clear(){ values.clear(); }
+
+    /*! Reduces the option of a rule: pops option's values from the stack,
+     *  invokes the bound action, and pushes the result.
+     *  @param ruleID - the ID of the rule (tag) being reduced.
+     *  @param option - the index of the rule's option which was matched.
+     *  @throws runtime_error if the rule isn't bound, option is out of range, 
+     *          or not enough values are on the stack.
+     */
+    void reduce( size_t ruleID, size_t option ){
+        if( ruleID >= ruleOffsets.size() || ruleOffsets[ ruleID ] == (size_t)(-1) )
+            throw std::runtime_error( "[SemanticActions::reduce()]: Rule "+
+                std::to_string( ruleID )+" is not bound." );
+        if( option >= ruleOptionCounts[ ruleID ] )
+            throw std::runtime_error( "[SemanticActions::reduce()]: Rule "+
+                std::to_string( ruleID )+" has no option "+std::to_string( option )+"." );
+
+        const size_t prod = ruleOffsets[ ruleID ] + option;
+        const size_t arity = productionArity[ prod ];
+        const int actID = productionActions[ prod ];
+
+        if( values.size() < arity )
+            throw std::runtime_error( "[SemanticActions::reduce()]: Value stack underflow." );
+
+        Value* args = values.data() + ( values.size() - arity );
+        Value result = ( actID != NO_ACTION ? actions[ actID ]( args, arity ) :
+                         ( arity ? std::move( args[0] ) : Value() ) );
+
+        values.resize( values.size() - arity );
+        values.push_back( std::move( result ) );
+    }
+};
+
+}
+
+#endif // GBNFACTIONS_HPP_INCLUDED
@@ -0,0 +1,443 @@
+#include <algorithm>
+#include "gbnfanalysis.hpp"
+
+namespace gbnf{
+
+/*! ORs the src words into dst.
+ *  @return true if dst has changed.
+ */
+static inline bool orInto( uint64_t* dst, const uint64_t* src, size_t words ){
+    uint64_t changed = 0;
+    for( size_t i = 0; i < words; i++ ){
+        changed |= src[ i ] & ~dst[ i ];
+        dst[ i ] |= src[ i ];
+    }
+    return changed != 0;
+}
+
+static inline void setBit( uint64_t* words, size_t i ){
+    words[ i / 64 ] |= (uint64_t)1 << ( i % 64 );
+}
+
+static inline bool isOptionalGroup( char type ){
+    return type == GrammarToken::GROUP_OPTIONAL || type == GrammarToken::GROUP_REPEAT_NONE;
+}
+
+static inline bool isRepeatGroup( char type ){
+    return type == GrammarToken::GROUP_REPEAT_NONE || type == GrammarToken::GROUP_REPEAT_ONE;
+}
+
+static inline bool isGroup( char type ){
+    return type == GrammarToken::GROUP_ONE || isOptionalGroup( type ) || isRepeatGroup( type );
+}
+
+size_t BitsetView::count() const {
+    size_t cnt = 0;
+    forEach( [&cnt]( size_t ){ cnt++; } );
+    return cnt;
+}
+
+/*! Interns the terminals of the symbols, and records the rule references.
+ */
+void GrammarAnalysis::collectSymbols( const FlatSymbol* syms, size_t count, uint32_t rule ){
+    for( size_t i = 0; i < count; i++ ){
+        const FlatSymbol& s = syms[ i ];
+
+        if( s.type == GrammarToken::REGEX_STRING ){
+            std::string str = view.symbolData( s );
+            auto it = terminalIndex.find( str );
+            if( it == terminalIndex.end() ){
+                it = terminalIndex.insert( std::make_pair( str, terminals.size() ) ).first;
+                terminals.push_back( std::move( str ) );
+                terminalTags.push_back( 0 );
+            }
+            symbolTerminal[ &s - view.symbols ] = it->second;
+        }
+        else if( s.type == GrammarToken::TAG_ID ){
+            uint32_t ri = ruleIndex( s.id );
+            if( ri != NO_RULE ){
+                refs[ rule ].push_back( ri );
+                users[ ri ].push_back( rule );
+            }
+        }
+        else if( isGroup( s.type ) )
+            collectSymbols( view.symbols + s.firstChild, s.childCount, rule );
+    }
+}
+
+/*! Interns the tags without a rule as token terminals, after the regex ones.
+ */
+void GrammarAnalysis::collectTagTerminals( const FlatSymbol* syms, size_t count ){
+    for( size_t i = 0; i < count; i++ ){
+        const FlatSymbol& s = syms[ i ];
+
+        if( s.type == GrammarToken::TAG_ID && ruleIndex( s.id ) == NO_RULE ){
+            auto it = tagTerminalIndex.find( s.id );
+            if( it == tagTerminalIndex.end() ){
+                it = tagTerminalIndex.insert( std::make_pair( s.id, terminals.size() ) ).first;
+                const FlatTag* tag = view.getTag( s.id );
+                terminals.push_back( "<" + ( tag ? view.tagName( *tag ) : 
+                                             std::to_string( s.id ) ) + ">" );
+                terminalTags.push_back( s.id );
+            }
+            symbolTerminal[ &s - view.symbols ] = it->second;
+        }
+        else if( isGroup( s.type ) )
+            collectTagTerminals( view.symbols + s.firstChild, s.childCount );
+    }
+}
+
+/*! ORs the FIRST set of the symbol sequence into "out", using the current sets.
+ *  @return true if the sequence is nullable.
+ */
+bool GrammarAnalysis::sequenceFirst( const FlatSymbol* syms, size_t count, uint64_t* out ){
+    for( size_t i = 0; i < count; i++ ){
+        const FlatSymbol& s = syms[ i ];
+
+        if( s.type == GrammarToken::REGEX_STRING ){
+            setBit( out, symbolTerminal[ &s - view.symbols ] );
+            return false;
+        }
+        else if( s.type == GrammarToken::TAG_ID ){
+            uint32_t ri = ruleIndex( s.id );
+            if( ri == NO_RULE ){
+                setBit( out, symbolTerminal[ &s - view.symbols ] );
+                return false;
+            }
+            orInto( out, firstRow( ri ), setWords );
+            if( !nullable[ ri ] )
+                return false;
+        }
+        else if( isGroup( s.type ) ){
+            bool childNullable = sequenceFirst( view.symbols + s.firstChild, s.childCount, out );
+            if( !childNullable && !isOptionalGroup( s.type ) )
+                return false;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+bool GrammarAnalysis::sequenceProductive( const FlatSymbol* syms, size_t count ) const {
+    for( size_t i = 0; i < count; i++ ){
+        const FlatSymbol& s = syms[ i ];
+
+        if( s.type == GrammarToken::TAG_ID ){
+            uint32_t ri = ruleIndex( s.id );
+            if( ri != NO_RULE && !productive[ ri ] )
+                return false;
+        }
+        else if( isGroup( s.type ) ){
+            if( !isOptionalGroup( s.type ) &&
+                !sequenceProductive( view.symbols + s.firstChild, s.childCount ) )
+                return false;
+        }
+        else if( s.type != GrammarToken::REGEX_STRING )
+            return false;
+    }
+    return true;
+}
+
+/*! Nullable and FIRST sets.
+ *  - Worklist of rules. When the rule's sets grow, the rules using it are re-evaluated.
+ */
+void GrammarAnalysis::computeNullableAndFirst(){
+    const size_t n = ruleCount();
+    nullable.assign( n, false );
+    firstSets.assign( n * setWords, 0 );
+
+    std::vector< uint32_t > work;
+    std::vector< bool > inWork( n, true );
+    work.reserve( n );
+    for( size_t r = n; r > 0; r-- )
+        work.push_back( r - 1 );
+
+    std::vector< uint64_t > temp( setWords );
+    while( !work.empty() ){
+        uint32_t r = work.back();
+        work.pop_back();
+        inWork[ r ] = false;
+
+        std::copy( firstRow( r ), firstRow( r ) + setWords, temp.begin() );
+
+        bool isNullable = false;
+        forEachOption( r, [ & ]( const FlatOption& opt ){
+            if( sequenceFirst( view.symbols + opt.firstSymbol, opt.symbolCount, temp.data() ) )
+                isNullable = true;
+        } );
+
+        bool changed = orInto( firstRow( r ), temp.data(), setWords );
+        if( isNullable && !nullable[ r ] ){
+            nullable[ r ] = true;
+            changed = true;
+        }
+
+        if( changed ){
+            for( auto&& u : users[ r ] ){
+                if( !inWork[ u ] ){
+                    inWork[ u ] = true;
+                    work.push_back( u );
+                }
+            }
+        }
+    }
+}
+
+/*! Walks the sequence right to left, carrying the "trailer" - the set of
+ *  terminals which can follow the current position.
+ *  - FOLLOW sets get the trailer directly.
+ *  - If the rest of the sequence is nullable (trailerHasFollow), FOLLOW of the
+ *    rule flows into FOLLOW of the symbol. These edges are propagated later.
+ *  - Content of the repeat groups can also be followed by the group's FIRST set.
+ */
+void GrammarAnalysis::sequenceFollow( const FlatSymbol* syms, size_t count,
+                                      std::vector< uint64_t > trailer, bool trailerHasFollow,
+                                      uint32_t rule,
+                                      std::vector< std::vector< uint32_t > >& followEdges ){
+    for( size_t i = count; i > 0; i-- ){
+        const FlatSymbol& s = syms[ i - 1 ];
+
+        if( s.type == GrammarToken::TAG_ID ){
+            uint32_t ri = ruleIndex( s.id );
+            if( ri == NO_RULE ){
+                std::fill( trailer.begin(), trailer.end(), 0 );
+                trailerHasFollow = false;
+                setBit( trailer.data(), symbolTerminal[ &s - view.symbols ] );
+                continue;
+            }
+
+            orInto( followRow( ri ), trailer.data(), setWords );
+            if( trailerHasFollow )
+                followEdges[ rule ].push_back( ri );
+
+            if( !nullable[ ri ] ){
+                std::fill( trailer.begin(), trailer.end(), 0 );
+                trailerHasFollow = false;
+            }
+            orInto( trailer.data(), firstRow( ri ), setWords );
+        }
+        else if( isGroup( s.type ) ){
+            const FlatSymbol* children = view.symbols + s.firstChild;
+
+            std::vector< uint64_t > contentFirst( setWords, 0 );
+            bool contentNullable = sequenceFirst( children, s.childCount, contentFirst.data() );
+
+            std::vector< uint64_t > inner( trailer );
+            if( isRepeatGroup( s.type ) )
+                orInto( inner.data(), contentFirst.data(), setWords );
+            sequenceFollow( children, s.childCount, std::move( inner ), trailerHasFollow,
+                            rule, followEdges );
+
+            if( !contentNullable && !isOptionalGroup( s.type ) ){
+                std::fill( trailer.begin(), trailer.end(), 0 );
+                trailerHasFollow = false;
+            }
+            orInto( trailer.data(), contentFirst.data(), setWords );
+        }
+        else{
+            std::fill( trailer.begin(), trailer.end(), 0 );
+            trailerHasFollow = false;
+            if( s.type == GrammarToken::REGEX_STRING )
+                setBit( trailer.data(), symbolTerminal[ &s - view.symbols ] );
+        }
+    }
+}
+
+/*! FOLLOW sets.
+ *  - Constant parts are collected in one pass over the options, then FOLLOW sets
+ *    are propagated along the "FOLLOW(A) is in FOLLOW(B)" edges with a worklist.
+ */
+void GrammarAnalysis::computeFollow(){
+    const size_t n = ruleCount();
+    followSets.assign( n * setWords, 0 );
+    if( startRule != NO_RULE )
+        setBit( followRow( startRule ), endMarker() );
+
+    std::vector< std::vector< uint32_t > > edges( n );
+    for( size_t r = 0; r < n; r++ ){
+        forEachOption( r, [ & ]( const FlatOption& opt ){
+            sequenceFollow( view.symbols + opt.firstSymbol, opt.symbolCount,
+                            std::vector< uint64_t >( setWords, 0 ), true, r, edges );
+        } );
+    }
+
+    std::vector< uint32_t > work;
+    std::vector< bool > inWork( n, false );
+    for( size_t r = n; r > 0; r-- ){
+        auto& e = edges[ r - 1 ];
+        std::sort( e.begin(), e.end() );
+        e.erase( std::unique( e.begin(), e.end() ), e.end() );
+        if( !e.empty() ){
+            inWork[ r - 1 ] = true;
+            work.push_back( r - 1 );
+        }
+    }
+
+    while( !work.empty() ){
+        uint32_t r = work.back();
+        work.pop_back();
+        inWork[ r ] = false;
+
+        for( auto&& target : edges[ r ] ){
+            if( target != r && orInto( followRow( target ), followRow( r ), setWords ) &&
+                !inWork[ target ] && !edges[ target ].empty() ){
+                inWork[ target ] = true;
+                work.push_back( target );
+            }
+        }
+    }
+}
+
+void GrammarAnalysis::computeReachable(){
+    reachable.assign( ruleCount(), false );
+    if( startRule == NO_RULE )
+        return;
+
+    std::vector< uint32_t > work( 1, startRule );
+    reachable[ startRule ] = true;
+    while( !work.empty() ){
+        uint32_t r = work.back();
+        work.pop_back();
+
+        for( auto&& ref : refs[ r ] ){
+            if( !reachable[ ref ] ){
+                reachable[ ref ] = true;
+                work.push_back( ref );
+            }
+        }
+    }
+}
+
+/*! Productive rules - the ones which can derive a string of terminals.
+ *  - Worklist: a rule is re-checked only when one of the rules it uses becomes productive.
+ */
+void GrammarAnalysis::computeProductive(){
+    const size_t n = ruleCount();
+    productive.assign( n, false );
+
+    std::vector< uint32_t > work;
+    std::vector< bool > inWork( n, true );
+    for( size_t r = n; r > 0; r-- )
+        work.push_back( r - 1 );
+
+    while( !work.empty() ){
+        uint32_t r = work.back();
+        work.pop_back();
+        inWork[ r ] = false;
+        if( productive[ r ] )
+            continue;
+
+        forEachOption( r, [ & ]( const FlatOption& opt ){
+            if( !productive[ r ] )
+                productive[ r ] = sequenceProductive( view.symbols + opt.firstSymbol,
+                                                      opt.symbolCount );
+        } );
+
+        if( productive[ r ] ){
+            for( auto&& u : users[ r ] ){
+                if( !inWork[ u ] && !productive[ u ] ){
+                    inWork[ u ] = true;
+                    work.push_back( u );
+                }
+            }
+        }
+    }
+}
+
+GrammarAnalysis::GrammarAnalysis( const GrammarView& grammar, size_t startID )
+    : view( grammar )
+{
+    // Group the entries of the split rules.
+    entryRule.assign( view.ruleCount, 0 );
+    for( size_t e = 0; e < view.ruleCount; e++ ){
+        if( !e || view.rules[ e ].id != view.rules[ e - 1 ].id )
+            ruleEntries.push_back( e );
+        entryRule[ e ] = ruleEntries.size() - 1;
+    }
+    ruleEntries.push_back( view.ruleCount );
+
+    const size_t n = ruleCount();
+    if( n )
+        startRule = ( startID ? ruleIndex( startID ) : 0 );
+
+    refs.resize( n );
+    users.resize( n );
+    symbolTerminal.assign( view.symbolCount, 0 );
+    for( size_t r = 0; r < n; r++ ){
+        forEachOption( r, [ & ]( const FlatOption& opt ){
+            collectSymbols( view.symbols + opt.firstSymbol, opt.symbolCount, r );
+        } );
+    }
+    for( size_t r = 0; r < n; r++ ){
+        forEachOption( r, [ & ]( const FlatOption& opt ){
+            collectTagTerminals( view.symbols + opt.firstSymbol, opt.symbolCount );
+        } );
+    }
+    for( size_t r = 0; r < n; r++ ){
+        std::sort( refs[ r ].begin(), refs[ r ].end() );
+        refs[ r ].erase( std::unique( refs[ r ].begin(), refs[ r ].end() ), refs[ r ].end() );
+        std::sort( users[ r ].begin(), users[ r ].end() );
+        users[ r ].erase( std::unique( users[ r ].begin(), users[ r ].end() ), users[ r ].end() );
+    }
+
+    // One more bit for the end marker.
+    setWords = ( terminals.size() + 1 + 63 ) / 64;
+    emptyRow.assign( setWords, 0 );
+
+    computeNullableAndFirst();
+    computeFollow();
+    computeReachable();
+    computeProductive();
+}
+
+size_t GrammarAnalysis::getTerminalIndex( const std::string& regex ) const {
+    auto it = terminalIndex.find( regex );
+    return ( it != terminalIndex.end() ? it->second : (size_t)(-1) );
+}
+
+size_t GrammarAnalysis::getTagTerminalIndex( size_t tagID ) const {
+    auto it = tagTerminalIndex.find( tagID );
+    return ( it != tagTerminalIndex.end() ? it->second : (size_t)(-1) );
+}
+
+bool GrammarAnalysis::isNullable( size_t id ) const {
+    uint32_t ri = ruleIndex( id );
+    return ri != NO_RULE && nullable[ ri ];
+}
+
+bool GrammarAnalysis::isReachable( size_t id ) const {
+    uint32_t ri = ruleIndex( id );
+    return ri != NO_RULE && reachable[ ri ];
+}
+
+bool GrammarAnalysis::isProductive( size_t id ) const {
+    uint32_t ri = ruleIndex( id );
+    return ri != NO_RULE && productive[ ri ];
+}
+
+BitsetView GrammarAnalysis::first( size_t id ) const {
+    uint32_t ri = ruleIndex( id );
+    return BitsetView( ri != NO_RULE ? firstSets.data() + ri * setWords : emptyRow.data(),
+                       terminals.size() );
+}
+
+BitsetView GrammarAnalysis::follow( size_t id ) const {
+    uint32_t ri = ruleIndex( id );
+    return BitsetView( ri != NO_RULE ? followSets.data() + ri * setWords : emptyRow.data(),
+                       terminals.size() + 1 );
+}
+
+const GrammarAnalysis& AnalysisCache::get( const GbnfData& data, size_t start ){
+    if( analysis && data.getGeneration() == generation && start == startID )
+        return *analysis;
+
+    invalidate();
+    frozen.reset( new FlatGrammar( data ) );
+    analysis.reset( new GrammarAnalysis( frozen->view(), start ) );
+    generation = data.getGeneration();
+    startID = start;
+    return *analysis;
+}
+
+}
@@ -0,0 +1,192 @@
+#ifndef GBNFANALYSIS_HPP_INCLUDED
+#define GBNFANALYSIS_HPP_INCLUDED
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include "gbnf.hpp"
+#include "gbnfflat.hpp"
+
+namespace gbnf{
+
+/*! Read-only view of one row of a bit matrix.
+ */
+class BitsetView{
+private:
+    const uint64_t* words;
+    size_t bits;
+
+public:
+    BitsetView( const uint64_t* _words, size_t _bits ) : words( _words ), bits( _bits ) {}
+
+    inline size_t size() const { return bits; }
+    inline bool test( size_t i ) const {
+        return i < bits && ( words[ i / 64 ] >> ( i % 64 ) ) & 1;
+    }
+
+    size_t count() const;
+
+    // Calls f( index ) for every set bit, in increasing order.
+    template< typename F >
+    void forEach( F&& f ) const {
+        for( size_t w = 0; w * 64 < bits; w++ ){
+            uint64_t word = words[ w ];
+            for( size_t b = 0; word; b++, word >>= 1 ){
+                if( word & 1 )
+                    f( w * 64 + b );
+            }
+        }
+    }
+};
+
+/*! Grammar analysis.
+ *  Computes the sets every parser/lexer builder needs:
+ *  - Nullable rules, FIRST and FOLLOW sets, reachable and productive rules.
+ *  - Sets are dense bitsets over terminals: every distinct regex string is a
+ *    terminal. FOLLOW sets have one more bit - the end of input (endMarker()).
+ *  - Tags which have no rule are external (lexer) tokens, i.e. <ident> defined
+ *    in lexic.bnf. Each of them is a terminal too, named "<tag>", placed after 
+ *    the regex terminals. They are productive and non-nullable.
+ *  - All sets are computed once, with worklist fixed points over the rule graph,
+ *    so the cost is near-linear in grammar size.
+ *  - Works on both BNF and EBNF (group) grammars.
+ *  - A rule split into several entries with the same ID ( <a> ::= "x" ; <a> ::= "y" ; )
+ *    is one rule: sets are computed over the options of all of its entries.
+ */
+class GrammarAnalysis{
+private:
+    const static uint32_t NO_RULE = FLAT_NONE;
+
+    GrammarView view;
+    uint32_t startRule = NO_RULE;
+
+    // Rules are the groups of the view's rule entries with the same ID, which are
+    // contiguous. Rule g has entries [ ruleEntries[ g ], ruleEntries[ g + 1 ] ).
+    std::vector< uint32_t > ruleEntries;
+    std::vector< uint32_t > entryRule;
+
+    // Terminals. Tag IDs of the token terminals (0 for the regex ones).
+    std::vector< std::string > terminals;
+    std::vector< size_t > terminalTags;
+    std::unordered_map< std::string, size_t > terminalIndex;
+    std::unordered_map< size_t, size_t > tagTerminalIndex;
+
+    // Sets, indexed by rule position in the view. Bit matrices are row-contiguous,
+    // with rows of setWords words (FIRST and FOLLOW rows are the same size).
+    size_t setWords = 0;
+    std::vector< uint64_t > firstSets;
+    std::vector< uint64_t > followSets;
+    std::vector< bool > nullable;
+    std::vector< bool > reachable;
+    std::vector< bool > productive;
+    std::vector< uint64_t > emptyRow;
+
+    // Terminal index of every REGEX_STRING symbol, and of every TAG_ID 
+    // symbol without a rule, by symbol position.
+    std::vector< uint32_t > symbolTerminal;
+
+    // Rules the rule references, and rules referencing the rule (reverse edges).
+    std::vector< std::vector< uint32_t > > refs;
+    std::vector< std::vector< uint32_t > > users;
+
+    inline uint32_t ruleIndex( size_t id ) const {
+        return ( id < view.idLimit && view.ruleByID[ id ] != NO_RULE ?
+                 entryRule[ view.ruleByID[ id ] ] : NO_RULE );
+    }
+    inline size_t ruleCount() const { return ruleEntries.size() - 1; }
+
+    // Calls f( option ) for every option of every entry of the rule.
+    template< typename F >
+    void forEachOption( size_t r, F&& f ) const {
+        for( size_t e = ruleEntries[ r ]; e < ruleEntries[ r + 1 ]; e++ ){
+            const FlatRule& entry = view.rules[ e ];
+            for( size_t o = 0; o < entry.optionCount; o++ )
+                f( view.option( entry, o ) );
+        }
+    }
+    inline uint64_t* firstRow( size_t r ){ return firstSets.data() + r * setWords; }
+    inline uint64_t* followRow( size_t r ){ return followSets.data() + r * setWords; }
+
+    void collectSymbols( const FlatSymbol* syms, size_t count, uint32_t rule );
+    void collectTagTerminals( const FlatSymbol* syms, size_t count );
+    bool sequenceFirst( const FlatSymbol* syms, size_t count, uint64_t* out );
+    bool sequenceProductive( const FlatSymbol* syms, size_t count ) const;
+    void sequenceFollow( const FlatSymbol* syms, size_t count, std::vector< uint64_t > trailer,
+                         bool trailerHasFollow, uint32_t rule,
+                         std::vector< std::vector< uint32_t > >& followEdges );
+
+    void computeNullableAndFirst();
+    void computeFollow();
+    void computeReachable();
+    void computeProductive();
+
+public:
+    /*! Analyses the grammar.
+     *  - View must stay valid while this object is used.
+     *  @param startID - ID of the start rule. If 0, the rule with the lowest ID is used.
+     */
+    GrammarAnalysis( const GrammarView& grammar, size_t startID = 0 );
+
+    // Terminals.
+    inline size_t terminalCount() const { return terminals.size(); }
+    inline const std::string& terminal( size_t i ) const { return terminals[ i ]; }
+    inline size_t endMarker() const { return terminals.size(); }
+
+    // Tag ID of the token terminal, or 0 if it's a regex.
+    inline size_t terminalTag( size_t i ) const { return terminalTags[ i ]; }
+
+    /*! @return the index of the terminal, or (size_t)-1 if it's not in the grammar.
+     */
+    size_t getTerminalIndex( const std::string& regex ) const;
+
+    /*! @return the index of the token terminal of the ruleless tag, or (size_t)-1 
+     *          if it's not used in the grammar, or has a rule.
+     */
+    size_t getTagTerminalIndex( size_t tagID ) const;
+
+    inline size_t getStartID() const {
+        return ( startRule != NO_RULE ? view.rules[ ruleEntries[ startRule ] ].id : 0 );
+    }
+
+    // Queries by rule ID. IDs without a rule give empty sets and false.
+    bool isNullable( size_t id ) const;
+    bool isReachable( size_t id ) const;
+    bool isProductive( size_t id ) const;
+    BitsetView first( size_t id ) const;
+    BitsetView follow( size_t id ) const;
+};
+
+/*! Analysis cache of a mutable grammar.
+ *  - Grammar is frozen to a FlatGrammar, and analysed, on the first get().
+ *  - The cache is keyed by the grammar's generation (see GbnfData::getGeneration()),
+ *    so a cache hit is O(1), and any mutation of the grammar invalidates it.
+ */
+class AnalysisCache{
+private:
+    uint64_t generation = 0;
+    size_t startID = 0;
+    std::unique_ptr< FlatGrammar > frozen;
+    std::unique_ptr< GrammarAnalysis > analysis;
+
+public:
+    AnalysisCache(){}
+    AnalysisCache( const AnalysisCache& ) = delete;
+    AnalysisCache& operator= ( const AnalysisCache& ) = delete;
+
+    /*! @return the analysis of the current state of the grammar.
+     *  Reference is valid until the next call to get() or invalidate().
+     */
+    const GrammarAnalysis& get( const GbnfData& data, size_t startID = 0 );
+
+    inline void invalidate(){
+        analysis.reset();
+        frozen.reset();
+    }
+    inline bool isValid() const { return (bool)analysis; }
+};
+
+}
+
+#endif // GBNFANALYSIS_HPP_INCLUDED
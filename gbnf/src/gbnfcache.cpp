@@ -0,0 +1,201 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include "gbnfcache.hpp"
+
+#ifdef _WIN32
+    #define GBNF_NO_MMAP
+#else
+    #include <unistd.h>
+#endif
+
+namespace gbnf{
+
+/*! FNV-1a 64-bit hasher.
+ *  - Integers are fed as fixed-width little-endian words, so the
+ *    hash doesn't depend on the platform.
+ */
+class Fnv1aHasher{
+private:
+    uint64_t hash = 14695981039346656037ULL;
+
+public:
+    inline void add( const char* bytes, size_t len ){
+        for( size_t i = 0; i < len; i++ ){
+            hash ^= (unsigned char)bytes[ i ];
+            hash *= 1099511628211ULL;
+        }
+    }
+    inline void add( uint64_t val ){
+        for( int i = 0; i < 8; i++ ){
+            hash ^= (unsigned char)( val >> (i * 8) );
+            hash *= 1099511628211ULL;
+        }
+    }
+    inline void add( const std::string& str ){
+        add( (uint64_t)str.size() );
+        add( str.c_str(), str.size() );
+    }
+
+    inline uint64_t get() const { return hash; }
+};
+
+static void hashGrammarToken( Fnv1aHasher& h, const GrammarToken& tok ){
+    h.add( (uint64_t)tok.type );
+    h.add( (uint64_t)tok.id );
+    h.add( tok.data );
+    h.add( (uint64_t)tok.children.size() );
+    for( auto&& child : tok.children )
+        hashGrammarToken( h, child );
+}
+
+/*! Computes a structural fingerprint of the grammar.
+ *  - Hashes the flags, the tag table, and every rule, option and token.
+ *  - Rules are hashed in ID order, so the result doesn't depend on
+ *    whether the grammar table is sorted.
+ */
+uint64_t getFingerprint( const GbnfData& data ){
+    Fnv1aHasher h;
+    h.add( (uint64_t)data.flags );
+
+    h.add( (uint64_t)data.tagTableConst().size() );
+    for( auto&& tag : data.tagTableConst() ){
+        h.add( (uint64_t)tag.getID() );
+        h.add( tag.data );
+    }
+
+    std::vector< const GrammarRule* > rules;
+    rules.reserve( data.grammarTableConst().size() );
+    for( auto&& rule : data.grammarTableConst() )
+        rules.push_back( &rule );
+
+    if( !data.isSorted() ){
+        std::sort( rules.begin(), rules.end(),
+            []( const GrammarRule* a, const GrammarRule* b ){ return *a < *b; } );
+    }
+
+    h.add( (uint64_t)rules.size() );
+    for( auto&& rule : rules ){
+        h.add( (uint64_t)rule->getID() );
+        h.add( (uint64_t)rule->options.size() );
+        for( auto&& opt : rule->options )
+            hashGrammarToken( h, opt );
+    }
+
+    return h.get();
+}
+
+uint64_t getRuleFingerprint( const GrammarRule& rule ){
+    Fnv1aHasher h;
+    h.add( (uint64_t)rule.getID() );
+    h.add( (uint64_t)rule.options.size() );
+    for( auto&& opt : rule.options )
+        hashGrammarToken( h, opt );
+    return h.get();
+}
+
+//==========================================================//
+// Table Cache.
+
+static inline void writeLE( char* dest, uint64_t val, size_t bytes ){
+    for( size_t i = 0; i < bytes; i++ )
+        dest[ i ] = (char)( val >> (i * 8) );
+}
+
+static inline uint64_t readLE( const char* src, size_t bytes ){
+    uint64_t val = 0;
+    for( size_t i = 0; i < bytes; i++ )
+        val |= (uint64_t)( (unsigned char)src[ i ] ) << (i * 8);
+    return val;
+}
+
+void TableCache::unmap(){
+    file.close();
+    fallbackBuffer.clear();
+    blob = nullptr;
+    blobSize = 0;
+}
+
+bool TableCache::load( uint64_t fingerprint ){
+    unmap();
+
+    if( !file.open( path ) || file.size() < HEADER_SIZE ){
+        unmap();
+        return false;
+    }
+
+    const char* mem = file.data();
+
+    // Check the header. On mismatch, the cache is stale.
+    if( std::memcmp( mem, "gTBL", 4 ) != 0 ||
+        readLE( mem + 4, 4 ) != VERSION ||
+        readLE( mem + 8, 8 ) != fingerprint ||
+        readLE( mem + 16, 8 ) > file.size() - HEADER_SIZE )
+    {
+        unmap();
+        return false;
+    }
+
+    blob = mem + HEADER_SIZE;
+    blobSize = readLE( mem + 16, 8 );
+    return true;
+}
+
+bool TableCache::store( uint64_t fingerprint, const void* tables, size_t size ){
+    char header[ HEADER_SIZE ] = { 0 };
+    std::memcpy( header, "gTBL", 4 );
+    writeLE( header + 4, VERSION, 4 );
+    writeLE( header + 8, fingerprint, 8 );
+    writeLE( header + 16, size, 8 );
+
+    // Write to a temporary file, and rename it, so concurrent
+    // readers never see a partially written cache.
+#ifndef GBNF_NO_MMAP
+    std::string tmpPath = path + ".tmp" + std::to_string( (long)getpid() );
+#else
+    std::string tmpPath = path + ".tmp";
+#endif
+    {
+        std::ofstream file( tmpPath, std::ios::out | std::ios::binary | std::ios::trunc );
+        if( !file.is_open() )
+            return false;
+        file.write( header, HEADER_SIZE );
+        file.write( (const char*)tables, size );
+        if( !file.good() ){
+            file.close();
+            std::remove( tmpPath.c_str() );
+            return false;
+        }
+    }
+
+    unmap();
+#ifdef _WIN32
+    std::remove( path.c_str() ); // Rename doesn't replace existing files on Windows.
+#endif
+    if( std::rename( tmpPath.c_str(), path.c_str() ) != 0 ){
+        std::remove( tmpPath.c_str() );
+        return false;
+    }
+
+    return load( fingerprint );
+}
+
+bool TableCache::loadOrBuild( uint64_t fingerprint,
+                              const std::function< std::string() >& builder ){
+    if( load( fingerprint ) )
+        return true;
+
+    std::string tables = builder();
+    if( !store( fingerprint, tables.data(), tables.size() ) ){
+        // Can't write the cache - serve the tables from memory.
+        unmap();
+        fallbackBuffer = std::move( tables );
+        blob = fallbackBuffer.data();
+        blobSize = fallbackBuffer.size();
+    }
+    return false;
+}
+
+}
+
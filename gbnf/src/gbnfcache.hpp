@@ -0,0 +1,71 @@
+#ifndef GBNFCACHE_HPP_INCLUDED
+#define GBNFCACHE_HPP_INCLUDED
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include "gbnf.hpp"
+#include "gbnffile.hpp"
+
+namespace gbnf{
+
+/*! On-disk cache of compiled parse tables.
+ *  - Tables are stored as an opaque binary blob, keyed by the fingerprint
+ *    of the grammar they were built from (see getFingerprint()).
+ *  - The file is mapped into memory, so tables written in a position-independent
+ *    format can be used directly from the mapping, without any parsing.
+ *
+ *  Cache file structure (all integers little-endian):
+ *  - Bytes 0-3:   Magic Number "gTBL"
+ *  - Bytes 4-7:   Cache format version.
+ *  - Bytes 8-15:  Grammar fingerprint.
+ *  - Bytes 16-23: Table blob size in bytes.
+ *  - Bytes 24-31: Padding. Blob starts at offset 32, so it's 32-byte aligned.
+ */
+class TableCache{
+private:
+    std::string path;
+
+    MappedFile file;
+    std::string fallbackBuffer; // Tables, if they couldn't be stored.
+
+    const char* blob = nullptr;
+    size_t blobSize = 0;
+
+    void unmap();
+
+public:
+    const static uint32_t VERSION = 1;
+    const static size_t HEADER_SIZE = 32;
+
+    TableCache( const std::string& filePath ) : path( filePath ) {}
+    TableCache( const TableCache& ) = delete;
+    TableCache& operator= ( const TableCache& ) = delete;
+    ~TableCache(){ unmap(); }
+
+    /*! Maps the cache file and checks if it was built for this fingerprint.
+     *  @return true if tables are available via data() and size().
+     */
+    bool load( uint64_t fingerprint );
+
+    /*! Writes the tables to the cache file, replacing it atomically,
+     *  and maps the new file.
+     *  @return true if tables were stored successfully.
+     */
+    bool store( uint64_t fingerprint, const void* tables, size_t size );
+
+    /*! Loads the tables if the fingerprint matches. Otherwise, builds them with
+     *  the builder, and stores them to the cache.
+     *  @param builder - function producing the serialized tables.
+     *  @return true if tables were loaded from cache (builder was not called).
+     */
+    bool loadOrBuild( uint64_t fingerprint, const std::function< std::string() >& builder );
+
+    inline const char* data() const { return blob; }
+    inline size_t size() const { return blobSize; }
+    inline bool ready() const { return blob != nullptr; }
+};
+
+}
+
+#endif // GBNFCACHE_HPP_INCLUDED
@@ -6,6 +6,7 @@
 #include <gryltools/stringtools.hpp>
 #include <gryltools/printtools.hpp>
 #include "gbnf.hpp"
+#include "gbnfflat.hpp"
 extern "C" {
     #include <gryltools/hlog.h>
 }
@@ -23,6 +24,7 @@ private:
     // Core:
     std::ostream& output;
     std::string includeGuard;
+    int mode;
 
     // Helper Methods
     void properizeVarName( std::string& vname );
@@ -33,11 +35,18 @@ private:
     static void outputGrammarToken( std::ostream& outp, const GrammarToken& tok, 
                              const gtools::PrintTools::ListOutputParams& ps );
 
+    void generateStaticTables( const GbnfData& data, const std::string& variableName );
+    void outputStringLiteral( const char* str, size_t len );
+    template< typename T, typename F >
+    void outputStaticArray( const char* type, const std::string& name, 
+                            const T* arr, size_t size, F&& outputElement );
+
 public:
     /*! Constructor. Just makes sure all necessary data is set checked.
      */  
-    GbnfCodeGenerator( std::ostream& outp, const std::string& fName )
-        : output( outp )
+    GbnfCodeGenerator( std::ostream& outp, const std::string& fName, 
+                       int _mode = CODEGEN_CONSTRUCTION )
+        : output( outp ), mode( _mode )
     { 
         makeIncludeGuard( fName ); 
     }
@@ -83,7 +92,10 @@ void GbnfCodeGenerator::outputStart(){
     output << "\n#ifndef "<< includeGuard <<"\n#define "<< includeGuard <<"\n\n";
     output << "/* File automatically generated by GBNFCodeGen Tool.\n";
     output << " * Edit at your own risk.\n */\n\n";
-    output << "#include <gbnf.hpp>\n\nusing namespace gbnf;\n\n";
+    if( mode == CODEGEN_STATIC_TABLES )
+        output << "#include <gbnfflat.hpp>\n\nusing namespace gbnf;\n\n";
+    else
+        output << "#include <gbnf.hpp>\n\nusing namespace gbnf;\n\n";
 }
 
 void GbnfCodeGenerator::outputEnd(){
@@ -96,6 +108,11 @@ void GbnfCodeGenerator::generate( const GbnfData& data, const std::string& vn ){
     std::string variableName = vn;
     properizeVarName( variableName );
 
+    if( mode == CODEGEN_STATIC_TABLES ){
+        generateStaticTables( data, variableName );
+        return;
+    }
+
     output << "\nconst GbnfData "<< variableName<< "= GbnfData( "<< data.flags <<" , \n";
     
     // Output TagTbl constructor
@@ -162,14 +179,119 @@ void GbnfCodeGenerator::outputGrammarToken( std::ostream& outp, const GrammarTok
     outp<<" )";
 }
 
+/*! Outputs the string as a C++ string literal.
+ *  - Every non-printable character is octal-escaped, so the literal holds any bytes.
+ */ 
+void GbnfCodeGenerator::outputStringLiteral( const char* str, size_t len ){
+    const size_t LINE_LENGTH = 80;
+
+    output << "\"";
+    size_t lineStart = 0;
+    for( size_t i = 0; i < len; i++ ){
+        unsigned char c = str[ i ];
+        if( c == '\\' || c == '\"' || c == '?' )
+            output << '\\' << c;
+        else if( c >= 32 && c < 127 )
+            output << c;
+        else{
+            const char* digits = "01234567";
+            output << '\\' << digits[ c >> 6 ] << digits[ (c >> 3) & 7 ] << digits[ c & 7 ];
+        }
+
+        // Split the long literals.
+        if( i - lineStart >= LINE_LENGTH && i + 1 < len ){
+            output << "\"\n    \"";
+            lineStart = i;
+        }
+    }
+    output << "\"";
+}
+
+/*! Outputs a static constexpr array.
+ *  - Empty arrays aren't allowed in C++, so nothing is output for them.
+ */ 
+template< typename T, typename F >
+void GbnfCodeGenerator::outputStaticArray( const char* type, const std::string& name,
+                                           const T* arr, size_t size, F&& outputElement ){
+    if( !size )
+        return;
+
+    output << "static constexpr "<< type <<" "<< name <<"[] = {\n";
+    for( size_t i = 0; i < size; i++ ){
+        output << "    ";
+        outputElement( arr[ i ] );
+        output << ( i + 1 < size ? ",\n" : "\n" );
+    }
+    output << "};\n\n";
+}
+
+/*! Generates the flat grammar tables as constexpr POD arrays, and a GrammarView over them.
+ *  - Tables are constant-initialized, so using them costs nothing at program start.
+ */ 
+void GbnfCodeGenerator::generateStaticTables( const GbnfData& data, const std::string& vn ){
+    FlatGrammar flat( data );
+    GrammarView view = flat.view();
+
+    output << "\n";
+    outputStaticArray( "FlatTag", vn + "_tags", view.tags, view.tagCount, 
+        [ this ]( const FlatTag& t ){
+            output << "{ "<< t.id <<", "<< t.nameOffset <<", "<< t.nameLength <<" }";
+        } );
+
+    outputStaticArray( "FlatRule", vn + "_rules", view.rules, view.ruleCount, 
+        [ this ]( const FlatRule& r ){
+            output << "{ "<< r.id <<", "<< r.firstOption <<", "<< r.optionCount <<" }";
+        } );
+
+    outputStaticArray( "FlatOption", vn + "_options", view.options, view.optionCount, 
+        [ this ]( const FlatOption& o ){
+            output << "{ "<< o.firstSymbol <<", "<< o.symbolCount <<", "
+                   << o.actionOffset <<", "<< o.actionLength <<" }";
+        } );
+
+    outputStaticArray( "FlatSymbol", vn + "_symbols", view.symbols, view.symbolCount, 
+        [ this ]( const FlatSymbol& s ){
+            output << "{ "<< GrammarToken::getTypeString( s.type, true ) <<", "<< s.id <<", "
+                   << s.dataOffset <<", "<< s.dataLength <<", "
+                   << s.firstChild <<", "<< s.childCount <<" }";
+        } );
+
+    auto outputIndex = [ this ]( uint32_t i ){
+        if( i == FLAT_NONE )
+            output << "FLAT_NONE";
+        else
+            output << i;
+    };
+    outputStaticArray( "uint32_t", vn + "_tagByID", view.tagByID, view.idLimit, outputIndex );
+    outputStaticArray( "uint32_t", vn + "_ruleByID", view.ruleByID, view.idLimit, outputIndex );
+
+    output << "static constexpr char "<< vn <<"_strings[] = \n    ";
+    outputStringLiteral( view.strings, view.stringsSize );
+    output << ";\n\n";
+
+    // The view. Empty tables are represented by nullptr.
+    auto table = [ &vn ]( const char* name, size_t size ){
+        return size ? vn + name : std::string( "nullptr" );
+    };
+
+    output << "constexpr GrammarView "<< vn <<" = {\n"
+           << "    "<< table( "_tags", view.tagCount ) <<", "<< view.tagCount <<",\n"
+           << "    "<< table( "_rules", view.ruleCount ) <<", "<< view.ruleCount <<",\n"
+           << "    "<< table( "_options", view.optionCount ) <<", "<< view.optionCount <<",\n"
+           << "    "<< table( "_symbols", view.symbolCount ) <<", "<< view.symbolCount <<",\n"
+           << "    "<< vn <<"_strings, "<< view.stringsSize <<",\n"
+           << "    "<< table( "_tagByID", view.idLimit ) <<", "
+           << table( "_ruleByID", view.idLimit ) <<", "<< view.idLimit <<",\n"
+           << "    "<< view.flags <<"\n};\n\n";
+}
 
 //==========================================================//
 //class CodeGenerator_impl;
 
 /*! Constructor. Just makes sure all necessary data is set checked.
  */  
-CodeGenerator::CodeGenerator( std::ostream& outp, const std::string& filename )
-    : impl( new GbnfCodeGenerator( outp, filename ) )
+CodeGenerator::CodeGenerator( std::ostream& outp, const std::string& filename, int mode )
+    : impl( new GbnfCodeGenerator( outp, filename, mode ) )
 {}
 
 void CodeGenerator::outputStart(){
@@ -189,8 +311,8 @@ void CodeGenerator::generateConstructionCode( const GbnfData& gbData,
  *  Generates a C++ header file from GBNF data passed, and outputs to a stream.
  */ 
 void generateCode( const GbnfData& data, std::ostream& output, 
-                   const char* variableName, int verbosity ){
-    GbnfCodeGenerator gen( output, std::string( variableName ) );
+                   const char* variableName, int verbosity, int mode ){
+    GbnfCodeGenerator gen( output, std::string( variableName ), mode );
     gen.outputStart();
     gen.generate( data, std::string( variableName ) );
     gen.outputEnd();
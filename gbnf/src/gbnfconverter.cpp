@@ -1,41 +1,146 @@
 #include "gbnfconverter.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+#include <thread>
+#include <exception>
+#include <iterator>
+#include "gbnfanalysis.hpp"
 
 namespace gbnf{
 
+class ConverterToBNF;
+static std::vector< std::vector< size_t > > replayTagAllocation( GbnfData& data, 
+        const std::vector< ConverterToBNF* >& parts, bool consume );
+
 class ConverterToBNF{
+public:
+    // A lookup of a group in the hash-consing table, logged in deferred mode.
+    // - key: local index of the group's key.
+    // - recurse: if the lookup creates a rule, the group's body is converted too.
+    struct GroupVisit{
+        size_t key;
+        bool recurse;
+    };
+
 private:
     GbnfData& data;
     std::vector< GrammarRule > newRules;
     const bool preferRightRecursion = true; // For LR Pars0rz
     int verbosity = 0;
 
+    // Hash-consing table: structural key of a group -> ID of the rule generated for it.
+    // Identical groups share one generated rule.
+    std::unordered_map< std::string, size_t > consTable;
+
+    // Deferred mode - used by the parallel conversion. No tags are inserted to data.
+    // - Generated rules get placeholder IDs: placeholderBase + local key index.
+    // - Every group lookup is logged, so the serial tag allocation can be replayed.
+    bool deferred = false;
+    size_t placeholderBase = 0;
+    std::vector< std::string > groupKeys;
+    std::vector< std::vector< GroupVisit > > groupVisits; // Lookups done by group's body.
+    std::vector< std::vector< GroupVisit > > ruleVisits;  // Lookups done by every rule.
+
+    // Current lookup log: the body of group visitGroup, or the rule visitRule if NO_GROUP.
+    // Indices are used, because the logs are reallocated while converting.
+    const static size_t NO_GROUP = (size_t)(-1);
+    size_t visitGroup = NO_GROUP;
+    size_t visitRule = 0;
+
+    size_t allocateTag( const std::string& key ){
+        if( !deferred )
+            return data.insertTag( "__tmp_bnfmode_"+std::to_string( data.getLastTagID() + 1 ) );
+
+        groupKeys.push_back( key );
+        groupVisits.push_back( std::vector< GroupVisit >() );
+        return placeholderBase + groupKeys.size() - 1;
+    }
+
+    inline void logVisit( size_t id, bool recurse ){
+        if( deferred ){
+            auto& log = ( visitGroup != NO_GROUP ? groupVisits[ visitGroup ] 
+                                                 : ruleVisits[ visitRule ] );
+            log.push_back( GroupVisit{ id - placeholderBase, recurse } );
+        }
+    }
+
+    friend std::vector< std::vector< size_t > > replayTagAllocation( 
+        GbnfData&, const std::vector< ConverterToBNF* >&, bool );
+
 public:
     ConverterToBNF( GbnfData& _data, bool _preferRightRec = true, int _verbosity = 0 ) 
         : data( _data ), preferRightRecursion( _preferRightRec ), verbosity( _verbosity ) 
     {}
 
     void convert();
+    void convertDeferred( size_t firstRule, size_t ruleCount, size_t _placeholderBase );
 
-    short createNewRuleAndGetTag( GrammarToken&& rootToken, int recLevel = 0 );
+    inline size_t getPlaceholderBase() const { return placeholderBase; }
+
+    size_t createNewRuleAndGetTag( GrammarToken&& rootToken, int recLevel = 0 );
     void fixNonBNFTokensInRule( const GrammarRule& rule, int recLevel = 0 );
 };
 
+/*! Appends the structural key of the token sequence to "key".
+ *  - Equal sequences (types, tag IDs, strings, children) get equal keys.
+ *  - Sizes are prefixed, so the key is unambiguous.
+ */ 
+static void appendStructureKey( std::string& key, const std::vector< GrammarToken >& toks ){
+    key.append( std::to_string( toks.size() ) );
+    key.push_back( ':' );
+
+    for( auto&& tok : toks ){
+        key.push_back( tok.type );
+        if( tok.type == GrammarToken::TAG_ID )
+            key.append( std::to_string( tok.id ) );
+        else if( tok.type == GrammarToken::REGEX_STRING ){
+            key.append( std::to_string( tok.data.size() ) );
+            key.push_back( ',' );
+            key.append( tok.data );
+        }
+        else
+            appendStructureKey( key, tok.children );
+        key.push_back( ';' );
+    }
+}
 
 /*! Converts a container-type token to a new grammar rule.
  * - Puts new rule to the newRules vector
+ * - If a structurally identical group was already converted, its rule is reused.
+ *   Optionality is handled by the caller, so GROUP_OPTIONAL shares rules with 
+ *   GROUP_ONE, and GROUP_REPEAT_NONE with GROUP_REPEAT_ONE.
  *  @param token - a group-type grammar token containing tokens to be parsed.
  *  @param recLevel - level of recursion. Default Zero.
  *  @return an ID of the NonTerminal which the newly created rule defines.
  */ 
-short ConverterToBNF::createNewRuleAndGetTag( GrammarToken&& token, int recLevel ){
-    // Backup current token's type
-    auto tokType = token.type; 
+size_t ConverterToBNF::createNewRuleAndGetTag( GrammarToken&& token, int recLevel ){
+    const bool isRepeat = ( token.type == GrammarToken::GROUP_REPEAT_NONE ||
+                            token.type == GrammarToken::GROUP_REPEAT_ONE );
 
-    short nruleID = data.insertTag( "__tmp_bnfmode_"+
-                        std::to_string( data.getLastTagID() + 1 ) );
+    // Check if identical group already has a rule.
+    std::string bodyKey;
+    appendStructureKey( bodyKey, token.children );
+    std::string key = ( isRepeat ? "R" : "G" ) + bodyKey;
+
+    auto consed = consTable.find( key );
+    if( consed != consTable.end() ){
+        logVisit( consed->second, true );
+        return consed->second;
+    }
+
+    size_t nruleID = allocateTag( key );
+    consTable.insert( std::make_pair( std::move( key ), nruleID ) );
+    logVisit( nruleID, true );
+
+    // Lookups done while converting the body belong to this group.
+    const size_t parentVisitGroup = visitGroup;
+    if( deferred )
+        visitGroup = nruleID - placeholderBase;
 
     // Create a new rule to be added to newRules.
-    // Assign the being-fixed token's children as new rule's Option no.1 .
+    // Move the being-fixed token's children to new rule's Option no.1 .
     GrammarRule nrule( nruleID );
     nrule.options.push_back( 
         GrammarToken( GrammarToken::ROOT_TOKEN, 0, "", 
@@ -49,20 +154,31 @@ short ConverterToBNF::createNewRuleAndGetTag( GrammarToken&& token, int recLevel
 
     // If original token, which we are currently fixing, is of repeatable type,
     // Add current rule's tag as an option, to support recursive repeat.
-    if( tokType == GrammarToken::GROUP_REPEAT_NONE ||
-        tokType == GrammarToken::GROUP_REPEAT_ONE )
-    {
-        // Check if only one option is left in the rule. If not, make another rule.
+    if( isRepeat ){
+        // Check if only one option is left in the rule. If not, move the options to 
+        // another rule. It's the same rule as the one of a plain group with these 
+        // children, so it's shared with such groups.
         if( nrule.options.size() > 1 ){
-            short newTagID = data.insertTag( "__tmp_bnfmode_"+
-                    std::to_string( data.getLastTagID() + 1 ) );
-
-            // Make a new rule containing all option of the current rule.
-            // The new rule defines a tag with ID of "newTagID".
-            this->newRules.push_back( GrammarRule(
-                newTagID,
-                std::move( nrule.options )
-            ) );
+            std::string groupKey = "G" + bodyKey;
+            size_t newTagID;
+
+            auto body = consTable.find( groupKey );
+            if( body != consTable.end() ){
+                newTagID = body->second;
+                logVisit( newTagID, false );
+            }
+            else{
+                newTagID = allocateTag( groupKey );
+                consTable.insert( std::make_pair( std::move( groupKey ), newTagID ) );
+                logVisit( newTagID, false );
+
+                // Make a new rule containing all option of the current rule.
+                // The new rule defines a tag with ID of "newTagID".
+                this->newRules.push_back( GrammarRule(
+                    newTagID,
+                    std::move( nrule.options )
+                ) );
+            }
             
             // Now clear current rule's options, and add a single option - reference to
             // a new rule.
@@ -72,36 +188,33 @@ short ConverterToBNF::createNewRuleAndGetTag( GrammarToken&& token, int recLevel
             ) );
         }
 
-        // Create a repetition option (copy tokens in first option)
-        GrammarToken reptok ( GrammarToken::ROOT_TOKEN, 0, std::string(), {} );
-        reptok.children = nrule.options[ 0 ].children;
+        // Create a repetition option: the body, and a nonTerminal with Current Rule's ID 
+        // at end or beginning, depending on parser type, to initiate recursive repetition.
+        // Body is already fixed, so its tokens are leaves.
+        const auto& body = nrule.options[ 0 ].children;
+        GrammarToken reptok( GrammarToken::ROOT_TOKEN, 0, std::string(), {} );
+        reptok.children.reserve( body.size() + 1 );
 
-        // Insert a nonTerminal option with Current Rule's ID at end or beginning,
-        // depending on parser type, to initiate recursive repetition. 
-        if( preferRightRecursion ){ // If right recursion, add in the end.
-            reptok.children.insert( reptok.children.end(), 
-                GrammarToken( GrammarToken::TAG_ID, nrule.getID(), std::string(), {} )
-            );
+        if( !preferRightRecursion ) // If left recursion, add in the beginning.
+            reptok.children.push_back( 
+                GrammarToken( GrammarToken::TAG_ID, nrule.getID(), std::string(), {} ) );
 
-            //nrule.options.insert( nrule.options.end(), std::move( reptok ) );
-        }
-        else{ // If left recursion, add in the beginning.
-            reptok.children.insert( reptok.children.begin(),
-                GrammarToken( GrammarToken::TAG_ID, nrule.getID(), std::string(), {} )
-            );
+        reptok.children.insert( reptok.children.end(), body.begin(), body.end() );
 
-            //nrule.options.insert( nrule.options.begin(), std::move( reptok ) );
-        }
+        if( preferRightRecursion ) // If right recursion, add in the end.
+            reptok.children.push_back( 
+                GrammarToken( GrammarToken::TAG_ID, nrule.getID(), std::string(), {} ) );
 
         // Add repetition option to the rule.
-        nrule.options.insert( nrule.options.end(), std::move( reptok ) );
+        nrule.options.push_back( std::move( reptok ) );
     }
 
     // Push (move) this rule to newRules vector.
     this->newRules.push_back( std::move( nrule ) );
+    visitGroup = parentVisitGroup;
 
     // Return ID of this rule.
-    return nrule.getID();
+    return nruleID;
 }
 
 /*! Converts all Non-BNF tokens in a Rule to BNF tokens, creating new Rules if needed.
@@ -110,7 +223,9 @@ short ConverterToBNF::createNewRuleAndGetTag( GrammarToken&& token, int recLevel
  *
  *    - GROUP_OPTIONAL and GROUP_REPEAT_NONE, which indicate optional tokens, are 
  *      getting a separate rule, and after that, are also being handled on this function, 
- *      where additional option is added to the Rule.
+ *      where options without them are added to the Rule.
+ *      Options with semantic actions can't have optional elements, because the
+ *      variants would pass a different number of values to the action.
  *
  *    - GROUP_ONE and GROUP_REPEAT_ONE, which are non-optional, are just getting a
  *      separate rule, and the token in current Rule is being replaced by a tag of
@@ -133,55 +248,84 @@ void ConverterToBNF::fixNonBNFTokensInRule( const GrammarRule& rule, int recLeve
     const size_t optSize = rule.options.size();
 
     for( size_t oi = 0; oi < optSize; oi++ ){
+        // Positions of the optional elements of this option.
+        std::vector< size_t > optionals;
+
         // Lvalue reference, because we don't want to move it. 
         auto& option = rule.options[ oi ]; 
 
         // Check first-level tokens of the current option.
         for( size_t i = 0; i < option.children.size(); i++ ){
-            auto&& token = option.children[ i ];
+            auto& token = option.children[ i ];
             auto type = token.type;
 
             // Check if it's illegal ( A group ). If so, it needs replacement.
-            if( type != GrammarToken::TAG_ID && 
-                type != GrammarToken::REGEX_STRING )
+            if( type == GrammarToken::TAG_ID || type == GrammarToken::REGEX_STRING )
+                continue;
+
+            // If only one child, and it's a leaf, just use it as repl. However, if
+            // there are more than one, or if it's a tree, create a separate rule. 
+            // Replace current group-type element with generated tag-type 
+            // element, referring to the newly created rule or element.
+            if( token.children.size() == 1 && token.children[ 0 ].children.empty() && 
+                ( type == GrammarToken::GROUP_ONE || type == GrammarToken::GROUP_OPTIONAL ) )
             {
-                // If only one child, and it's a leaf, just use it as repl. However, if
-                // there are more than one, or if it's a tree, create a separate rule. 
-                // TODO: Maybe dont't check anything.
-                auto&& replacement = ( 
-                    ( token.children.size() == 1 && 
-                      token.children[ 0 ].children.empty() && (
-                        type == GrammarToken::GROUP_ONE ||
-                        type == GrammarToken::GROUP_OPTIONAL
-                      )    
-                    ) ?
-                    // If only one child and it's a non-group type:
-                    token.children[0] :
-                    // If many childs, and/or it/they have group types:
-                    GrammarToken( 
-                        GrammarToken::TAG_ID, 
-                        createNewRuleAndGetTag( std::move( token ), recLevel ),
-                        "", {} 
-                    )   
-                );
-
-                // Now create new options according to the type.
-                // Replace current group-type element with generated tag-type 
-                // element, referring to the newly created rule or element.
-                option.children[ i ] = std::move( replacement );
-
-                // If optional/repeatable, create a new option without current element.
-                if( type == GrammarToken::GROUP_OPTIONAL || 
-                    type == GrammarToken::GROUP_REPEAT_NONE )
-                {
-                    // Copy current option, but without a current element.
-                    GrammarToken newOption( option );
-                    newOption.children.erase( newOption.children.begin() + i );
-
-                    // Push this new option to our rule.
-                    rule.options.push_back( std::move( newOption ) );
+                GrammarToken leaf = std::move( token.children[ 0 ] );
+                token = std::move( leaf );
+            }
+            else{
+                size_t id = createNewRuleAndGetTag( std::move( token ), recLevel );
+                token = GrammarToken( GrammarToken::TAG_ID, id, "", {} );
+            }
+
+            if( type == GrammarToken::GROUP_OPTIONAL || type == GrammarToken::GROUP_REPEAT_NONE )
+                optionals.push_back( i );
+        }
+
+        if( optionals.empty() )
+            continue;
+
+        // Variants omitting optionals would have less values than the action expects,
+        // and its arguments would refer to different symbols in each variant.
+        if( !option.data.empty() )
+            throw std::runtime_error( "convertToBNF: option of rule "+
+                std::to_string( rule.getID() )+" has action @"+option.data+
+                ", but has optional elements. Move them to a separate rule." );
+
+        // Option is BNF now. Create the options without the optional elements,
+        // for every combination of them. Each variant omits a set of optionals, and 
+        // spawns the variants omitting additional optionals after the last omitted one.
+        struct Variant{
+            std::vector< bool > omitted;
+            size_t next;
+        };
+        std::vector< Variant > variants( 1, Variant{ std::vector< bool >( optionals.size() ), 0 } );
+
+        for( size_t v = 0; v < variants.size(); v++ ){
+            for( size_t k = variants[ v ].next; k < optionals.size(); k++ ){
+                Variant nv = variants[ v ];
+                nv.omitted[ k ] = true;
+                nv.next = k + 1;
+                variants.push_back( std::move( nv ) );
+            }
+        }
+
+        // First variant is the current option itself.
+        for( size_t v = 1; v < variants.size(); v++ ){
+            const auto& full = rule.options[ oi ];
+            GrammarToken newOption( GrammarToken::ROOT_TOKEN, 0, full.data, {} );
+            newOption.children.reserve( full.children.size() );
+
+            for( size_t i = 0, k = 0; i < full.children.size(); i++ ){
+                if( k < optionals.size() && optionals[ k ] == i ){
+                    if( variants[ v ].omitted[ k++ ] )
+                        continue;
                 }
+                newOption.children.push_back( full.children[ i ] );
             }
+
+            // Push this new option to our rule.
+            rule.options.push_back( std::move( newOption ) );
         }
     }
 }
@@ -194,24 +338,1209 @@ void ConverterToBNF::convert(){
         fixNonBNFTokensInRule( rule );
     }
 
-    // At the end, append newly constructed rules to grammar table.
+    // At the end, merge newly constructed rules into the grammar table.
+    auto batch = data.batch();
     for( auto&& rl : newRules ){
-        data.insertRule( std::move( rl ) );
+        batch.insertRule( std::move( rl ) );
+    }
+    batch.commit();
+}
+
+/*! Converts a range of the grammar table in deferred mode.
+ *  - Only the options of the rules in the range are modified, so ranges can be
+ *    converted concurrently.
+ */ 
+void ConverterToBNF::convertDeferred( size_t firstRule, size_t ruleCount, 
+                                      size_t _placeholderBase ){
+    deferred = true;
+    placeholderBase = _placeholderBase;
+    ruleVisits.resize( ruleCount );
+
+    const auto& table = data.grammarTableConst();
+    for( size_t i = 0; i < ruleCount; i++ ){
+        visitRule = i;
+        fixNonBNFTokensInRule( table[ firstRule + i ] );
+    }
+}
+
+/*! Replaces the placeholder IDs of a deferred conversion in the options.
+ *  - Options are BNF, so only the first-level tokens are checked.
+ */ 
+static void replacePlaceholders( std::vector< GrammarToken >& options, size_t placeholderBase,
+                                 const std::vector< size_t >& ids ){
+    for( auto&& opt : options ){
+        for( auto&& tok : opt.children ){
+            if( tok.type == GrammarToken::TAG_ID && tok.id >= placeholderBase )
+                tok.id = ids[ tok.id - placeholderBase ];
+        }
+    }
+}
+
+/*! Replays the tag allocation of the deferred conversions.
+ *  - The logged group lookups are visited in the order the serial conversion would 
+ *    do them (parts in order, rules in order), and tags are inserted on the first 
+ *    visit of every key. So the tag IDs and names are the same as of the serial 
+ *    conversion.
+ *  - Generated rule of every key is taken from the part which visited it first, 
+ *    and inserted to data with the placeholders replaced. If "consume" is set, 
+ *    rules are moved out of the parts, otherwise they're copied.
+ *  @return the tag IDs of every part's keys.
+ */ 
+static std::vector< std::vector< size_t > > replayTagAllocation( GbnfData& data, 
+        const std::vector< ConverterToBNF* >& parts, bool consume ){
+    typedef ConverterToBNF::GroupVisit GroupVisit;
+
+    std::unordered_map< std::string, size_t > allocated;
+    std::vector< std::vector< size_t > > mapping( parts.size() );
+    std::vector< std::pair< size_t, size_t > > owned;
+    for( size_t t = 0; t < parts.size(); t++ )
+        mapping[ t ].assign( parts[ t ]->groupKeys.size(), 0 );
+
+    std::function< void( size_t, const GroupVisit& ) > visit = 
+        [ & ]( size_t t, const GroupVisit& v ){
+            const std::string& key = parts[ t ]->groupKeys[ v.key ];
+            auto it = allocated.find( key );
+            if( it != allocated.end() ){
+                mapping[ t ][ v.key ] = it->second;
+                return;
+            }
+
+            size_t id = data.insertTag( "__tmp_bnfmode_"+
+                            std::to_string( data.getLastTagID() + 1 ) );
+            allocated.insert( std::make_pair( key, id ) );
+            mapping[ t ][ v.key ] = id;
+            owned.push_back( std::make_pair( t, v.key ) );
+
+            if( v.recurse ){
+                for( auto&& nested : parts[ t ]->groupVisits[ v.key ] )
+                    visit( t, nested );
+            }
+        };
+
+    for( size_t t = 0; t < parts.size(); t++ ){
+        for( auto&& rv : parts[ t ]->ruleVisits ){
+            for( auto&& v : rv )
+                visit( t, v );
+        }
+    }
+
+    std::vector< std::vector< size_t > > ruleOfKey( parts.size() );
+    for( size_t t = 0; t < parts.size(); t++ ){
+        auto& rules = parts[ t ]->newRules;
+        ruleOfKey[ t ].resize( rules.size() );
+        for( size_t i = 0; i < rules.size(); i++ )
+            ruleOfKey[ t ][ rules[ i ].getID() - parts[ t ]->placeholderBase ] = i;
+    }
+
+    for( auto&& own : owned ){
+        const size_t t = own.first;
+        GrammarRule& rule = parts[ t ]->newRules[ ruleOfKey[ t ][ own.second ] ];
+
+        GrammarRule nrule( mapping[ t ][ own.second ] );
+        if( consume )
+            nrule.options = std::move( rule.options );
+        else
+            nrule.options = rule.options;
+
+        replacePlaceholders( nrule.options, parts[ t ]->placeholderBase, mapping[ t ] );
+        data.insertRule( std::move( nrule ) );
+    }
+
+    return mapping;
+}
+
+/*! Parallel EBNF -> BNF conversion.
+ *  - Grammar table is split into contiguous ranges, converted by the threads in
+ *    deferred mode, with thread-private hash-consing tables and placeholder IDs.
+ *  - Then the tag allocation is replayed serially (see replayTagAllocation()), so 
+ *    the whole output is the same as of the serial conversion, for any thread count.
+ *  - Placeholders are then replaced with the allocated tag IDs.
+ */ 
+static void convertToBNFInParallel( GbnfData& data, bool preferRightRecursion, int verbosity, 
+                                    size_t threadCount ){
+    const size_t ruleCount = data.grammarTableConst().size();
+    const size_t placeholderBase = data.getLastTagID() + 1;
+
+    // Convert the ranges.
+    std::vector< std::unique_ptr< ConverterToBNF > > workers;
+    std::vector< ConverterToBNF* > parts;
+    std::vector< size_t > firstRules;
+    for( size_t t = 0; t < threadCount; t++ ){
+        workers.push_back( std::unique_ptr< ConverterToBNF >( 
+            new ConverterToBNF( data, preferRightRecursion, verbosity ) ) );
+        parts.push_back( workers.back().get() );
+        firstRules.push_back( ruleCount * t / threadCount );
+    }
+    firstRules.push_back( ruleCount );
+
+    std::vector< std::exception_ptr > errors( threadCount );
+    std::vector< std::thread > threads;
+    for( size_t t = 0; t < threadCount; t++ ){
+        threads.push_back( std::thread( [ & ]( size_t ti ){
+            try{
+                workers[ ti ]->convertDeferred( firstRules[ ti ], 
+                    firstRules[ ti + 1 ] - firstRules[ ti ], placeholderBase );
+            } catch( ... ){
+                errors[ ti ] = std::current_exception();
+            }
+        }, t ) );
+    }
+    for( auto&& th : threads )
+        th.join();
+    for( auto&& err : errors ){
+        if( err )
+            std::rethrow_exception( err );
+    }
+
+    auto mapping = replayTagAllocation( data, parts, true );
+
+    const auto& table = data.grammarTableConst();
+    for( size_t t = 0; t < threadCount; t++ ){
+        for( size_t r = firstRules[ t ]; r < firstRules[ t + 1 ]; r++ )
+            replacePlaceholders( table[ r ].options, placeholderBase, mapping[ t ] );
     }
 
-    // Sort rules by ID.
     data.sort();
 }
 
+/*! Incremental converter's state.
+ *  - Fragment: deferred conversion of one source rule, cached by the rule's fingerprint.
+ *    Converted rule is kept in the fragment's own grammar, with placeholder IDs.
+ */
+class IncrementalConverter::Impl{
+public:
+    struct Fragment{
+        GbnfData rule;
+        std::unique_ptr< ConverterToBNF > converter;
+        bool used = false;
+    };
+
+    const bool preferRightRecursion;
+    const int recursionFixMode;
+    const int optimizationPasses;
+
+    std::unordered_map< uint64_t, std::unique_ptr< Fragment > > fragments;
+    std::unordered_map< size_t, uint64_t > ruleFingerprints; // Of the previous build, by ID.
+
+    bool built = false;
+    uint64_t bnfFingerprint = 0;
+    GbnfData result;
+
+    Impl( bool preferRight, int fixMode, int passes )
+        : preferRightRecursion( preferRight ), recursionFixMode( fixMode ), 
+          optimizationPasses( passes )
+    {}
+
+    Fragment& getFragment( const GrammarRule& rule, uint64_t fingerprint, 
+                           size_t placeholderBase, IncrementalConverter::Report& report );
+    void diff( const GbnfData& source, const std::vector< uint64_t >& fingerprints,
+               IncrementalConverter::Report& report );
+    void build( const GbnfData& source, IncrementalConverter::Report& report );
+};
+
+IncrementalConverter::Impl::Fragment& IncrementalConverter::Impl::getFragment( 
+        const GrammarRule& rule, uint64_t fingerprint, size_t placeholderBase, 
+        IncrementalConverter::Report& report ){
+    auto& frag = fragments[ fingerprint ];
+    if( !frag ){
+        frag.reset( new Fragment() );
+        frag->rule.insertRule( rule );
+        frag->converter.reset( new ConverterToBNF( frag->rule, preferRightRecursion ) );
+        frag->converter->convertDeferred( 0, 1, placeholderBase );
+        report.convertedRules++;
+    }
+    frag->used = true;
+    return *frag;
+}
+
+/*! Computes the rule-level diff against the previous build.
+ *  - Fingerprints of the rules with the same ID are combined.
+ *  - Affected rules are found on the reference graph of the source: rules which
+ *    reference a changed or removed rule, and are not changed themselves.
+ */
+void IncrementalConverter::Impl::diff( const GbnfData& source, 
+        const std::vector< uint64_t >& fingerprints, IncrementalConverter::Report& report ){
+    std::unordered_map< size_t, uint64_t > current;
+    const auto& table = source.grammarTableConst();
+    for( size_t i = 0; i < table.size(); i++ ){
+        auto ins = current.insert( std::make_pair( table[ i ].getID(), fingerprints[ i ] ) );
+        if( !ins.second )
+            ins.first->second = ins.first->second * 1099511628211ULL ^ fingerprints[ i ];
+    }
+
+    std::unordered_set< size_t > dirty;
+    for( auto&& rf : current ){
+        auto prev = ruleFingerprints.find( rf.first );
+        if( prev == ruleFingerprints.end() || prev->second != rf.second ){
+            report.changed.push_back( rf.first );
+            dirty.insert( rf.first );
+        }
+    }
+    for( auto&& rf : ruleFingerprints ){
+        if( !current.count( rf.first ) ){
+            report.removed.push_back( rf.first );
+            dirty.insert( rf.first );
+        }
+    }
+
+    std::function< bool( const std::vector< GrammarToken >& ) > usesDirty = 
+        [ & ]( const std::vector< GrammarToken >& toks ){
+            for( auto&& tok : toks ){
+                if( ( tok.type == GrammarToken::TAG_ID && dirty.count( tok.id ) ) ||
+                    usesDirty( tok.children ) )
+                    return true;
+            }
+            return false;
+        };
+
+    if( !dirty.empty() ){
+        for( auto&& rule : table ){
+            if( !dirty.count( rule.getID() ) && usesDirty( rule.options ) )
+                report.affected.push_back( rule.getID() );
+        }
+    }
+
+    std::sort( report.changed.begin(), report.changed.end() );
+    std::sort( report.removed.begin(), report.removed.end() );
+    std::sort( report.affected.begin(), report.affected.end() );
+    report.affected.erase( std::unique( report.affected.begin(), report.affected.end() ),
+                           report.affected.end() );
+
+    ruleFingerprints = std::move( current );
+}
+
+void IncrementalConverter::Impl::build( const GbnfData& source, 
+                                        IncrementalConverter::Report& report ){
+    const auto& table = source.grammarTableConst();
+    const size_t placeholderBase = source.getLastTagID() + 1;
+
+    std::vector< uint64_t > fingerprints( table.size() );
+    for( size_t i = 0; i < table.size(); i++ )
+        fingerprints[ i ] = getRuleFingerprint( table[ i ] );
+
+    diff( source, fingerprints, report );
+
+    // Convert the new rules, and pick the cached conversions of the others.
+    for( auto&& frag : fragments )
+        frag.second->used = false;
+
+    std::vector< Fragment* > ruleFragments;
+    std::vector< ConverterToBNF* > parts;
+    for( size_t i = 0; i < table.size(); i++ ){
+        ruleFragments.push_back( &getFragment( table[ i ], fingerprints[ i ], 
+                                               placeholderBase, report ) );
+        parts.push_back( ruleFragments.back()->converter.get() );
+    }
+
+    // Assemble the BNF grammar, like convertToBNF does.
+    GbnfData bnf;
+    bnf.flags = source.flags;
+    for( auto&& tag : source.tagTableConst() )
+        bnf.insertTag( tag.getID(), std::string( tag.data ) );
+
+    auto mapping = replayTagAllocation( bnf, parts, false );
+
+    for( size_t i = 0; i < table.size(); i++ ){
+        GrammarRule rule( table[ i ].getID() );
+        rule.options = ruleFragments[ i ]->rule.grammarTableConst()[ 0 ].options;
+        replacePlaceholders( rule.options, parts[ i ]->getPlaceholderBase(), mapping[ i ] );
+        bnf.insertRule( std::move( rule ) );
+    }
+    bnf.sort();
+
+    // Drop the conversions of the rules not present anymore.
+    for( auto it = fragments.begin(); it != fragments.end(); ){
+        if( !it->second->used )
+            it = fragments.erase( it );
+        else
+            ++it;
+    }
+
+    // Whole-grammar passes.
+    const uint64_t fingerprint = getFingerprint( bnf );
+    if( built && fingerprint == bnfFingerprint ){
+        report.resultChanged = false;
+        return;
+    }
+
+    if( recursionFixMode )
+        fixRecursion( bnf, recursionFixMode );
+    if( optimizationPasses )
+        optimizeGrammar( bnf, optimizationPasses );
+
+    result = std::move( bnf );
+    bnfFingerprint = fingerprint;
+    built = true;
+}
+
+/*! Creates a tag for a rule derived from the rule, named "<rule><suffix>".
+ *  - If the name is taken, a number is appended.
+ *  @return the ID of the new tag.
+ */ 
+static size_t createDerivedTag( GbnfData& data, size_t ruleID, const char* suffix ){
+    auto tag = data.getTag( ruleID );
+    std::string base = ( tag != data.tagTableConst().end() && tag->getID() == ruleID ?
+                         tag->data : std::to_string( ruleID ) ) + suffix;
+
+    std::string name = base;
+    for( size_t i = 2; data.getTagIDfromTable( name, false ) != (size_t)(-1); i++ )
+        name = base + std::to_string( i );
+
+    return data.insertTag( std::move( name ) );
+}
+
+/*! Left recursion remover.
+ *  - Builds the "starts with" graph of the rules (A -> B if some option of A starts 
+ *    with B), and finds it's Strongly Connected Components using Tarjan's algorithm.
+ *  - Only the recursive components (more than one rule, or a rule starting with 
+ *    itself) are rewritten, using Paull's algorithm, limited to the component.
+ *  - Right recursion is removed by mirroring the options, removing left 
+ *    recursion, and mirroring them back.
+ */ 
+class RecursionFixer{
+private:
+    GbnfData& data;
+    bool mirror;
+    RecursionFixReport report;
+
+    std::vector< GrammarRule > newRules;
+
+    // Rule graph. Nodes are the positions in the grammar table.
+    std::vector< std::vector< size_t > > edges;
+    std::vector< std::vector< size_t > > components;
+
+    void mirrorOptions();
+    void buildGraph();
+    void findComponents();
+    void checkActions() const;
+    void fixComponent( std::vector< size_t >& comp );
+    void removeImmediateRecursion( const GrammarRule& rule, 
+                                   RecursionFixReport::Component& stats );
+
+    static size_t countSymbols( const GrammarRule& rule ){
+        size_t cnt = 0;
+        for( auto&& opt : rule.options )
+            cnt += opt.children.size();
+        return cnt;
+    }
+
+    // Returns the ID of a rule the option starts with, or 0 if starts with something else.
+    static size_t getStartingRule( const GrammarToken& option ){
+        if( option.children.empty() || option.children[0].type != GrammarToken::TAG_ID )
+            return 0;
+        return option.children[0].id;
+    }
+
+public:
+    RecursionFixer( GbnfData& _data, bool _mirror ) : data( _data ), mirror( _mirror ) {}
+
+    RecursionFixReport fix();
+};
+
+/*! Reverses the children of every option. 
+ *  - Right recursion of the grammar becomes left recursion, and vice versa.
+ */ 
+void RecursionFixer::mirrorOptions(){
+    for( auto&& rule : data.grammarTableConst() ){
+        for( auto&& opt : rule.options )
+            std::reverse( opt.children.begin(), opt.children.end() );
+    }
+}
+
+/*! Builds the "starts with" edges between the rules.
+ *  @throws runtime_error if grammar has groups.
+ */ 
+void RecursionFixer::buildGraph(){
+    const auto& table = data.grammarTableConst();
+    edges.assign( table.size(), std::vector< size_t >() );
+
+    for( size_t i = 0; i < table.size(); i++ ){
+        for( auto&& opt : table[ i ].options ){
+            for( auto&& tok : opt.children ){
+                if( tok.type != GrammarToken::TAG_ID && tok.type != GrammarToken::REGEX_STRING )
+                    throw std::runtime_error( "fixRecursion: grammar is not BNF (rule "+
+                        std::to_string( table[ i ].getID() )+" has groups)." );
+            }
+
+            size_t startID = getStartingRule( opt );
+            if( !startID )
+                continue;
+
+            auto target = data.getRule( startID );
+            if( target != table.end() && target->getID() == startID )
+                edges[ i ].push_back( target - table.begin() );
+        }
+    }
+}
+
+/*! Tarjan's SCC algorithm, iterative, so big grammars don't overflow the stack.
+ *  - Stores only the recursive components.
+ */ 
+void RecursionFixer::findComponents(){
+    const size_t NONE = (size_t)(-1);
+    const size_t n = edges.size();
+
+    std::vector< size_t > index( n, NONE ), low( n, 0 );
+    std::vector< bool > onStack( n, false );
+    std::vector< size_t > stack;
+    std::vector< std::pair< size_t, size_t > > calls; // Node, and next edge to visit.
+    size_t counter = 0;
+
+    for( size_t root = 0; root < n; root++ ){
+        if( index[ root ] != NONE )
+            continue;
+
+        calls.push_back( std::make_pair( root, 0 ) );
+        while( !calls.empty() ){
+            size_t v = calls.back().first;
+            size_t& e = calls.back().second;
+
+            // First visit.
+            if( e == 0 && index[ v ] == NONE ){
+                index[ v ] = low[ v ] = counter++;
+                stack.push_back( v );
+                onStack[ v ] = true;
+            }
+
+            // Visit the next successor.
+            if( e < edges[ v ].size() ){
+                size_t w = edges[ v ][ e++ ];
+                if( index[ w ] == NONE )
+                    calls.push_back( std::make_pair( w, 0 ) );
+                else if( onStack[ w ] )
+                    low[ v ] = std::min( low[ v ], index[ w ] );
+                continue;
+            }
+
+            // All successors visited. Pop the component if v is it's root.
+            if( low[ v ] == index[ v ] ){
+                std::vector< size_t > comp;
+                size_t w;
+                do{
+                    w = stack.back();
+                    stack.pop_back();
+                    onStack[ w ] = false;
+                    comp.push_back( w );
+                } while( w != v );
+
+                bool recursive = comp.size() > 1 || 
+                    std::find( edges[ v ].begin(), edges[ v ].end(), v ) != edges[ v ].end();
+                if( recursive )
+                    components.push_back( std::move( comp ) );
+            }
+
+            calls.pop_back();
+            if( !calls.empty() ){
+                size_t parent = calls.back().first;
+                low[ parent ] = std::min( low[ parent ], low[ v ] );
+            }
+        }
+    }
+}
+
+/*! Checks that no rule of the recursive components has semantic actions.
+ *  - Tail options "A' ::= a1 A'" would lose A's value as the first argument, and
+ *    the options expanded by Paull's algorithm would lose the substituted 
+ *    option's action, so the actions would get wrong arguments.
+ *  @throws runtime_error if some rule has an action.
+ */ 
+void RecursionFixer::checkActions() const {
+    const auto& table = data.grammarTableConst();
+    for( auto&& comp : components ){
+        for( auto&& ri : comp ){
+            for( auto&& opt : table[ ri ].options ){
+                if( !opt.data.empty() )
+                    throw std::runtime_error( "fixRecursion: recursive rule "+
+                        std::to_string( table[ ri ].getID() )+" has action @"+opt.data+
+                        ", which can't be kept when rewriting it." );
+            }
+        }
+    }
+}
+
+/*! Removes the immediate left recursion of the rule:
+ *    A ::= A a1 | ... | A an | b1 | ... | bm
+ *  becomes
+ *    A ::= b1 A' | ... | bm A' ;
+ *    A' ::= a1 A' | ... | an A' | ;
+ *  - The options "A ::= A" are useless, and are dropped.
+ */ 
+void RecursionFixer::removeImmediateRecursion( const GrammarRule& rule, 
+                                               RecursionFixReport::Component& stats ){
+    const size_t id = rule.getID();
+
+    std::vector< GrammarToken > recursive, others;
+    for( auto&& opt : rule.options ){
+        if( getStartingRule( opt ) == id ){
+            if( opt.children.size() > 1 )
+                recursive.push_back( std::move( opt ) );
+        }
+        else
+            others.push_back( std::move( opt ) );
+    }
+
+    if( recursive.empty() ){
+        rule.options = std::move( others );
+        return;
+    }
+    if( others.empty() )
+        throw std::runtime_error( "fixRecursion: rule "+std::to_string( id )+
+                                  " has no non-recursive options." );
+
+    size_t tailID = createDerivedTag( data, id, "__tail" );
+    GrammarToken tail( GrammarToken::TAG_ID, tailID, "", {} );
+
+    for( auto&& opt : others )
+        opt.children.push_back( tail );
+
+    GrammarRule tailRule( tailID );
+    tailRule.options.reserve( recursive.size() + 1 );
+    for( auto&& opt : recursive ){
+        opt.children.erase( opt.children.begin() );
+        opt.children.push_back( tail );
+        tailRule.options.push_back( std::move( opt ) );
+    }
+    tailRule.options.push_back( GrammarToken( GrammarToken::ROOT_TOKEN, 0, "", {} ) );
+
+    rule.options = std::move( others );
+
+    stats.newRules++;
+    stats.optionsAfter += tailRule.options.size();
+    stats.symbolsAfter += countSymbols( tailRule );
+    newRules.push_back( std::move( tailRule ) );
+}
+
+/*! Runs Paull's algorithm on a recursive component.
+ *  - Rules are ordered by ID. Options of the i-th rule starting with the j-th 
+ *    rule (j < i) are expanded with the j-th rule's (already fixed) options, and 
+ *    then the immediate recursion of the i-th rule is removed.
+ *  - Expansion happens only inside the component.
+ */ 
+void RecursionFixer::fixComponent( std::vector< size_t >& comp ){
+    const auto& table = data.grammarTableConst();
+    std::sort( comp.begin(), comp.end() );
+
+    RecursionFixReport::Component stats;
+
+    // Position of each rule ID in the component.
+    std::unordered_map< size_t, size_t > position;
+    for( size_t i = 0; i < comp.size(); i++ ){
+        const GrammarRule& rule = table[ comp[ i ] ];
+        position[ rule.getID() ] = i;
+
+        stats.rules.push_back( rule.getID() );
+        stats.optionsBefore += rule.options.size();
+        stats.symbolsBefore += countSymbols( rule );
+    }
+
+    for( size_t i = 0; i < comp.size(); i++ ){
+        const GrammarRule& rule = table[ comp[ i ] ];
+
+        // Expand the options starting with the earlier rules. Expanded options start 
+        // with a later rule than the one expanded, so the loop ends.
+        // Work stack is reversed, to keep the order of options.
+        std::vector< GrammarToken > work( std::make_move_iterator( rule.options.rbegin() ), 
+                                          std::make_move_iterator( rule.options.rend() ) );
+        std::vector< GrammarToken > result;
+
+        while( !work.empty() ){
+            GrammarToken opt = std::move( work.back() );
+            work.pop_back();
+
+            auto pos = position.find( getStartingRule( opt ) );
+            if( pos == position.end() || pos->second >= i ){
+                result.push_back( std::move( opt ) );
+                continue;
+            }
+
+            const auto& earlier = table[ comp[ pos->second ] ].options;
+            for( auto it = earlier.rbegin(); it != earlier.rend(); ++it ){
+                GrammarToken expanded( GrammarToken::ROOT_TOKEN, 0, opt.data, {} );
+                expanded.children.reserve( it->children.size() + opt.children.size() - 1 );
+                expanded.children.insert( expanded.children.end(), 
+                                          it->children.begin(), it->children.end() );
+                expanded.children.insert( expanded.children.end(), 
+                                          opt.children.begin() + 1, opt.children.end() );
+                work.push_back( std::move( expanded ) );
+            }
+        }
+
+        rule.options = std::move( result );
+        removeImmediateRecursion( rule, stats );
+    }
+
+    for( auto&& ri : comp ){
+        stats.optionsAfter += table[ ri ].options.size();
+        stats.symbolsAfter += countSymbols( table[ ri ] );
+    }
+
+    report.components.push_back( std::move( stats ) );
+}
+
+RecursionFixReport RecursionFixer::fix(){
+    data.sort();
+    if( mirror )
+        mirrorOptions();
+
+    buildGraph();
+    findComponents();
+
+    try{
+        checkActions();
+    } catch( ... ){
+        if( mirror )
+            mirrorOptions();
+        throw;
+    }
+
+    for( auto&& comp : components )
+        fixComponent( comp );
+
+    // New rules are mirrored too, to get them back to the right-recursive form.
+    auto batch = data.batch();
+    for( auto&& rl : newRules )
+        batch.insertRule( std::move( rl ) );
+    batch.commit();
+
+    if( mirror )
+        mirrorOptions();
+
+    // Components are found in reverse topological order. Report them by rule ID.
+    std::sort( report.components.begin(), report.components.end(), 
+        []( const RecursionFixReport::Component& a, const RecursionFixReport::Component& b ){
+            return a.rules.front() < b.rules.front();
+        } );
+
+    return std::move( report );
+}
+
+/*! Appends the structural key of a BNF symbol to "key".
+ *  - If selfID is set, references to it get a special key, so rules referencing
+ *    themselves can be compared.
+ */ 
+static void appendSymbolKey( std::string& key, const GrammarToken& tok, size_t selfID = 0 ){
+    key.push_back( tok.type );
+    if( tok.type == GrammarToken::TAG_ID ){
+        if( selfID && tok.id == selfID )
+            key.push_back( 'S' );
+        else
+            key.append( std::to_string( tok.id ) );
+    }
+    else{
+        key.append( std::to_string( tok.data.size() ) );
+        key.push_back( ',' );
+        key.append( tok.data );
+    }
+    key.push_back( ';' );
+}
+
+/*! Appends the structural key of a BNF option (action and symbols) to "key".
+ */ 
+static void appendOptionKey( std::string& key, const GrammarToken& opt, size_t selfID = 0 ){
+    key.append( std::to_string( opt.data.size() ) );
+    key.push_back( '@' );
+    key.append( opt.data );
+    key.append( std::to_string( opt.children.size() ) );
+    key.push_back( ':' );
+    for( auto&& tok : opt.children )
+        appendSymbolKey( key, tok, selfID );
+}
+
+static inline bool isSameSymbol( const GrammarToken& a, const GrammarToken& b ){
+    return a.type == b.type && ( a.type == GrammarToken::TAG_ID ? a.id == b.id 
+                                                                 : a.data == b.data );
+}
+
+/*! Grammar optimizer.
+ *  - Runs the optimization passes on a BNF grammar.
+ *  - Every pass leaves the grammar sorted.
+ */ 
+class GrammarOptimizer{
+private:
+    GbnfData& data;
+    size_t startID = 0;
+
+    void checkBNF() const;
+    void mergeSplitRules();
+    void measure( size_t& rules, size_t& options, size_t& symbols ) const;
+    void replaceReferences( const std::unordered_map< size_t, GrammarToken >& replacements );
+    void removeRules( const std::unordered_set< size_t >& ids );
+    void removeDuplicateOptions();
+    void factorRule( const GrammarRule& rule, std::vector< GrammarRule >& pending );
+
+    void removeDeadRules();
+    void inlineUnitRules();
+    void leftFactor();
+    void mergeDuplicates();
+
+public:
+    GrammarOptimizer( GbnfData& _data ) : data( _data ) {}
+
+    OptimizationReport optimize( int passes );
+};
+
+/*! @throws runtime_error if grammar has groups.
+ */ 
+void GrammarOptimizer::checkBNF() const {
+    for( auto&& rule : data.grammarTableConst() ){
+        for( auto&& opt : rule.options ){
+            for( auto&& tok : opt.children ){
+                if( tok.type != GrammarToken::TAG_ID && tok.type != GrammarToken::REGEX_STRING )
+                    throw std::runtime_error( "optimizeGrammar: grammar is not BNF (rule "+
+                        std::to_string( rule.getID() )+" has groups)." );
+            }
+        }
+    }
+}
+
+/*! Merges the entries of the split rules ( <a> ::= "x" ; <a> ::= "y" ; ) into one,
+ *  so the passes see every option of a rule. Table must be sorted.
+ */ 
+void GrammarOptimizer::mergeSplitRules(){
+    const auto& table = data.grammarTableConst();
+    std::vector< bool > merged( table.size(), false );
+    bool changed = false;
+    for( size_t head = 0, i = 1; i < table.size(); i++ ){
+        if( table[ i ].getID() != table[ head ].getID() ){
+            head = i;
+            continue;
+        }
+        auto& opts = table[ head ].options;
+        opts.insert( opts.end(), std::make_move_iterator( table[ i ].options.begin() ),
+                     std::make_move_iterator( table[ i ].options.end() ) );
+        merged[ i ] = changed = true;
+    }
+
+    if( changed ){
+        size_t i = 0;
+        data.removeRulesIf( [ &merged, &i ]( const GrammarRule& ){ return merged[ i++ ]; } );
+    }
+}
+
+void GrammarOptimizer::measure( size_t& rules, size_t& options, size_t& symbols ) const {
+    rules = data.grammarTableConst().size();
+    options = symbols = 0;
+    for( auto&& rule : data.grammarTableConst() ){
+        options += rule.options.size();
+        for( auto&& opt : rule.options )
+            symbols += opt.children.size();
+    }
+}
+
+/*! Replaces every reference to the tags in the map with the mapped symbol.
+ */ 
+void GrammarOptimizer::replaceReferences( 
+        const std::unordered_map< size_t, GrammarToken >& replacements ){
+    for( auto&& rule : data.grammarTableConst() ){
+        for( auto&& opt : rule.options ){
+            for( auto&& tok : opt.children ){
+                if( tok.type != GrammarToken::TAG_ID )
+                    continue;
+                auto it = replacements.find( tok.id );
+                if( it != replacements.end() )
+                    tok = it->second;
+            }
+        }
+    }
+}
+
+/*! Removes the rules, and the tags they define.
+ */ 
+void GrammarOptimizer::removeRules( const std::unordered_set< size_t >& ids ){
+    if( ids.empty() )
+        return;
+    auto batch = data.batch();
+    for( size_t id : ids ){
+        batch.removeRule( id );
+        batch.removeTag( id );
+    }
+    batch.commit();
+}
+
+void GrammarOptimizer::removeDuplicateOptions(){
+    std::unordered_set< std::string > seen;
+    for( auto&& rule : data.grammarTableConst() ){
+        if( rule.options.size() < 2 )
+            continue;
+
+        seen.clear();
+        auto& opts = rule.options;
+        opts.erase( std::remove_if( opts.begin(), opts.end(), 
+            [ &seen ]( const GrammarToken& opt ){
+                std::string key;
+                appendOptionKey( key, opt );
+                return !seen.insert( std::move( key ) ).second;
+            } ), opts.end() );
+    }
+}
+
+/*! Removes the unreachable and unproductive rules.
+ *  - Options using unproductive rules can never be matched, so they're removed too.
+ */ 
+void GrammarOptimizer::removeDeadRules(){
+    FlatGrammar frozen( data );
+    GrammarAnalysis analysis( frozen.view(), startID );
+
+    std::unordered_set< size_t > unproductive, dead;
+    for( auto&& rule : data.grammarTableConst() ){
+        if( !analysis.isProductive( rule.getID() ) )
+            unproductive.insert( rule.getID() );
+        if( rule.getID() != startID && ( !analysis.isReachable( rule.getID() ) || 
+                                         !analysis.isProductive( rule.getID() ) ) )
+            dead.insert( rule.getID() );
+    }
+
+    if( !unproductive.empty() ){
+        for( auto&& rule : data.grammarTableConst() ){
+            auto& opts = rule.options;
+            opts.erase( std::remove_if( opts.begin(), opts.end(), 
+                [ &unproductive ]( const GrammarToken& opt ){
+                    for( auto&& tok : opt.children ){
+                        if( tok.type == GrammarToken::TAG_ID && unproductive.count( tok.id ) )
+                            return true;
+                    }
+                    return false;
+                } ), opts.end() );
+        }
+    }
+
+    removeRules( dead );
+}
+
+/*! Inlines the unit rules - rules with one option of one symbol, and no action.
+ *  - Chains of unit rules are resolved to their final symbol.
+ *  - Rules on cycles of unit rules are kept.
+ */ 
+void GrammarOptimizer::inlineUnitRules(){
+    std::unordered_map< size_t, GrammarToken > units;
+    for( auto&& rule : data.grammarTableConst() ){
+        if( rule.getID() == startID || rule.options.size() != 1 )
+            continue;
+
+        const GrammarToken& opt = rule.options[ 0 ];
+        if( opt.children.size() != 1 || !opt.data.empty() ||
+            ( opt.children[0].type == GrammarToken::TAG_ID && 
+              opt.children[0].id == rule.getID() ) )
+            continue;
+
+        units.insert( std::make_pair( rule.getID(), opt.children[0] ) );
+    }
+
+    std::unordered_map< size_t, GrammarToken > replacements;
+    std::unordered_set< size_t > inlined;
+    for( auto&& unit : units ){
+        const GrammarToken* target = &unit.second;
+        size_t steps = 0;
+
+        while( target->type == GrammarToken::TAG_ID && steps <= units.size() ){
+            auto next = units.find( target->id );
+            if( next == units.end() )
+                break;
+            target = &next->second;
+            steps++;
+        }
+
+        if( steps <= units.size() ){
+            replacements.insert( std::make_pair( unit.first, *target ) );
+            inlined.insert( unit.first );
+        }
+    }
+
+    replaceReferences( replacements );
+    removeRules( inlined );
+}
+
+/*! Left-factors the options of the rule. 
+ *    A ::= x y b | x y c | d ;
+ *  becomes
+ *    A ::= x y A' | d ;
+ *    A' ::= b | c ;
+ *  - Options with semantic actions are not factored.
+ *  - New rules are put to "pending", because their options can have common prefixes too.
+ */ 
+void GrammarOptimizer::factorRule( const GrammarRule& rule, std::vector< GrammarRule >& pending ){
+    auto& opts = rule.options;
+
+    // Group the options by their first symbol, in order of appearance.
+    std::unordered_map< std::string, size_t > groupIndex;
+    std::vector< std::vector< size_t > > groups;
+    for( size_t i = 0; i < opts.size(); i++ ){
+        if( !opts[ i ].data.empty() || opts[ i ].children.empty() )
+            continue;
+
+        std::string key;
+        appendSymbolKey( key, opts[ i ].children[0] );
+        auto it = groupIndex.insert( std::make_pair( std::move( key ), groups.size() ) ).first;
+        if( it->second == groups.size() )
+            groups.push_back( std::vector< size_t >() );
+        groups[ it->second ].push_back( i );
+    }
+
+    std::vector< bool > merged( opts.size(), false );
+    bool changed = false;
+    for( auto&& group : groups ){
+        if( group.size() < 2 )
+            continue;
+
+        // Longest common prefix.
+        const auto& first = opts[ group[0] ].children;
+        size_t len = 1;
+        for( bool common = true; common; ){
+            for( auto&& i : group ){
+                if( opts[ i ].children.size() <= len || 
+                    !isSameSymbol( opts[ i ].children[ len ], first[ len ] ) ){
+                    common = false;
+                    break;
+                }
+            }
+            if( common )
+                len++;
+        }
+
+        // Suffixes. Equal ones are stored once.
+        std::vector< GrammarToken > suffixes;
+        std::unordered_set< std::string > seen;
+        for( auto&& i : group ){
+            GrammarToken suffix( GrammarToken::ROOT_TOKEN, 0, "", std::vector< GrammarToken >( 
+                opts[ i ].children.begin() + len, opts[ i ].children.end() ) );
+
+            std::string key;
+            appendOptionKey( key, suffix );
+            if( seen.insert( std::move( key ) ).second )
+                suffixes.push_back( std::move( suffix ) );
+            if( i != group[0] )
+                merged[ i ] = true;
+        }
+        changed = true;
+
+        // All options were equal - nothing to factor.
+        GrammarToken& head = opts[ group[0] ];
+        if( suffixes.size() == 1 )
+            continue;
+
+        size_t newID = createDerivedTag( data, rule.getID(), "__fact" );
+        head.children.resize( len );
+        head.children.push_back( GrammarToken( GrammarToken::TAG_ID, newID, "", {} ) );
+        pending.push_back( GrammarRule( newID, std::move( suffixes ) ) );
+    }
+
+    if( changed ){
+        size_t i = 0;
+        opts.erase( std::remove_if( opts.begin(), opts.end(), 
+            [ &merged, &i ]( const GrammarToken& ){ return merged[ i++ ]; } ), opts.end() );
+    }
+}
+
+void GrammarOptimizer::leftFactor(){
+    std::vector< GrammarRule > pending, factored;
+    for( auto&& rule : data.grammarTableConst() )
+        factorRule( rule, pending );
+
+    while( !pending.empty() ){
+        GrammarRule rule = std::move( pending.back() );
+        pending.pop_back();
+        factorRule( rule, pending );
+        factored.push_back( std::move( rule ) );
+    }
+
+    auto batch = data.batch();
+    for( auto&& rule : factored )
+        batch.insertRule( std::move( rule ) );
+    batch.commit();
+}
+
+/*! Merges the structurally equal rules into the one with the lowest ID.
+ *  - Self references are compared as equal, so "A ::= x A | y" equals "B ::= x B | y".
+ *  - Merging can make other rules equal, so it's repeated until nothing changes.
+ */ 
+void GrammarOptimizer::mergeDuplicates(){
+    while( true ){
+        removeDuplicateOptions();
+        data.sort();
+
+        std::unordered_map< std::string, size_t > canonical;
+        std::unordered_map< size_t, GrammarToken > replacements;
+        std::unordered_set< size_t > merged;
+
+        for( auto&& rule : data.grammarTableConst() ){
+            std::string key;
+            for( auto&& opt : rule.options ){
+                appendOptionKey( key, opt, rule.getID() );
+                key.push_back( '|' );
+            }
+
+            auto it = canonical.insert( std::make_pair( std::move( key ), rule.getID() ) ).first;
+            if( it->second != rule.getID() ){
+                replacements.insert( std::make_pair( rule.getID(), 
+                    GrammarToken( GrammarToken::TAG_ID, it->second, "", {} ) ) );
+                merged.insert( rule.getID() );
+            }
+        }
+
+        if( merged.empty() )
+            break;
+
+        replaceReferences( replacements );
+        removeRules( merged );
+    }
+}
+
+OptimizationReport GrammarOptimizer::optimize( int passes ){
+    OptimizationReport report;
+
+    data.sort();
+    checkBNF();
+    if( data.grammarTableConst().empty() )
+        return report;
+    mergeSplitRules();
+    startID = data.grammarTableConst().front().getID();
+
+    const int order[] = { OPTIMIZE_REMOVE_DEAD_RULES, OPTIMIZE_INLINE_UNIT_RULES,
+                          OPTIMIZE_LEFT_FACTOR, OPTIMIZE_MERGE_DUPLICATES };
+
+    for( int pass : order ){
+        if( !( passes & pass ) )
+            continue;
+
+        OptimizationReport::Pass stats;
+        stats.pass = pass;
+        measure( stats.rulesBefore, stats.optionsBefore, stats.symbolsBefore );
+
+        switch( pass ){
+        case OPTIMIZE_REMOVE_DEAD_RULES: removeDeadRules(); break;
+        case OPTIMIZE_INLINE_UNIT_RULES: inlineUnitRules(); break;
+        case OPTIMIZE_LEFT_FACTOR:       leftFactor();      break;
+        case OPTIMIZE_MERGE_DUPLICATES:  mergeDuplicates(); break;
+        }
+        data.sort();
+
+        measure( stats.rulesAfter, stats.optionsAfter, stats.symbolsAfter );
+        report.passes.push_back( stats );
+    }
+
+    return report;
+}
+
+const char* OptimizationReport::getPassName( int pass ){
+    switch( pass ){
+    case OPTIMIZE_REMOVE_DEAD_RULES: return "dead";
+    case OPTIMIZE_INLINE_UNIT_RULES: return "unit";
+    case OPTIMIZE_LEFT_FACTOR:       return "factor";
+    case OPTIMIZE_MERGE_DUPLICATES:  return "merge";
+    }
+    return "unknown";
+}
+
 //============= PUBLIC SECTION =============//
 
-void convertToBNF( GbnfData& data, bool preferRightRecursion, int verbosity ){
+void convertToBNF( GbnfData& data, bool preferRightRecursion, int verbosity, 
+                   size_t threadCount ){
+    if( !threadCount )
+        threadCount = std::max< size_t >( 1, std::thread::hardware_concurrency() );
+    threadCount = std::min( threadCount, data.grammarTableConst().size() );
+
+    // Options are rewritten in place.
+    data.touch();
+
+    if( threadCount > 1 ){
+        convertToBNFInParallel( data, preferRightRecursion, verbosity, threadCount );
+        return;
+    }
+
     ConverterToBNF cbnf( data, preferRightRecursion, verbosity );
     cbnf.convert();
 }
 
-void fixRecursion( GbnfData& data, int recursionFixMode, int verbosity ){
+RecursionFixReport fixRecursion( GbnfData& data, int recursionFixMode, int ){
+    if( recursionFixMode != FIX_LEFT_RECURSION && recursionFixMode != FIX_RIGHT_RECURSION )
+        return RecursionFixReport();
+
+    RecursionFixer fixer( data, recursionFixMode == FIX_RIGHT_RECURSION );
+    RecursionFixReport report = fixer.fix();
+    data.touch();
+
+    data.flags &= ~( recursionFixMode == FIX_LEFT_RECURSION ? GbnfData::LEFT_RECURSIVE 
+                                                            : GbnfData::RIGHT_RECURSIVE );
+    return report;
+}
+
+OptimizationReport optimizeGrammar( GbnfData& data, int passes, int ){
+    GrammarOptimizer optimizer( data );
+    OptimizationReport report = optimizer.optimize( passes );
+    data.touch();
+    return report;
+}
+
+
+/*! Replaces the tag IDs of the tokens, recursively.
+ */ 
+static void remapTagIDs( std::vector< GrammarToken >& toks, const std::vector< size_t >& ids ){
+    for( auto&& tok : toks ){
+        if( tok.type == GrammarToken::TAG_ID && tok.id < ids.size() )
+            tok.id = ids[ tok.id ];
+        remapTagIDs( tok.children, ids );
+    }
+}
+
+IncrementalConverter::IncrementalConverter( bool preferRightRecursion, int recursionFixMode,
+                                            int optimizationPasses )
+    : impl( new Impl( preferRightRecursion, recursionFixMode, optimizationPasses ) )
+{}
+
+IncrementalConverter::~IncrementalConverter(){}
+
+const GbnfData& IncrementalConverter::build( const GbnfData& source, Report* report ){
+    Report rep;
+    impl->build( source, rep );
+    if( report )
+        *report = std::move( rep );
+    return impl->result;
+}
+
+const GbnfData& IncrementalConverter::result() const {
+    return impl->result;
+}
+
+void IncrementalConverter::clear(){
+    impl->fragments.clear();
+    impl->ruleFingerprints.clear();
+    impl->built = false;
+}
+
+std::vector< MergeConflict > mergeGrammars( GbnfData& dest, std::vector< GbnfData >& sources ){
+    std::vector< MergeConflict > conflicts;
+    std::unordered_map< size_t, size_t > definedIn; // Tag ID -> grammar index.
+    auto batch = dest.batch();
+
+    for( size_t gi = 0; gi < sources.size(); gi++ ){
+        GbnfData& src = sources[ gi ];
+        dest.flags |= src.flags;
+        src.touch(); // Options are moved out.
+
+        // Source ID -> dest ID.
+        std::vector< size_t > ids( src.getLastTagID() + 1, 0 );
+        for( auto&& tag : src.tagTableConst() )
+            ids[ tag.getID() ] = dest.getTagIDfromTable( tag.data, true );
+
+        for( auto&& rule : src.grammarTableConst() ){
+            size_t id = ( rule.getID() < ids.size() ? ids[ rule.getID() ] : 0 );
+            if( !id )
+                continue;
+
+            auto defined = definedIn.insert( std::make_pair( id, gi ) );
+            if( defined.first->second != gi ){
+                conflicts.push_back( MergeConflict{ dest.getTag( id )->data, 
+                                                    defined.first->second, gi } );
+                continue;
+            }
+
+            remapTagIDs( rule.options, ids );
+            batch.insertRule( GrammarRule( id, std::move( rule.options ) ) );
+        }
+    }
 
+    batch.commit();
+    return conflicts;
 }
 
 
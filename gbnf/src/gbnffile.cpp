@@ -0,0 +1,496 @@
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include "gbnffile.hpp"
+
+#ifdef _WIN32
+    #define GBNF_NO_MMAP
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace gbnf{
+
+const static size_t HEADER_SIZE = 15;
+const static size_t MAX_WORD = 0xFFFFFFFF;
+const static size_t MAX_VARINT_SIZE = 5;
+const static char ACTION_MARK = '@';
+
+static inline uint64_t readLE( const char* src, size_t bytes ){
+    uint64_t val = 0;
+    for( size_t i = 0; i < bytes; i++ )
+        val |= (uint64_t)( (unsigned char)src[ i ] ) << (i * 8);
+    return val;
+}
+
+static inline void writeLE( std::ostream& os, uint64_t val, size_t bytes ){
+    for( size_t i = 0; i < bytes; i++ )
+        os.put( (char)( val >> (i * 8) ) );
+}
+
+static inline size_t checkWord( size_t val, const char* what ){
+    if( val > MAX_WORD )
+        throw std::runtime_error( std::string("[writeGbnfFile]: ") + what +
+                                  " doesn't fit into 32 bits." );
+    return val;
+}
+
+/*! Varints (LEB128): 7 bits per byte, low bits first. High bit is set on every
+ *  byte but the last one.
+ */
+static inline size_t varintSize( size_t val ){
+    size_t size = 1;
+    for( ; val >= 0x80; val >>= 7 )
+        size++;
+    return size;
+}
+
+static inline void writeVarint( std::ostream& os, size_t val ){
+    for( ; val >= 0x80; val >>= 7 )
+        os.put( (char)( val | 0x80 ) );
+    os.put( (char)val );
+}
+
+// Decodes validated data.
+static inline const char* readVarint( const char* pos, size_t& val ){
+    val = 0;
+    for( size_t shift = 0; ; shift += 7 ){
+        unsigned char c = *pos++;
+        val |= (size_t)( c & 0x7F ) << shift;
+        if( !( c & 0x80 ) )
+            return pos;
+    }
+}
+
+static inline size_t ruleID( const char* pos ){
+    size_t id;
+    readVarint( pos, id );
+    return id;
+}
+
+static inline bool isGroup( char type ){
+    return type == GrammarToken::GROUP_ONE || type == GrammarToken::GROUP_OPTIONAL ||
+           type == GrammarToken::GROUP_REPEAT_NONE || type == GrammarToken::GROUP_REPEAT_ONE;
+}
+
+//==========================================================//
+// Writer.
+// Sizes are computed first, so tables can be written straight to the stream.
+// Size functions also check the format's limits, so nothing is written if
+// grammar can't be represented.
+
+static size_t tokenSize( const GrammarToken& tok ){
+    if( tok.type == GrammarToken::TAG_ID )
+        return 1 + varintSize( checkWord( tok.id, "Tag ID" ) );
+    if( tok.type == GrammarToken::REGEX_STRING ){
+        return 1 + varintSize( checkWord( tok.data.size(), "String length" ) ) + 
+               tok.data.size();
+    }
+    if( !isGroup( tok.type ) )
+        throw std::runtime_error( "[writeGbnfFile]: Invalid token type." );
+
+    size_t size = 1 + varintSize( checkWord( tok.children.size(), "Group size" ) );
+    for( auto&& child : tok.children )
+        size += tokenSize( child );
+    return size;
+}
+
+static size_t optionSize( const GrammarToken& opt ){
+    size_t size = 0;
+    if( !opt.data.empty() ){
+        size += 1 + varintSize( checkWord( opt.data.size(), "Action name length" ) ) + 
+                opt.data.size();
+    }
+    for( auto&& tok : opt.children )
+        size += tokenSize( tok );
+    return checkWord( size, "Option size" );
+}
+
+static void writeToken( std::ostream& os, const GrammarToken& tok ){
+    os.put( tok.type );
+    if( tok.type == GrammarToken::TAG_ID ){
+        writeVarint( os, tok.id );
+    }
+    else if( tok.type == GrammarToken::REGEX_STRING ){
+        writeVarint( os, tok.data.size() );
+        os.write( tok.data.c_str(), tok.data.size() );
+    }
+    else{
+        writeVarint( os, tok.children.size() );
+        for( auto&& child : tok.children )
+            writeToken( os, child );
+    }
+}
+
+void writeGbnfFile( const GbnfData& data, std::ostream& output ){
+    // Rules are written in ID order, so reader can search them by ID.
+    std::vector< const GrammarRule* > rules;
+    rules.reserve( data.grammarTableConst().size() );
+    for( auto&& rule : data.grammarTableConst() )
+        rules.push_back( &rule );
+    if( !data.isSorted() ){
+        std::sort( rules.begin(), rules.end(),
+            []( const GrammarRule* a, const GrammarRule* b ){ return *a < *b; } );
+    }
+
+    // Compute table sizes.
+    size_t tagTableSize = 0;
+    for( auto&& tag : data.tagTableConst() ){
+        tagTableSize += varintSize( checkWord( tag.getID(), "Tag ID" ) ) + tag.data.size() + 1;
+    }
+
+    std::vector< size_t > optSizes;
+    size_t ruleTableSize = 0;
+    for( auto&& rule : rules ){
+        ruleTableSize += varintSize( checkWord( rule->getID(), "Rule ID" ) ) +
+                         varintSize( checkWord( rule->options.size(), "Option count" ) );
+        for( auto&& opt : rule->options ){
+            optSizes.push_back( optionSize( opt ) );
+            ruleTableSize += varintSize( optSizes.back() ) + optSizes.back();
+        }
+    }
+    checkWord( tagTableSize, "Tag table size" );
+    checkWord( ruleTableSize, "Rule table size" );
+
+    // Header.
+    output.write( "gBNF", 4 );
+    output.put( (char)GBNF_FILE_VERSION );
+    writeLE( output, GBNF_FILE_TAG_TABLE | GBNF_FILE_RULE_TABLE | (data.flags & 0xFF) << 8, 2 );
+    writeLE( output, tagTableSize, 4 );
+    writeLE( output, ruleTableSize, 4 );
+
+    // Tag table.
+    for( auto&& tag : data.tagTableConst() ){
+        writeVarint( output, tag.getID() );
+        output.write( tag.data.c_str(), tag.data.size() + 1 );
+    }
+
+    // Rule table.
+    size_t optIndex = 0;
+    for( auto&& rule : rules ){
+        writeVarint( output, rule->getID() );
+        writeVarint( output, rule->options.size() );
+
+        for( auto&& opt : rule->options ){
+            writeVarint( output, optSizes[ optIndex++ ] );
+            if( !opt.data.empty() ){
+                output.put( ACTION_MARK );
+                writeVarint( output, opt.data.size() );
+                output.write( opt.data.c_str(), opt.data.size() );
+            }
+            for( auto&& tok : opt.children )
+                writeToken( output, tok );
+        }
+    }
+
+    if( !output.good() )
+        throw std::runtime_error( "[writeGbnfFile]: Output error." );
+}
+
+//==========================================================//
+// Reader.
+
+static void invalidFile( const char* why ){
+    throw std::runtime_error( std::string("[GbnfFileView]: Invalid gBNF data: ") + why );
+}
+
+/*! Decodes a varint, checking the bounds and the 32-bit limit.
+ */
+static const char* readCheckedVarint( const char* pos, const char* end, size_t& val, 
+                                      const char* what ){
+    val = 0;
+    for( size_t i = 0; i < MAX_VARINT_SIZE; i++ ){
+        if( pos >= end )
+            break;
+        unsigned char c = *pos++;
+        val |= (size_t)( c & 0x7F ) << ( i * 7 );
+        if( !( c & 0x80 ) ){
+            if( val > MAX_WORD )
+                break;
+            return pos;
+        }
+    }
+    invalidFile( what );
+    return nullptr;
+}
+
+/*! Checks the token at "pos", and returns the position after it.
+ */
+static const char* validateToken( const char* pos, const char* end ){
+    if( pos >= end )
+        invalidFile( "Token is truncated." );
+
+    char type = *pos;
+    size_t word;
+    pos = readCheckedVarint( pos + 1, end, word, "Token is truncated." );
+
+    if( type == GrammarToken::TAG_ID )
+        return pos;
+
+    if( type == GrammarToken::REGEX_STRING ){
+        if( (size_t)( end - pos ) < word )
+            invalidFile( "String is truncated." );
+        return pos + word;
+    }
+
+    if( !isGroup( type ) )
+        invalidFile( "Unknown token type." );
+
+    for( size_t i = 0; i < word; i++ )
+        pos = validateToken( pos, end );
+    return pos;
+}
+
+void GbnfFileView::indexTags( const char* pos, const char* end ){
+    size_t lastID = 0;
+    while( pos < end ){
+        // IDs must be increasing, as in the tag table of GbnfData.
+        size_t id;
+        const char* name = readCheckedVarint( pos, end, id, "Tag is truncated." );
+        if( id <= lastID )
+            invalidFile( "Tags are not in ID order." );
+        lastID = id;
+
+        const char* nameEnd = (const char*)std::memchr( name, '\0', end - name );
+        if( !nameEnd )
+            invalidFile( "Tag name is not terminated." );
+
+        tagIndex.push_back( pos );
+        pos = nameEnd + 1;
+    }
+}
+
+void GbnfFileView::indexRules( const char* pos, const char* end ){
+    bool sorted = true;
+    while( pos < end ){
+        size_t id, optCount;
+        const char* rulePos = pos;
+        pos = readCheckedVarint( pos, end, id, "Rule is truncated." );
+        pos = readCheckedVarint( pos, end, optCount, "Rule is truncated." );
+
+        if( !ruleIndex.empty() && ruleID( ruleIndex.back() ) >= id )
+            sorted = false;
+        ruleIndex.push_back( rulePos );
+
+        for( size_t i = 0; i < optCount; i++ ){
+            size_t optSize;
+            pos = readCheckedVarint( pos, end, optSize, "Option is truncated." );
+            if( (size_t)( end - pos ) < optSize )
+                invalidFile( "Option is truncated." );
+            const char* optEnd = pos + optSize;
+
+            if( pos < optEnd && *pos == ACTION_MARK ){
+                size_t actionSize;
+                pos = readCheckedVarint( pos + 1, optEnd, actionSize, "Action name is truncated." );
+                if( (size_t)( optEnd - pos ) < actionSize )
+                    invalidFile( "Action name is truncated." );
+                pos += actionSize;
+            }
+
+            while( pos < optEnd )
+                pos = validateToken( pos, optEnd );
+        }
+    }
+
+    if( !sorted ){
+        std::stable_sort( ruleIndex.begin(), ruleIndex.end(),
+            []( const char* a, const char* b ){ return ruleID( a ) < ruleID( b ); } );
+    }
+}
+
+GbnfFileView::GbnfFileView( const char* data, size_t size ){
+    if( size < HEADER_SIZE || std::memcmp( data, "gBNF", 4 ) != 0 )
+        invalidFile( "Bad header." );
+    if( (uint8_t)data[ 4 ] != GBNF_FILE_VERSION )
+        invalidFile( "Unsupported version." );
+
+    size_t fileFlags = readLE( data + 5, 2 );
+    grammarFlags = fileFlags >> 8;
+
+    size_t tagTableSize = ( fileFlags & GBNF_FILE_TAG_TABLE ) ? readLE( data + 7, 4 ) : 0;
+    size_t ruleTableSize = ( fileFlags & GBNF_FILE_RULE_TABLE ) ? readLE( data + 11, 4 ) : 0;
+    if( tagTableSize > size - HEADER_SIZE ||
+        ruleTableSize > size - HEADER_SIZE - tagTableSize )
+        invalidFile( "Tables are truncated." );
+
+    const char* tags = data + HEADER_SIZE;
+    indexTags( tags, tags + tagTableSize );
+    indexRules( tags + tagTableSize, tags + tagTableSize + ruleTableSize );
+}
+
+GbnfTagView GbnfFileView::tag( size_t index ) const {
+    GbnfTagView view;
+    view.name = readVarint( tagIndex[ index ], view.id );
+    view.length = std::strlen( view.name );
+    return view;
+}
+
+GbnfRuleView GbnfFileView::rule( size_t index ) const {
+    GbnfRuleView view;
+    const char* pos = readVarint( ruleIndex[ index ], view.id );
+    view.options = readVarint( pos, view.optionCount );
+    return view;
+}
+
+bool GbnfFileView::findRule( size_t id, GbnfRuleView& result ) const {
+    auto it = std::lower_bound( ruleIndex.begin(), ruleIndex.end(), id,
+        []( const char* r, size_t val ){ return ruleID( r ) < val; } );
+    if( it == ruleIndex.end() || ruleID( *it ) != id )
+        return false;
+
+    result = rule( it - ruleIndex.begin() );
+    return true;
+}
+
+const char* GbnfFileView::readOption( const char* pos, GbnfOptionView& option ){
+    size_t optSize;
+    pos = readVarint( pos, optSize );
+    option.end = pos + optSize;
+
+    option.action = pos;
+    option.actionLength = 0;
+    if( pos < option.end && *pos == ACTION_MARK ){
+        option.action = readVarint( pos + 1, option.actionLength );
+        pos = option.action + option.actionLength;
+    }
+
+    option.tokens = pos;
+    return option.end;
+}
+
+const char* GbnfFileView::readToken( const char* pos, GbnfTokenView& token ){
+    token.type = *pos;
+    token.id = 0;
+    token.data = nullptr;
+    token.dataLength = 0;
+    token.childCount = 0;
+    token.children = nullptr;
+
+    size_t word;
+    pos = readVarint( pos + 1, word );
+
+    if( token.type == GrammarToken::TAG_ID ){
+        token.id = word;
+        return pos;
+    }
+    if( token.type == GrammarToken::REGEX_STRING ){
+        token.data = pos;
+        token.dataLength = word;
+        return pos + word;
+    }
+
+    token.childCount = word;
+    token.children = pos;
+
+    GbnfTokenView child;
+    for( size_t i = 0; i < word; i++ )
+        pos = readToken( pos, child );
+    return pos;
+}
+
+static const char* decodeToken( const char* pos, GrammarToken& tok ){
+    GbnfTokenView view;
+    const char* next = GbnfFileView::readToken( pos, view );
+
+    tok.type = view.type;
+    tok.id = view.id;
+    tok.data.assign( view.data ? view.data : "", view.dataLength );
+    tok.children.resize( view.childCount );
+
+    const char* child = view.children;
+    for( size_t i = 0; i < view.childCount; i++ )
+        child = decodeToken( child, tok.children[ i ] );
+    return next;
+}
+
+void GbnfFileView::toGbnfData( GbnfData& data ) const {
+    // Tags are inserted with their own IDs, which must be greater than the last one.
+    data = GbnfData();
+    data.flags = grammarFlags;
+
+    for( size_t i = 0; i < tagCount(); i++ ){
+        GbnfTagView tv = tag( i );
+        data.insertTag( tv.id, std::string( tv.name, tv.length ) );
+    }
+
+    for( size_t i = 0; i < ruleCount(); i++ ){
+        GbnfRuleView rv = rule( i );
+        GrammarRule rule( rv.id );
+        rule.options.resize( rv.optionCount );
+
+        const char* pos = rv.options;
+        for( auto&& opt : rule.options ){
+            GbnfOptionView ov;
+            pos = readOption( pos, ov );
+            opt.data.assign( ov.action, ov.actionLength );
+
+            for( const char* tp = ov.tokens; tp < ov.end; ){
+                opt.children.push_back( GrammarToken() );
+                tp = decodeToken( tp, opt.children.back() );
+            }
+        }
+        data.insertRule( std::move( rule ) );
+    }
+    data.sort();
+}
+
+bool MappedFile::open( const std::string& path ){
+    close();
+
+#ifndef GBNF_NO_MMAP
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+        return false;
+
+    struct stat st;
+    if( fstat( fd, &st ) != 0 ){
+        ::close( fd );
+        return false;
+    }
+
+    if( st.st_size > 0 ){
+        void* mapped = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( mapped == MAP_FAILED ){
+            ::close( fd );
+            return false;
+        }
+        mapping = (const char*)mapped;
+    }
+    ::close( fd );
+    mappingSize = st.st_size;
+#else
+    std::ifstream file( path, std::ios::in | std::ios::binary );
+    if( !file.is_open() )
+        return false;
+    buffer.assign( std::istreambuf_iterator<char>( file ),
+                   std::istreambuf_iterator<char>() );
+    mappingSize = buffer.size();
+#endif
+    return true;
+}
+
+void MappedFile::close(){
+#ifndef GBNF_NO_MMAP
+    if( mapping )
+        munmap( (void*)mapping, mappingSize );
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+    buffer.clear();
+}
+
+bool GbnfFile::open( const std::string& path ){
+    fileView = GbnfFileView();
+    if( !file.open( path ) )
+        return false;
+
+    fileView = GbnfFileView( file.data(), file.size() );
+    return true;
+}
+
+}
+
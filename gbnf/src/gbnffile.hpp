@@ -0,0 +1,155 @@
+#ifndef GBNFFILE_HPP_INCLUDED
+#define GBNFFILE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include "gbnf.hpp"
+
+namespace gbnf{
+
+/*! Binary gBNF file (.gbnf) support.
+ *  - The format is described in gbnf.hpp.
+ *  - Writer streams the data straight to the output, without building
+ *    the file in memory.
+ *  - Reader works on the raw bytes (usually a mapped file). Tags, rules, options
+ *    and tokens are served as views pointing into the file - no object tree is built.
+ */
+
+const uint8_t GBNF_FILE_VERSION = 2;
+
+const int GBNF_FILE_TAG_TABLE  = 1;
+const int GBNF_FILE_RULE_TABLE = 2;
+
+/*! Writes the grammar in binary gBNF format.
+ *  @throws runtime_error if grammar doesn't fit into the format's limits.
+ */
+void writeGbnfFile( const GbnfData& data, std::ostream& output );
+
+/*! Views of the file's entities. Pointers point into the file's memory,
+ *  so views are valid as long as the file is.
+ */
+struct GbnfTagView{
+    size_t id;
+    const char* name; // Null-terminated.
+    size_t length;
+};
+
+struct GbnfRuleView{
+    size_t id;
+    size_t optionCount;
+    const char* options; // Encoded options.
+};
+
+struct GbnfOptionView{
+    const char* action; // Semantic action name. Not null-terminated.
+    size_t actionLength;
+    const char* tokens; // Encoded tokens [tokens, end).
+    const char* end;
+};
+
+struct GbnfTokenView{
+    char type;
+    size_t id;           // If TAG_ID.
+    const char* data;    // If REGEX_STRING. Not null-terminated.
+    size_t dataLength;
+    size_t childCount;   // If group.
+    const char* children;
+};
+
+/*! Read-only view of the binary gBNF data in memory.
+ *  - Whole structure is validated on construction, so views can be
+ *    decoded later without any bounds checks.
+ *  - Only the offsets of tags and rules are indexed.
+ */
+class GbnfFileView{
+private:
+    int grammarFlags = 0;
+
+    std::vector< const char* > tagIndex;
+    std::vector< const char* > ruleIndex; // Sorted by ID.
+
+    void indexTags( const char* pos, const char* end );
+    void indexRules( const char* pos, const char* end );
+
+public:
+    GbnfFileView(){}
+
+    /*! @throws runtime_error if data is not valid gBNF.
+     */
+    GbnfFileView( const char* data, size_t size );
+
+    inline int flags() const { return grammarFlags; }
+    inline size_t tagCount() const { return tagIndex.size(); }
+    inline size_t ruleCount() const { return ruleIndex.size(); }
+
+    GbnfTagView tag( size_t index ) const;
+    GbnfRuleView rule( size_t index ) const;
+
+    /*! Finds a rule by the ID of the tag it defines.
+     *  @return false if there's no such rule.
+     */
+    bool findRule( size_t id, GbnfRuleView& rule ) const;
+
+    /*! Decoders. Read the entity at "pos", and return the position of the next one.
+     *  - First option of the rule is at rule.options,
+     *    first token of the option is at option.tokens,
+     *    first child of the group token is at token.children.
+     */
+    static const char* readOption( const char* pos, GbnfOptionView& option );
+    static const char* readToken( const char* pos, GbnfTokenView& token );
+
+    /*! Builds the tree representation of the grammar.
+     *  - Previous contents of "data" are replaced.
+     */
+    void toGbnfData( GbnfData& data ) const;
+};
+
+/*! Read-only memory mapping of a whole file.
+ *  - Uses mmap where available. Otherwise, file is read into a buffer.
+ */
+class MappedFile{
+private:
+    const char* mapping = nullptr;
+    size_t mappingSize = 0;
+    std::string buffer;
+
+public:
+    MappedFile(){}
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator= ( const MappedFile& ) = delete;
+    ~MappedFile(){ close(); }
+
+    /*! Maps the file. @return true on success.
+     */
+    bool open( const std::string& path );
+    void close();
+
+    inline const char* data() const { return mapping ? mapping : buffer.data(); }
+    inline size_t size() const { return mappingSize; }
+    inline bool isOpen() const { return mappingSize || mapping; }
+};
+
+/*! Binary gBNF file, mapped into memory.
+ */
+class GbnfFile{
+private:
+    MappedFile file;
+    GbnfFileView fileView;
+
+public:
+    GbnfFile(){}
+
+    /*! Maps and validates the file.
+     *  @return false if file can't be opened.
+     *  @throws runtime_error if file is not valid gBNF.
+     */
+    bool open( const std::string& path );
+
+    inline const GbnfFileView& view() const { return fileView; }
+};
+
+}
+
+#endif // GBNFFILE_HPP_INCLUDED
@@ -0,0 +1,142 @@
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include "gbnfflat.hpp"
+
+namespace gbnf{
+
+/*! Adds a string to the pool, reusing the equal one if already pooled.
+ *  @return offset of the string in the pool.
+ */
+uint32_t FlatGrammar::addString( const std::string& str,
+                                 std::unordered_map< std::string, uint32_t >& pooled ){
+    if( str.empty() )
+        return 0;
+
+    auto it = pooled.find( str );
+    if( it != pooled.end() )
+        return it->second;
+
+    uint32_t offset = strings.size();
+    strings.append( str );
+    pooled.insert( std::make_pair( str, offset ) );
+    return offset;
+}
+
+/*! Fills the symbol block starting at "first" with the tokens,
+ *  and recursively appends the children blocks of the groups.
+ */
+void FlatGrammar::addSymbols( uint32_t first, const std::vector< GrammarToken >& toks,
+                              std::unordered_map< std::string, uint32_t >& pooled ){
+    for( size_t i = 0; i < toks.size(); i++ ){
+        const GrammarToken& tok = toks[ i ];
+
+        FlatSymbol sym;
+        sym.type       = tok.type;
+        sym.id         = tok.id;
+        sym.dataOffset = addString( tok.data, pooled );
+        sym.dataLength = tok.data.size();
+        sym.firstChild = symbols.size();
+        sym.childCount = tok.children.size();
+
+        // Reserve the children block, and fill it.
+        symbols.resize( symbols.size() + tok.children.size() );
+        addSymbols( sym.firstChild, tok.children, pooled );
+
+        symbols[ first + i ] = sym;
+    }
+}
+
+FlatGrammar::FlatGrammar( const GbnfData& data ) : flags( data.flags ) {
+    std::unordered_map< std::string, uint32_t > pooled;
+
+    // Tags.
+    size_t idLimit = 0;
+    tags.reserve( data.tagTableConst().size() );
+    for( auto&& t : data.tagTableConst() ){
+        tags.push_back( FlatTag{ (uint32_t)t.getID(), addString( t.data, pooled ),
+                                 (uint32_t)t.data.size() } );
+        idLimit = std::max( idLimit, t.getID() + 1 );
+    }
+
+    // Rules, options, symbols. Rules are stored in ID order.
+    std::vector< const GrammarRule* > srcRules;
+    srcRules.reserve( data.grammarTableConst().size() );
+    for( auto&& r : data.grammarTableConst() ){
+        srcRules.push_back( &r );
+        idLimit = std::max( idLimit, r.getID() + 1 );
+    }
+    if( !data.isSorted() ){
+        // Stable, so the entries of a split rule keep their order.
+        std::stable_sort( srcRules.begin(), srcRules.end(),
+            []( const GrammarRule* a, const GrammarRule* b ){ return *a < *b; } );
+    }
+
+    rules.reserve( srcRules.size() );
+    for( auto&& r : srcRules ){
+        rules.push_back( FlatRule{ (uint32_t)r->getID(), (uint32_t)options.size(),
+                                   (uint32_t)r->options.size() } );
+
+        for( auto&& opt : r->options ){
+            FlatOption fo;
+            fo.firstSymbol  = symbols.size();
+            fo.symbolCount  = opt.children.size();
+            fo.actionOffset = addString( opt.data, pooled );
+            fo.actionLength = opt.data.size();
+            options.push_back( fo );
+
+            symbols.resize( symbols.size() + opt.children.size() );
+            addSymbols( fo.firstSymbol, opt.children, pooled );
+        }
+    }
+
+    if( symbols.size() >= FLAT_NONE || strings.size() >= FLAT_NONE || idLimit >= FLAT_NONE )
+        throw std::runtime_error( "[FlatGrammar]: Grammar is too big." );
+
+    // Dense ID -> index maps.
+    tagByID.assign( idLimit, FLAT_NONE );
+    ruleByID.assign( idLimit, FLAT_NONE );
+    for( size_t i = 0; i < tags.size(); i++ )
+        tagByID[ tags[ i ].id ] = i;
+    for( size_t i = rules.size(); i > 0; i-- )
+        ruleByID[ rules[ i - 1 ].id ] = i - 1;
+}
+
+static void flatSymbolToToken( const GrammarView& view, const FlatSymbol& sym,
+                               GrammarToken& tok ){
+    tok.type = sym.type;
+    tok.id = sym.id;
+    tok.data.assign( view.strings + sym.dataOffset, sym.dataLength );
+    tok.children.resize( sym.childCount );
+    for( size_t i = 0; i < sym.childCount; i++ )
+        flatSymbolToToken( view, view.child( sym, i ), tok.children[ i ] );
+}
+
+void FlatGrammar::toGbnfData( const GrammarView& view, GbnfData& data ){
+    // Tags are inserted with their own IDs, which must be greater than the last one.
+    data = GbnfData();
+    data.flags = view.flags;
+
+    for( size_t i = 0; i < view.tagCount; i++ )
+        data.insertTag( view.tags[ i ].id, view.tagName( view.tags[ i ] ) );
+
+    for( size_t r = 0; r < view.ruleCount; r++ ){
+        const FlatRule& fr = view.rules[ r ];
+        GrammarRule rule( fr.id );
+        rule.options.resize( fr.optionCount );
+
+        for( size_t o = 0; o < fr.optionCount; o++ ){
+            const FlatOption& fo = view.option( fr, o );
+            GrammarToken& opt = rule.options[ o ];
+            opt.data = view.actionName( fo );
+            opt.children.resize( fo.symbolCount );
+
+            for( size_t s = 0; s < fo.symbolCount; s++ )
+                flatSymbolToToken( view, view.symbol( fo, s ), opt.children[ s ] );
+        }
+        data.insertRule( std::move( rule ) );
+    }
+    data.sort();
+}
+
+}
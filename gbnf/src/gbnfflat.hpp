@@ -0,0 +1,153 @@
+#ifndef GBNFFLAT_HPP_INCLUDED
+#define GBNFFLAT_HPP_INCLUDED
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include "gbnf.hpp"
+
+namespace gbnf{
+
+/*! Flat (frozen) grammar representation.
+ *  - Every table is one contiguous array of POD records. Records reference
+ *    each other by indices, and strings are (offset, length) pairs into
+ *    one shared string pool. No pointer chasing, no per-node allocations.
+ *  - Rules and tags can be looked up by ID directly, using dense ID-indexed arrays.
+ *  - Rules are sorted by ID. A rule split into several entries with the same ID
+ *    ( <a> ::= "x" ; <a> ::= "y" ; ) has contiguous entries, and lookup by ID
+ *    gives the first of them.
+ *
+ *  Symbol layout:
+ *  - Top-level symbols of an option are contiguous:
+ *    [ option.firstSymbol, option.firstSymbol + option.symbolCount ).
+ *  - Children of a group symbol are contiguous too:
+ *    [ symbol.firstChild, symbol.firstChild + symbol.childCount ).
+ */
+
+const uint32_t FLAT_NONE = 0xFFFFFFFF;
+
+struct FlatTag{
+    uint32_t id;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+struct FlatRule{
+    uint32_t id;
+    uint32_t firstOption;
+    uint32_t optionCount;
+};
+
+struct FlatOption{
+    uint32_t firstSymbol;
+    uint32_t symbolCount;
+    uint32_t actionOffset; // Semantic action name (empty if no action).
+    uint32_t actionLength;
+};
+
+struct FlatSymbol{
+    char     type;         // GrammarToken type.
+    uint32_t id;           // Tag ID, if TAG_ID.
+    uint32_t dataOffset;   // Regex string, if REGEX_STRING.
+    uint32_t dataLength;
+    uint32_t firstChild;   // Children, if group.
+    uint32_t childCount;
+};
+
+/*! Non-owning view of the flat grammar tables.
+ *  - It's an aggregate of pointers, so it can also view static (constexpr) tables.
+ *  - Lookups by ID are O(1).
+ */
+struct GrammarView{
+    const FlatTag*    tags;
+    size_t            tagCount;
+    const FlatRule*   rules;
+    size_t            ruleCount;
+    const FlatOption* options;
+    size_t            optionCount;
+    const FlatSymbol* symbols;
+    size_t            symbolCount;
+    const char*       strings;
+    size_t            stringsSize;
+
+    // ID -> index maps. Size is idLimit. FLAT_NONE if ID has no tag/rule.
+    const uint32_t*   tagByID;
+    const uint32_t*   ruleByID;
+    size_t            idLimit;
+
+    int flags;
+
+    // Lookups by ID. @return nullptr if not present. For a split rule,
+    // the first entry - the others follow it.
+    constexpr const FlatRule* getRule( size_t id ) const {
+        return ( id < idLimit && ruleByID[ id ] != FLAT_NONE ) ? rules + ruleByID[ id ] : nullptr;
+    }
+    constexpr const FlatTag* getTag( size_t id ) const {
+        return ( id < idLimit && tagByID[ id ] != FLAT_NONE ) ? tags + tagByID[ id ] : nullptr;
+    }
+
+    // Record accessors.
+    constexpr const FlatOption& option( const FlatRule& r, size_t i ) const {
+        return options[ r.firstOption + i ];
+    }
+    constexpr const FlatSymbol& symbol( const FlatOption& o, size_t i ) const {
+        return symbols[ o.firstSymbol + i ];
+    }
+    constexpr const FlatSymbol& child( const FlatSymbol& s, size_t i ) const {
+        return symbols[ s.firstChild + i ];
+    }
+
+    // String accessors.
+    inline std::string tagName( const FlatTag& t ) const {
+        return std::string( strings + t.nameOffset, t.nameLength );
+    }
+    inline std::string symbolData( const FlatSymbol& s ) const {
+        return std::string( strings + s.dataOffset, s.dataLength );
+    }
+    inline std::string actionName( const FlatOption& o ) const {
+        return std::string( strings + o.actionOffset, o.actionLength );
+    }
+};
+
+/*! Owning flat grammar. Built from GbnfData, and frozen afterwards.
+ *  - Equal strings are stored in the pool only once.
+ */
+class FlatGrammar{
+private:
+    std::vector< FlatTag >    tags;
+    std::vector< FlatRule >   rules;
+    std::vector< FlatOption > options;
+    std::vector< FlatSymbol > symbols;
+    std::string               strings;
+    std::vector< uint32_t >   tagByID;
+    std::vector< uint32_t >   ruleByID;
+    int flags = 0;
+
+    uint32_t addString( const std::string& str,
+                        std::unordered_map< std::string, uint32_t >& pooled );
+    void addSymbols( uint32_t first, const std::vector< GrammarToken >& toks,
+                     std::unordered_map< std::string, uint32_t >& pooled );
+
+public:
+    FlatGrammar(){}
+    FlatGrammar( const GbnfData& data );
+
+    /*! @return a view of the tables. Valid until this object is destroyed or moved.
+     */
+    GrammarView view() const {
+        return GrammarView{ tags.data(), tags.size(), rules.data(), rules.size(),
+                            options.data(), options.size(), symbols.data(), symbols.size(),
+                            strings.data(), strings.size(), tagByID.data(), ruleByID.data(),
+                            tagByID.size(), flags };
+    }
+
+    /*! Converts back to the tree representation.
+     *  - Previous contents of "data" are replaced.
+     */
+    static void toGbnfData( const GrammarView& view, GbnfData& data );
+};
+
+}
+
+#endif // GBNFFLAT_HPP_INCLUDED
@@ -4,8 +4,15 @@
 #include <memory>
 #include <functional>
 #include <cstring>
+#include <cstdlib>
 #include <set>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <exception>
 #include "gbnf.hpp"
+#include "gbnffile.hpp"
 
 const char* testData = 
   "<trans_unit> ::== {<ext_object>}* ;              \n" 
@@ -68,6 +75,99 @@ struct BnfInputFile{
     }
 };
 
+static bool isBinaryGbnfFile( const std::string& fname ){
+    return fname.size() > 5 && fname.compare( fname.size() - 5, 5, ".gbnf" ) == 0;
+}
+
+/*! Settings of the rebuild on every change of the input (--watch).
+ */
+struct WatchSetup{
+    std::string inFileName;
+    std::string outFileName;
+    bool binaryOutput;
+    int codegenMode;
+    int recursionFixMode;
+    int optimizationPasses;
+    int verbosity;
+};
+
+/*! Writes the grammar to the output file, replacing it.
+ *  @return false if file can't be opened.
+ */
+static bool writeOutput( const WatchSetup& setup, const gbnf::GbnfData& data ){
+    std::ofstream out( setup.outFileName, std::ios::out | std::ios::binary | std::ios::trunc );
+    if( !out.is_open() )
+        return false;
+
+    if( setup.binaryOutput ){
+        gbnf::writeGbnfFile( data, out );
+        return true;
+    }
+
+    gbnf::CodeGenerator gen( out, setup.outFileName, setup.codegenMode );
+    gen.outputStart();
+    gen.generateConstructionCode( data, setup.inFileName, setup.verbosity-1 );
+    gen.outputEnd();
+    return true;
+}
+
+/*! Rebuilds the output every time the input file changes. Runs until killed.
+ *  - Input is polled once per second. Only the rules changed since the last 
+ *    build are converted again (see gbnf::IncrementalConverter), and the output
+ *    is rewritten only if the resulting grammar has changed.
+ *  - Parse errors are reported, and the previous output is kept.
+ */
+static int watchAndRebuild( const WatchSetup& setup ){
+    gbnf::IncrementalConverter converter( setup.recursionFixMode == gbnf::FIX_LEFT_RECURSION,
+        setup.recursionFixMode, setup.optimizationPasses );
+    std::string lastText;
+    bool first = true;
+
+    while( true ){
+        std::ifstream in( setup.inFileName, std::ios::in | std::ios::binary );
+        std::string text( ( std::istreambuf_iterator<char>( in ) ), 
+                            std::istreambuf_iterator<char>() );
+
+        if( in.is_open() && ( first || text != lastText ) ){
+            first = false;
+            lastText = text;
+
+            try{
+                gbnf::GbnfData source;
+                std::istringstream strm( text );
+                gbnf::convertToGbnf( source, strm );
+
+                gbnf::IncrementalConverter::Report report;
+                const gbnf::GbnfData& result = converter.build( source, &report );
+
+                if( setup.verbosity > 0 ){
+                    std::cout<<"Rebuilt \""<< setup.inFileName <<"\": changed rules: "<<
+                        report.changed.size() <<", removed: "<< report.removed.size() <<
+                        ", affected: "<< report.affected.size() <<", converted: "<< 
+                        report.convertedRules <<"\n";
+                    for( auto&& id : report.affected )
+                        std::cout<<"  Affected: <"<< source.getTag( id )->data <<">\n";
+                }
+
+                if( !report.resultChanged ){
+                    if( setup.verbosity > 0 )
+                        std::cout<<" Grammar is unchanged. Output is kept.\n";
+                }
+                else if( !writeOutput( setup, result ) )
+                    std::cerr<<"Can't open output file \""<< setup.outFileName <<"\"!\n";
+                else if( setup.verbosity > 0 )
+                    std::cout<<" Written to \""<< setup.outFileName <<"\".\n";
+            } catch( const std::exception& e ){
+                std::cerr<<"Error in \""<< setup.inFileName <<"\": "<< e.what() <<"\n";
+            }
+            std::cout.flush();
+        }
+
+        std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+    }
+    return 0;
+}
+
 int main(int argc, char** argv){
     // Properties
     std::set< BnfInputFile > inFiles;
@@ -78,6 +178,12 @@ int main(int argc, char** argv){
     int verbosity = 0;
     bool convertToBnf = false;
     int recursionFixMode = 0;
+    int optimizationPasses = 0;
+    size_t threadCount = 0; // All hardware threads. Output doesn't depend on it.
+    bool mergeInputs = false;
+    bool binaryOutput = false;
+    bool watch = false;
+    int codegenMode = gbnf::CODEGEN_CONSTRUCTION;
 
     // Parse arguments.
     if(argc > 1){
@@ -106,6 +212,40 @@ int main(int argc, char** argv){
             else if(!strcmp(argv[i], "--fix-recursion=right"))
                 recursionFixMode = gbnf::FIX_RIGHT_RECURSION;
 
+            // Thread count. 0 means all hardware threads.
+            else if(!strcmp(argv[i], "-j") && i < argc-1)
+                threadCount = std::strtoul( argv[++i], nullptr, 10 );
+            else if(!strncmp(argv[i], "--threads=", 10))
+                threadCount = std::strtoul( argv[i] + 10, nullptr, 10 );
+
+            else if(!strcmp(argv[i], "-O") || !strcmp(argv[i], "--optimize"))
+                optimizationPasses = gbnf::OPTIMIZE_ALL;
+            else if(!strncmp(argv[i], "--optimize=", 11)){
+                // Comma-separated pass names.
+                std::istringstream passList( argv[i] + 11 );
+                std::string pass;
+                while( std::getline( passList, pass, ',' ) ){
+                    int flag = 0;
+                    for( int p = 1; p <= gbnf::OPTIMIZE_ALL; p <<= 1 ){
+                        if( pass == gbnf::OptimizationReport::getPassName( p ) )
+                            flag = p;
+                    }
+                    if( !flag )
+                        std::cerr<<"Unknown optimization pass \""<< pass <<"\"!\n";
+                    optimizationPasses |= flag;
+                }
+            }
+
+            else if(!strcmp(argv[i], "-m") || !strcmp(argv[i], "--merge"))
+                mergeInputs = true;
+
+            else if(!strcmp(argv[i], "-b") || !strcmp(argv[i], "--binary"))
+                binaryOutput = true;
+            else if(!strcmp(argv[i], "-w") || !strcmp(argv[i], "--watch"))
+                watch = true;
+            else if(!strcmp(argv[i], "--static-tables"))
+                codegenMode = gbnf::CODEGEN_STATIC_TABLES;
+
             // Output file is indicated by "-o"
             else if((!strcmp(argv[i], "-o") || !strcmp(argv[i], "--outfile")) && i < argc-1){
                 i++;
@@ -122,16 +262,31 @@ int main(int argc, char** argv){
                 ); 
 
                 if( ff->is_open() )
-                    inFiles.insert( BnfInputFile( ff, argv[i] ) );
+                    inFiles.insert( BnfInputFile( ff, argv[i], 
+                        isBinaryGbnfFile( argv[i] ) ? "gbnf" : "" ) );
                 else
                     std::cerr<<"Can't open input file \""<< argv[i] <<"\"!\n";
             }
         }
     }
 
+    // Rebuild mode. Converts to BNF, and writes to the file on every change.
+    if( watch ){
+        if( inFiles.size() != 1 || inFiles.begin()->type == "gbnf" || !outFile.is_open() ){
+            std::cerr<<"Watch mode needs one EBNF input file, and an output file (-o)!\n";
+            return 1;
+        }
+        outFile.close();
+        return watchAndRebuild( WatchSetup{ inFiles.begin()->filename, outFileName, 
+            binaryOutput, codegenMode, recursionFixMode, optimizationPasses, verbosity } );
+    }
+
     // Set final output - cout if no set.
     std::ostream& output = ( outFile.is_open() ? outFile : std::cout );
 
+    // Logs go to stderr if the output goes to stdout, so they don't corrupt it.
+    std::ostream& log = ( outFile.is_open() ? std::cout : std::cerr );
+
     // Fix input if no found - cin if no present.
     if( inFiles.empty() ){
         if( !debug ){
@@ -157,56 +312,190 @@ int main(int argc, char** argv){
 
     // Output everything if mega verbose.
     if( verbosity > 1 ){
-        std::cout<<"Final setup:\n inFiles: "<< inFiles.size() <<"\n debug: "<<debug;
-        std::cout<<"\n verbosity: "<<verbosity<<"\n convertToBnf: "<<convertToBnf;
-        std::cout<<"\n recursionFixMode: "<< recursionFixMode <<"\n\n";
+        log<<"Final setup:\n inFiles: "<< inFiles.size() <<"\n debug: "<<debug;
+        log<<"\n verbosity: "<<verbosity<<"\n convertToBnf: "<<convertToBnf;
+        log<<"\n recursionFixMode: "<< recursionFixMode;
+        log<<"\n optimizationPasses: "<< optimizationPasses;
+        log<<"\n threadCount: "<< threadCount;
+        log<<"\n mergeInputs: "<< mergeInputs;
+        log<<"\n binaryOutput: "<< binaryOutput <<"\n\n";
     }
 
-    gbnf::CodeGenerator gen( output, outFileName );
-    gen.outputStart();
+    // Binary gBNF file holds one grammar.
+    if( binaryOutput && inFiles.size() > 1 && !mergeInputs ){
+        std::cerr<<"Binary output supports only one input file, unless inputs are merged!\n";
+        return 1;
+    }
 
-    // Run through each input, and produce an output
-    for( auto& a : inFiles ){
-        if( verbosity > 0)
-            std::cout<<"\nParsing file: "<< a.filename <<"\n";
+    // Parse the inputs concurrently, each to its own GbnfData. 
+    // Binary files are loaded directly.
+    std::vector< const BnfInputFile* > inputs;
+    for( auto& a : inFiles )
+        inputs.push_back( &a );
+
+    std::vector< gbnf::GbnfData > grammars( inputs.size() );
+    std::vector< char > loaded( inputs.size(), false );
+    std::vector< std::exception_ptr > errors( inputs.size() );
+    std::atomic< size_t > nextInput( 0 );
+
+    // Threads left over by the inputs parse the parts of a file.
+    size_t parserCount = ( threadCount ? threadCount : 
+                           std::max< size_t >( 1, std::thread::hardware_concurrency() ) );
+    const size_t fileThreads = std::max< size_t >( 1, parserCount / std::max< size_t >( 1, inputs.size() ) );
+    parserCount = std::min( parserCount, inputs.size() );
+
+    // Debug logs of the parsers must stay in order of input, and the logger isn't
+    // thread-safe, so the inputs are parsed one by one.
+    if( verbosity > 1 )
+        parserCount = 1;
+
+    auto parseInputs = [&](){
+        for( size_t i = nextInput++; i < inputs.size(); i = nextInput++ ){
+            const BnfInputFile& a = *inputs[ i ];
+            try{
+                if( a.type == "gbnf" ){
+                    gbnf::GbnfFile file;
+                    if( !file.open( a.filename ) )
+                        continue;
+                    file.view().toGbnfData( grammars[ i ] );
+                }
+                else
+                    gbnf::convertToGbnf( grammars[ i ], *(a.is), verbosity-1, fileThreads );
+                loaded[ i ] = true;
+            } catch( ... ){
+                errors[ i ] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector< std::thread > parsers;
+    for( size_t t = 1; t < parserCount; t++ )
+        parsers.push_back( std::thread( parseInputs ) );
+    parseInputs();
+    for( auto&& th : parsers )
+        th.join();
+
+    // Grammars to produce the output for, and their names.
+    std::vector< std::pair< std::string, gbnf::GbnfData* > > outputs;
+    std::vector< gbnf::GbnfData > loadedGrammars;
+    std::vector< std::string > loadedNames;
+
+    for( size_t i = 0; i < inputs.size(); i++ ){
+        if( errors[ i ] )
+            std::rethrow_exception( errors[ i ] );
+        if( !loaded[ i ] ){
+            std::cerr<<"Can't map input file \""<< inputs[ i ]->filename <<"\"!\n";
+            continue;
+        }
+
+        if( verbosity > 0){
+            log<<"\nParsed file: "<< inputs[ i ]->filename <<"\n";
+            log<<" Parsed to GBNF. No. of Rules: "<< 
+                grammars[ i ].grammarTableConst().size() <<"\n";
+        }
 
-        // Allocate data.
-        gbnf::GbnfData data;
+        if( mergeInputs ){
+            loadedGrammars.push_back( std::move( grammars[ i ] ) );
+            loadedNames.push_back( inputs[ i ]->filename );
+        }
+        else
+            outputs.push_back( std::make_pair( inputs[ i ]->filename, &grammars[ i ] ) );
+    }
 
-        // Parse file to GBNF
-        gbnf::convertToGbnf( data, *(a.is), verbosity-1 );
+    // Merge the inputs to one tag ID space.
+    gbnf::GbnfData merged;
+    if( mergeInputs ){
+        auto conflicts = gbnf::mergeGrammars( merged, loadedGrammars );
+        for( auto&& c : conflicts ){
+            std::cerr<<"Merge conflict: <"<< c.tag <<"> is defined in \""<< 
+                loadedNames[ c.definedIn ] <<"\" and \""<< loadedNames[ c.redefinedIn ] <<
+                "\". Keeping the first definition.\n";
+        }
+
+        if( verbosity > 0){
+            log<<"\nMerged "<< loadedGrammars.size() <<" files. No. of Rules: "<< 
+                merged.grammarTableConst().size() <<", conflicts: "<< conflicts.size() <<"\n";
+        }
+        outputs.push_back( std::make_pair( outFileName, &merged ) );
+    }
+
+    gbnf::CodeGenerator gen( output, outFileName, codegenMode );
+    if( !binaryOutput )
+        gen.outputStart();
+
+    // Run through each grammar, and produce an output
+    for( auto& out : outputs ){
+        gbnf::GbnfData& data = *out.second;
 
         if( verbosity > 0)
-            std::cout<<" Parsed to GBNF. No. of Rules: "<< data.grammarTableConst().size() <<"\n";
+            log<<"\nProcessing: "<< out.first <<"\n";
 
         // Convert to BNF
         if( convertToBnf ){
             gbnf::convertToBNF( data, ( recursionFixMode == 
-                gbnf::FIX_LEFT_RECURSION ? true : false ), verbosity-1 );
+                gbnf::FIX_LEFT_RECURSION ? true : false ), verbosity-1, threadCount );
 
             if( verbosity > 0){
-                std::cout<<" Converted to BNF. No. of Rules: "<< 
+                log<<" Converted to BNF. No. of Rules: "<< 
                     data.grammarTableConst().size() <<"\n";
             }
         }
 
         // Fixing recursion
         if( recursionFixMode ){    
-            if( verbosity > 0)
-                std::cout<<" Fixing recursion: ";
-            std::cout<< (recursionFixMode==gbnf::FIX_LEFT_RECURSION ? "left" : "right") <<"\n";
+            if( verbosity > 0){
+                log<<" Fixing recursion: "<< 
+                    (recursionFixMode==gbnf::FIX_LEFT_RECURSION ? "left" : "right") <<"\n";
+            }
         
-            gbnf::fixRecursion( data, recursionFixMode, verbosity-1 );
+            auto report = gbnf::fixRecursion( data, recursionFixMode, verbosity-1 );
+
+            // Growth of every rewritten component.
+            if( verbosity > 0){
+                for( auto&& comp : report.components ){
+                    log<<"  Component of "<< comp.rules.size() <<" rules (first: "<<
+                        data.getTag( comp.rules.front() )->data <<"): options "<< 
+                        comp.optionsBefore <<" -> "<< comp.optionsAfter <<", symbols "<<
+                        comp.symbolsBefore <<" -> "<< comp.symbolsAfter <<", new rules: "<<
+                        comp.newRules <<"\n";
+                }
+                log<<" Fixed "<< report.components.size() <<" recursive components. "<<
+                    "No. of Rules: "<< data.grammarTableConst().size() <<"\n";
+            }
+        }
+
+        // Optimizing
+        if( optimizationPasses ){
+            auto report = gbnf::optimizeGrammar( data, optimizationPasses, verbosity-1 );
+
+            if( verbosity > 0){
+                for( auto&& pass : report.passes ){
+                    log<<" Optimization pass \""<< 
+                        gbnf::OptimizationReport::getPassName( pass.pass ) <<"\": rules "<<
+                        pass.rulesBefore <<" -> "<< pass.rulesAfter <<", options "<<
+                        pass.optionsBefore <<" -> "<< pass.optionsAfter <<", symbols "<<
+                        pass.symbolsBefore <<" -> "<< pass.symbolsAfter <<"\n";
+                }
+            }
         }
     
         // Generating
+        if( binaryOutput ){
+            if( verbosity > 0)
+                log<<" Writing binary gBNF ... \n";
+
+            gbnf::writeGbnfFile( data, output );
+            continue;
+        }
+
         if( verbosity > 0)
-            std::cout<<" Generating Code ... \n";
+            log<<" Generating Code ... \n";
 
-        gen.generateConstructionCode( data, a.filename, verbosity-1 ); 
+        gen.generateConstructionCode( data, out.first, verbosity-1 ); 
     }
 
-    gen.outputEnd();
+    if( !binaryOutput )
+        gen.outputEnd();
 
     return 0;
 }
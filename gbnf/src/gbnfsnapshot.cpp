@@ -0,0 +1,258 @@
+#include <algorithm>
+#include "gbnfsnapshot.hpp"
+
+namespace gbnf{
+
+static bool sameTokens( const std::vector< GrammarToken >& a,
+                        const std::vector< GrammarToken >& b ){
+    if( a.size() != b.size() )
+        return false;
+    for( size_t i = 0; i < a.size(); i++ ){
+        if( a[ i ].type != b[ i ].type || a[ i ].id != b[ i ].id ||
+            a[ i ].data != b[ i ].data || !sameTokens( a[ i ].children, b[ i ].children ) )
+            return false;
+    }
+    return true;
+}
+
+static inline bool ruleIDLess( const GrammarSnapshot::RulePtr& a,
+                               const GrammarSnapshot::RulePtr& b ){
+    return a->getID() < b->getID();
+}
+
+GrammarSnapshot::GrammarSnapshot() : tagTable( std::make_shared< TagTable >() ) {}
+
+GrammarSnapshot::GrammarSnapshot( const GbnfData& data ) : flags( data.flags ) {
+    setTags( data );
+    rules.reserve( data.grammarTableConst().size() );
+    for( auto&& rule : data.grammarTableConst() )
+        rules.push_back( std::make_shared< const GrammarRule >( rule ) );
+
+    // Stable, so the rules with equal IDs keep their order.
+    std::stable_sort( rules.begin(), rules.end(), ruleIDLess );
+}
+
+GrammarSnapshot::GrammarSnapshot( GbnfData&& data ) : flags( data.flags ) {
+    setTags( data );
+    rules.reserve( data.grammarTableConst().size() );
+    for( auto&& rule : data.grammarTableConst() ){
+        rules.push_back( std::make_shared< const GrammarRule >(
+            rule.getID(), std::move( rule.options ) ) );
+    }
+    std::stable_sort( rules.begin(), rules.end(), ruleIDLess );
+}
+
+void GrammarSnapshot::setTags( const GbnfData& data ){
+    auto table = std::make_shared< TagTable >();
+    table->tags = data.tagTableConst();
+    table->index.reserve( table->tags.size() );
+    for( auto&& tag : table->tags )
+        table->index.insert( tag.data, tag.getID() );
+    table->lastTagID = data.getLastTagID();
+    tagTable = std::move( table );
+}
+
+std::vector< GrammarSnapshot::RulePtr >::const_iterator
+GrammarSnapshot::lowerBound( size_t id ) const {
+    return std::lower_bound( rules.begin(), rules.end(), id,
+        []( const RulePtr& r, size_t i ){ return r->getID() < i; } );
+}
+
+const NonTerminal* GrammarSnapshot::getTag( size_t id ) const {
+    const auto& tags = tagTable->tags;
+    auto it = std::lower_bound( tags.begin(), tags.end(), NonTerminal( id ) );
+    return ( it != tags.end() && it->getID() == id ? &*it : nullptr );
+}
+
+const GrammarRule* GrammarSnapshot::getRule( size_t id ) const {
+    auto it = lowerBound( id );
+    return ( it != rules.end() && (*it)->getID() == id ? it->get() : nullptr );
+}
+
+GrammarSnapshot GrammarSnapshot::withRule( GrammarRule&& rule ) const {
+    const size_t id = rule.getID();
+    auto first = lowerBound( id );
+    auto last = first;
+    while( last != rules.end() && (*last)->getID() == id )
+        ++last;
+
+    GrammarSnapshot result;
+    result.flags = flags;
+    result.tagTable = tagTable;
+    result.rules.reserve( rules.size() + 1 - ( last - first ) );
+    result.rules.insert( result.rules.end(), rules.begin(), first );
+    result.rules.push_back( std::make_shared< const GrammarRule >( std::move( rule ) ) );
+    result.rules.insert( result.rules.end(), last, rules.end() );
+    return result;
+}
+
+GrammarSnapshot GrammarSnapshot::withoutRule( size_t id ) const {
+    GrammarSnapshot result( *this );
+    auto first = result.lowerBound( id );
+    auto last = first;
+    while( last != result.rules.end() && (*last)->getID() == id )
+        ++last;
+
+    result.rules.erase( first, last );
+    return result;
+}
+
+GrammarSnapshot GrammarSnapshot::withTag( const std::string& name, size_t* id ) const {
+    size_t existing = getTagID( name );
+    if( existing != SymbolIndex::NOT_FOUND ){
+        if( id )
+            *id = existing;
+        return *this;
+    }
+
+    auto table = std::make_shared< TagTable >( *tagTable );
+    table->lastTagID++;
+    table->tags.push_back( NonTerminal( table->lastTagID, name ) );
+    table->index.insert( name, table->lastTagID );
+    if( id )
+        *id = table->lastTagID;
+
+    GrammarSnapshot result( *this );
+    result.tagTable = std::move( table );
+    return result;
+}
+
+GrammarSnapshot GrammarSnapshot::withFlags( int newFlags ) const {
+    GrammarSnapshot result( *this );
+    result.flags = newFlags;
+    return result;
+}
+
+/*! Shares the old tag table with the new version, if they're equal.
+ */
+void GrammarSnapshot::shareTagTable( const std::shared_ptr< const TagTable >& old,
+                                     std::shared_ptr< const TagTable >& current ){
+    const auto& oldTags = old->tags;
+    const auto& newTags = current->tags;
+    if( oldTags.size() == newTags.size() && old->lastTagID == current->lastTagID &&
+        std::equal( oldTags.begin(), oldTags.end(), newTags.begin(),
+            []( const NonTerminal& a, const NonTerminal& b ){
+                return a.getID() == b.getID() && a.data == b.data;
+            } ) )
+    {
+        current = old;
+    }
+}
+
+GrammarSnapshot GrammarSnapshot::rebase( GbnfData&& data ) const {
+    GrammarSnapshot result( std::move( data ) );
+    shareTagTable( tagTable, result.tagTable );
+
+    // Rules. The k-th rule with an ID is matched with the k-th old rule with the ID.
+    auto old = rules.begin();
+    for( size_t i = 0; i < result.rules.size(); ){
+        const size_t id = result.rules[ i ]->getID();
+        while( old != rules.end() && (*old)->getID() < id )
+            ++old;
+
+        for( ; i < result.rules.size() && result.rules[ i ]->getID() == id; i++ ){
+            if( old != rules.end() && (*old)->getID() == id ){
+                if( sameTokens( (*old)->options, result.rules[ i ]->options ) )
+                    result.rules[ i ] = *old;
+                ++old;
+            }
+        }
+    }
+
+    return result;
+}
+
+void GrammarSnapshot::selectWholeRules( std::vector< char >& selected ) const {
+    for( size_t i = 0; i < rules.size(); ){
+        size_t end = i;
+        bool any = false;
+        for( ; end < rules.size() && rules[ end ]->getID() == rules[ i ]->getID(); end++ )
+            any = any || selected[ end ];
+        for( ; i < end; i++ )
+            selected[ i ] = any;
+    }
+}
+
+/*! Rebases the result of a pass on the selected rules.
+ *  - Unselected rules are taken over as they are. Rules of the data are shared 
+ *    with the selected rules, if equal.
+ */
+GrammarSnapshot GrammarSnapshot::rebaseSelected( GbnfData&& data, 
+                                                 const std::vector< char >& selected ) const {
+    GrammarSnapshot changed( std::move( data ) );
+    shareTagTable( tagTable, changed.tagTable );
+
+    GrammarSnapshot result;
+    result.flags = changed.flags;
+    result.tagTable = changed.tagTable;
+    result.rules.reserve( rules.size() + changed.rules.size() );
+
+    // Merge by ID. Selected old rules are only matched against the new ones.
+    auto nw = changed.rules.begin();
+    for( size_t i = 0; i < rules.size(); ){
+        const size_t id = rules[ i ]->getID();
+        for( ; nw != changed.rules.end() && (*nw)->getID() < id; ++nw )
+            result.rules.push_back( std::move( *nw ) );
+
+        if( !selected[ i ] ){
+            for( ; i < rules.size() && rules[ i ]->getID() == id; i++ )
+                result.rules.push_back( rules[ i ] );
+            continue;
+        }
+
+        // The k-th new rule with the ID is matched with the k-th old one.
+        for( ; nw != changed.rules.end() && (*nw)->getID() == id; ++nw ){
+            if( i < rules.size() && rules[ i ]->getID() == id ){
+                if( sameTokens( rules[ i ]->options, (*nw)->options ) )
+                    *nw = rules[ i ];
+                i++;
+            }
+            result.rules.push_back( std::move( *nw ) );
+        }
+        for( ; i < rules.size() && rules[ i ]->getID() == id; i++ );
+    }
+    for( ; nw != changed.rules.end(); ++nw )
+        result.rules.push_back( std::move( *nw ) );
+
+    return result;
+}
+
+GbnfData GrammarSnapshot::toGbnfData() const {
+    return toGbnfData( nullptr );
+}
+
+GbnfData GrammarSnapshot::toGbnfData( const std::vector< char >* selected ) const {
+    GbnfData data;
+    data.flags = flags;
+    for( auto&& tag : tagTable->tags )
+        data.insertTag( tag.getID(), std::string( tag.data ) );
+
+    // IDs of the removed last tags must not be given again.
+    if( tagTable->lastTagID > data.getLastTagID() ){
+        data.insertTag( tagTable->lastTagID, std::string() );
+        data.removeTag( tagTable->lastTagID );
+    }
+    for( size_t i = 0; i < rules.size(); i++ ){
+        if( !selected || (*selected)[ i ] )
+            data.insertRule( *rules[ i ] );
+    }
+    return data;
+}
+
+size_t GrammarSnapshot::countSharedRules( const GrammarSnapshot& other ) const {
+    size_t count = 0;
+    auto it = other.rules.begin();
+    for( auto&& rule : rules ){
+        while( it != other.rules.end() && (*it)->getID() < rule->getID() )
+            ++it;
+        for( auto jt = it; jt != other.rules.end() && (*jt)->getID() == rule->getID(); ++jt ){
+            if( *jt == rule ){
+                count++;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+}
@@ -0,0 +1,138 @@
+#ifndef GBNFSNAPSHOT_HPP_INCLUDED
+#define GBNFSNAPSHOT_HPP_INCLUDED
+
+#include <vector>
+#include <string>
+#include <memory>
+#include "gbnf.hpp"
+
+namespace gbnf{
+
+/*! Immutable, structurally shared version of a grammar.
+ *  - Rules are held by shared pointers to const rules, and the tag table by one
+ *    shared pointer. Copying a snapshot copies only the pointers, and versions
+ *    share every rule they don't change.
+ *  - Edits return new versions. A snapshot never changes, so it can be read
+ *    from many threads at once.
+ *  - The in-place passes (convertToBNF, fixRecursion, optimizeGrammar) are run
+ *    with transform(), which shares the rules the pass left untouched. Passes 
+ *    which change only some of the rules can be given only those (see transform()
+ *    with a selector), so the other rules aren't copied at all.
+ */
+class GrammarSnapshot{
+public:
+    typedef std::shared_ptr< const GrammarRule > RulePtr;
+
+private:
+    // Tag table with its name index. Shared until a tag is inserted.
+    struct TagTable{
+        std::vector< NonTerminal > tags;
+        SymbolIndex index;
+        size_t lastTagID = 0;
+    };
+
+    int flags = 0;
+    std::shared_ptr< const TagTable > tagTable;
+    std::vector< RulePtr > rules; // Sorted by ID.
+
+    void setTags( const GbnfData& data );
+    std::vector< RulePtr >::const_iterator lowerBound( size_t id ) const;
+
+    static void shareTagTable( const std::shared_ptr< const TagTable >& old,
+                               std::shared_ptr< const TagTable >& current );
+
+    // Extends the selection of rules to all rules with the selected IDs.
+    void selectWholeRules( std::vector< char >& selected ) const;
+    GbnfData toGbnfData( const std::vector< char >* selected ) const;
+    GrammarSnapshot rebaseSelected( GbnfData&& data, const std::vector< char >& selected ) const;
+
+public:
+    GrammarSnapshot();
+    explicit GrammarSnapshot( const GbnfData& data );
+    explicit GrammarSnapshot( GbnfData&& data );
+
+    inline int getFlags() const { return flags; }
+    inline size_t getLastTagID() const { return tagTable->lastTagID; }
+    inline const std::vector< NonTerminal >& tagTableConst() const { return tagTable->tags; }
+
+    /*! @return the tag with the ID, or nullptr if not present.
+     */
+    const NonTerminal* getTag( size_t id ) const;
+
+    /*! @return the ID of the tag, or (size_t)-1 if not present.
+     */
+    inline size_t getTagID( const std::string& name ) const {
+        return tagTable->index.find( name );
+    }
+
+    // Rules, by position. Rules are sorted by ID.
+    inline size_t ruleCount() const { return rules.size(); }
+    inline const GrammarRule& rule( size_t i ) const { return *rules[ i ]; }
+    inline const RulePtr& rulePtr( size_t i ) const { return rules[ i ]; }
+
+    /*! @return the first rule with the ID, or nullptr if not present.
+     */
+    const GrammarRule* getRule( size_t id ) const;
+
+    /*! Edits. Every edit returns a new version, sharing everything else.
+     *  - withRule: replaces all rules with the rule's ID by the rule.
+     *  - withTag:  inserts a tag with the next free ID, or gives the ID of the
+     *              existing tag with the name.
+     */
+    GrammarSnapshot withRule( GrammarRule&& rule ) const;
+    GrammarSnapshot withoutRule( size_t id ) const;
+    GrammarSnapshot withTag( const std::string& name, size_t* id = nullptr ) const;
+    GrammarSnapshot withFlags( int newFlags ) const;
+
+    /*! Runs an in-place transformation of a GbnfData on a copy of this version.
+     *  - NOTE: it's O(grammar) in time: the whole grammar is copied for the pass,
+     *    and every rule of the result is compared with this version's, to share 
+     *    the equal ones. Use the selecting transform() for passes with a known scope.
+     *  @return the transformed version, sharing the rules equal to this version's.
+     */
+    template< typename F >
+    GrammarSnapshot transform( F&& f ) const {
+        GbnfData data = toGbnfData();
+        f( data );
+        return rebase( std::move( data ) );
+    }
+
+    /*! Runs an in-place transformation on the selected rules only.
+     *  - Pass gets the tag table, and the rules for which select( rule ) is true
+     *    (all rules with the ID, if any of them is). The other rules are shared 
+     *    without being copied or compared, so the cost is O(tags + selected rules).
+     *  - Selected rules are replaced by the rules left in the data, so the pass
+     *    can change, add or remove them. It must not need the other rules, i.e.
+     *    select the rules with groups for convertToBNF.
+     *  @return the transformed version.
+     */
+    template< typename Select, typename F >
+    GrammarSnapshot transform( Select&& select, F&& f ) const {
+        std::vector< char > selected( rules.size(), 0 );
+        for( size_t i = 0; i < rules.size(); i++ )
+            selected[ i ] = select( *rules[ i ] ) ? 1 : 0;
+        selectWholeRules( selected );
+
+        GbnfData data = toGbnfData( &selected );
+        f( data );
+        return rebaseSelected( std::move( data ), selected );
+    }
+
+    /*! Makes a new version with the contents of the data.
+     *  - Rules structurally equal to this version's rules with the same ID, and the
+     *    tag table if it's equal, are shared with this version.
+     */
+    GrammarSnapshot rebase( GbnfData&& data ) const;
+
+    /*! @return a deep copy of the grammar, for the tools working on GbnfData.
+     */
+    GbnfData toGbnfData() const;
+
+    /*! @return number of rules shared with the other version.
+     */
+    size_t countSharedRules( const GrammarSnapshot& other ) const;
+};
+
+}
+
+#endif // GBNFSNAPSHOT_HPP_INCLUDED
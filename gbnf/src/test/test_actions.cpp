@@ -0,0 +1,133 @@
+#include <iostream>
+#include <sstream>
+#include <cassert>
+#include "gbnf.hpp"
+#include "gbnfactions.hpp"
+
+/*! Unit Tests for semantic actions.
+ *  - Parses a grammar with "@action" options, and simulates the parser's
+ *    shift/reduce calls for expression "2 + 3 + 4".
+ */
+
+const char* testGrammar =
+    "<sum> ::= <sum> \"\\+\" <num> @add \n"
+    "        | <num> ;                  \n"
+    "<num> ::= \"[0-9]+\" @number ;     \n";
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing gbnf::SemanticActions ] ... ";
+
+    gbnf::GbnfData data;
+    std::istringstream strm( testGrammar );
+    gbnf::convertToGbnf( data, strm );
+
+    // Action names are stored on the options.
+    auto sum = data.getRule( data.getTagIDfromTable( "sum", false ) );
+    assert( sum != data.grammarTableConst().end() );
+    assert( sum->options.size() == 2 );
+    assert( sum->options[0].data == "add" );
+    assert( sum->options[1].data.empty() );
+
+    gbnf::SemanticActions< int > acts;
+    acts.registerAction( "add", []( int* v, size_t n ){ return v[0] + v[2]; } );
+    acts.registerAction( "number", []( int* v, size_t n ){ return v[0]; } );
+    acts.bind( data );
+
+    size_t sumID = sum->getID();
+    size_t numID = data.getTagIDfromTable( "num", false );
+
+    // 2
+    acts.shift( 2 );  acts.reduce( numID, 0 );  acts.reduce( sumID, 1 );
+    // + 3
+    acts.shift( 0 );  acts.shift( 3 );  acts.reduce( numID, 0 );  acts.reduce( sumID, 0 );
+    // + 4
+    acts.shift( 0 );  acts.shift( 4 );  acts.reduce( numID, 0 );  acts.reduce( sumID, 0 );
+
+    assert( acts.stackSize() == 1 );
+    assert( acts.pop() == 9 );
+
+    // Options of a split rule are indexed across its entries.
+    gbnf::GbnfData splitData;
+    std::istringstream splitStrm( "<v> ::= \"a\" @one ;\n"
+                                  "<v> ::= \"b\" \"c\" @two ;\n" );
+    gbnf::convertToGbnf( splitData, splitStrm );
+
+    gbnf::SemanticActions< int > splitActs;
+    splitActs.registerAction( "one", []( int* v, size_t n ){ return 1; } );
+    splitActs.registerAction( "two", []( int* v, size_t n ){ return (int)n * 10; } );
+    splitActs.bind( splitData );
+
+    size_t vID = splitData.getTagIDfromTable( "v", false );
+    splitActs.shift( 0 );  splitActs.reduce( vID, 0 );
+    assert( splitActs.pop() == 1 );
+    splitActs.shift( 0 );  splitActs.shift( 0 );  splitActs.reduce( vID, 1 );
+    assert( splitActs.pop() == 20 );
+
+    // Unregistered actions are reported on binding.
+    gbnf::SemanticActions< int > empty;
+    bool thrown = false;
+    try{
+        empty.bind( data );
+    } catch( const std::exception& e ){
+        thrown = true;
+    }
+    assert( thrown );
+
+    // Unbound rules and options out of range are reported on reducing.
+    thrown = false;
+    try{
+        acts.reduce( sumID, 2 );
+    } catch( const std::exception& e ){
+        thrown = true;
+    }
+    assert( thrown );
+
+    thrown = false;
+    try{
+        acts.reduce( data.getLastTagID() + 100, 0 );
+    } catch( const std::exception& e ){
+        thrown = true;
+    }
+    assert( thrown );
+
+    // Recursive rules with actions can't be rewritten by fixRecursion.
+    thrown = false;
+    const uint64_t beforeFix = gbnf::getFingerprint( data );
+    try{
+        gbnf::fixRecursion( data, gbnf::FIX_LEFT_RECURSION );
+    } catch( const std::exception& e ){
+        thrown = true;
+    }
+    assert( thrown );
+    assert( gbnf::getFingerprint( data ) == beforeFix );
+
+    // Actions can't be on options with optional elements, because the
+    // omitting variants would pass less values to the action.
+    gbnf::GbnfData optData;
+    std::istringstream optStrm( "<a> ::= <b> { \"x\" }? <b> @pair | <b> ;\n"
+                                "<b> ::= \"[0-9]+\" ;\n" );
+    gbnf::convertToGbnf( optData, optStrm );
+    thrown = false;
+    try{
+        gbnf::convertToBNF( optData );
+    } catch( const std::exception& e ){
+        thrown = true;
+    }
+    assert( thrown );
+
+    // Moved to a separate rule, arity of the action is fixed.
+    gbnf::GbnfData fixedData;
+    std::istringstream fixedStrm( "<a> ::= <b> <x> <b> @pair | <b> ;\n"
+                                  "<x> ::= { \"x\" }? ;\n"
+                                  "<b> ::= \"[0-9]+\" ;\n" );
+    gbnf::convertToGbnf( fixedData, fixedStrm );
+    gbnf::convertToBNF( fixedData );
+
+    auto fixedA = fixedData.getRule( fixedData.getTagIDfromTable( "a", false ) );
+    assert( fixedA->options.size() == 2 );
+    for( auto&& opt : fixedA->options )
+        assert( opt.data.empty() || opt.children.size() == 3 );
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <sstream>
+#include <cassert>
+#include "gbnf.hpp"
+#include "gbnfanalysis.hpp"
+
+/*! Unit Tests for the grammar analysis (nullable/FIRST/FOLLOW/reachable/productive).
+ */
+
+const char* testGrammar =
+    "<s> ::= <a> \"x\" | <b> ;\n"
+    "<a> ::= { \"y\" }* ;\n"
+    "<b> ::= <b> \"z\" | \"w\" ;\n"
+    "<dead> ::= <dead> \"q\" ;\n"
+    "<u> ::= \"k\" ;\n";
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing gbnf::GrammarAnalysis ] ... ";
+
+    gbnf::GbnfData data;
+    std::istringstream strm( testGrammar );
+    gbnf::convertToGbnf( data, strm );
+
+    size_t s = data.getTagIDfromTable( "s", false );
+    size_t a = data.getTagIDfromTable( "a", false );
+    size_t b = data.getTagIDfromTable( "b", false );
+    size_t dead = data.getTagIDfromTable( "dead", false );
+    size_t u = data.getTagIDfromTable( "u", false );
+
+    gbnf::AnalysisCache cache;
+    const gbnf::GrammarAnalysis& an = cache.get( data );
+    assert( an.getStartID() == s && an.terminalCount() == 6 );
+
+    auto term = [&]( const char* t ){ return an.getTerminalIndex( t ); };
+
+    assert( an.isNullable( a ) && !an.isNullable( s ) && !an.isNullable( b ) );
+
+    auto firstS = an.first( s );
+    assert( firstS.count() == 3 && firstS.test( term("x") ) && 
+            firstS.test( term("y") ) && firstS.test( term("w") ) );
+    assert( an.first( a ).count() == 1 && an.first( a ).test( term("y") ) );
+
+    assert( an.follow( s ).count() == 1 && an.follow( s ).test( an.endMarker() ) );
+    assert( an.follow( a ).count() == 1 && an.follow( a ).test( term("x") ) );
+    assert( an.follow( b ).count() == 2 && an.follow( b ).test( term("z") ) &&
+            an.follow( b ).test( an.endMarker() ) );
+
+    assert( an.isReachable( s ) && an.isReachable( a ) && an.isReachable( b ) );
+    assert( !an.isReachable( dead ) && !an.isReachable( u ) );
+    assert( an.isProductive( u ) && an.isProductive( a ) && !an.isProductive( dead ) );
+
+    // Same grammar - cached analysis. Mutated grammar - recomputed.
+    assert( &cache.get( data ) == &an );
+
+    data.insertRule( gbnf::GrammarRule( dead, { gbnf::GrammarToken( 
+        gbnf::GrammarToken::ROOT_TOKEN, 0, "", { gbnf::GrammarToken( 
+            gbnf::GrammarToken::REGEX_STRING, 0, "q", {} ) } ) } ) );
+    data.sort();
+
+    const gbnf::GrammarAnalysis& an2 = cache.get( data );
+    assert( an2.isProductive( dead ) );
+
+    // BNF conversion keeps the sets of the original rules.
+    gbnf::convertToBNF( data );
+    const gbnf::GrammarAnalysis& bnf = cache.get( data );
+    assert( bnf.isNullable( a ) && bnf.first( s ).count() == 3 );
+    assert( bnf.follow( a ).test( bnf.getTerminalIndex( "x" ) ) );
+
+    // In-place changes of the options are seen after touch().
+    auto sRule = data.getRule( s );
+    sRule->options[0].children[1].data = "v";
+    data.touch();
+    assert( cache.get( data ).getTerminalIndex( "v" ) != (size_t)(-1) );
+    data.grammarTableConst()[0].options.clear();
+    data.touch();
+    assert( cache.get( data ).first( data.grammarTableConst()[0].getID() ).count() == 0 );
+
+    // Tags without a rule (lexer tokens) are terminals.
+    gbnf::GbnfData tok;
+    std::istringstream tokStrm( "<list> ::= <decl> <number> ;\n"
+                                "<decl> ::= <ident> { \"=\" <number> }? ;\n" );
+    gbnf::convertToGbnf( tok, tokStrm );
+
+    const gbnf::GrammarAnalysis& tan = cache.get( tok );
+    size_t list = tok.getTagIDfromTable( "list", false );
+    size_t decl = tok.getTagIDfromTable( "decl", false );
+    size_t ident = tok.getTagIDfromTable( "ident", false );
+    size_t identTerm = tan.getTagTerminalIndex( ident );
+    size_t numberTerm = tan.getTagTerminalIndex( tok.getTagIDfromTable( "number", false ) );
+    assert( tan.terminalCount() == 3 && identTerm == 2 && numberTerm == 1 );
+    assert( tan.terminal( identTerm ) == "<ident>" && tan.terminalTag( identTerm ) == ident );
+    assert( tan.terminalTag( tan.getTerminalIndex( "=" ) ) == 0 );
+    assert( tan.getTagTerminalIndex( decl ) == (size_t)(-1) );
+
+    assert( tan.first( list ).count() == 1 && tan.first( list ).test( identTerm ) );
+    assert( tan.follow( decl ).count() == 1 && tan.follow( decl ).test( numberTerm ) );
+
+    // A rule split into several entries is analysed over all of them.
+    gbnf::GbnfData split;
+    std::istringstream splitStrm( "<s> ::= <a> ;\n"
+                                  "<a> ::= \"x\" <b> ;\n"
+                                  "<a> ::= \"y\" ;\n"
+                                  "<b> ::= \"z\" ;\n" );
+    gbnf::convertToGbnf( split, splitStrm );
+
+    const gbnf::GrammarAnalysis& san = cache.get( split );
+    size_t sa = split.getTagIDfromTable( "a", false );
+    size_t sb = split.getTagIDfromTable( "b", false );
+    assert( san.first( sa ).count() == 2 && san.first( sa ).test( san.getTerminalIndex( "x" ) ) &&
+            san.first( sa ).test( san.getTerminalIndex( "y" ) ) );
+    assert( san.isReachable( sb ) && san.follow( sb ).test( san.endMarker() ) );
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
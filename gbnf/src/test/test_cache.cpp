@@ -0,0 +1,83 @@
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include "gbnf.hpp"
+#include "gbnfcache.hpp"
+
+/*! Unit Tests for grammar fingerprints and the TableCache.
+ */
+
+const char* testGrammar =
+    "<list> ::= <item> {\",\" <item>}* ;\n"
+    "<item> ::= \"[a-z]+\" | <list> ;\n";
+
+/*! @return path of the file in the temporary directory, so no files are
+ *          left in the directory the tests are run from.
+ */
+static std::string tempPath( const char* name ){
+    const char* dir = std::getenv( "TMPDIR" );
+    if( !dir ) dir = std::getenv( "TEMP" );
+    if( !dir ) dir = std::getenv( "TMP" );
+#ifdef _WIN32
+    if( !dir ) dir = ".";
+#else
+    if( !dir ) dir = "/tmp";
+#endif
+    return std::string( dir ) + "/" + name;
+}
+
+static void parse( gbnf::GbnfData& data, const char* grammar ){
+    std::istringstream strm( grammar );
+    gbnf::convertToGbnf( data, strm );
+}
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing gbnf::TableCache ] ... ";
+
+    // Fingerprints are structural.
+    gbnf::GbnfData g1, g2, g3;
+    parse( g1, testGrammar );
+    parse( g2, testGrammar );
+    parse( g3, "<list> ::= <item> {\";\" <item>}* ;\n<item> ::= \"[a-z]+\" | <list> ;\n" );
+
+    assert( gbnf::getFingerprint( g1 ) == gbnf::getFingerprint( g2 ) );
+    assert( gbnf::getFingerprint( g1 ) != gbnf::getFingerprint( g3 ) );
+
+    gbnf::convertToBNF( g2 );
+    assert( gbnf::getFingerprint( g1 ) != gbnf::getFingerprint( g2 ) );
+
+    // Cache roundtrip.
+    const std::string path = tempPath( "gbnf_test_tables.cache" );
+    const std::string tables = "TABLES-nyaa";
+    std::remove( path.c_str() );
+
+    size_t builds = 0;
+    auto builder = [&](){ builds++; return tables; };
+    {
+        gbnf::TableCache cache( path );
+        assert( !cache.load( gbnf::getFingerprint( g1 ) ) );
+        assert( !cache.loadOrBuild( gbnf::getFingerprint( g1 ), builder ) );
+        assert( cache.ready() && cache.size() == tables.size() );
+        assert( !std::memcmp( cache.data(), tables.data(), tables.size() ) );
+    }
+    {
+        // Fingerprint matches - builder must not be called.
+        gbnf::TableCache cache( path );
+        assert( cache.loadOrBuild( gbnf::getFingerprint( g1 ), builder ) );
+        assert( builds == 1 );
+        assert( std::string( cache.data(), cache.size() ) == tables );
+
+        // Stale cache is rebuilt.
+        assert( !cache.loadOrBuild( gbnf::getFingerprint( g3 ), builder ) );
+        assert( builds == 2 );
+        assert( cache.load( gbnf::getFingerprint( g3 ) ) );
+        assert( !cache.load( gbnf::getFingerprint( g1 ) ) );
+    }
+    std::remove( path.c_str() );
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "gbnf.hpp"
+#include "gbnfcache.hpp"
+
+/*! Unit Tests for the EBNF -> BNF converter.
+ *  - Identical groups must share one generated rule.
+ *  - No group tokens must be left after conversion.
+ */
+
+static bool hasGroups( const gbnf::GbnfData& data ){
+    for( auto&& rule : data.grammarTableConst() ){
+        for( auto&& opt : rule.options ){
+            for( auto&& tok : opt.children ){
+                if( tok.type != gbnf::GrammarToken::TAG_ID &&
+                    tok.type != gbnf::GrammarToken::REGEX_STRING )
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing gbnf::convertToBNF ] ... ";
+
+    gbnf::GbnfData data;
+    std::istringstream strm(
+        "<a> ::= <x> { <y> <z> } { \",\" { <y> <z> } }? ;\n"
+        "<b> ::= { <y> <z> }* { <y> <z> } ;\n"
+        "<c> ::= { <y> <z> }+ { \";\" }? ;\n"
+        "<d> ::= { <y> { <z> }? }* { <y> { <z> }? } ;\n"
+        "<x> ::= \"x\" ; <y> ::= \"y\" ; <z> ::= \"z\" ;\n" );
+    gbnf::convertToGbnf( data, strm );
+
+    const size_t tagCount = data.tagTableConst().size();
+    gbnf::convertToBNF( data );
+
+    assert( !hasGroups( data ) );
+
+    // Rules for "{ <y> <z> }", "{ "," { <y> <z> } }", and one for both repeats.
+    // For <d>, the group "{ <y> { <z> }? }" has two options, so it's also 
+    // the body rule of the repeat.
+    assert( data.tagTableConst().size() == tagCount + 5 );
+    assert( data.grammarTableConst().size() == tagCount + 5 );
+
+    // <a> gets an option without the optional part, and <c> without the ";".
+    auto a = data.getRule( data.getTagIDfromTable( "a", false ) );
+    assert( a->options.size() == 2 );
+    assert( a->options[0].children.size() == 3 && a->options[1].children.size() == 2 );
+    assert( a->options[0].children[1].id == a->options[1].children[1].id );
+
+    auto c = data.getRule( data.getTagIDfromTable( "c", false ) );
+    assert( c->options.size() == 2 && c->options[1].children.size() == 1 );
+
+    std::cout<<"[ Success! ]\n";
+
+    std::cout<<"[ Testing gbnf::fixRecursion ] ... ";
+
+    gbnf::GbnfData rec;
+    std::istringstream recStrm(
+        "<e> ::= <e> \"\\+\" <t> | <t> ;\n"
+        "<t> ::= <t> \"\\*\" <f> | <f> ;\n"
+        "<f> ::= \"\\(\" <e> \"\\)\" | \"n\" ;\n"
+        "<a> ::= <b> \"x\" | \"y\" ;\n"
+        "<b> ::= <a> \"z\" | <c> ;\n"
+        "<c> ::= <b> | \"w\" ;\n" );
+    gbnf::convertToGbnf( rec, recStrm );
+
+    // Components: <e>, <t>, and <a> <b> <c>. 
+    auto report = gbnf::fixRecursion( rec, gbnf::FIX_LEFT_RECURSION );
+    assert( report.components.size() == 3 );
+    assert( report.components[2].rules.size() == 3 );
+
+    // Tails are created only for rules starting with themselves after expansion.
+    auto e = rec.getRule( rec.getTagIDfromTable( "e", false ) );
+    auto eTail = rec.getRule( rec.getTagIDfromTable( "e__tail", false ) );
+    assert( e->options.size() == 1 && e->options[0].children.back().id == eTail->getID() );
+    assert( eTail->options.size() == 2 && eTail->options[0].children.size() == 3 );
+    assert( eTail->options[1].children.empty() );
+
+    // No left recursion is left.
+    assert( gbnf::fixRecursion( rec, gbnf::FIX_LEFT_RECURSION ).components.empty() );
+
+    // Right recursion. Tails are right-recursive, so use other grammar.
+    gbnf::GbnfData right;
+    std::istringstream rightStrm( "<r> ::= \"x\" <r> | \"y\" ;\n" );
+    gbnf::convertToGbnf( right, rightStrm );
+
+    report = gbnf::fixRecursion( right, gbnf::FIX_RIGHT_RECURSION );
+    assert( report.components.size() == 1 && report.components[0].newRules == 1 );
+    auto r = right.getRule( right.getTagIDfromTable( "r", false ) );
+    assert( r->options.size() == 1 && r->options[0].children.back().type == 
+            gbnf::GrammarToken::REGEX_STRING );
+
+    // Grammar must be BNF.
+    bool thrown = false;
+    try{
+        gbnf::GbnfData ebnf;
+        std::istringstream ebnfStrm( "<a> ::= <a> { \"x\" }* | \"y\" ;\n" );
+        gbnf::convertToGbnf( ebnf, ebnfStrm );
+        gbnf::fixRecursion( ebnf );
+    } catch( const std::exception& ){
+        thrown = true;
+    }
+    assert( thrown );
+
+    std::cout<<"[ Success! ]\n";
+    std::cout<<"[ Testing gbnf::optimizeGrammar ] ... ";
+
+    gbnf::GbnfData opt;
+    std::istringstream optStrm(
+        "<s> ::= <a> \"x\" \"y\" \"1\" | <a> \"x\" \"y\" \"2\" | <u1> | \"z\" <l2> | \"w\" <bad> ;\n"
+        "<a> ::= \"a\" ;\n"
+        "<u1> ::= <u2> ;\n"
+        "<u2> ::= <l1> ;\n"
+        "<l1> ::= \"k\" <l1> | \"m\" ;\n"
+        "<l2> ::= \"k\" <l2> | \"m\" ;\n"
+        "<dead> ::= \"q\" ;\n"
+        "<bad> ::= <bad> \"r\" ;\n" );
+    gbnf::convertToGbnf( opt, optStrm );
+
+    auto optReport = gbnf::optimizeGrammar( opt );
+    assert( optReport.passes.size() == 4 );
+    assert( optReport.passes[0].pass == gbnf::OPTIMIZE_REMOVE_DEAD_RULES &&
+            optReport.passes[0].rulesBefore == 8 && optReport.passes[0].rulesAfter == 6 );
+
+    // <s>, <l2>, and the factored suffix rule are left.
+    assert( opt.grammarTableConst().size() == 3 );
+    assert( opt.getTagIDfromTable( "dead", false ) == (size_t)(-1) );
+
+    // Tag IDs are given in order of appearance, so <l1> is merged into <l2>.
+    size_t l2 = opt.getTagIDfromTable( "l2", false );
+    assert( opt.getTagIDfromTable( "l1", false ) == (size_t)(-1) );
+    auto s = opt.getRule( opt.getTagIDfromTable( "s", false ) );
+    auto fact = opt.getRule( opt.getTagIDfromTable( "s__fact", false ) );
+    assert( s->options.size() == 3 && fact->options.size() == 2 );
+    assert( s->options[0].children.size() == 4 && s->options[0].children[0].data == "a" &&
+            s->options[0].children[3].id == fact->getID() );
+    assert( s->options[1].children.size() == 1 && s->options[1].children[0].id == l2 );
+    assert( s->options[2].children[1].id == l2 );
+
+    // Passes can be run separately. Nothing's left to do.
+    optReport = gbnf::optimizeGrammar( opt, gbnf::OPTIMIZE_LEFT_FACTOR );
+    assert( optReport.passes.size() == 1 && optReport.passes[0].rulesAfter == 3 );
+
+    // Split rules are merged, so no option of theirs is lost.
+    gbnf::GbnfData splitDead;
+    std::istringstream splitDeadStrm( "<s> ::= <a> ;\n"
+                                      "<a> ::= \"x\" <b> ;\n"
+                                      "<a> ::= \"y\" ;\n"
+                                      "<b> ::= \"z\" ;\n" );
+    gbnf::convertToGbnf( splitDead, splitDeadStrm );
+    gbnf::optimizeGrammar( splitDead, gbnf::OPTIMIZE_REMOVE_DEAD_RULES );
+    assert( splitDead.grammarTableConst().size() == 3 );
+    assert( splitDead.getRule( splitDead.getTagIDfromTable( "a", false ) )->options.size() == 2 );
+    assert( splitDead.getTagIDfromTable( "b", false ) != (size_t)(-1) );
+
+    gbnf::GbnfData splitUnit;
+    std::istringstream splitUnitStrm( "<s> ::= <a> <c> ;\n"
+                                      "<a> ::= \"x\" ;\n"
+                                      "<a> ::= \"y\" ;\n"
+                                      "<c> ::= \"q\" ;\n" );
+    gbnf::convertToGbnf( splitUnit, splitUnitStrm );
+    gbnf::optimizeGrammar( splitUnit, gbnf::OPTIMIZE_INLINE_UNIT_RULES );
+    size_t splitA = splitUnit.getTagIDfromTable( "a", false );
+    auto splitS = splitUnit.getRule( splitUnit.getTagIDfromTable( "s", false ) );
+    assert( splitUnit.grammarTableConst().size() == 2 && splitA != (size_t)(-1) );
+    assert( splitUnit.getRule( splitA )->options.size() == 2 );
+    assert( splitS->options[0].children[0].id == splitA && 
+            splitS->options[0].children[1].data == "q" );
+
+    std::cout<<"[ Success! ]\n";
+    std::cout<<"[ Testing parallel gbnf::convertToBNF ] ... ";
+
+    // Rules sharing groups across the thread ranges, with nested, repeated and optional groups.
+    const char* groups[] = { "{ \"a\" <x> }", "{ \"b\" { \"c\" }? <y> }*", "{ <x> { <y> \"d\" }+ }?",
+                             "{ \"e\" }+", "{ { \"f\" <x> }* \"g\" }", "{ \"b\" { \"c\" }? <y> }" };
+    std::ostringstream big;
+    for( size_t i = 0; i < 300; i++ ){
+        big<<"<r"<< i <<"> ::= \"s\" "<< groups[ i % 6 ] <<" <r"<< ( i * 7 ) % 300 <<"> "<< 
+             groups[ ( i / 6 ) % 6 ] <<" | "<< groups[ ( i * 5 ) % 6 ] <<" \"t\" ;\n";
+    }
+
+    gbnf::GbnfData serial;
+    std::istringstream serialStrm( big.str() );
+    gbnf::convertToGbnf( serial, serialStrm );
+    gbnf::convertToBNF( serial );
+    assert( !hasGroups( serial ) );
+
+    for( size_t threads = 2; threads <= 8; threads++ ){
+        gbnf::GbnfData parallel;
+        std::istringstream parallelStrm( big.str() );
+        gbnf::convertToGbnf( parallel, parallelStrm );
+        gbnf::convertToBNF( parallel, false, 0, threads );
+
+        assert( gbnf::getFingerprint( parallel ) == gbnf::getFingerprint( serial ) );
+        assert( parallel.tagTableConst().size() == serial.tagTableConst().size() );
+        for( size_t i = 0; i < serial.tagTableConst().size(); i++ ){
+            assert( parallel.tagTableConst()[ i ].getID() == serial.tagTableConst()[ i ].getID() &&
+                    parallel.tagTableConst()[ i ].data == serial.tagTableConst()[ i ].data );
+        }
+    }
+
+    std::cout<<"[ Success! ]\n";
+    std::cout<<"[ Testing gbnf::IncrementalConverter ] ... ";
+
+    // Same grammar, with rule <r5> edited.
+    std::ostringstream edited;
+    {
+        std::string text = big.str();
+        size_t begin = text.find( "<r5> ::=" );
+        size_t end = text.find( '\n', begin );
+        edited<< text.substr( 0, begin ) <<"<r5> ::= \"s\" "<< groups[ 0 ] <<" <r35> ;"<< 
+                 text.substr( end );
+    }
+
+    gbnf::IncrementalConverter inc( false, gbnf::FIX_LEFT_RECURSION );
+    gbnf::IncrementalConverter::Report incReport;
+
+    for( size_t step = 0; step < 4; step++ ){
+        const std::string& text = ( step % 2 ? edited.str() : big.str() );
+
+        gbnf::GbnfData source, full;
+        std::istringstream sourceStrm( text ), fullStrm( text );
+        gbnf::convertToGbnf( source, sourceStrm );
+        gbnf::convertToGbnf( full, fullStrm );
+        gbnf::convertToBNF( full );
+        gbnf::fixRecursion( full, gbnf::FIX_LEFT_RECURSION );
+
+        const uint64_t sourceFingerprint = gbnf::getFingerprint( source );
+        const gbnf::GbnfData& res = inc.build( source, &incReport );
+        assert( gbnf::getFingerprint( source ) == sourceFingerprint );
+        assert( gbnf::getFingerprint( res ) == gbnf::getFingerprint( full ) );
+
+        if( step == 0 ){
+            assert( incReport.convertedRules == 300 && incReport.changed.size() == 300 );
+            continue;
+        }
+
+        // Only <r5> is converted again. <r215> references it.
+        // Conversions of the rules not present in the last build are dropped.
+        size_t r5 = source.getTagIDfromTable( "r5", false );
+        size_t r215 = source.getTagIDfromTable( "r215", false );
+        assert( incReport.changed.size() == 1 && incReport.changed[0] == r5 );
+        assert( incReport.convertedRules == 1 );
+        assert( incReport.removed.empty() && incReport.resultChanged );
+        assert( std::find( incReport.affected.begin(), incReport.affected.end(), r215 ) != 
+                incReport.affected.end() );
+    }
+
+    // Nothing changed - the result is reused.
+    {
+        gbnf::GbnfData source;
+        std::istringstream sourceStrm( edited.str() );
+        gbnf::convertToGbnf( source, sourceStrm );
+        inc.build( source, &incReport );
+        assert( incReport.changed.empty() && incReport.convertedRules == 0 && 
+                !incReport.resultChanged );
+    }
+
+    std::cout<<"[ Success! ]\n";
+    std::cout<<"[ Testing gbnf::mergeGrammars ] ... ";
+
+    std::vector< gbnf::GbnfData > parts( 2 );
+    std::istringstream partStrm1( "<decl> ::= \"var\" <ident> | <x> ;\n<x> ::= \"x\" ;\n" );
+    std::istringstream partStrm2( "<ident> ::= \"[a-z]+\" ;\n<x> ::= \"y\" ;\n" );
+    gbnf::convertToGbnf( parts[0], partStrm1 );
+    gbnf::convertToGbnf( parts[1], partStrm2 );
+
+    gbnf::GbnfData merged;
+    auto conflicts = gbnf::mergeGrammars( merged, parts );
+    assert( conflicts.size() == 1 && conflicts[0].tag == "x" && 
+            conflicts[0].definedIn == 0 && conflicts[0].redefinedIn == 1 );
+
+    // One ID space: <ident> used by the first grammar is defined by the second.
+    assert( merged.tagTableConst().size() == 3 && merged.grammarTableConst().size() == 3 );
+    size_t ident = merged.getTagIDfromTable( "ident", false );
+    auto decl = merged.getRule( merged.getTagIDfromTable( "decl", false ) );
+    assert( decl->options[0].children[1].id == ident );
+    assert( merged.getRule( ident )->getID() == ident );
+    assert( merged.getRule( merged.getTagIDfromTable( "x", false ) )->options[0]
+                .children[0].data == "x" );
+
+    // Rule split in one file isn't a conflict. Redefinition in other file is.
+    std::vector< gbnf::GbnfData > splits( 2 );
+    std::istringstream splitStrm1( "<a> ::= \"x\" ;\n<a> ::= \"y\" ;\n" );
+    std::istringstream splitStrm2( "<a> ::= \"z\" ;\n" );
+    gbnf::convertToGbnf( splits[0], splitStrm1 );
+    gbnf::convertToGbnf( splits[1], splitStrm2 );
+
+    gbnf::GbnfData splitMerged;
+    conflicts = gbnf::mergeGrammars( splitMerged, splits );
+    assert( conflicts.size() == 1 && conflicts[0].tag == "a" &&
+            conflicts[0].definedIn == 0 && conflicts[0].redefinedIn == 1 );
+
+    size_t splitOptions = 0;
+    for( auto&& rule : splitMerged.grammarTableConst() ){
+        for( auto&& opt : rule.options ){
+            assert( opt.children[0].data != "z" );
+            splitOptions++;
+        }
+    }
+    assert( splitOptions == 2 );
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
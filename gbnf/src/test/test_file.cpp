@@ -0,0 +1,121 @@
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <fstream>
+#include <cassert>
+#include "gbnf.hpp"
+#include "gbnffile.hpp"
+
+/*! Unit Tests for the binary gBNF file format.
+ */
+
+const char* testGrammar =
+    "<list> ::= <item> {\",\" <item>}* @list | \"\\(\" <list> \"\\)\" ;\n"
+    "<item> ::= \"[a-z]+\" | { <item> \"[0-9]\" }+ ;\n";
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing gbnf::GbnfFile ] ... ";
+
+    gbnf::GbnfData data;
+    std::istringstream strm( testGrammar );
+    gbnf::convertToGbnf( data, strm );
+
+    const std::string path = "gbnf_test_grammar.gbnf";
+    {
+        std::ofstream out( path, std::ios::out | std::ios::binary | std::ios::trunc );
+        gbnf::writeGbnfFile( data, out );
+    }
+
+    gbnf::GbnfFile file;
+    assert( file.open( path ) );
+    const gbnf::GbnfFileView& view = file.view();
+    assert( view.tagCount() == 2 && view.ruleCount() == 2 );
+    assert( view.flags() == data.flags );
+
+    // Views point straight into the file.
+    size_t listID = data.getTagIDfromTable( "list", false );
+    gbnf::GbnfRuleView list;
+    assert( !view.findRule( 100, list ) );
+    assert( view.findRule( listID, list ) && list.optionCount == 2 );
+
+    gbnf::GbnfOptionView opt;
+    gbnf::GbnfFileView::readOption( list.options, opt );
+    assert( std::string( opt.action, opt.actionLength ) == "list" );
+
+    gbnf::GbnfTokenView tok;
+    const char* next = gbnf::GbnfFileView::readToken( opt.tokens, tok );
+    assert( tok.type == gbnf::GrammarToken::TAG_ID );
+    gbnf::GbnfFileView::readToken( next, tok );
+    assert( tok.type == gbnf::GrammarToken::GROUP_REPEAT_NONE && tok.childCount == 2 );
+    gbnf::GbnfFileView::readToken( tok.children, tok );
+    assert( std::string( tok.data, tok.dataLength ) == "," );
+
+    // Roundtrip.
+    gbnf::GbnfData restored;
+    view.toGbnfData( restored );
+    assert( gbnf::getFingerprint( data ) == gbnf::getFingerprint( restored ) );
+
+    gbnf::GbnfData reused;
+    reused.insertTag( "old" );
+    reused.insertRule( gbnf::GrammarRule( 1 ) );
+    view.toGbnfData( reused );
+    assert( gbnf::getFingerprint( data ) == gbnf::getFingerprint( reused ) );
+
+    // Corrupted data is rejected.
+    std::ostringstream out;
+    gbnf::writeGbnfFile( data, out );
+    std::string bytes = out.str();
+    bool thrown = false;
+    try{
+        gbnf::GbnfFileView bad( bytes.data(), bytes.size() - 1 );
+    } catch( const std::exception& e ){
+        thrown = true;
+    }
+    assert( thrown );
+
+    // 32-bit IDs. Small IDs and sizes take one byte, so the tag table of
+    // the test grammar is [id]["list\0"][id]["item\0"].
+    assert( (unsigned char)bytes[ 15 ] == data.tagTableConst()[0].getID() && 
+            bytes[ 16 ] == 'l' && (unsigned char)bytes[ 21 ] == data.tagTableConst()[1].getID() );
+
+    gbnf::GbnfData big;
+    const size_t bigIDs[] = { 200, 70000, 3000000000u };
+    for( size_t id : bigIDs )
+        big.insertTag( id, "tag_" + std::to_string( id ) );
+    big.insertRule( gbnf::GrammarRule( 3000000000u, { 
+        gbnf::GrammarToken( gbnf::GrammarToken::ROOT_TOKEN, 0, "", {
+            gbnf::GrammarToken( gbnf::GrammarToken::TAG_ID, 70000, "", {} ),
+            gbnf::GrammarToken( gbnf::GrammarToken::REGEX_STRING, 0, std::string( 300, 'x' ), {} ) 
+        } ) } ) );
+    big.insertRule( gbnf::GrammarRule( 200, { 
+        gbnf::GrammarToken( gbnf::GrammarToken::ROOT_TOKEN, 0, "", {
+            gbnf::GrammarToken( gbnf::GrammarToken::TAG_ID, 3000000000u, "", {} ) } ) } ) );
+
+    std::ostringstream bigOut;
+    gbnf::writeGbnfFile( big, bigOut );
+    std::string bigBytes = bigOut.str();
+
+    gbnf::GbnfFileView bigView( bigBytes.data(), bigBytes.size() );
+    assert( bigView.tag( 2 ).id == 3000000000u && bigView.rule( 1 ).id == 3000000000u );
+
+    gbnf::GbnfData bigRestored;
+    bigView.toGbnfData( bigRestored );
+    assert( gbnf::getFingerprint( big ) == gbnf::getFingerprint( bigRestored ) );
+    assert( bigRestored.getLastTagID() == 3000000000u );
+
+    // IDs over 32 bits don't fit.
+    thrown = false;
+    try{
+        big.insertTag( (size_t)1 << 33, "too_big" );
+        std::ostringstream tooBig;
+        gbnf::writeGbnfFile( big, tooBig );
+    } catch( const std::exception& e ){
+        thrown = true;
+    }
+    assert( thrown );
+
+    std::remove( path.c_str() );
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
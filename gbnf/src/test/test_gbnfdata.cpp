@@ -0,0 +1,199 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <cassert>
+#include <algorithm>
+#include "gbnf.hpp"
+#include "gbnfflat.hpp"
+
+/*! Unit Tests for the GbnfData tables.
+ */
+
+static void testTagIndex(){
+    const size_t TAG_COUNT = 50000;
+
+    gbnf::GbnfData data;
+    for( size_t i = 0; i < TAG_COUNT; i++ )
+        data.insertTag( "tag_" + std::to_string( i ) );
+
+    // Lookups by name.
+    assert( data.getTagIDfromTable( "tag_0", false ) == 1 );
+    assert( data.getTagIDfromTable( "tag_31337", false ) == 31338 );
+    assert( data.getTagIDfromTable( "nope", false ) == (size_t)(-1) );
+
+    // Insert if not present.
+    size_t id = data.getTagIDfromTable( "nope", true );
+    assert( id == TAG_COUNT + 1 );
+    assert( data.getTagIDfromTable( "nope", true ) == id );
+
+    // Removal keeps the index in sync.
+    data.removeTag( 31338 );
+    assert( data.getTagIDfromTable( "tag_31337", false ) == (size_t)(-1) );
+    assert( data.getTagIDfromTable( "tag_31338", false ) == 31339 );
+
+    // Copies own their index.
+    gbnf::GbnfData copy = data;
+    data.removeTag( 10 );
+    assert( copy.getTagIDfromTable( "tag_8", false ) == 9 );
+    assert( copy.getTagIDfromTable( "tag_9", false ) == 10 );
+    assert( data.getTagIDfromTable( "tag_9", false ) == (size_t)(-1) );
+
+    gbnf::GbnfData moved = std::move( copy );
+    assert( moved.getTagIDfromTable( "tag_9", false ) == 10 );
+    assert( moved.insertTag( "new" ) == TAG_COUNT + 2 );
+
+    // Initializer-list construction builds the index.
+    gbnf::GbnfData init( 0, { gbnf::NonTerminal( 1, "a" ), gbnf::NonTerminal( 2, "b" ) }, {} );
+    assert( init.getTagIDfromTable( "b", false ) == 2 );
+    assert( init.insertTag( "c" ) == 3 );
+}
+
+static void testLookupByID(){
+    gbnf::GbnfData data;
+    for( size_t i = 0; i < 100; i++ ){
+        size_t id = data.insertTag( "t" + std::to_string( i ) );
+        data.insertRule( gbnf::GrammarRule( id ) );
+    }
+    data.sort();
+
+    // Fast path: IDs start at 1.
+    assert( data.getTag( 1 ) == data.tagTableConst().begin() );
+    assert( data.getTag( 42 )->getID() == 42 );
+    assert( data.getRule( 42 )->getID() == 42 );
+
+    // After removal, the lookups fall back to binary search.
+    data.removeTag( 10 );
+    data.removeRule( 10 );
+    assert( data.getTag( 42 )->getID() == 42 );
+    assert( data.getRule( 42 )->getID() == 42 );
+    assert( data.getRule( 9 )->getID() == 9 );
+}
+
+template< class Storage >
+static void testStoragePolicy(){
+    gbnf::BasicGbnfData< Storage > data;
+    for( size_t i = 0; i < 100; i++ ){
+        size_t id = data.insertTag( "t" + std::to_string( i ) );
+        data.insertRule( gbnf::GrammarRule( 101 - id ) );
+    }
+    data.insertRule( gbnf::GrammarRule( 42, { gbnf::GrammarToken() } ) );
+
+    data.sort();
+    auto dup = data.getRule( 42 );
+    assert( dup->getID() == 42 && ( dup - 1 )->getID() == 41 );
+    assert( data.getTag( 7 )->data == "t6" );
+    assert( data.getRule( 500 ) == data.grammarTableConst().end() );
+
+    // Removals keep the index in sync.
+    data.removeRule( 42 );
+    data.removeRule( 42 );
+    data.removeTag( 7 );
+    assert( data.getRule( 42 ) == data.grammarTableConst().end() || 
+            data.getRule( 42 )->getID() != 42 );
+    assert( data.getRule( 43 )->getID() == 43 );
+    assert( data.getTag( 8 )->data == "t7" );
+    data.removeRulesIf( []( const gbnf::GrammarRule& r ){ return r.getID() % 2; } );
+    assert( data.getRule( 44 )->getID() == 44 );
+
+    // Sparse IDs.
+    data.insertTag( 3000000000u, "far" );
+    assert( data.getTag( 3000000000u )->data == "far" );
+    assert( data.getTag( 8 )->data == "t7" );
+    assert( data.getTagIDfromTable( "far", false ) == 3000000000u );
+}
+
+static void testBatch(){
+    const size_t RULE_COUNT = 200000;
+
+    gbnf::GbnfData data;
+    for( size_t i = 0; i < RULE_COUNT; i++ ){
+        size_t id = data.insertTag( "t" + std::to_string( i ) );
+        data.insertRule( gbnf::GrammarRule( id ) );
+    }
+
+    // Remove every second rule and tag, insert rules for new tags, and a duplicate.
+    auto batch = data.batch();
+    for( size_t id = 2; id <= RULE_COUNT; id += 2 ){
+        batch.removeRule( id );
+        batch.removeTag( id );
+    }
+    for( size_t i = 0; i < 1000; i++ )
+        batch.insertRule( gbnf::GrammarRule( batch.insertTag( "n" + std::to_string( i ) ) ) );
+    batch.insertRule( gbnf::GrammarRule( 5, { gbnf::GrammarToken() } ) );
+    batch.removeRule( RULE_COUNT + 1 ); // Queued rules are not affected.
+
+    // Nothing is removed before the commit.
+    assert( data.grammarTableConst().size() == RULE_COUNT );
+    batch.commit();
+
+    assert( data.isSorted() );
+    assert( data.grammarTableConst().size() == RULE_COUNT / 2 + 1001 );
+    assert( data.tagTableConst().size() == RULE_COUNT / 2 + 1000 );
+    assert( std::is_sorted( data.grammarTableConst().begin(), data.grammarTableConst().end() ) );
+    assert( data.getRule( 4 ) == data.grammarTableConst().end() || data.getRule( 4 )->getID() != 4 );
+    assert( data.getTagIDfromTable( "t3", false ) == (size_t)(-1) );
+    assert( data.getTagIDfromTable( "t4", false ) == 5 );
+    assert( data.getRule( RULE_COUNT + 1 )->getID() == RULE_COUNT + 1 );
+
+    // Present rules go before the inserted ones with the same ID.
+    auto five = data.getRule( 5 );
+    assert( five->options.empty() && ( five + 1 )->getID() == 5 && 
+            ( five + 1 )->options.size() == 1 );
+
+    // Batch can be reused.
+    batch.removeRule( 5 );
+    batch.commit();
+    assert( data.getRule( 5 ) == data.grammarTableConst().end() || data.getRule( 5 )->getID() != 5 );
+    assert( data.getRule( 7 )->getID() == 7 );
+}
+
+static void testFlatGrammar(){
+    std::istringstream strm(
+        "<list> ::= <item> {\",\" <item>}* @list | \"\\(\" <list> \"\\)\" ;\n"
+        "<item> ::= \"[a-z]+\" | { <item> \"[0-9]\" }+ ;\n" );
+
+    gbnf::GbnfData data;
+    gbnf::convertToGbnf( data, strm );
+
+    gbnf::FlatGrammar flat( data );
+    gbnf::GrammarView view = flat.view();
+
+    assert( view.ruleCount == 2 && view.tagCount == 2 );
+    const gbnf::FlatRule* list = view.getRule( data.getTagIDfromTable( "list", false ) );
+    assert( list && list->optionCount == 2 );
+    assert( view.actionName( view.option( *list, 0 ) ) == "list" );
+
+    const gbnf::FlatSymbol& group = view.symbol( view.option( *list, 0 ), 1 );
+    assert( group.type == gbnf::GrammarToken::GROUP_REPEAT_NONE && group.childCount == 2 );
+    assert( view.symbolData( view.child( group, 0 ) ) == "," );
+    assert( view.getRule( 100 ) == nullptr );
+
+    // Roundtrip.
+    gbnf::GbnfData restored;
+    gbnf::FlatGrammar::toGbnfData( view, restored );
+    assert( gbnf::getFingerprint( data ) == gbnf::getFingerprint( restored ) );
+
+    // Previous contents of the target are replaced, not merged.
+    gbnf::GbnfData reused;
+    reused.insertTag( "old" );
+    reused.insertTag( "older" );
+    reused.insertRule( gbnf::GrammarRule( 1 ) );
+    gbnf::FlatGrammar::toGbnfData( view, reused );
+    assert( gbnf::getFingerprint( data ) == gbnf::getFingerprint( reused ) );
+    assert( reused.getTagIDfromTable( "old", false ) == (size_t)(-1) );
+}
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing gbnf::GbnfData ] ... ";
+
+    testTagIndex();
+    testLookupByID();
+    testStoragePolicy< gbnf::SortedVectorStorage >();
+    testStoragePolicy< gbnf::DenseIndexStorage >();
+    testStoragePolicy< gbnf::FlatHashStorage >();
+    testBatch();
+    testFlatGrammar();
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
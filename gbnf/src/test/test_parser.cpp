@@ -0,0 +1,85 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cassert>
+#include "gbnf.hpp"
+#include "gbnfcache.hpp"
+
+/*! Unit Tests for the EBNF parser.
+ *  - Grammar is bigger than the scanner's block, so tags, strings
+ *    and comments get split between the blocks.
+ *  - Parallel parsing must give the same result as the serial one.
+ */
+
+const size_t RULE_COUNT = 5000;
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing gbnf::convertToGbnf ] ... ";
+
+    std::ostringstream grammar;
+    for( size_t i = 0; i < RULE_COUNT; i++ ){
+        grammar << "# Rule number "<< i <<"\n"
+                << "<rule_"<< i <<"> ::= \"str\\\"ing_"<< i <<"\" { <rule_"<< i+1 <<"> # in group; not an end\n"
+                << "    \",\" }* @act_"<< i <<" | <end> \";\" ;\n";
+    }
+
+    gbnf::GbnfData data;
+    std::istringstream strm( grammar.str() );
+    gbnf::convertToGbnf( data, strm );
+
+    assert( data.grammarTableConst().size() == RULE_COUNT );
+    assert( data.tagTableConst().size() == RULE_COUNT + 2 );
+
+    for( size_t i = 0; i < RULE_COUNT; i += 997 ){
+        auto rule = data.getRule( data.getTagIDfromTable( "rule_"+std::to_string(i), false ) );
+        assert( rule != data.grammarTableConst().end() && rule->options.size() == 2 );
+
+        const gbnf::GrammarToken& opt = rule->options[0];
+        assert( opt.data == "act_"+std::to_string(i) );
+        assert( opt.children.size() == 2 );
+        assert( opt.children[0].data == "str\\\"ing_"+std::to_string(i) );
+        assert( opt.children[1].type == gbnf::GrammarToken::GROUP_REPEAT_NONE );
+        assert( opt.children[1].children.size() == 2 );
+    }
+
+    // Errors report the location.
+    std::string what;
+    try{
+        gbnf::GbnfData bad;
+        std::istringstream badStrm( "<a> ::= <b> ;\n<c> ::= <d e> ;\n" );
+        gbnf::convertToGbnf( bad, badStrm );
+    } catch( const std::exception& e ){
+        what = e.what();
+    }
+    assert( what.find( "[2:11]" ) == 0 );
+
+    std::cout<<"[ Success! ]\n";
+    std::cout<<"[ Testing parallel gbnf::convertToGbnf ] ... ";
+
+    for( size_t threads = 2; threads <= 8; threads += 3 ){
+        gbnf::GbnfData parallel;
+        std::istringstream parStrm( grammar.str() );
+        gbnf::convertToGbnf( parallel, parStrm, 0, threads );
+
+        assert( gbnf::getFingerprint( parallel ) == gbnf::getFingerprint( data ) );
+        assert( parallel.tagTableConst().size() == data.tagTableConst().size() );
+        for( size_t i = 0; i < data.tagTableConst().size(); i++ ){
+            assert( parallel.tagTableConst()[ i ].getID() == data.tagTableConst()[ i ].getID() &&
+                    parallel.tagTableConst()[ i ].data == data.tagTableConst()[ i ].data );
+        }
+    }
+
+    // Errors in the later parts report the location in the whole input.
+    std::string parWhat;
+    try{
+        gbnf::GbnfData bad;
+        std::istringstream badStrm( grammar.str() + "<c> ::= <d e> ;\n" );
+        gbnf::convertToGbnf( bad, badStrm, 0, 4 );
+    } catch( const std::exception& e ){
+        parWhat = e.what();
+    }
+    assert( parWhat.find( "["+ std::to_string( RULE_COUNT * 3 + 1 ) +":11]" ) == 0 );
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cassert>
+#include "gbnf.hpp"
+#include "gbnfcache.hpp"
+#include "gbnfsnapshot.hpp"
+
+/*! Unit Tests for the grammar snapshots.
+ *  - Versions must share the rules they don't change.
+ *  - Older versions must stay unchanged.
+ */
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing gbnf::GrammarSnapshot ] ... ";
+
+    gbnf::GbnfData data;
+    std::istringstream strm(
+        "<s> ::= <a> { \",\" <a> }* ;\n"
+        "<a> ::= <a> \"\\+\" <b> | <b> ;\n"
+        "<b> ::= \"x\" | \"y\" ;\n"
+        "<c> ::= \"z\" ;\n" );
+    gbnf::convertToGbnf( data, strm );
+    const uint64_t fingerprint = gbnf::getFingerprint( data );
+
+    const gbnf::GrammarSnapshot v1( data );
+    assert( v1.ruleCount() == 4 && gbnf::getFingerprint( v1.toGbnfData() ) == fingerprint );
+
+    // Transformation shares the untouched rules. Only <s> has a group.
+    auto v2 = v1.transform( []( gbnf::GbnfData& d ){ gbnf::convertToBNF( d ); } );
+    assert( v2.ruleCount() == 5 && v2.countSharedRules( v1 ) == 3 );
+    assert( v2.getTag( v2.getLastTagID() ) != nullptr );
+
+    // Only the rules with groups are given to the pass. Result is the same,
+    // and the other rules aren't even compared.
+    auto hasGroups = []( const gbnf::GrammarRule& rule ){
+        for( auto&& opt : rule.options ){
+            for( auto&& tok : opt.children ){
+                if( tok.type != gbnf::GrammarToken::TAG_ID && 
+                    tok.type != gbnf::GrammarToken::REGEX_STRING )
+                    return true;
+            }
+        }
+        return false;
+    };
+    size_t passRules = 0;
+    auto v2s = v1.transform( hasGroups, [ &passRules ]( gbnf::GbnfData& d ){ 
+        passRules = d.grammarTableConst().size();
+        gbnf::convertToBNF( d ); } );
+    assert( passRules == 1 );
+    assert( v2s.ruleCount() == 5 && v2s.countSharedRules( v1 ) == 3 );
+    assert( gbnf::getFingerprint( v2s.toGbnfData() ) == gbnf::getFingerprint( v2.toGbnfData() ) );
+
+    // Pass can remove the selected rules.
+    auto noC = v1.transform( [ &v1 ]( const gbnf::GrammarRule& rule ){ 
+            return rule.getID() == v1.getTagID( "c" ); },
+        []( gbnf::GbnfData& d ){ d.removeRulesIf( []( const gbnf::GrammarRule& ){ return true; } ); } );
+    assert( noC.ruleCount() == 3 && noC.countSharedRules( v1 ) == 3 && !noC.getRule( v1.getTagID( "c" ) ) );
+
+    auto v3 = v2.transform( []( gbnf::GbnfData& d ){ 
+        gbnf::fixRecursion( d, gbnf::FIX_LEFT_RECURSION ); } );
+    size_t a = v3.getTagID( "a" ), b = v3.getTagID( "b" );
+    assert( v3.getRule( a ) != v2.getRule( a ) && v3.getRule( b ) == v2.getRule( b ) );
+    assert( v3.getTagID( "a__tail" ) != (size_t)(-1) && v2.getTagID( "a__tail" ) == (size_t)(-1) );
+
+    // Edits.
+    size_t d = 0;
+    auto v4 = v3.withTag( "d", &d ).withRule( gbnf::GrammarRule( d, { 
+        gbnf::GrammarToken( gbnf::GrammarToken::ROOT_TOKEN, 0, "", {
+            gbnf::GrammarToken( gbnf::GrammarToken::REGEX_STRING, 0, "w", {} ) } ) } ) );
+    auto v5 = v4.withoutRule( v4.getTagID( "c" ) );
+
+    assert( v4.getRule( d ) && v4.getRule( d )->options[0].children[0].data == "w" );
+    assert( !v3.getRule( d ) && v3.getTagID( "d" ) == (size_t)(-1) );
+    assert( v5.ruleCount() == v4.ruleCount() - 1 && v5.countSharedRules( v4 ) == v5.ruleCount() );
+    assert( v4.getRule( v4.getTagID( "c" ) ) != nullptr );
+
+    // Older versions are unchanged.
+    assert( gbnf::getFingerprint( v1.toGbnfData() ) == fingerprint );
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
@@ -0,0 +1,341 @@
+#include "ast.h"
+
+namespace gpar{
+namespace ast{
+
+const char* opString(Op op){
+    switch(op){
+    case Op::Add:       return "+";
+    case Op::Sub:       return "-";
+    case Op::Mul:       return "*";
+    case Op::Div:       return "/";
+    case Op::Mod:       return "%";
+    case Op::Shl:       return "<<";
+    case Op::Shr:       return ">>";
+    case Op::BitAnd:    return "&";
+    case Op::BitOr:     return "|";
+    case Op::BitXor:    return "^";
+    case Op::LogAnd:    return "&&";
+    case Op::LogOr:     return "||";
+    case Op::Eq:        return "==";
+    case Op::Ne:        return "!=";
+    case Op::Lt:        return "<";
+    case Op::Gt:        return ">";
+    case Op::Le:        return "<=";
+    case Op::Ge:        return ">=";
+    case Op::Neg:       return "-";
+    case Op::Plus:      return "+";
+    case Op::Not:       return "!";
+    case Op::BitNot:    return "~";
+    case Op::Deref:     return "*";
+    case Op::AddrOf:    return "&";
+    case Op::PreInc:    return "++";
+    case Op::PreDec:    return "--";
+    case Op::PostInc:   return "post++";
+    case Op::PostDec:   return "post--";
+    case Op::SizeOf:    return "sizeof";
+    case Op::Assign:    return "=";
+    default:            return "";
+    }
+}
+
+static const char* typeString(TypeKind kind){
+    switch(kind){
+    case TypeKind::Char:    return "char";
+    case TypeKind::Int:     return "int";
+    case TypeKind::Int16:   return "int16";
+    case TypeKind::Int32:   return "int32";
+    case TypeKind::Int64:   return "int64";
+    case TypeKind::Float:   return "float";
+    case TypeKind::Double:  return "double";
+    case TypeKind::Void:    return "void";
+    case TypeKind::Fun:     return "fun";
+    case TypeKind::Var:     return "var";
+    default:                return "";
+    }
+}
+
+static void newLine(std::ostream& os, int indent){
+    os<<"\n"<<std::string(indent, ' ');
+}
+
+void CompilationUnit::dump(std::ostream& os) const {
+    for(uint32_t i = 0; i < topLevel.count; i++){
+        dumpDecl(os, at(topLevel, i), 0);
+        os<<"\n";
+    }
+}
+
+/*! Type, as in the source. Qualified ones are parenthesized.
+ */
+void CompilationUnit::dumpType(std::ostream& os, NodeIndex i) const {
+    const Type& t = types[ i ];
+    if(t.qualifiers)
+        os<<"("<<(t.qualifiers & Type::CONST ? "const " : "")
+          <<(t.qualifiers & Type::VOLATILE ? "volatile " : "");
+
+    if(t.kind == TypeKind::Named)
+        os<<text(t.text);
+    else
+        os<<typeString(t.kind);
+
+    for(uint32_t d = 0; d < t.dims.count; d++){
+        os<<"[";
+        if(at(t.dims, d) != NO_NODE)
+            dumpExpr(os, at(t.dims, d));
+        os<<"]";
+    }
+    os<<std::string(t.pointers, '*');
+    if(t.qualifiers)
+        os<<")";
+}
+
+void CompilationUnit::dumpExpr(std::ostream& os, NodeIndex i) const {
+    if(i == NO_NODE){
+        os<<"-";
+        return;
+    }
+
+    const Expr& e = exprs[ i ];
+    switch(e.kind){
+    case ExprKind::Ident:
+    case ExprKind::Integer:
+    case ExprKind::Float:
+        os<<text(e.text);
+        break;
+    case ExprKind::Char:
+        os<<"'"<<text(e.text)<<"'";
+        break;
+    case ExprKind::String:
+        os<<"\""<<text(e.text)<<"\"";
+        break;
+    case ExprKind::Binary:
+        os<<"("<<opString(e.op)<<" ";
+        dumpExpr(os, e.a);
+        os<<" ";
+        dumpExpr(os, e.b);
+        os<<")";
+        break;
+    case ExprKind::Unary:
+        os<<"("<<opString(e.op)<<" ";
+        dumpExpr(os, e.a);
+        os<<")";
+        break;
+    case ExprKind::Cast:
+        os<<"(cast ";
+        dumpType(os, e.a);
+        os<<" ";
+        dumpExpr(os, e.b);
+        os<<")";
+        break;
+    case ExprKind::Call:
+        os<<"(call ";
+        dumpExpr(os, e.a);
+        for(uint32_t k = 0; k < e.list.count; k++){
+            os<<" ";
+            dumpExpr(os, at(e.list, k));
+        }
+        os<<")";
+        break;
+    case ExprKind::Index:
+        os<<"(index ";
+        dumpExpr(os, e.a);
+        os<<" ";
+        dumpExpr(os, e.b);
+        os<<")";
+        break;
+    case ExprKind::Member:
+        os<<"("<<(e.flag ? "->" : ".")<<" ";
+        dumpExpr(os, e.a);
+        os<<" "<<text(e.text)<<")";
+        break;
+    case ExprKind::Assign:
+        os<<"("<<opString(e.op)<<"= ";
+        dumpExpr(os, e.a);
+        os<<" ";
+        dumpExpr(os, e.b);
+        os<<")";
+        break;
+    case ExprKind::Init:
+        os<<"(init";
+        for(uint32_t k = 0; k < e.list.count; k++){
+            os<<" ";
+            dumpExpr(os, at(e.list, k));
+        }
+        os<<")";
+        break;
+    case ExprKind::RangeExpr:
+        os<<"(.. ";
+        dumpExpr(os, e.a);
+        os<<" ";
+        dumpExpr(os, e.b);
+        os<<")";
+        break;
+    case ExprKind::Print:
+        os<<(e.flag ? "(println " : "(print ");
+        dumpExpr(os, e.a);
+        os<<")";
+        break;
+    }
+}
+
+void CompilationUnit::dumpStmt(std::ostream& os, NodeIndex i, int indent) const {
+    if(i == NO_NODE){
+        os<<"-";
+        return;
+    }
+
+    const Stmt& s = stmts[ i ];
+    switch(s.kind){
+    case StmtKind::Block:
+        os<<"(block";
+        for(uint32_t k = 0; k < s.list.count; k++){
+            newLine(os, indent + 2);
+            dumpStmt(os, at(s.list, k), indent + 2);
+        }
+        os<<")";
+        break;
+    case StmtKind::If:
+        os<<"(if ";
+        dumpExpr(os, s.a);
+        newLine(os, indent + 2);
+        dumpStmt(os, s.b, indent + 2);
+        if(s.c != NO_NODE){
+            newLine(os, indent + 2);
+            dumpStmt(os, s.c, indent + 2);
+        }
+        os<<")";
+        break;
+    case StmtKind::Switch:
+        os<<"(switch ";
+        dumpExpr(os, s.a);
+        for(uint32_t k = 0; k < s.list.count; k++){
+            newLine(os, indent + 2);
+            dumpStmt(os, at(s.list, k), indent + 2);
+        }
+        os<<")";
+        break;
+    case StmtKind::Case:
+        if(s.a == NO_NODE)
+            os<<"(default";
+        else{
+            os<<"(case ";
+            dumpExpr(os, s.a);
+        }
+        for(uint32_t k = 0; k < s.list.count; k++){
+            newLine(os, indent + 2);
+            dumpStmt(os, at(s.list, k), indent + 2);
+        }
+        os<<")";
+        break;
+    case StmtKind::While:
+        os<<"(while ";
+        dumpExpr(os, s.a);
+        newLine(os, indent + 2);
+        dumpStmt(os, s.b, indent + 2);
+        os<<")";
+        break;
+    case StmtKind::For:
+        os<<"(for ";
+        dumpExpr(os, s.a);
+        os<<" ";
+        dumpExpr(os, s.b);
+        os<<" ";
+        dumpExpr(os, s.c);
+        newLine(os, indent + 2);
+        dumpStmt(os, s.d, indent + 2);
+        os<<")";
+        break;
+    case StmtKind::Foreach:
+        os<<"(foreach "<<text(s.text)<<" ";
+        dumpExpr(os, s.a);
+        newLine(os, indent + 2);
+        dumpStmt(os, s.b, indent + 2);
+        os<<")";
+        break;
+    case StmtKind::Break:
+        os<<"(break)";
+        break;
+    case StmtKind::Goto:
+        os<<"(goto "<<text(s.text)<<")";
+        break;
+    case StmtKind::Return:
+        os<<"(return";
+        if(s.a != NO_NODE){
+            os<<" ";
+            dumpExpr(os, s.a);
+        }
+        os<<")";
+        break;
+    case StmtKind::Label:
+        os<<"(label "<<text(s.text)<<")";
+        break;
+    case StmtKind::VarDecl:
+        dumpDecl(os, s.a, indent);
+        break;
+    case StmtKind::ExprStmt:
+        dumpExpr(os, s.a);
+        break;
+    }
+}
+
+void CompilationUnit::dumpDecl(std::ostream& os, NodeIndex i, int indent) const {
+    const Decl& d = decls[ i ];
+    const char* kinds[] = { "var", "fun", "class", "constructor", "destructor" };
+    os<<"("<<kinds[ (int)d.kind ];
+
+    const char* accesses[] = { "private", "protected", "public", "override", "final" };
+    for(int k = 0; k < 5; k++){
+        if(d.access & (1 << k))
+            os<<" :"<<accesses[ k ];
+    }
+    os<<" "<<text(d.name);
+
+    switch(d.kind){
+    case DeclKind::Variable:
+        os<<" ";
+        dumpType(os, d.type);
+        if(d.init != NO_NODE){
+            os<<" ";
+            dumpExpr(os, d.init);
+        }
+        break;
+    case DeclKind::Function:
+    case DeclKind::Constructor:
+    case DeclKind::Destructor:
+        if(d.kind != DeclKind::Destructor){
+            os<<" (";
+            for(uint32_t k = 0; k < d.params.count; k++){
+                if(k) os<<" ";
+                dumpDecl(os, at(d.params, k), indent);
+            }
+            os<<")";
+        }
+        if(d.type != NO_NODE){
+            os<<" : ";
+            dumpType(os, d.type);
+        }
+        if(d.body != NO_NODE){
+            newLine(os, indent + 2);
+            dumpStmt(os, d.body, indent + 2);
+        }
+        break;
+    case DeclKind::Class:
+        if(d.bases.count){
+            os<<(d.implements ? " implements" : " extends");
+            for(uint32_t k = 0; k < d.bases.count; k++){
+                os<<" ";
+                dumpExpr(os, at(d.bases, k));
+            }
+        }
+        for(uint32_t k = 0; k < d.members.count; k++){
+            newLine(os, indent + 2);
+            dumpDecl(os, at(d.members, k), indent + 2);
+        }
+        break;
+    }
+    os<<")";
+}
+
+}
+}
@@ -0,0 +1,189 @@
+#ifndef AST_H_INCLUDED
+#define AST_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace gpar{
+namespace ast{
+
+/*! Grylang Abstract Syntax Tree.
+ *  - Nodes are plain structs, stored by value in the typed pools of their
+ *    CompilationUnit, and referred to by index into the pool.
+ *  - Child lists are index ranges in the unit's list pool. Pool of the
+ *    elements is given by the field (i.e. Block's list holds Stmt indexes).
+ *  - Names and literals are Text ranges of the unit's source - nothing is copied.
+ *  - No node owns anything, so a unit is freed by freeing it's pools.
+ */
+
+typedef uint32_t NodeIndex;
+const NodeIndex NO_NODE = 0xFFFFFFFF;
+
+struct Text{
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+struct Range{
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+enum class Op : uint8_t {
+    None = 0,
+    // Binary.
+    Add, Sub, Mul, Div, Mod, Shl, Shr, BitAnd, BitOr, BitXor,
+    LogAnd, LogOr, Eq, Ne, Lt, Gt, Le, Ge,
+    // Unary.
+    Neg, Plus, Not, BitNot, Deref, AddrOf, PreInc, PreDec, PostInc, PostDec, SizeOf,
+    // Assignment. Compound ones are Assign + binary op.
+    Assign
+};
+
+enum class ExprKind : uint8_t {
+    Ident,      // text
+    Integer,    // text
+    Float,      // text
+    Char,       // text, without quotes. Escapes are kept.
+    String,     // text, without quotes. Escapes are kept.
+    Binary,     // op, a, b
+    Unary,      // op, a
+    Cast,       // a: Type, b: operand
+    Call,       // a: callee, list: arguments
+    Index,      // a: array, b: index (or NO_NODE)
+    Member,     // a: object, text: member name, flag: "->"
+    Assign,     // op: None, or the op of compound assignment. a: target, b: value
+    Init,       // list: elements
+    RangeExpr,  // a .. b
+    Print       // a: argument, flag: println
+};
+
+struct Expr{
+    ExprKind kind;
+    Op op = Op::None;
+    bool flag = false;      // Member: "->". Print: println.
+    NodeIndex a = NO_NODE;
+    NodeIndex b = NO_NODE;
+    Range list;
+    Text text;
+};
+
+enum class StmtKind : uint8_t {
+    Block,      // list: statements
+    If,         // a: condition, b: then, c: else (or NO_NODE)
+    Switch,     // a: expression, list: Case statements
+    Case,       // a: expression (NO_NODE for default), list: statements
+    While,      // a: condition (or NO_NODE), b: body
+    For,        // a: init, b: condition, c: step (each can be NO_NODE), d: body
+    Foreach,    // text: variable, a: expression, b: body
+    Break,
+    Goto,       // text: label
+    Return,     // a: expression (or NO_NODE)
+    Label,      // text: label
+    VarDecl,    // a: Decl
+    ExprStmt    // a: expression
+};
+
+struct Stmt{
+    StmtKind kind;
+    NodeIndex a = NO_NODE;
+    NodeIndex b = NO_NODE;
+    NodeIndex c = NO_NODE;
+    NodeIndex d = NO_NODE;
+    Range list;
+    Text text;
+};
+
+enum class TypeKind : uint8_t {
+    Char, Int, Int16, Int32, Int64, Float, Double, Void, Fun, Var,
+    Named // text: class name
+};
+
+struct Type{
+    TypeKind kind;
+    uint8_t qualifiers = 0;
+    uint8_t pointers = 0;
+    Text text;
+    Range dims; // Array dimension Exprs. NO_NODE for an unsized dimension.
+
+    const static uint8_t CONST    = 1;
+    const static uint8_t VOLATILE = 2;
+};
+
+enum class DeclKind : uint8_t {
+    Variable,       // type, name, init (or NO_NODE)
+    Function,       // name, params: Variable Decls, type: return type (or NO_NODE),
+                    // body: Block Stmt (or NO_NODE for a declaration)
+    Class,          // name, bases: Ident Exprs, members: Decls
+    Constructor,    // name, params, body (or NO_NODE)
+    Destructor      // name, body (or NO_NODE)
+};
+
+struct Decl{
+    DeclKind kind;
+    uint8_t access = 0;         // Access flags, for class members.
+    bool implements = false;    // Class: "implements" instead of "extends".
+    Text name;
+    NodeIndex type = NO_NODE;
+    NodeIndex init = NO_NODE;   // Variable: initializer.
+    NodeIndex body = NO_NODE;
+    Range params;
+    Range bases;
+    Range members;
+
+    const static uint8_t PRIVATE   = 1;
+    const static uint8_t PROTECTED = 2;
+    const static uint8_t PUBLIC    = 4;
+    const static uint8_t OVERRIDE  = 8;
+    const static uint8_t FINAL     = 16;
+};
+
+/*! Compilation Unit - the source, and the AST parsed from it.
+ *  - Pools are the arenas of the nodes. Nodes are trivially destructible,
+ *    so freeing the unit frees a few blocks, regardless of the tree size.
+ */
+class CompilationUnit{
+public:
+    std::string source;
+
+    std::vector< Expr > exprs;
+    std::vector< Stmt > stmts;
+    std::vector< Decl > decls;
+    std::vector< Type > types;
+    std::vector< NodeIndex > lists;
+
+    Range topLevel; // Decls.
+
+    CompilationUnit(){}
+    explicit CompilationUnit(std::string&& src) : source( std::move(src) ) {}
+
+    inline std::string text(Text t) const { return source.substr( t.offset, t.length ); }
+    inline bool textIs(Text t, const char* str) const {
+        return source.compare( t.offset, t.length, str ) == 0;
+    }
+    inline NodeIndex at(Range r, size_t i) const { return lists[ r.first + i ]; }
+
+    /*! Frees the tree, keeping the source.
+     */
+    void clearTree(){
+        exprs.clear(); stmts.clear(); decls.clear(); types.clear(); lists.clear();
+        topLevel = Range();
+    }
+
+    /*! Prints the tree as S-expressions, for debugging and testing.
+     */
+    void dump(std::ostream& os) const;
+    void dumpExpr(std::ostream& os, NodeIndex i) const;
+    void dumpStmt(std::ostream& os, NodeIndex i, int indent) const;
+    void dumpDecl(std::ostream& os, NodeIndex i, int indent) const;
+    void dumpType(std::ostream& os, NodeIndex i) const;
+};
+
+const char* opString(Op op);
+
+}
+}
+
+#endif //AST_H_INCLUDED
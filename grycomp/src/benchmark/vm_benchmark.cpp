@@ -0,0 +1,85 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../grylangparser.h"
+#include "../compiler.h"
+#include "../vm.h"
+
+/*! VM dispatch benchmark.
+ *  - Runs the Grylang programs (spec/bench/ by default) with the threaded and
+ *    the switch dispatch, and prints the best time of a few runs for each.
+ *  - Output of the programs is captured, and must be the same for both.
+ *
+ *  Usage: vm_benchmark [program.gg ...]
+ */
+
+const int RUNS = 3;
+
+static double runProgram( const gpar::vm::Program& program, gpar::vm::VM::Dispatch dispatch,
+                          std::string& output ){
+    using namespace std::chrono;
+    double best = 1e30;
+    for( int i = 0; i < RUNS; i++ ){
+        std::ostringstream os;
+        gpar::vm::VM vm( program, os );
+        vm.setDispatch( dispatch );
+
+        high_resolution_clock::time_point t1 = high_resolution_clock::now();
+        vm.run();
+        high_resolution_clock::time_point t2 = high_resolution_clock::now();
+
+        best = std::min( best, duration_cast<duration<double>>( t2 - t1 ).count() );
+        output = os.str();
+    }
+    return best;
+}
+
+int main( int argc, char** argv ){
+    std::vector<std::string> files;
+    for( int i = 1; i < argc; i++ )
+        files.push_back( argv[i] );
+    if( files.empty() )
+        files = { "../spec/bench/loops.gg", "../spec/bench/calls.gg", 
+                  "../spec/bench/strings.gg", "../spec/bench/sieve.gg" };
+
+    if( !gpar::vm::VM::threadedAvailable() )
+        std::cout << "Threaded dispatch is not available - switch dispatch only.\n";
+
+    for( auto&& file : files ){
+        std::ifstream strm( file, std::ios::binary );
+        if( !strm ){
+            std::cout << file << ": can't open\n";
+            return 1;
+        }
+        std::ostringstream contents;
+        contents << strm.rdbuf();
+
+        gpar::ast::CompilationUnit unit( contents.str() );
+        gpar::vm::Program program;
+        try{
+            gpar::GrylangParser( unit ).parse();
+            gpar::vm::BytecodeCompiler( unit, program ).compile();
+        } catch( std::exception& e ){
+            std::cout << file << ":" << e.what() << "\n";
+            return 1;
+        }
+
+        std::string switchOutput, threadedOutput;
+        double switchTime = runProgram( program, gpar::vm::VM::Dispatch::Switch, switchOutput );
+        std::cout << file << "\n  switch:   " << switchTime << " s\n";
+
+        if( gpar::vm::VM::threadedAvailable() ){
+            double threadedTime = runProgram( program, gpar::vm::VM::Dispatch::Threaded, threadedOutput );
+            std::cout << "  threaded: " << threadedTime << " s (" 
+                      << ( switchTime / threadedTime ) << "x)\n";
+            if( threadedOutput != switchOutput ){
+                std::cout << "  Outputs differ!\n";
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "bytecode.h"
+#include <iomanip>
+
+namespace gpar{
+namespace vm{
+
+const char* opcodeName(Opcode op){
+    static const char* const names[] = {
+    #define GRY_OPCODE_NAME(name) #name,
+        GRY_OPCODES(GRY_OPCODE_NAME)
+    #undef GRY_OPCODE_NAME
+    };
+    return (op < Opcode::COUNT ? names[ (int)op ] : "?");
+}
+
+void printValue(std::ostream& os, const Value& v){
+    switch(v.type){
+    case Value::Nil:
+        os<<"nil";
+        break;
+    case Value::Int:
+        os<<v.i;
+        break;
+    case Value::Float:
+        os<<v.f;
+        break;
+    case Value::Char:
+        os<<(char)v.i;
+        break;
+    case Value::String:
+        os<<stringOf(v);
+        break;
+    case Value::Array:{
+        os<<"[";
+        const std::vector<Value>& elems = arrayOf(v);
+        for(size_t i = 0; i < elems.size(); i++){
+            if(i) os<<", ";
+            printValue(os, elems[i]);
+        }
+        os<<"]";
+        break;
+    }
+    }
+}
+
+/*! Prints the functions' code, with jump targets and constants resolved.
+ */
+void Program::disassemble(std::ostream& os) const {
+    for(size_t f = 0; f < functions.size(); f++){
+        const Function& fn = functions[f];
+        os<<"function "<<f<<" "<<fn.name<<" (params "<<fn.params
+          <<", registers "<<fn.frameSize<<")\n";
+
+        for(size_t pc = 0; pc < fn.code.size(); pc++){
+            Instr i = fn.code[pc];
+            Opcode op = opOf(i);
+            os<<std::setw(6)<<pc<<"  "<<std::left<<std::setw(8)<<opcodeName(op)<<std::right;
+
+            switch(op){
+            case Opcode::LOADK:
+                os<<argA(i)<<" "<<argBx(i)<<"\t; ";
+                if(constants[ argBx(i) ].type == Value::String)
+                    os<<"\""<<stringOf(constants[ argBx(i) ])<<"\"";
+                else
+                    printValue(os, constants[ argBx(i) ]);
+                break;
+            case Opcode::GETG:
+            case Opcode::SETG:
+                os<<argA(i)<<" "<<argBx(i)<<"\t; "<<globalNames[ argBx(i) ];
+                break;
+            case Opcode::CALL:
+                os<<argA(i)<<" "<<argBx(i)<<"\t; "<<functions[ argBx(i) ].name;
+                break;
+            case Opcode::LOADI:
+                os<<argA(i)<<" "<<argSBx(i);
+                break;
+            case Opcode::JMP:
+                os<<argSBx(i)<<"\t; to "<<(long)pc + 1 + argSBx(i);
+                break;
+            case Opcode::JMPT:
+            case Opcode::JMPF:
+                os<<argA(i)<<" "<<argSBx(i)<<"\t; to "<<(long)pc + 1 + argSBx(i);
+                break;
+            case Opcode::NOP:
+            case Opcode::RETNIL:
+                break;
+            default:
+                os<<argA(i)<<" "<<argB(i)<<" "<<argC(i);
+            }
+            os<<"\n";
+        }
+    }
+}
+
+}
+}
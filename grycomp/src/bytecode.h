@@ -0,0 +1,191 @@
+#ifndef BYTECODE_H_INCLUDED
+#define BYTECODE_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+
+namespace gpar{
+namespace vm{
+
+/*! Grylang bytecode.
+ *  - Register-based: every function has a frame of up to 256 registers.
+ *    Params are the first registers, then locals, then temporaries.
+ *  - Instructions are 32 bits: opcode, and A, B, C bytes. Bx is B and C
+ *    as one 16-bit operand, sBx is Bx biased by 32767 (jump offsets, small ints).
+ *  - Calls slide the register window: arguments are put in R[A]..., which
+ *    become the callee's first registers, and the result is returned in R[A].
+ */
+
+// Opcode list. Operands are given in the comments.
+#define GRY_OPCODES(X) \
+    X(NOP)      /*                                                       */ \
+    X(MOVE)     /* A B     R[A] = R[B]                                   */ \
+    X(LOADK)    /* A Bx    R[A] = K[Bx]                                  */ \
+    X(LOADI)    /* A sBx   R[A] = sBx                                    */ \
+    X(LOADNIL)  /* A       R[A] = nil                                    */ \
+    X(GETG)     /* A Bx    R[A] = G[Bx]                                  */ \
+    X(SETG)     /* A Bx    G[Bx] = R[A]                                  */ \
+    X(ADD)      /* A B C   R[A] = R[B] + R[C]. Strings are concatenated. */ \
+    X(SUB)      /* A B C   R[A] = R[B] - R[C]                            */ \
+    X(MUL)      /* A B C                                                 */ \
+    X(DIV)      /* A B C                                                 */ \
+    X(MOD)      /* A B C                                                 */ \
+    X(SHL)      /* A B C                                                 */ \
+    X(SHR)      /* A B C                                                 */ \
+    X(BAND)     /* A B C                                                 */ \
+    X(BOR)      /* A B C                                                 */ \
+    X(BXOR)     /* A B C                                                 */ \
+    X(EQ)       /* A B C   R[A] = R[B] == R[C]                           */ \
+    X(NE)       /* A B C                                                 */ \
+    X(LT)       /* A B C   R[A] = R[B] < R[C]. ">" swaps B and C.        */ \
+    X(LE)       /* A B C                                                 */ \
+    X(NEG)      /* A B     R[A] = -R[B]                                  */ \
+    X(NOT)      /* A B     R[A] = !R[B]                                  */ \
+    X(BNOT)     /* A B     R[A] = ~R[B]                                  */ \
+    X(BOOL)     /* A B     R[A] = R[B] ? 1 : 0                           */ \
+    X(INC)      /* A       R[A] += 1                                     */ \
+    X(DEC)      /* A       R[A] -= 1                                     */ \
+    X(CONV)     /* A B C   R[A] = (Conversion C) R[B]                    */ \
+    X(JMP)      /* sBx     pc += sBx                                     */ \
+    X(JMPT)     /* A sBx   if R[A] then pc += sBx                        */ \
+    X(JMPF)     /* A sBx   if !R[A] then pc += sBx                       */ \
+    X(NEWARR)   /* A B C   R[A] = array of R[B] elements of Conversion C */ \
+    X(INITARR)  /* A B C   R[A] = array of R[B]...R[B+C-1]               */ \
+    X(GETIDX)   /* A B C   R[A] = R[B][R[C]]                             */ \
+    X(SETIDX)   /* A B C   R[A][R[B]] = R[C]                             */ \
+    X(LEN)      /* A B     R[A] = length of R[B]                         */ \
+    X(CALL)     /* A Bx    R[A] = F[Bx](R[A]...)                         */ \
+    X(CALLB)    /* A B C   R[A] = Builtin B(R[A]...R[A+C-1])             */ \
+    X(RET)      /* A       return R[A]                                   */ \
+    X(RETNIL)   /*         return nil                                    */ \
+    X(PRINT)    /* A B     print R[A], and a newline if B                */
+
+enum class Opcode : uint8_t {
+#define GRY_OPCODE_ENUM(name) name,
+    GRY_OPCODES(GRY_OPCODE_ENUM)
+#undef GRY_OPCODE_ENUM
+    COUNT
+};
+
+const char* opcodeName(Opcode op);
+
+// Conversions of CONV and NEWARR.
+enum class Conversion : uint8_t {
+    None, ToInt, ToFloat, ToChar, ToString
+};
+
+enum class Builtin : uint8_t {
+    Rand, SRand, Len
+};
+
+typedef uint32_t Instr;
+
+const unsigned MAX_REGISTERS = 256;
+const int SBX_BIAS = 32767;
+const int SBX_MAX  = 32768;
+
+inline Instr encode(Opcode op, unsigned a, unsigned b = 0, unsigned c = 0){
+    return (Instr)op | (a << 8) | (b << 16) | (c << 24);
+}
+inline Instr encodeBx(Opcode op, unsigned a, unsigned bx){
+    return (Instr)op | (a << 8) | (bx << 16);
+}
+inline Instr encodeSBx(Opcode op, unsigned a, int sbx){
+    return encodeBx(op, a, (unsigned)(sbx + SBX_BIAS));
+}
+
+inline Opcode opOf(Instr i){ return (Opcode)(i & 0xFF); }
+inline unsigned argA(Instr i){ return (i >> 8) & 0xFF; }
+inline unsigned argB(Instr i){ return (i >> 16) & 0xFF; }
+inline unsigned argC(Instr i){ return i >> 24; }
+inline unsigned argBx(Instr i){ return i >> 16; }
+inline int argSBx(Instr i){ return (int)(i >> 16) - SBX_BIAS; }
+
+//=========================================//
+// Values
+
+struct Object;
+
+/*! Value of a register - 16 bytes, trivially copyable.
+ *  - Strings and arrays are Objects on the VM heap, collected by mark & sweep.
+ */
+struct Value{
+    enum Type : uint8_t {
+        Nil, Int, Float, Char, String, Array
+    };
+
+    Type type = Nil;
+    union{
+        int64_t i;
+        double f;
+        Object* obj;
+    };
+
+    Value() : i(0) {}
+
+    static inline Value integer(int64_t v){ Value r; r.type = Int; r.i = v; return r; }
+    static inline Value floating(double v){ Value r; r.type = Float; r.f = v; return r; }
+    static inline Value character(int64_t v){ Value r; r.type = Char; r.i = (unsigned char)v; return r; }
+    static inline Value object(Type t, Object* o){ Value r; r.type = t; r.obj = o; return r; }
+
+    inline bool isObject() const { return type >= String; }
+};
+
+struct Object{
+    enum Kind : uint8_t { StringObj, ArrayObj };
+
+    Kind kind;
+    bool marked = false;
+    bool constant = false;  // Program's constants - not on the heap, never collected.
+    Object* next = nullptr; // Heap list.
+
+    Object(Kind k) : kind(k) {}
+};
+
+struct StringObject : Object{
+    std::string data;
+    StringObject(std::string&& str) : Object(StringObj), data(std::move(str)) {}
+};
+
+struct ArrayObject : Object{
+    std::vector<Value> elems;
+    ArrayObject() : Object(ArrayObj) {}
+};
+
+inline std::string& stringOf(const Value& v){ return static_cast<StringObject*>(v.obj)->data; }
+inline std::vector<Value>& arrayOf(const Value& v){ return static_cast<ArrayObject*>(v.obj)->elems; }
+
+void printValue(std::ostream& os, const Value& v);
+
+//=========================================//
+// Program
+
+struct Function{
+    std::string name;
+    std::vector<Instr> code;
+    unsigned params = 0;
+    unsigned frameSize = 0; // Registers used.
+};
+
+/*! Compiled program - functions, constants and global count.
+ *  - initFunction initializes the globals, and is run before main.
+ */
+struct Program{
+    std::vector<Function> functions;
+    std::vector<Value> constants;
+    std::vector< std::unique_ptr<StringObject> > constantStrings;
+    std::vector<std::string> globalNames;
+
+    int initFunction = -1;
+    int mainFunction = -1;
+
+    void disassemble(std::ostream& os) const;
+};
+
+}
+}
+
+#endif //BYTECODE_H_INCLUDED
@@ -0,0 +1,876 @@
+#include "compiler.h"
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace gpar{
+namespace vm{
+
+using namespace ast;
+
+namespace{
+
+struct BuiltinFunction{
+    const char* name;
+    Builtin id;
+    unsigned params;
+};
+
+const BuiltinFunction builtins[] = {
+    {"rand", Builtin::Rand, 0}, {"srand", Builtin::SRand, 1}, {"len", Builtin::Len, 1}
+};
+
+}
+
+void BytecodeCompiler::error(const std::string& msg, Text at) const {
+    if(at.length == 0)
+        throw std::runtime_error(msg);
+
+    size_t line = 1, lineStart = 0;
+    for(size_t i = 0; i < at.offset; i++){
+        if(unit.source[i] == '\n'){
+            line++;
+            lineStart = i + 1;
+        }
+    }
+    throw std::runtime_error(std::to_string(line) + ":" + std::to_string(at.offset - lineStart + 1) +
+                             ": " + msg);
+}
+
+//=========================================//
+// Emitting
+
+size_t BytecodeCompiler::emit(Instr instr){
+    fn->code.push_back(instr);
+    return fn->code.size() - 1;
+}
+
+size_t BytecodeCompiler::emitJump(Opcode op, unsigned a){
+    return emit(encodeSBx(op, a, 0));
+}
+
+void BytecodeCompiler::patchJump(size_t pos, size_t target){
+    long offset = (long)target - (long)(pos + 1);
+    if(offset < -SBX_BIAS || offset > SBX_MAX)
+        error("Function " + fn->name + " is too long for a jump");
+
+    Instr instr = fn->code[pos];
+    fn->code[pos] = encodeSBx(opOf(instr), argA(instr), (int)offset);
+}
+
+void BytecodeCompiler::patchJumpHere(size_t pos){
+    patchJump(pos, fn->code.size());
+}
+
+unsigned BytecodeCompiler::allocReg(){
+    if(top >= MAX_REGISTERS)
+        error("Function " + fn->name + " needs more than " + std::to_string(MAX_REGISTERS) + " registers");
+    if(top + 1 > fn->frameSize)
+        fn->frameSize = top + 1;
+    return top++;
+}
+
+unsigned BytecodeCompiler::constant(const Value& v){
+    auto key = std::make_pair((int)v.type, v.i);
+    auto it = numberConstants.find(key);
+    if(it != numberConstants.end())
+        return it->second;
+
+    if(program.constants.size() > 0xFFFF)
+        error("Too many constants");
+    program.constants.push_back(v);
+    numberConstants[key] = (unsigned)(program.constants.size() - 1);
+    return (unsigned)(program.constants.size() - 1);
+}
+
+unsigned BytecodeCompiler::stringConstant(std::string&& str){
+    auto it = stringConstants.find(str);
+    if(it != stringConstants.end())
+        return it->second;
+
+    if(program.constants.size() > 0xFFFF)
+        error("Too many constants");
+    StringObject* obj = new StringObject(std::string(str));
+    obj->constant = true;
+    program.constantStrings.emplace_back(obj);
+    program.constants.push_back(Value::object(Value::String, obj));
+
+    unsigned index = (unsigned)(program.constants.size() - 1);
+    stringConstants.emplace(std::move(str), index);
+    return index;
+}
+
+void BytecodeCompiler::loadInteger(unsigned dst, int64_t value){
+    if(value >= -SBX_BIAS && value <= SBX_MAX)
+        emit(encodeSBx(Opcode::LOADI, dst, (int)value));
+    else
+        emit(encodeBx(Opcode::LOADK, dst, constant(Value::integer(value))));
+}
+
+//=========================================//
+// Names
+
+const BytecodeCompiler::Local* BytecodeCompiler::findLocal(Text name) const {
+    for(size_t i = locals.size(); i-- > 0; ){
+        const Text& t = locals[i].name;
+        if(t.length == name.length && unit.source.compare(t.offset, t.length, unit.source,
+                                                          name.offset, name.length) == 0)
+            return &locals[i];
+    }
+    return nullptr;
+}
+
+/*! Declares a local in the next register. Redeclaring a name shadows it.
+ */
+unsigned BytecodeCompiler::declareLocal(Text name){
+    unsigned reg = allocReg();
+    locals.push_back(Local{ name, reg });
+    return reg;
+}
+
+std::string BytecodeCompiler::unescape(Text text) const {
+    std::string str;
+    str.reserve(text.length);
+    for(size_t i = text.offset; i < text.offset + text.length; i++){
+        char c = unit.source[i];
+        if(c == '\\' && i + 1 < text.offset + text.length){
+            c = unit.source[++i];
+            switch(c){
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case '0': c = '\0'; break;
+            default: break; // \\, \', \" and others are the char itself.
+            }
+        }
+        str.push_back(c);
+    }
+    return str;
+}
+
+//=========================================//
+// Declarations
+
+void BytecodeCompiler::compile(){
+    collectTopLevel();
+    compileInit();
+    for(unsigned i = 0; i < functionDecls.size(); i++)
+        compileFunction(i);
+}
+
+/*! Creates the functions and globals, so they can be used before their declaration.
+ */
+void BytecodeCompiler::collectTopLevel(){
+    for(uint32_t i = 0; i < unit.topLevel.count; i++){
+        NodeIndex index = unit.at(unit.topLevel, i);
+        const Decl& d = unit.decls[index];
+        std::string name = unit.text(d.name);
+
+        if(d.kind == DeclKind::Function){
+            auto it = functionIndexes.find(name);
+            if(it == functionIndexes.end()){
+                functionIndexes[name] = (unsigned)functionDecls.size();
+                functionDecls.push_back(index);
+            }
+            else{ // Declaration and definition.
+                const Decl& prev = unit.decls[ functionDecls[it->second] ];
+                if(prev.body != NO_NODE && d.body != NO_NODE)
+                    error("Function " + name + " is defined twice", d.name);
+                if(prev.params.count != d.params.count)
+                    error("Function " + name + " is declared with other params", d.name);
+                if(d.body != NO_NODE)
+                    functionDecls[it->second] = index;
+            }
+        }
+        else if(d.kind == DeclKind::Variable){
+            if(globalIndexes.count(name))
+                error("Global " + name + " is defined twice", d.name);
+            if(program.globalNames.size() > 0xFFFF)
+                error("Too many globals", d.name);
+            globalIndexes[name] = (unsigned)program.globalNames.size();
+            program.globalNames.push_back(name);
+        }
+    }
+
+    program.functions.resize(functionDecls.size() + 1);
+    for(unsigned i = 0; i < functionDecls.size(); i++){
+        program.functions[i].name = unit.text( unit.decls[ functionDecls[i] ].name );
+        program.functions[i].params = unit.decls[ functionDecls[i] ].params.count;
+    }
+    program.initFunction = (int)functionDecls.size();
+    program.functions.back().name = "$init";
+
+    auto main = functionIndexes.find("main");
+    if(main != functionIndexes.end())
+        program.mainFunction = (int)main->second;
+}
+
+/*! Init function - evaluates the globals' initializers.
+ */
+void BytecodeCompiler::compileInit(){
+    fn = &program.functions[ program.initFunction ];
+    top = 0;
+    locals.clear();
+
+    for(uint32_t i = 0; i < unit.topLevel.count; i++){
+        const Decl& d = unit.decls[ unit.at(unit.topLevel, i) ];
+        if(d.kind != DeclKind::Variable)
+            continue;
+
+        unsigned reg = allocReg();
+        compileVariableInit(d, reg);
+        emit(encodeBx(Opcode::SETG, reg, globalIndexes[ unit.text(d.name) ]));
+        top = 0;
+    }
+    emit(encode(Opcode::RETNIL, 0));
+}
+
+void BytecodeCompiler::compileFunction(unsigned index){
+    const Decl& d = unit.decls[ functionDecls[index] ];
+    fn = &program.functions[index];
+    top = 0;
+    locals.clear();
+    labels.clear();
+    gotos.clear();
+    breakJumps.clear();
+
+    for(uint32_t i = 0; i < d.params.count; i++)
+        declareLocal( unit.decls[ unit.at(d.params, i) ].name );
+
+    if(d.body == NO_NODE){ // Declared only - calls are compile errors.
+        emit(encode(Opcode::RETNIL, 0));
+        return;
+    }
+
+    compileStatement(d.body);
+    emit(encode(Opcode::RETNIL, 0));
+
+    for(auto&& g : gotos){
+        auto label = labels.find(unit.text(g.label));
+        if(label == labels.end())
+            error("Label " + unit.text(g.label) + " is not defined", g.label);
+        patchJump(g.pos, label->second);
+    }
+}
+
+/*! Conversion making a value of the declared type.
+ */
+Conversion BytecodeCompiler::conversionOf(const Type& type) const {
+    if(type.pointers)
+        return Conversion::None;
+    if(type.dims.count) // Char arrays are strings. Copied, as literals are constant.
+        return (type.kind == TypeKind::Char ? Conversion::ToString : Conversion::None);
+
+    switch(type.kind){
+    case TypeKind::Char:
+        return Conversion::ToChar;
+    case TypeKind::Int:
+    case TypeKind::Int16:
+    case TypeKind::Int32:
+    case TypeKind::Int64:
+        return Conversion::ToInt;
+    case TypeKind::Float:
+    case TypeKind::Double:
+        return Conversion::ToFloat;
+    default:
+        return Conversion::None;
+    }
+}
+
+/*! Puts the variable's initial value into dst - the initializer converted to
+ *  the declared type, or the type's default.
+ */
+void BytecodeCompiler::compileVariableInit(const Decl& decl, unsigned dst){
+    const Type& type = unit.types[ decl.type ];
+    Conversion conv = conversionOf(type);
+
+    if(decl.init != NO_NODE){
+        compileExpr(decl.init, (int)dst);
+
+        // Literals of the declared type need no conversion.
+        ExprKind kind = unit.exprs[ decl.init ].kind;
+        if((conv == Conversion::ToInt && kind == ExprKind::Integer) ||
+           (conv == Conversion::ToFloat && kind == ExprKind::Float) ||
+           (conv == Conversion::ToChar && kind == ExprKind::Char))
+            return;
+        if(conv != Conversion::None)
+            emit(encode(Opcode::CONV, dst, dst, (unsigned)conv));
+        return;
+    }
+
+    if(type.dims.count){
+        if(type.dims.count > 1 || unit.at(type.dims, 0) == NO_NODE){
+            emit(encode(Opcode::LOADNIL, dst));
+            return;
+        }
+        Type elem = type;
+        elem.dims = Range();
+        unsigned mark = top;
+        unsigned size = compileAny( unit.at(type.dims, 0) );
+        emit(encode(Opcode::NEWARR, dst, size, (unsigned)conversionOf(elem)));
+        top = mark;
+        return;
+    }
+
+    switch(conv){
+    case Conversion::ToInt:
+        loadInteger(dst, 0);
+        break;
+    case Conversion::ToFloat:
+        emit(encodeBx(Opcode::LOADK, dst, constant(Value::floating(0))));
+        break;
+    case Conversion::ToChar:
+        emit(encodeBx(Opcode::LOADK, dst, constant(Value::character(0))));
+        break;
+    default:
+        emit(encode(Opcode::LOADNIL, dst));
+    }
+}
+
+//=========================================//
+// Statements
+
+void BytecodeCompiler::compileStatement(NodeIndex i){
+    const Stmt& s = unit.stmts[i];
+    unsigned mark = top;
+
+    switch(s.kind){
+    case StmtKind::Block:{
+        size_t localMark = locals.size();
+        for(uint32_t k = 0; k < s.list.count; k++)
+            compileStatement( unit.at(s.list, k) );
+        locals.resize(localMark);
+        break;
+    }
+    case StmtKind::If:{
+        size_t toElse = emitJump(Opcode::JMPF, compileAny(s.a));
+        top = mark;
+        compileStatement(s.b);
+        if(s.c != NO_NODE){
+            size_t toEnd = emitJump(Opcode::JMP);
+            patchJumpHere(toElse);
+            compileStatement(s.c);
+            patchJumpHere(toEnd);
+        }
+        else
+            patchJumpHere(toElse);
+        break;
+    }
+    case StmtKind::While:
+    case StmtKind::For:{
+        bool isFor = (s.kind == StmtKind::For);
+        NodeIndex cond = (isFor ? s.b : s.a);
+        if(isFor && s.a != NO_NODE){
+            compileExpr(s.a, DISCARD);
+            top = mark;
+        }
+
+        size_t start = fn->code.size();
+        size_t toEnd = 0;
+        if(cond != NO_NODE){
+            toEnd = emitJump(Opcode::JMPF, compileAny(cond));
+            top = mark;
+        }
+
+        breakJumps.emplace_back();
+        compileStatement(isFor ? s.d : s.b);
+        if(isFor && s.c != NO_NODE){
+            compileExpr(s.c, DISCARD);
+            top = mark;
+        }
+        patchJump(emitJump(Opcode::JMP), start);
+
+        if(cond != NO_NODE)
+            patchJumpHere(toEnd);
+        for(size_t pos : breakJumps.back())
+            patchJumpHere(pos);
+        breakJumps.pop_back();
+        break;
+    }
+    case StmtKind::Foreach:
+        compileForeach(s);
+        break;
+    case StmtKind::Switch:
+        compileSwitch(s);
+        break;
+    case StmtKind::Case:
+        error("Case outside of a switch");
+    case StmtKind::Break:
+        if(breakJumps.empty())
+            error("Break outside of a loop or switch");
+        breakJumps.back().push_back( emitJump(Opcode::JMP) );
+        break;
+    case StmtKind::Goto:
+        gotos.push_back(Goto{ s.text, emitJump(Opcode::JMP) });
+        break;
+    case StmtKind::Label:
+        if(!labels.emplace(unit.text(s.text), fn->code.size()).second)
+            error("Label " + unit.text(s.text) + " is defined twice", s.text);
+        break;
+    case StmtKind::Return:
+        if(s.a != NO_NODE)
+            emit(encode(Opcode::RET, compileAny(s.a)));
+        else
+            emit(encode(Opcode::RETNIL, 0));
+        break;
+    case StmtKind::VarDecl:{
+        // Initializer is compiled before declaring, so "int a = a" gets the outer a.
+        const Decl& d = unit.decls[ s.a ];
+        if(d.kind != DeclKind::Variable)
+            error("Only variables can be declared in a function", d.name);
+        unsigned reg = allocReg();
+        compileVariableInit(d, reg);
+        locals.push_back(Local{ d.name, reg });
+        mark = top = reg + 1;
+        break;
+    }
+    case StmtKind::ExprStmt:
+        compileExpr(s.a, DISCARD);
+        break;
+    }
+
+    // Locals declared by a statement which is not a block, i.e. "if(x) int y".
+    top = mark;
+    while(!locals.empty() && locals.back().reg >= top)
+        locals.pop_back();
+}
+
+/*! Switch. Cases are compared in order, and bodies fall through, as in C.
+ */
+void BytecodeCompiler::compileSwitch(const Stmt& s){
+    unsigned value = compileAny(s.a); // Stays allocated through the bodies.
+    unsigned mark = top;
+
+    std::vector<size_t> toCase( s.list.count );
+    int defaultCase = -1;
+    for(uint32_t k = 0; k < s.list.count; k++){
+        const Stmt& c = unit.stmts[ unit.at(s.list, k) ];
+        if(c.a == NO_NODE){
+            defaultCase = (int)k;
+            continue;
+        }
+        unsigned test = allocReg();
+        unsigned caseValue = compileAny(c.a);
+        emit(encode(Opcode::EQ, test, value, caseValue));
+        toCase[k] = emitJump(Opcode::JMPT, test);
+        top = mark;
+    }
+    size_t toDefault = emitJump(Opcode::JMP);
+
+    breakJumps.emplace_back();
+    size_t localMark = locals.size();
+    for(uint32_t k = 0; k < s.list.count; k++){
+        const Stmt& c = unit.stmts[ unit.at(s.list, k) ];
+        if((int)k == defaultCase)
+            patchJumpHere(toDefault);
+        else
+            patchJumpHere(toCase[k]);
+
+        for(uint32_t n = 0; n < c.list.count; n++)
+            compileStatement( unit.at(c.list, n) );
+    }
+    locals.resize(localMark);
+
+    if(defaultCase < 0)
+        patchJumpHere(toDefault);
+    for(size_t pos : breakJumps.back())
+        patchJumpHere(pos);
+    breakJumps.pop_back();
+}
+
+/*! Foreach over a range (a .. b, b excluded), or over the elements of
+ *  an array or string. The variable is a copy of a hidden counter, so the
+ *  body can't change the iteration.
+ */
+void BytecodeCompiler::compileForeach(const Stmt& s){
+    size_t localMark = locals.size();
+    size_t start, toEnd = 0;
+    bool infinite = (s.a == NO_NODE);
+
+    if(infinite){
+        start = fn->code.size();
+        breakJumps.emplace_back();
+        compileStatement(s.b);
+    }
+    else{
+        const Expr& e = unit.exprs[ s.a ];
+        bool isRange = (e.kind == ExprKind::RangeExpr);
+
+        unsigned counter = allocReg();
+        unsigned limit = allocReg();
+        unsigned collection = 0;
+        if(isRange){
+            compileExpr(e.a, (int)counter);
+            compileExpr(e.b, (int)limit);
+        }
+        else{
+            collection = allocReg();
+            compileExpr(s.a, (int)collection);
+            loadInteger(counter, 0);
+            emit(encode(Opcode::LEN, limit, collection));
+        }
+        unsigned var = declareLocal(s.text);
+        unsigned test = allocReg();
+
+        start = fn->code.size();
+        emit(encode(Opcode::LT, test, counter, limit));
+        toEnd = emitJump(Opcode::JMPF, test);
+        if(isRange)
+            emit(encode(Opcode::MOVE, var, counter));
+        else
+            emit(encode(Opcode::GETIDX, var, collection, counter));
+
+        breakJumps.emplace_back();
+        compileStatement(s.b);
+        emit(encode(Opcode::INC, counter));
+    }
+    patchJump(emitJump(Opcode::JMP), start);
+
+    if(!infinite)
+        patchJumpHere(toEnd);
+    for(size_t pos : breakJumps.back())
+        patchJumpHere(pos);
+    breakJumps.pop_back();
+    locals.resize(localMark);
+}
+
+//=========================================//
+// Expressions
+
+/*! Compiles the expression into a register.
+ *  @return the local's register for a local variable, or a new temporary.
+ */
+unsigned BytecodeCompiler::compileAny(NodeIndex i){
+    const Expr& e = unit.exprs[i];
+    if(e.kind == ExprKind::Ident){
+        const Local* local = findLocal(e.text);
+        if(local)
+            return local->reg;
+    }
+    else if(e.kind == ExprKind::Call){ // Result stays in the call's first register.
+        unsigned reg = top;
+        compileCall(e, (int)reg);
+        top = reg + 1;
+        return reg;
+    }
+    unsigned reg = allocReg();
+    compileExpr(i, (int)reg);
+    return reg;
+}
+
+/*! Compiles the expression into dst. If dst is DISCARD, only it's side
+ *  effects are compiled, if possible.
+ */
+void BytecodeCompiler::compileExpr(NodeIndex i, int dst){
+    const Expr& e = unit.exprs[i];
+    unsigned mark = top;
+
+    switch(e.kind){
+    case ExprKind::Ident:{
+        if(dst == DISCARD)
+            break;
+        const Local* local = findLocal(e.text);
+        if(local){
+            if(local->reg != (unsigned)dst)
+                emit(encode(Opcode::MOVE, dst, local->reg));
+            break;
+        }
+        auto global = globalIndexes.find(unit.text(e.text));
+        if(global == globalIndexes.end())
+            error("Variable " + unit.text(e.text) + " is not declared", e.text);
+        emit(encodeBx(Opcode::GETG, dst, global->second));
+        break;
+    }
+    case ExprKind::Integer:{
+        errno = 0;
+        long long value = std::strtoll(unit.text(e.text).c_str(), nullptr, 10);
+        if(errno == ERANGE)
+            error("Integer constant is too large", e.text);
+        if(dst != DISCARD)
+            loadInteger(dst, value);
+        break;
+    }
+    case ExprKind::Float:
+        if(dst != DISCARD)
+            emit(encodeBx(Opcode::LOADK, dst, constant(Value::floating(std::strtod(unit.text(e.text).c_str(), nullptr)))));
+        break;
+    case ExprKind::Char:{
+        std::string c = unescape(e.text);
+        if(c.size() != 1)
+            error("Char constant must have one char", e.text);
+        if(dst != DISCARD)
+            emit(encodeBx(Opcode::LOADK, dst, constant(Value::character(c[0]))));
+        break;
+    }
+    case ExprKind::String:
+        if(dst != DISCARD)
+            emit(encodeBx(Opcode::LOADK, dst, stringConstant(unescape(e.text))));
+        break;
+    case ExprKind::Binary:
+        if(e.op == Op::LogAnd || e.op == Op::LogOr)
+            compileLogical(e, dst);
+        else
+            compileBinary(e, dst);
+        break;
+    case ExprKind::Unary:
+        compileUnary(e, dst);
+        break;
+    case ExprKind::Cast:{
+        unsigned src = compileAny(e.b);
+        Conversion conv = conversionOf( unit.types[ e.a ] );
+        unsigned out = (dst == DISCARD ? allocReg() : (unsigned)dst);
+        if(conv != Conversion::None)
+            emit(encode(Opcode::CONV, out, src, (unsigned)conv));
+        else if(src != out)
+            emit(encode(Opcode::MOVE, out, src));
+        break;
+    }
+    case ExprKind::Call:
+        compileCall(e, dst);
+        break;
+    case ExprKind::Index:{
+        if(e.b == NO_NODE)
+            error("Index is missing");
+        unsigned array = compileAny(e.a);
+        unsigned index = compileAny(e.b);
+        emit(encode(Opcode::GETIDX, dst == DISCARD ? allocReg() : (unsigned)dst, array, index));
+        break;
+    }
+    case ExprKind::Member:
+        error("Class members are not supported by the bytecode compiler", e.text);
+    case ExprKind::Assign:
+        compileAssign(e, dst);
+        break;
+    case ExprKind::Init:{
+        unsigned first = top;
+        if(e.list.count >= MAX_REGISTERS)
+            error("Initializer list is too long");
+        for(uint32_t k = 0; k < e.list.count; k++)
+            compileExpr( unit.at(e.list, k), (int)allocReg() );
+        emit(encode(Opcode::INITARR, dst == DISCARD ? first : (unsigned)dst, first, e.list.count));
+        break;
+    }
+    case ExprKind::RangeExpr:
+        error("Ranges are only supported in foreach");
+    case ExprKind::Print:
+        emit(encode(Opcode::PRINT, compileAny(e.a), e.flag ? 1 : 0));
+        if(dst != DISCARD)
+            emit(encode(Opcode::LOADNIL, dst));
+        break;
+    }
+    top = mark;
+}
+
+static Opcode binaryOpcode(Op op){
+    switch(op){
+    case Op::Add:    return Opcode::ADD;
+    case Op::Sub:    return Opcode::SUB;
+    case Op::Mul:    return Opcode::MUL;
+    case Op::Div:    return Opcode::DIV;
+    case Op::Mod:    return Opcode::MOD;
+    case Op::Shl:    return Opcode::SHL;
+    case Op::Shr:    return Opcode::SHR;
+    case Op::BitAnd: return Opcode::BAND;
+    case Op::BitOr:  return Opcode::BOR;
+    case Op::BitXor: return Opcode::BXOR;
+    case Op::Eq:     return Opcode::EQ;
+    case Op::Ne:     return Opcode::NE;
+    case Op::Lt:
+    case Op::Gt:     return Opcode::LT;
+    case Op::Le:
+    case Op::Ge:     return Opcode::LE;
+    default:         return Opcode::NOP;
+    }
+}
+
+void BytecodeCompiler::compileBinary(const Expr& e, int dst){
+    unsigned b = compileAny(e.a);
+    unsigned c = compileAny(e.b);
+    if(e.op == Op::Gt || e.op == Op::Ge)
+        std::swap(b, c);
+
+    Opcode op = binaryOpcode(e.op);
+    if(op == Opcode::NOP)
+        error(std::string("Operator ") + opString(e.op) + " is not binary");
+    emit(encode(op, dst == DISCARD ? allocReg() : (unsigned)dst, b, c));
+}
+
+/*! && and || - the right side is evaluated only if needed. Result is 0 or 1.
+ *  Computed in a temporary, as dst can be a variable used by the right side.
+ */
+void BytecodeCompiler::compileLogical(const Expr& e, int dst){
+    unsigned result = allocReg();
+    compileExpr(e.a, (int)result);
+    size_t toEnd = emitJump(e.op == Op::LogAnd ? Opcode::JMPF : Opcode::JMPT, result);
+    compileExpr(e.b, (int)result);
+    patchJumpHere(toEnd);
+    if(dst != DISCARD)
+        emit(encode(Opcode::BOOL, dst, result));
+}
+
+void BytecodeCompiler::compileUnary(const Expr& e, int dst){
+    Opcode op;
+    switch(e.op){
+    case Op::PreInc:
+    case Op::PreDec:
+    case Op::PostInc:
+    case Op::PostDec:
+        compileIncDec(e, dst);
+        return;
+    case Op::Neg:    op = Opcode::NEG; break;
+    case Op::Not:    op = Opcode::NOT; break;
+    case Op::BitNot: op = Opcode::BNOT; break;
+    case Op::SizeOf: op = Opcode::LEN; break;
+    case Op::Plus:   op = Opcode::MOVE; break;
+    default:
+        error(std::string("Operator ") + opString(e.op) + " is not supported by the bytecode compiler");
+    }
+
+    unsigned src = compileAny(e.a);
+    if(dst == DISCARD || (op == Opcode::MOVE && src == (unsigned)dst))
+        return;
+    emit(encode(op, dst, src));
+}
+
+/*! Call of a function or a builtin. Arguments are put in the registers
+ *  starting at the first free one, which then gets the result.
+ */
+void BytecodeCompiler::compileCall(const Expr& e, int dst){
+    const Expr& callee = unit.exprs[ e.a ];
+    if(callee.kind != ExprKind::Ident)
+        error("Only functions can be called");
+    std::string name = unit.text(callee.text);
+    if(findLocal(callee.text))
+        error("Calling function values is not supported", callee.text);
+
+    unsigned params = 0;
+    Instr call;
+    auto fun = functionIndexes.find(name);
+    if(fun != functionIndexes.end()){
+        if(unit.decls[ functionDecls[ fun->second ] ].body == NO_NODE)
+            error("Function " + name + " is declared, but not defined", callee.text);
+        params = program.functions[ fun->second ].params;
+        call = encodeBx(Opcode::CALL, top, fun->second);
+    }
+    else{
+        const BuiltinFunction* builtin = nullptr;
+        for(auto&& b : builtins){
+            if(name == b.name)
+                builtin = &b;
+        }
+        if(!builtin)
+            error("Function " + name + " is not declared", callee.text);
+        params = builtin->params;
+        call = encode(Opcode::CALLB, top, (unsigned)builtin->id, params);
+    }
+    if(params != e.list.count)
+        error("Function " + name + " takes " + std::to_string(params) + " arguments", callee.text);
+
+    unsigned base = allocReg();
+    for(uint32_t k = 0; k < e.list.count; k++)
+        compileExpr( unit.at(e.list, k), (int)(k == 0 ? base : allocReg()) );
+    emit(call);
+
+    if(dst != DISCARD && (unsigned)dst != base)
+        emit(encode(Opcode::MOVE, dst, base));
+}
+
+void BytecodeCompiler::compileAssign(const Expr& e, int dst){
+    LValue lv = compileLValue(e.a);
+    Opcode op = (e.op == Op::None ? Opcode::NOP : binaryOpcode(e.op));
+
+    unsigned value;
+    if(lv.kind == LValue::Local && op == Opcode::NOP){
+        compileExpr(e.b, (int)lv.reg);
+        value = lv.reg;
+    }
+    else if(op == Opcode::NOP){
+        value = compileAny(e.b);
+        storeLValue(lv, value);
+    }
+    else{
+        value = (lv.kind == LValue::Local ? lv.reg : allocReg());
+        loadLValue(lv, value);
+        unsigned rhs = compileAny(e.b);
+        emit(encode(op, value, value, rhs));
+        storeLValue(lv, value);
+    }
+
+    if(dst != DISCARD && (unsigned)dst != value)
+        emit(encode(Opcode::MOVE, dst, value));
+}
+
+void BytecodeCompiler::compileIncDec(const Expr& e, int dst){
+    LValue lv = compileLValue(e.a);
+    bool post = (e.op == Op::PostInc || e.op == Op::PostDec);
+    Opcode op = (e.op == Op::PreInc || e.op == Op::PostInc ? Opcode::INC : Opcode::DEC);
+
+    unsigned value = (lv.kind == LValue::Local ? lv.reg : allocReg());
+    loadLValue(lv, value);
+    if(post && dst != DISCARD)
+        emit(encode(Opcode::MOVE, dst, value));
+    emit(encode(op, value));
+    storeLValue(lv, value);
+    if(!post && dst != DISCARD && (unsigned)dst != value)
+        emit(encode(Opcode::MOVE, dst, value));
+}
+
+BytecodeCompiler::LValue BytecodeCompiler::compileLValue(NodeIndex i){
+    const Expr& e = unit.exprs[i];
+    LValue lv;
+    if(e.kind == ExprKind::Ident){
+        const Local* local = findLocal(e.text);
+        if(local){
+            lv.kind = LValue::Local;
+            lv.reg = local->reg;
+            return lv;
+        }
+        auto global = globalIndexes.find(unit.text(e.text));
+        if(global == globalIndexes.end())
+            error("Variable " + unit.text(e.text) + " is not declared", e.text);
+        lv.kind = LValue::Global;
+        lv.index = global->second;
+        return lv;
+    }
+    if(e.kind == ExprKind::Index && e.b != NO_NODE){
+        lv.kind = LValue::Index;
+        lv.reg = compileAny(e.a);
+        lv.index = compileAny(e.b);
+        return lv;
+    }
+    error("Expression can't be assigned", e.text);
+}
+
+void BytecodeCompiler::loadLValue(const LValue& lv, unsigned dst){
+    switch(lv.kind){
+    case LValue::Local:
+        if(lv.reg != dst)
+            emit(encode(Opcode::MOVE, dst, lv.reg));
+        break;
+    case LValue::Global:
+        emit(encodeBx(Opcode::GETG, dst, lv.index));
+        break;
+    case LValue::Index:
+        emit(encode(Opcode::GETIDX, dst, lv.reg, lv.index));
+        break;
+    }
+}
+
+void BytecodeCompiler::storeLValue(const LValue& lv, unsigned src){
+    switch(lv.kind){
+    case LValue::Local:
+        if(lv.reg != src)
+            emit(encode(Opcode::MOVE, lv.reg, src));
+        break;
+    case LValue::Global:
+        emit(encodeBx(Opcode::SETG, src, lv.index));
+        break;
+    case LValue::Index:
+        emit(encode(Opcode::SETIDX, lv.reg, lv.index, src));
+        break;
+    }
+}
+
+}
+}
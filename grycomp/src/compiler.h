@@ -0,0 +1,118 @@
+#ifndef COMPILER_H_INCLUDED
+#define COMPILER_H_INCLUDED
+
+#include "ast.h"
+#include "bytecode.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+namespace gpar{
+namespace vm{
+
+/*! Compiles the AST of a CompilationUnit to a bytecode Program.
+ *  - Registers are allocated as a stack: locals in declaration order, and
+ *    temporaries above them, freed after every statement.
+ *  - Top-level variables are globals, initialized by the init function.
+ *  - Classes are not compiled yet - they're skipped, and using a member is an error.
+ *  - Errors throw std::runtime_error, with "line:col:" when the node has a text.
+ */
+class BytecodeCompiler
+{
+private:
+    static const int DISCARD = -1; // Destination of values not needed.
+
+    const ast::CompilationUnit& unit;
+    Program& program;
+
+    // Function being compiled. Functions are all created before compiling,
+    // so the pointer stays valid.
+    Function* fn = nullptr;
+    unsigned top = 0; // First free register.
+
+    struct Local{
+        ast::Text name;
+        unsigned reg;
+    };
+    std::vector<Local> locals;
+
+    std::unordered_map<std::string, unsigned> functionIndexes;
+    std::vector<ast::NodeIndex> functionDecls;
+    std::unordered_map<std::string, unsigned> globalIndexes;
+
+    std::unordered_map<std::string, size_t> labels;
+    struct Goto{
+        ast::Text label;
+        size_t pos;
+    };
+    std::vector<Goto> gotos;
+    std::vector< std::vector<size_t> > breakJumps; // Of the enclosing loops and switches.
+
+    std::unordered_map<std::string, unsigned> stringConstants;
+    std::map<std::pair<int, int64_t>, unsigned> numberConstants;
+
+    // Place of an assignable expression.
+    struct LValue{
+        enum Kind{ Local, Global, Index } kind;
+        unsigned reg = 0;   // Local: variable. Index: the array.
+        unsigned index = 0; // Global: global index. Index: register of the index.
+    };
+
+    [[noreturn]] void error(const std::string& msg, ast::Text at = ast::Text()) const;
+
+    // Emitting.
+    size_t emit(Instr instr);
+    size_t emitJump(Opcode op, unsigned a = 0);
+    void patchJump(size_t pos, size_t target);
+    void patchJumpHere(size_t pos);
+    unsigned allocReg();
+    unsigned constant(const Value& v);
+    unsigned stringConstant(std::string&& str);
+    void loadInteger(unsigned dst, int64_t value);
+
+    // Names.
+    const Local* findLocal(ast::Text name) const;
+    unsigned declareLocal(ast::Text name);
+    std::string unescape(ast::Text text) const;
+
+    // Declarations.
+    void collectTopLevel();
+    void compileInit();
+    void compileFunction(unsigned index);
+    void compileVariableInit(const ast::Decl& decl, unsigned dst);
+    Conversion conversionOf(const ast::Type& type) const;
+
+    // Statements.
+    void compileStatement(ast::NodeIndex i);
+    void compileSwitch(const ast::Stmt& s);
+    void compileForeach(const ast::Stmt& s);
+
+    // Expressions.
+    void compileExpr(ast::NodeIndex i, int dst);
+    unsigned compileAny(ast::NodeIndex i);
+    void compileBinary(const ast::Expr& e, int dst);
+    void compileLogical(const ast::Expr& e, int dst);
+    void compileUnary(const ast::Expr& e, int dst);
+    void compileCall(const ast::Expr& e, int dst);
+    void compileAssign(const ast::Expr& e, int dst);
+    void compileIncDec(const ast::Expr& e, int dst);
+
+    LValue compileLValue(ast::NodeIndex i);
+    void loadLValue(const LValue& lv, unsigned dst);
+    void storeLValue(const LValue& lv, unsigned src);
+
+public:
+    BytecodeCompiler(const ast::CompilationUnit& compUnit, Program& prog)
+        : unit( compUnit ), program( prog ) {}
+
+    /*! Compiles the unit into the program, which must be empty.
+     *  @throws runtime_error on a semantic error.
+     */
+    void compile();
+};
+
+}
+}
+
+#endif //COMPILER_H_INCLUDED
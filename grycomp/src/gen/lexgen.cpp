@@ -0,0 +1,358 @@
+/*! Grylang lexer generator.
+ *  - Reads the lexic spec (spec/lexic.bnf) through the gBNF parser, and writes a
+ *    header with the spec-dependent parts of the GrylangLexer:
+ *    - Character class table, from the <ident>, <w> and <d> rules.
+ *    - Keyword lookup, as a perfect hash of the <keyword> rule's strings.
+ *    - Operator DFA, direct-coded as nested switches, from the <operator> rule.
+ *  - Lexer's automaton states (strings, numbers, comments) are written by hand,
+ *    so the rules they implement are checked to have the expected shape.
+ *
+ *  Usage: lexgen <lexic.bnf> <output header>
+ */
+
+#include <gbnf/gbnf.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <stdexcept>
+
+namespace lexgen{
+
+const int CLASS_IDENT_START = 1;
+const int CLASS_IDENT_CHAR  = 2;
+const int CLASS_DIGIT       = 4;
+
+/*! Gets the rule defining the tag with the name.
+ *  @throws runtime_error if rule is not present.
+ */
+const gbnf::GrammarRule& getRule( const gbnf::GbnfData& data, const std::string& name ){
+    size_t id = const_cast< gbnf::GbnfData& >( data ).getTagIDfromTable( name, false );
+    auto rule = data.getRule( id );
+    if( id == (size_t)(-1) || rule == data.grammarTableConst().end() || rule->getID() != id )
+        throw std::runtime_error( "Spec has no <"+name+"> rule." );
+    return *rule;
+}
+
+/*! Gets the strings of the rule, which must consist of one-string options.
+ */
+std::vector< std::string > getStrings( const gbnf::GrammarRule& rule, const std::string& name ){
+    std::vector< std::string > strings;
+    for( auto&& opt : rule.options ){
+        if( opt.children.size() != 1 || opt.children[0].type != gbnf::GrammarToken::REGEX_STRING )
+            throw std::runtime_error( "<"+name+"> options must be single strings." );
+        strings.push_back( opt.children[0].data );
+    }
+    return strings;
+}
+
+/*! Parses the hex digit. @return -1 if not a hex digit.
+ */
+int hexValue( char c ){
+    if( c >= '0' && c <= '9' ) return c - '0';
+    if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    return -1;
+}
+
+/*! Reads one (possibly escaped) char of a character class.
+ */
+int readClassChar( const std::string& str, size_t& i ){
+    if( str[ i ] != '\\' )
+        return (unsigned char)str[ i++ ];
+
+    if( i + 1 >= str.size() )
+        throw std::runtime_error( "Bad escape in class \""+str+"\"" );
+    if( str[ i + 1 ] == 'x' ){
+        int hi = ( i + 2 < str.size() ? hexValue( str[ i + 2 ] ) : -1 );
+        int lo = ( i + 3 < str.size() ? hexValue( str[ i + 3 ] ) : -1 );
+        if( hi < 0 || lo < 0 )
+            throw std::runtime_error( "Bad hex escape in class \""+str+"\"" );
+        i += 4;
+        return hi * 16 + lo;
+    }
+    i += 2;
+    return (unsigned char)str[ i - 1 ];
+}
+
+/*! Parses a character class regex ("[a-zA-Z_]"), and sets the flag on its chars.
+ */
+void addCharClass( std::vector< int >& classes, const std::string& str, int flag ){
+    if( str.size() < 3 || str.front() != '[' || str.back() != ']' || str[1] == '^' )
+        throw std::runtime_error( "Expected a character class, got \""+str+"\"" );
+
+    const std::string body = str.substr( 1, str.size() - 2 );
+    for( size_t i = 0; i < body.size(); ){
+        int first = readClassChar( body, i );
+        int last = first;
+        if( i + 1 < body.size() && body[ i ] == '-' ){
+            i++;
+            last = readClassChar( body, i );
+        }
+        for( int c = first; c <= last; c++ )
+            classes[ c ] |= flag;
+    }
+}
+
+/*! Gets the class string of a rule consisting of one character class.
+ */
+const std::string& getClassOfTag( const gbnf::GbnfData& data, size_t id ){
+    auto rule = data.getRule( id );
+    if( rule == data.grammarTableConst().end() || rule->getID() != id ||
+        rule->options.size() != 1 || rule->options[0].children.size() != 1 ||
+        rule->options[0].children[0].type != gbnf::GrammarToken::REGEX_STRING )
+        throw std::runtime_error( "Tag "+std::to_string( id )+" is not a character class." );
+    return rule->options[0].children[0].data;
+}
+
+/*! Gets the tag repeated in a group: {<tag>}* or {<tag>}+
+ */
+size_t getRepeatedTag( const gbnf::GrammarToken& group, const std::string& name ){
+    if( ( group.type != gbnf::GrammarToken::GROUP_REPEAT_NONE &&
+          group.type != gbnf::GrammarToken::GROUP_REPEAT_ONE ) ||
+        group.children.size() != 1 || group.children[0].type != gbnf::GrammarToken::TAG_ID )
+        throw std::runtime_error( "<"+name+"> must repeat a single tag." );
+    return group.children[0].id;
+}
+
+std::vector< int > buildCharClasses( const gbnf::GbnfData& data ){
+    std::vector< int > classes( 256, 0 );
+
+    // <ident> ::= "[start class]" {<w>}* ;
+    const gbnf::GrammarRule& ident = getRule( data, "ident" );
+    if( ident.options.size() != 1 || ident.options[0].children.size() != 2 ||
+        ident.options[0].children[0].type != gbnf::GrammarToken::REGEX_STRING )
+        throw std::runtime_error( "<ident> must be a class followed by a repeated tag." );
+    addCharClass( classes, ident.options[0].children[0].data, CLASS_IDENT_START );
+    addCharClass( classes, getClassOfTag( data,
+        getRepeatedTag( ident.options[0].children[1], "ident" ) ), CLASS_IDENT_CHAR );
+
+    // <integer_constant> ::= {<d>}+ ;
+    const gbnf::GrammarRule& integer = getRule( data, "integer_constant" );
+    if( integer.options.size() != 1 || integer.options[0].children.size() != 1 )
+        throw std::runtime_error( "<integer_constant> must be a repeated tag." );
+    addCharClass( classes, getClassOfTag( data,
+        getRepeatedTag( integer.options[0].children[0], "integer_constant" ) ), CLASS_DIGIT );
+
+    return classes;
+}
+
+/*! Checks the rules the hand-written automaton states implement.
+ */
+void checkFixedRules( const gbnf::GbnfData& data ){
+    // Comments start with "//", "/*" (CommOrDiv state), or "#" (directive lines).
+    const char* const commentStarts[] = { "//", "/*", "#" };
+    const gbnf::GrammarRule& comment = getRule( data, "comment" );
+    bool ok = ( comment.options.size() == 3 );
+    for( size_t i = 0; ok && i < 3; i++ ){
+        ok = !comment.options[ i ].children.empty() && 
+             comment.options[ i ].children[0].data == commentStarts[ i ];
+    }
+    if( !ok )
+        throw std::runtime_error( "<comment> must have the \"//\", \"/*\" and \"#\" options." );
+
+    // Float is digits, a point, and digits - IntOrFloat and Float states.
+    const gbnf::GrammarRule& flt = getRule( data, "floating_constant" );
+    if( flt.options.size() != 1 || flt.options[0].children.size() != 3 ||
+        flt.options[0].children[1].data != "." )
+        throw std::runtime_error( "<floating_constant> must be <d>+ \".\" <d>+" );
+}
+
+/*! Keyword perfect hash.
+ *  - hash = ( len*A + first*B + last*C ) % size. Parameters are searched at generation
+ *    time, so every keyword gets its own slot.
+ */
+struct KeywordHash{
+    size_t a = 0, b = 0, c = 0, size = 0;
+    std::vector< int > slots;
+
+    size_t hash( const std::string& s ) const {
+        return ( s.size()*a + (unsigned char)s.front()*b + (unsigned char)s.back()*c ) % size;
+    }
+};
+
+KeywordHash buildKeywordHash( const std::vector< std::string >& keywords ){
+    KeywordHash kh;
+    for( kh.size = keywords.size(); kh.size <= keywords.size() * 8; kh.size++ ){
+        for( kh.a = 1; kh.a < 64; kh.a++ ){
+            for( kh.b = 1; kh.b < 64; kh.b++ ){
+                for( kh.c = 0; kh.c < 64; kh.c++ ){
+                    kh.slots.assign( kh.size, -1 );
+                    bool ok = true;
+                    for( size_t k = 0; k < keywords.size() && ok; k++ ){
+                        int& slot = kh.slots[ kh.hash( keywords[ k ] ) ];
+                        ok = ( slot < 0 );
+                        slot = (int)k;
+                    }
+                    if( ok )
+                        return kh;
+                }
+            }
+        }
+    }
+    throw std::runtime_error( "No perfect hash found for the keywords." );
+}
+
+/*! Operator DFA - a trie of the operator strings. State 0 is the start.
+ *  - Lexer puts back only one char, so every prefix of an operator must be an operator.
+ */
+struct OperatorDFA{
+    std::vector< std::map< int, int > > transitions;
+    std::vector< bool > accepting;
+};
+
+OperatorDFA buildOperatorDFA( const std::vector< std::string >& operators ){
+    OperatorDFA dfa;
+    dfa.transitions.resize( 1 );
+    dfa.accepting.push_back( false );
+
+    for( auto&& op : operators ){
+        int state = 0;
+        for( char ch : op ){
+            auto it = dfa.transitions[ state ].find( (unsigned char)ch );
+            if( it == dfa.transitions[ state ].end() ){
+                it = dfa.transitions[ state ].insert( std::make_pair(
+                        (int)(unsigned char)ch, (int)dfa.transitions.size() ) ).first;
+                dfa.transitions.push_back( std::map< int, int >() );
+                dfa.accepting.push_back( false );
+            }
+            state = it->second;
+        }
+        dfa.accepting[ state ] = true;
+    }
+
+    for( size_t s = 1; s < dfa.accepting.size(); s++ ){
+        if( !dfa.accepting[ s ] )
+            throw std::runtime_error( "Operator prefixes must be operators too." );
+    }
+    return dfa;
+}
+
+std::string charComment( int c ){
+    if( c >= 0x20 && c < 0x7f && c != '\\' )
+        return std::string( " // '" ) + (char)c + "'";
+    return std::string();
+}
+
+void writeHeader( std::ostream& os, const std::string& specName,
+                  const std::vector< int >& classes,
+                  const std::vector< std::string >& keywords, const KeywordHash& kh,
+                  const OperatorDFA& dfa )
+{
+    os << "// Generated by lexgen from "<< specName <<". Do not edit.\n\n"
+       << "#ifndef LEXIC_GEN_H_INCLUDED\n#define LEXIC_GEN_H_INCLUDED\n\n"
+       << "#include <cstddef>\n#include <cstring>\n\n"
+       << "namespace gpar{\nnamespace lexic{\n\n";
+
+    // Character classes.
+    os << "const int IDENT_START = "<< CLASS_IDENT_START <<";\n"
+       << "const int IDENT_CHAR  = "<< CLASS_IDENT_CHAR <<";\n"
+       << "const int DIGIT       = "<< CLASS_DIGIT <<";\n\n"
+       << "static const unsigned char charClasses[256] = {";
+    for( size_t i = 0; i < classes.size(); i++ )
+        os << ( i % 16 ? " " : "\n    " ) << classes[ i ] << ",";
+    os << "\n};\n\n"
+       << "inline bool isIdentStart( int c ){ return charClasses[ (unsigned char)c ] & IDENT_START; }\n"
+       << "inline bool isIdentChar( int c ){ return charClasses[ (unsigned char)c ] & IDENT_CHAR; }\n"
+       << "inline bool isDigit( int c ){ return charClasses[ (unsigned char)c ] & DIGIT; }\n\n";
+
+    // Keywords.
+    os << "const int KEYWORD_COUNT = "<< keywords.size() <<";\n\n"
+       << "static const char* const keywords[ KEYWORD_COUNT ] = {";
+    for( size_t k = 0; k < keywords.size(); k++ )
+        os << ( k % 8 ? " " : "\n    " ) << "\"" << keywords[ k ] << "\",";
+    os << "\n};\n\n"
+       << "static const unsigned char keywordLengths[ KEYWORD_COUNT ] = {";
+    for( size_t k = 0; k < keywords.size(); k++ )
+        os << ( k % 16 ? " " : "\n    " ) << keywords[ k ].size() << ",";
+    os << "\n};\n\n"
+       << "// Perfect hash: ( len*"<< kh.a <<" + first*"<< kh.b <<" + last*"<< kh.c
+       << " ) % "<< kh.size <<"\n"
+       << "static const signed char keywordSlots[ "<< kh.size <<" ] = {";
+    for( size_t s = 0; s < kh.slots.size(); s++ )
+        os << ( s % 16 ? " " : "\n    " ) << kh.slots[ s ] << ",";
+    os << "\n};\n\n"
+       << "/*! @return the index of the keyword, or -1 if string is not a keyword.\n */\n"
+       << "inline int findKeyword( const char* str, size_t len ){\n"
+       << "    if( !len )\n        return -1;\n"
+       << "    int k = keywordSlots[ ( len*"<< kh.a <<" + (unsigned char)str[0]*"<< kh.b
+       << " + (unsigned char)str[len-1]*"<< kh.c <<" ) % "<< kh.size <<" ];\n"
+       << "    return ( k >= 0 && keywordLengths[ k ] == len && !memcmp( keywords[ k ], str, len ) ? k : -1 );\n"
+       << "}\n\n";
+
+    // Operator DFA.
+    os << "/*! Operator DFA. State 0 is the start, and all other states are accepting.\n"
+       << " *  @return the next state, or -1 if operator can't be continued by the char.\n */\n"
+       << "inline int operatorNext( int state, int c ){\n"
+       << "    switch( state ){\n";
+    for( size_t s = 0; s < dfa.transitions.size(); s++ ){
+        if( dfa.transitions[ s ].empty() )
+            continue;
+        os << "    case "<< s <<":\n        switch( c ){\n";
+        for( auto&& tr : dfa.transitions[ s ] )
+            os << "        case "<< tr.first <<": return "<< tr.second <<";"<< charComment( tr.first ) <<"\n";
+        os << "        }\n        break;\n";
+    }
+    os << "    }\n    return -1;\n}\n\n";
+
+    os << "/*! @return true if no operator continues from the state.\n */\n"
+       << "inline bool operatorFinal( int state ){\n"
+       << "    switch( state ){\n";
+    for( size_t s = 1; s < dfa.transitions.size(); s++ ){
+        if( !dfa.transitions[ s ].empty() )
+            os << "    case "<< s <<":\n";
+    }
+    os << "        return false;\n    }\n    return true;\n}\n\n";
+
+    os << "}\n}\n\n#endif // LEXIC_GEN_H_INCLUDED\n";
+}
+
+}
+
+int main( int argc, char** argv ){
+    if( argc < 3 ){
+        std::cerr << "Usage: "<< argv[0] <<" <lexic.bnf> <output header>\n";
+        return 1;
+    }
+
+    try{
+        std::ifstream spec( argv[1] );
+        if( !spec.is_open() )
+            throw std::runtime_error( std::string( "Can't open " ) + argv[1] );
+
+        gbnf::GbnfData data;
+        gbnf::convertToGbnf( data, spec );
+
+        lexgen::checkFixedRules( data );
+        std::vector< int > classes = lexgen::buildCharClasses( data );
+
+        std::vector< std::string > keywords =
+            lexgen::getStrings( lexgen::getRule( data, "keyword" ), "keyword" );
+        for( auto&& kw : keywords ){
+            bool ok = !kw.empty() && ( classes[ (unsigned char)kw[0] ] & lexgen::CLASS_IDENT_START );
+            for( char ch : kw )
+                ok = ok && ( classes[ (unsigned char)ch ] & lexgen::CLASS_IDENT_CHAR );
+            if( !ok )
+                throw std::runtime_error( "Keyword \""+kw+"\" is not an identifier." );
+        }
+        lexgen::KeywordHash kh = lexgen::buildKeywordHash( keywords );
+
+        lexgen::OperatorDFA dfa = lexgen::buildOperatorDFA(
+            lexgen::getStrings( lexgen::getRule( data, "operator" ), "operator" ) );
+
+        // Write to memory first, to not leave a broken header on error.
+        std::ostringstream out;
+        lexgen::writeHeader( out, argv[1], classes, keywords, kh, dfa );
+
+        std::ofstream outFile( argv[2], std::ios::out | std::ios::trunc );
+        if( !( outFile << out.str() ) )
+            throw std::runtime_error( std::string( "Can't write " ) + argv[2] );
+    } catch( const std::exception& e ){
+        std::cerr << "lexgen: "<< e.what() <<"\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,788 @@
+#include "grylangparser.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace gpar{
+
+using namespace ast;
+
+namespace{
+
+struct OpLexem{
+    const char* text;
+    Op op;
+    int precedence;
+};
+
+// Assignment operators. Op is the one of compound assignment.
+const OpLexem assignOps[] = {
+    {"=", Op::None, 0},    {"+=", Op::Add, 0},    {"-=", Op::Sub, 0},
+    {"*=", Op::Mul, 0},    {"/=", Op::Div, 0},    {"%=", Op::Mod, 0},
+    {"<<=", Op::Shl, 0},   {">>=", Op::Shr, 0},   {"&=", Op::BitAnd, 0},
+    {"|=", Op::BitOr, 0},  {"^=", Op::BitXor, 0}
+};
+
+// Binary operators, with the priorities of spec/grylang.bnf.
+const OpLexem binaryOps[] = {
+    {"||", Op::LogOr, 1},  {"&&", Op::LogAnd, 2},
+    {"==", Op::Eq, 3},     {"!=", Op::Ne, 3},     {"<", Op::Lt, 3},
+    {">", Op::Gt, 3},      {"<=", Op::Le, 3},     {">=", Op::Ge, 3},
+    {"|", Op::BitOr, 4},   {"^", Op::BitXor, 5},  {"&", Op::BitAnd, 6},
+    {"<<", Op::Shl, 7},    {">>", Op::Shr, 7},
+    {"+", Op::Add, 8},     {"-", Op::Sub, 8},
+    {"*", Op::Mul, 9},     {"/", Op::Div, 9},     {"%", Op::Mod, 9}
+};
+
+const OpLexem unaryOps[] = {
+    {"-", Op::Neg, 0},     {"+", Op::Plus, 0},    {"!", Op::Not, 0},
+    {"~", Op::BitNot, 0},  {"*", Op::Deref, 0},   {"&", Op::AddrOf, 0},
+    {"++", Op::PreInc, 0}, {"--", Op::PreDec, 0}
+};
+
+struct BasicType{
+    const char* text;
+    TypeKind kind;
+};
+
+const BasicType basicTypes[] = {
+    {"char", TypeKind::Char},   {"int", TypeKind::Int},       {"int16", TypeKind::Int16},
+    {"int32", TypeKind::Int32}, {"int64", TypeKind::Int64},   {"float", TypeKind::Float},
+    {"double", TypeKind::Double}, {"void", TypeKind::Void},   {"fun", TypeKind::Fun},
+    {"var", TypeKind::Var}
+};
+
+}
+
+/*! Lexes the whole source, dropping comments.
+ *  - Lexic has no "<<=", ">>=" and ".." lexems, so adjacent operator
+ *    lexems forming them are joined here.
+ *  - An end lexem (code NONE) is put at the end, so lookahead needs no checks.
+ */
+void GrylangParser::lexSource(){
+    const char* src = unit.source.data();
+    GrylangLexer lexer(src, unit.source.size());
+
+    lexems.clear();
+    Lexem lex;
+    while(lexer.nextLexem(lex)){
+        if(lex.code == GrylangLexer::COMMENT)
+            continue;
+
+        if(lex.code == GrylangLexer::OPERATOR && !lexems.empty()){
+            Lexem& prev = lexems.back();
+            // Lexer takes the point of "0..9" as a float's.
+            if(prev.code == GrylangLexer::FLOAT && prev.offset + prev.length == lex.offset &&
+               src[lex.offset - 1] == '.' && src[lex.offset] == '.' && lex.length == 1){
+                prev.code = GrylangLexer::INTEGER;
+                prev.length--;
+                lex.offset--;
+                lex.length++;
+            }
+            else if(prev.code == GrylangLexer::OPERATOR && prev.offset + prev.length == lex.offset){
+                const char* p = src + prev.offset;
+                bool shiftAssign = (prev.length == 2 && (p[0] == '<' || p[0] == '>') &&
+                                    p[1] == p[0] && src[lex.offset] == '=' && lex.length == 1);
+                bool range = (prev.length == 1 && p[0] == '.' &&
+                              src[lex.offset] == '.' && lex.length == 1);
+                if(shiftAssign || range){
+                    prev.length += lex.length;
+                    continue;
+                }
+            }
+        }
+        lexems.push_back(lex);
+    }
+
+    Lexem endLex;
+    endLex.offset = unit.source.size();
+    lexems.push_back(endLex);
+}
+
+const GrylangLexer::Lexem& GrylangParser::peek(size_t ahead) const {
+    return lexems[ std::min(cur + ahead, lexems.size() - 1) ];
+}
+
+bool GrylangParser::is(GrylangLexer::LexemCode code, const char* text, size_t ahead) const {
+    const Lexem& lex = peek(ahead);
+    return lex.code == code && lex.length == std::strlen(text) &&
+           std::memcmp(unit.source.data() + lex.offset, text, lex.length) == 0;
+}
+
+bool GrylangParser::isTypeKeyword(size_t ahead) const {
+    if(peek(ahead).code != GrylangLexer::KEYWORD)
+        return false;
+    if(isKeyword("const", ahead) || isKeyword("volatile", ahead))
+        return true;
+    for(auto&& type : basicTypes){
+        if(isKeyword(type.text, ahead))
+            return true;
+    }
+    return false;
+}
+
+/*! Checks if the current lexem is on the line of the previous one.
+ *  Used where a newline ends a statement, as semicolons are optional.
+ */
+bool GrylangParser::onSameLine() const {
+    if(cur == 0)
+        return false;
+    const Lexem& prev = lexems[ cur - 1 ];
+    size_t from = prev.offset + prev.length;
+    size_t to = peek().offset;
+    return to <= from || !std::memchr(unit.source.data() + from, '\n', to - from);
+}
+
+bool GrylangParser::startsExpression() const {
+    switch(peek().code){
+    case GrylangLexer::IDENT:
+    case GrylangLexer::INTEGER:
+    case GrylangLexer::FLOAT:
+    case GrylangLexer::CHAR:
+    case GrylangLexer::STRING:
+        return true;
+    case GrylangLexer::OPERATOR:
+        return !isOp(";") && !isOp("}") && !isOp(")");
+    default:
+        return false;
+    }
+}
+
+bool GrylangParser::acceptOp(const char* text){
+    if(!isOp(text))
+        return false;
+    cur++;
+    return true;
+}
+
+bool GrylangParser::acceptKeyword(const char* text){
+    if(!isKeyword(text))
+        return false;
+    cur++;
+    return true;
+}
+
+void GrylangParser::expectOp(const char* text){
+    if(!acceptOp(text))
+        error(std::string("Expected \"") + text + "\"");
+}
+
+Text GrylangParser::expectIdent(){
+    if(!isIdent())
+        error("Expected an identifier");
+    return textOf(lexems[ cur++ ]);
+}
+
+Text GrylangParser::textOf(const Lexem& lex) const {
+    Text t;
+    t.offset = (uint32_t)lex.offset;
+    t.length = (uint32_t)lex.length;
+    return t;
+}
+
+void GrylangParser::error(const std::string& msg) const {
+    const Lexem& lex = peek();
+    const char* src = unit.source.data();
+
+    size_t line = 1, lineStart = 0;
+    for(size_t i = 0; i < lex.offset; i++){
+        if(src[i] == '\n'){
+            line++;
+            lineStart = i + 1;
+        }
+    }
+    std::string got = (lex.code == GrylangLexer::NONE ? std::string("end of input") :
+                       "\"" + std::string(src + lex.offset, lex.length) + "\"");
+
+    throw std::runtime_error(std::to_string(line) + ":" + std::to_string(lex.offset - lineStart + 1) +
+                             ": " + msg + ", got " + got);
+}
+
+//=========================================//
+// Node constructors
+
+NodeIndex GrylangParser::addExpr(const Expr& e){
+    unit.exprs.push_back(e);
+    return (NodeIndex)(unit.exprs.size() - 1);
+}
+
+NodeIndex GrylangParser::addStmt(const Stmt& s){
+    unit.stmts.push_back(s);
+    return (NodeIndex)(unit.stmts.size() - 1);
+}
+
+NodeIndex GrylangParser::addDecl(const Decl& d){
+    unit.decls.push_back(d);
+    return (NodeIndex)(unit.decls.size() - 1);
+}
+
+NodeIndex GrylangParser::addType(const Type& t){
+    unit.types.push_back(t);
+    return (NodeIndex)(unit.types.size() - 1);
+}
+
+/*! Moves the scratch elements from mark to the end to the list pool.
+ */
+Range GrylangParser::finishList(size_t mark){
+    Range r;
+    r.first = (uint32_t)unit.lists.size();
+    r.count = (uint32_t)(scratch.size() - mark);
+    unit.lists.insert(unit.lists.end(), scratch.begin() + mark, scratch.end());
+    scratch.resize(mark);
+    return r;
+}
+
+//=========================================//
+// Declarations
+
+void GrylangParser::parse(){
+    unit.clearTree();
+    lexSource();
+    cur = 0;
+    scratch.clear();
+
+    while(peek().code != GrylangLexer::NONE){
+        if(acceptOp(";"))
+            continue;
+        scratch.push_back(parseExtObject());
+    }
+    unit.topLevel = finishList(0);
+}
+
+/*! Checks if a variable declaration starts here: a type keyword, or a
+ *  type name with it's array and pointer parts, followed by a name.
+ */
+bool GrylangParser::looksLikeDecl() const {
+    if(isTypeKeyword())
+        return true;
+    if(!isIdent())
+        return false;
+
+    size_t k = 1;
+    while(isOp("[", k)){
+        for(int depth = 0; ; k++){
+            if(isOp("[", k))
+                depth++;
+            else if(isOp("]", k) && --depth == 0)
+                break;
+            else if(peek(k).code == GrylangLexer::NONE)
+                return false;
+        }
+        k++;
+    }
+    while(isOp("*", k))
+        k++;
+    return isIdent(k);
+}
+
+NodeIndex GrylangParser::parseExtObject(){
+    NodeIndex obj;
+    if(isKeyword("fun") && isIdent(1) && isOp("(", 2))
+        obj = parseFunction();
+    else if(isKeyword("class"))
+        obj = parseClass();
+    else if(looksLikeDecl())
+        obj = parseVariable(true);
+    else
+        error("Expected a declaration");
+
+    acceptOp(";");
+    return obj;
+}
+
+NodeIndex GrylangParser::parseFunction(){
+    cur++; // "fun"
+    Decl d;
+    d.kind = DeclKind::Function;
+    d.name = expectIdent();
+    d.params = parseParams();
+    if(acceptOp(":"))
+        d.type = parseType();
+    if(isOp("{"))
+        d.body = parseBlock();
+    return addDecl(d);
+}
+
+/*! Class. Inheritance is optional, as in spec/program.gg.
+ */
+NodeIndex GrylangParser::parseClass(){
+    cur++; // "class"
+    Decl d;
+    d.kind = DeclKind::Class;
+    d.name = expectIdent();
+
+    d.implements = isKeyword("implements");
+    if(acceptKeyword("extends") || acceptKeyword("implements")){
+        size_t mark = scratch.size();
+        do{
+            Expr base;
+            base.kind = ExprKind::Ident;
+            base.text = expectIdent();
+            scratch.push_back(addExpr(base));
+        } while(acceptOp(","));
+        d.bases = finishList(mark);
+    }
+
+    if(acceptOp("{")){
+        size_t mark = scratch.size();
+        while(!acceptOp("}")){
+            if(acceptOp(";"))
+                continue;
+            scratch.push_back(parseClassMember());
+        }
+        d.members = finishList(mark);
+    }
+    return addDecl(d);
+}
+
+NodeIndex GrylangParser::parseClassMember(){
+    uint8_t access = 0;
+    for(;;){
+        if(acceptKeyword("private"))
+            access |= Decl::PRIVATE;
+        else if(acceptKeyword("protected"))
+            access |= Decl::PROTECTED;
+        else if(acceptKeyword("public"))
+            access |= Decl::PUBLIC;
+        // "override" and "final" are not keywords, so they can be names too.
+        else if(is(GrylangLexer::IDENT, "override") && !isOp("(", 1) && !isOp(":", 1)){
+            access |= Decl::OVERRIDE;
+            cur++;
+        }
+        else if(is(GrylangLexer::IDENT, "final") && !isOp("(", 1) && !isOp(":", 1)){
+            access |= Decl::FINAL;
+            cur++;
+        }
+        else
+            break;
+    }
+
+    NodeIndex member;
+    if(acceptOp("~")){
+        Decl d;
+        d.kind = DeclKind::Destructor;
+        d.name = expectIdent();
+        expectOp("(");
+        expectOp(")");
+        if(isOp("{"))
+            d.body = parseBlock();
+        member = addDecl(d);
+        acceptOp(";");
+    }
+    else if(isIdent() && isOp("(", 1)){
+        Decl d;
+        d.kind = DeclKind::Constructor;
+        d.name = expectIdent();
+        d.params = parseParams();
+        if(isOp("{"))
+            d.body = parseBlock();
+        member = addDecl(d);
+        acceptOp(";");
+    }
+    else
+        member = parseExtObject();
+
+    unit.decls[ member ].access = access;
+    return member;
+}
+
+NodeIndex GrylangParser::parseVariable(bool withInit){
+    Decl d;
+    d.kind = DeclKind::Variable;
+    d.type = parseType();
+    d.name = expectIdent();
+    if(withInit && acceptOp("="))
+        d.init = parseExpression();
+    return addDecl(d);
+}
+
+Range GrylangParser::parseParams(){
+    expectOp("(");
+    size_t mark = scratch.size();
+    if(!isOp(")")){
+        do{
+            scratch.push_back(parseVariable(false));
+        } while(acceptOp(","));
+    }
+    expectOp(")");
+    return finishList(mark);
+}
+
+/*! Type: qualifiers, a basic type or a class name, array dimensions, and pointers.
+ *  Qualifier is optional, as in spec/program.gg.
+ */
+NodeIndex GrylangParser::parseType(){
+    Type type;
+    for(;;){
+        if(acceptKeyword("const"))
+            type.qualifiers |= Type::CONST;
+        else if(acceptKeyword("volatile"))
+            type.qualifiers |= Type::VOLATILE;
+        else
+            break;
+    }
+
+    const Lexem& lex = peek();
+    if(lex.code == GrylangLexer::IDENT){
+        type.kind = TypeKind::Named;
+        type.text = textOf(lex);
+    }
+    else{
+        const BasicType* basic = nullptr;
+        for(auto&& bt : basicTypes){
+            if(isKeyword(bt.text))
+                basic = &bt;
+        }
+        if(!basic)
+            error("Expected a type");
+        type.kind = basic->kind;
+    }
+    cur++;
+
+    size_t mark = scratch.size();
+    while(acceptOp("[")){
+        scratch.push_back(isOp("]") ? NO_NODE : parseExpression());
+        expectOp("]");
+    }
+    type.dims = finishList(mark);
+
+    while(acceptOp("*"))
+        type.pointers++;
+    return addType(type);
+}
+
+//=========================================//
+// Statements
+
+/*! Statement, with an optional ";" after it.
+ */
+NodeIndex GrylangParser::parseStatement(){
+    Stmt s;
+    if(isOp("{")){
+        NodeIndex block = parseBlock();
+        acceptOp(";");
+        return block;
+    }
+    if(isKeyword("switch")){
+        NodeIndex sw = parseSwitch();
+        acceptOp(";");
+        return sw;
+    }
+
+    if(acceptKeyword("if")){
+        s.kind = StmtKind::If;
+        expectOp("(");
+        s.a = parseExpression();
+        expectOp(")");
+        s.b = parseStatement();
+        if(acceptKeyword("else"))
+            s.c = parseStatement();
+    }
+    else if(acceptKeyword("while")){
+        s.kind = StmtKind::While;
+        expectOp("(");
+        if(!isOp(")"))
+            s.a = parseExpression();
+        expectOp(")");
+        s.b = parseStatement();
+    }
+    else if(acceptKeyword("for")){
+        s.kind = StmtKind::For;
+        expectOp("(");
+        if(!isOp(";"))
+            s.a = parseExpression();
+        expectOp(";");
+        if(!isOp(";"))
+            s.b = parseExpression();
+        expectOp(";");
+        if(!isOp(")"))
+            s.c = parseExpression();
+        expectOp(")");
+        s.d = parseStatement();
+    }
+    else if(acceptKeyword("foreach")){
+        // Spec has no body in <foreach_loop>, but program.gg loops over a statement.
+        s.kind = StmtKind::Foreach;
+        expectOp("(");
+        if(!isOp(")")){
+            s.text = expectIdent();
+            if(!acceptKeyword("in"))
+                error("Expected \"in\"");
+            s.a = parseExpression();
+        }
+        expectOp(")");
+        s.b = parseStatement();
+    }
+    else if(acceptKeyword("break")){
+        s.kind = StmtKind::Break;
+    }
+    else if(acceptKeyword("goto")){
+        s.kind = StmtKind::Goto;
+        s.text = expectIdent();
+    }
+    else if(acceptKeyword("return")){
+        s.kind = StmtKind::Return;
+        if(onSameLine() && startsExpression())
+            s.a = parseExpression();
+    }
+    else if(isIdent() && isOp(":", 1)){
+        s.kind = StmtKind::Label;
+        s.text = expectIdent();
+        cur++;
+    }
+    else if(looksLikeDecl()){
+        s.kind = StmtKind::VarDecl;
+        s.a = parseVariable(true);
+    }
+    else{
+        s.kind = StmtKind::ExprStmt;
+        s.a = parseExpression();
+    }
+
+    acceptOp(";");
+    return addStmt(s);
+}
+
+NodeIndex GrylangParser::parseBlock(){
+    expectOp("{");
+    Stmt s;
+    s.kind = StmtKind::Block;
+
+    size_t mark = scratch.size();
+    while(!acceptOp("}")){
+        if(acceptOp(";"))
+            continue;
+        if(peek().code == GrylangLexer::NONE)
+            error("Expected \"}\"");
+        scratch.push_back(parseStatement());
+    }
+    s.list = finishList(mark);
+    return addStmt(s);
+}
+
+NodeIndex GrylangParser::parseSwitch(){
+    cur++; // "switch"
+    Stmt s;
+    s.kind = StmtKind::Switch;
+    expectOp("(");
+    s.a = parseExpression();
+    expectOp(")");
+    expectOp("{");
+
+    size_t mark = scratch.size();
+    while(!acceptOp("}")){
+        Stmt c;
+        c.kind = StmtKind::Case;
+        if(acceptKeyword("case"))
+            c.a = parseExpression();
+        else if(!acceptKeyword("default"))
+            error("Expected \"case\" or \"default\"");
+        expectOp(":");
+
+        size_t caseMark = scratch.size();
+        while(!isKeyword("case") && !isKeyword("default") && !isOp("}")){
+            if(acceptOp(";"))
+                continue;
+            scratch.push_back(parseStatement());
+        }
+        c.list = finishList(caseMark);
+        scratch.push_back(addStmt(c));
+    }
+    s.list = finishList(mark);
+    return addStmt(s);
+}
+
+//=========================================//
+// Expressions
+
+/*! Assignment - right-associative, lowest priority.
+ */
+NodeIndex GrylangParser::parseExpression(){
+    NodeIndex target = parseRange();
+    if(peek().code != GrylangLexer::OPERATOR)
+        return target;
+
+    for(auto&& op : assignOps){
+        if(acceptOp(op.text)){
+            Expr e;
+            e.kind = ExprKind::Assign;
+            e.op = op.op;
+            e.a = target;
+            e.b = parseExpression();
+            return addExpr(e);
+        }
+    }
+    return target;
+}
+
+NodeIndex GrylangParser::parseRange(){
+    NodeIndex from = parseBinary(1);
+    if(!acceptOp(".."))
+        return from;
+
+    Expr e;
+    e.kind = ExprKind::RangeExpr;
+    e.a = from;
+    e.b = parseBinary(1);
+    return addExpr(e);
+}
+
+/*! Binary operators by precedence climbing. All are left-associative.
+ */
+NodeIndex GrylangParser::parseBinary(int minPrecedence){
+    NodeIndex lhs = parseUnary();
+    for(;;){
+        const OpLexem* found = nullptr;
+        if(peek().code == GrylangLexer::OPERATOR){
+            for(auto&& op : binaryOps){
+                if(isOp(op.text)){
+                    found = &op;
+                    break;
+                }
+            }
+        }
+        if(!found || found->precedence < minPrecedence)
+            return lhs;
+        cur++;
+
+        Expr e;
+        e.kind = ExprKind::Binary;
+        e.op = found->op;
+        e.a = lhs;
+        e.b = parseBinary(found->precedence + 1);
+        lhs = addExpr(e);
+    }
+}
+
+NodeIndex GrylangParser::parseUnary(){
+    Expr e;
+    if(peek().code == GrylangLexer::OPERATOR){
+        for(auto&& op : unaryOps){
+            if(acceptOp(op.text)){
+                e.kind = ExprKind::Unary;
+                e.op = op.op;
+                e.a = parseUnary();
+                return addExpr(e);
+            }
+        }
+        // Cast. Only to keyword types, "(name)" is a parenthesized expression.
+        if(isOp("(") && isTypeKeyword(1)){
+            cur++;
+            e.kind = ExprKind::Cast;
+            e.a = parseType();
+            expectOp(")");
+            e.b = parseUnary();
+            return addExpr(e);
+        }
+    }
+    else if(is(GrylangLexer::IDENT, "sizeof") && (isIdent(1) || isOp("(", 1))){
+        cur++;
+        e.kind = ExprKind::Unary;
+        e.op = Op::SizeOf;
+        e.a = parseSecondary();
+        return addExpr(e);
+    }
+    return parseSecondary();
+}
+
+/*! Calls, indexing, member access and postfix increments.
+ */
+NodeIndex GrylangParser::parseSecondary(){
+    NodeIndex operand = parsePrimary();
+    for(;;){
+        Expr e;
+        e.a = operand;
+        if(acceptOp("(")){
+            e.kind = ExprKind::Call;
+            size_t mark = scratch.size();
+            if(!isOp(")")){
+                do{
+                    scratch.push_back(parseExpression());
+                } while(acceptOp(","));
+            }
+            expectOp(")");
+            e.list = finishList(mark);
+        }
+        else if(acceptOp("[")){
+            e.kind = ExprKind::Index;
+            if(!isOp("]"))
+                e.b = parseExpression();
+            expectOp("]");
+        }
+        else if(isOp(".") || isOp("->")){
+            e.kind = ExprKind::Member;
+            e.flag = isOp("->");
+            cur++;
+            e.text = expectIdent();
+        }
+        // A "++" on the next line belongs to the next statement.
+        else if((isOp("++") || isOp("--")) && onSameLine()){
+            e.kind = ExprKind::Unary;
+            e.op = (isOp("++") ? Op::PostInc : Op::PostDec);
+            cur++;
+        }
+        else
+            return operand;
+
+        operand = addExpr(e);
+    }
+}
+
+NodeIndex GrylangParser::parsePrimary(){
+    const Lexem& lex = peek();
+    Expr e;
+    e.text = textOf(lex);
+
+    switch(lex.code){
+    case GrylangLexer::IDENT:
+        if((is(GrylangLexer::IDENT, "print") || is(GrylangLexer::IDENT, "println")) && isOp("(", 1)){
+            e.kind = ExprKind::Print;
+            e.flag = (lex.length == 7);
+            e.text = Text();
+            cur += 2;
+            e.a = parseExpression();
+            expectOp(")");
+            return addExpr(e);
+        }
+        e.kind = ExprKind::Ident;
+        break;
+    case GrylangLexer::INTEGER:
+        e.kind = ExprKind::Integer;
+        break;
+    case GrylangLexer::FLOAT:
+        e.kind = ExprKind::Float;
+        break;
+    case GrylangLexer::CHAR:
+    case GrylangLexer::STRING:
+        // Lexer gives both as STRING. Text starts after the quote.
+        e.kind = (unit.source[ lex.offset - 1 ] == '\'' ? ExprKind::Char : ExprKind::String);
+        break;
+    case GrylangLexer::OPERATOR:
+        if(acceptOp("(")){
+            NodeIndex inner = parseExpression();
+            expectOp(")");
+            return inner;
+        }
+        if(acceptOp("{")){
+            e.kind = ExprKind::Init;
+            e.text = Text();
+            size_t mark = scratch.size();
+            if(!isOp("}")){
+                do{
+                    scratch.push_back(parseExpression());
+                } while(acceptOp(","));
+            }
+            expectOp("}");
+            e.list = finishList(mark);
+            return addExpr(e);
+        }
+        error("Expected an expression");
+    default:
+        error("Expected an expression");
+    }
+
+    cur++;
+    return addExpr(e);
+}
+
+}
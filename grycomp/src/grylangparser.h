@@ -0,0 +1,97 @@
+#ifndef GRYLANGPARSER_H_INCLUDED
+#define GRYLANGPARSER_H_INCLUDED
+
+#include "ast.h"
+#include "lexer.h"
+#include <vector>
+#include <string>
+
+namespace gpar{
+
+/*! Grylang parser - recursive descent over the lexem stream, building the
+ *  typed AST of spec/grylang.bnf into a CompilationUnit.
+ *  - Source is lexed in memory first, so lexem texts are the unit's Text ranges.
+ *  - Semicolons are optional, as in spec/program.gg.
+ *  - Errors throw std::runtime_error, with "line:col:" of the lexem.
+ */
+class GrylangParser
+{
+private:
+    typedef GrylangLexer::Lexem Lexem;
+
+    ast::CompilationUnit& unit;
+    std::vector<Lexem> lexems;
+    size_t cur = 0;
+
+    // Elements of the lists being parsed. finishList() moves the top ones
+    // to the unit's list pool, so nested lists don't interleave there.
+    std::vector<ast::NodeIndex> scratch;
+
+    void lexSource();
+
+    // Lexem checks.
+    const Lexem& peek(size_t ahead = 0) const;
+    bool is(GrylangLexer::LexemCode code, const char* text, size_t ahead = 0) const;
+    inline bool isOp(const char* text, size_t ahead = 0) const {
+        return is(GrylangLexer::OPERATOR, text, ahead);
+    }
+    inline bool isKeyword(const char* text, size_t ahead = 0) const {
+        return is(GrylangLexer::KEYWORD, text, ahead);
+    }
+    inline bool isIdent(size_t ahead = 0) const {
+        return peek(ahead).code == GrylangLexer::IDENT;
+    }
+    bool isTypeKeyword(size_t ahead = 0) const;
+    bool onSameLine() const;
+    bool startsExpression() const;
+
+    bool acceptOp(const char* text);
+    bool acceptKeyword(const char* text);
+    void expectOp(const char* text);
+    ast::Text expectIdent();
+    ast::Text textOf(const Lexem& lex) const;
+
+    [[noreturn]] void error(const std::string& msg) const;
+
+    // Node constructors.
+    ast::NodeIndex addExpr(const ast::Expr& e);
+    ast::NodeIndex addStmt(const ast::Stmt& s);
+    ast::NodeIndex addDecl(const ast::Decl& d);
+    ast::NodeIndex addType(const ast::Type& t);
+    ast::Range finishList(size_t mark);
+
+    // Declarations.
+    bool looksLikeDecl() const;
+    ast::NodeIndex parseExtObject();
+    ast::NodeIndex parseFunction();
+    ast::NodeIndex parseClass();
+    ast::NodeIndex parseClassMember();
+    ast::NodeIndex parseVariable(bool withInit);
+    ast::Range parseParams();
+    ast::NodeIndex parseType();
+
+    // Statements.
+    ast::NodeIndex parseStatement();
+    ast::NodeIndex parseBlock();
+    ast::NodeIndex parseSwitch();
+
+    // Expressions, by falling precedence.
+    ast::NodeIndex parseExpression();
+    ast::NodeIndex parseRange();
+    ast::NodeIndex parseBinary(int minPrecedence);
+    ast::NodeIndex parseUnary();
+    ast::NodeIndex parseSecondary();
+    ast::NodeIndex parsePrimary();
+
+public:
+    GrylangParser(ast::CompilationUnit& compUnit) : unit( compUnit ) {}
+
+    /*! Parses the unit's source. The previous tree of the unit is cleared.
+     *  @throws runtime_error on a lexic or syntax error.
+     */
+    void parse();
+};
+
+}
+
+#endif //GRYLANGPARSER_H_INCLUDED
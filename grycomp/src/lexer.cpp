@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "lexic_gen.h" // Generated from spec/lexic.bnf by lexgen.
 #include <string>
 #include <cstdio>
 #include <cctype>
@@ -8,105 +9,176 @@
 
 namespace gpar{
 
-GrylangLexer::GrylangLexer(std::istream& inpStream) : input( inpStream ) {}
+GrylangLexer::GrylangLexer(std::istream& inpStream) 
+    : input( &inpStream ), block( BLOCK_SIZE ) 
+{}
+
+GrylangLexer::GrylangLexer(const char* source, size_t size) 
+    : blockBase( source ), pos( source ), end( source + size ), inputDone( true ), 
+      memorySource( true )
+{}
 
 // One-node methods
 bool GrylangLexer::hasNext(){
     return this->nextNode != nullptr;
 }
 
+/*! ParseNode adapter over the lexem stream. Allocates the node and it's data.
+ */ 
 std::shared_ptr<ParseNode> GrylangLexer::getNextNode(){
-    return getNextNode_Priv();
+    Lexem lex;
+    if(!nextLexem(lex))
+        return nullptr;
+
+    LexicParseData* data = new LexicParseData(lex.code, std::string(lastText, lex.length));
+    return std::make_shared<ParseNode>( std::shared_ptr<ParseData>((ParseData*)data) );
+}
+
+bool GrylangLexer::nextLexem(Lexem& lex){
+    return scanLexem(lex);
+}
+
+/*! Lexes up to maxCount lexems into the buffer. Buffer is cleared first, 
+ *  so it's capacity is reused, and no allocations are made once it's grown.
+ *  @return number of lexems got. Less than maxCount only at the end of input.
+ */ 
+size_t GrylangLexer::nextLexems(std::vector<Lexem>& buffer, size_t maxCount){
+    buffer.clear();
+    Lexem lex;
+    while(buffer.size() < maxCount && scanLexem(lex))
+        buffer.push_back(lex);
+    return buffer.size();
+}
+
+/*! Reads the next block of input.
+ *  @return false if no more input is present.
+ */ 
+bool GrylangLexer::fillBlock(){
+    if(inputDone)
+        return false;
+
+    blockOffset += end - blockBase;
+
+    input->read(block.data(), block.size());
+    size_t count = input->gcount();
+    if(!*input)
+        inputDone = true;
+
+    blockBase = pos = block.data();
+    end = pos + count;
+    return count > 0;
 }
 
-std::shared_ptr<ParseNode> GrylangLexer::getNextNode_Priv(bool getNextNode){
+/*! Gets the next char of input, refilling the block if needed.
+ *  - After the end of input, two spaces are given to finish the last lexem.
+ *  @return the char, or EOF if nothing is left.
+ */ 
+int GrylangLexer::getChar(){
+    lastWasPadding = false;
+    if(pos < end)
+        return (unsigned char)*pos++;
+
+    // Block exhausted. Save the part of current lexem which is in the block.
+    if(lexemStart && lexemStart < end)
+        lexemData.append(lexemStart, end);
+
+    if(fillBlock()){
+        lexemStart = pos;
+        return (unsigned char)*pos++;
+    }
+    lexemStart = end;
+
+    if(paddingCount < 2){
+        paddingCount++;
+        lastWasPadding = true;
+        return ' ';
+    }
+    return EOF;
+}
+
+/*! Puts back the last char got. Only one char can be put back.
+ */ 
+void GrylangLexer::ungetChar(){
+    if(lastWasPadding)
+        paddingCount--;
+    else
+        pos--;
+    lastWasPadding = false;
+}
+
+/*! Lexes the next lexem. Text of the lexem is then at lastText.
+ *  @return false if no more lexems are present.
+ */ 
+bool GrylangLexer::scanLexem(Lexem& lex){
     // Finite automaton states, which will be used in a loop.
     enum AutoStates {None, IdentOrKeywd, IntOrFloat, Float, CharStringStart, SpecChar,
         StandardChar, StringStart, CommOrDiv, OneLineComm, MultiLineComm, MultiLineEnd, 
-        UnaryOp, AssignableOp, AssignableRepeatableOp, Dash, Arrow, OperEquals, OperEqualsOperOper
+        Operator
     };
 
-    std::shared_ptr<ParseNode> returnNode;
-    /*if(this->nextNode != nullptr){
-        returnNode = this->nextNode;
-        this->nextNode = nullptr;
-    }*/
-    // Check if input is at error state, and nextNode == nullptr
-    /*else*/ if(input.eof() && nextSymbols.empty())
-        return nullptr;
+    // Check if input is fully consumed.
+    if(pos == end && !fillBlock())
+        return false;
 
-    // Get next node if no error is present.
-    LexicParseData newNode;
-    char c;
-    int endCount = 0;
+    // Get next lexem if no error is present.
+    LexemCode code = LexemCode::NONE;
+    int c;
+    int opState = 0;
+    const char* lexemEnd = nullptr;
     int as = AutoStates::None;
 
+    lexemData.clear();
+    lexemStart = pos;
+    lex.offset = offsetOf(pos);
+
     while(true){
-        // Get first chars from the buffer of next chars read in previous loop.
-        if(!nextSymbols.empty()){
-            c = nextSymbols[0];
-            nextSymbols.erase(0,1); // erase first element from buffer.
-        }
-        else if(!input.eof())
-            input.read(&c, 1);
-        else{ // input.eof(), and no chars on nextSyms buffer
-            //std::cout<<"\nEnd. c= "<<c<<"\n";
-            if(endCount<2){
-                c=' ';
-                endCount++;
-            }
-            else
-                break;
-        }
+        if( (c = getChar()) == EOF )
+            break;
 
         // Print debug data
-        //std::cout<<"State: "<<as<<", c: \'"<<c<<"\', nextChars: "<<nextSymbols<<"\n";
-        
-        // Push current char to buffer
-        newNode.data.push_back(c);
+        //std::cout<<"State: "<<as<<", c: \'"<<(char)c<<"\'\n";
 
         // Simulate a finite automaton using a switch statement. Every state can have it's own 
-        // possible outcomes.
+        // possible outcomes. Lexem ends either at the current char (which is then put 
+        // back for the next lexem), or before it (which is then skipped).
 
         switch(as){
         // START.
         case None:
-            if( isalpha(c) || c=='_' )
+            if( lexic::isIdentStart(c) )
                 as = IdentOrKeywd;
-            else if( isdigit(c) )
+            else if( lexic::isDigit(c) )
                 as = IntOrFloat;
             else if(c=='\'' || c=='\"'){ // We don't differentiate between a char and a string.
-                newNode.data.pop_back();
+                lexemStart = pos;
+                lex.offset = offsetOf(pos);
                 as = CharStringStart;
             }
             else if(c=='/')
                 as = CommOrDiv;
-            else if( strchr("{}[]().,:;~", c) ){
-                newNode.code = LexemCode::OPERATOR;
-                break;
+            else if(c=='#') // Directive line - treated as a comment.
+                as = OneLineComm;
+            else if( (opState = lexic::operatorNext(0, c)) >= 0 ){
+                as = Operator;
+                if( lexic::operatorFinal(opState) ){ // No longer operator can start with it.
+                    code = LexemCode::OPERATOR;
+                    lexemEnd = pos;
+                }
+            }
+            else if( std::isspace(c) ){
+                lexemStart = pos;
+                lex.offset = offsetOf(pos);
             }
-            else if( strchr("^!*%=", c) )
-                as = AssignableOp;
-            else if( strchr("&|+<>", c) )
-                as = AssignableRepeatableOp;
-            else if( c=='-' )
-                as = Dash;
-            else if( std::isspace(c) )
-                newNode.data.pop_back();
             else // Error!
-                throw std::runtime_error("Wrong character!!! "+std::to_string(c));
+                throw std::runtime_error("Wrong character!!! "+std::to_string((char)c));
             // get out of switch, and continue iteration.
             break;
 
         case IdentOrKeywd:
-            if( !(isalnum(c) || c=='_') ){ // No longer a word character - lexem complete.
-                newNode.data.pop_back(); // Pop an extra char, and add it to next loop's first read chars
-                nextSymbols.push_back(c); 
-                // Check if data string (lexem) is a keyword. If not, it's an identifier.
-                if(std::find(GKeywords.begin(), GKeywords.end(), newNode.data) != GKeywords.end())
-                    newNode.code = LexemCode::KEYWORD;
-                else
-                    newNode.code = LexemCode::IDENT;
+            if( !lexic::isIdentChar(c) ){ // No longer a word character - lexem complete.
+                ungetChar(); // Put back an extra char, for the next lexem.
+                lexemEnd = pos;
+                code = LexemCode::IDENT; // Checked for keywords below.
             }
             // If word character, then don't change state - just resume the loop.
             break;
@@ -114,19 +186,19 @@ std::shared_ptr<ParseNode> GrylangLexer::getNextNode_Priv(bool getNextNode){
         case IntOrFloat:
             if(c=='.') // Decimal point occured - it's float.
                 as = Float;
-            else if( !isdigit(c) ){ // Not a digit - integer end.
-                newNode.code = LexemCode::INTEGER;
-                newNode.data.pop_back();
-                nextSymbols.push_back(c);
+            else if( !lexic::isDigit(c) ){ // Not a digit - integer end.
+                code = LexemCode::INTEGER;
+                ungetChar();
+                lexemEnd = pos;
             }
             // If digit, don't change anything - number end is not reached.
             break; 
                  
         case Float:
-            if( !isdigit(c) ){ // Not a digit - float end.
-                newNode.code = LexemCode::FLOAT;
-                newNode.data.pop_back();
-                nextSymbols.push_back(c);
+            if( !lexic::isDigit(c) ){ // Not a digit - float end.
+                code = LexemCode::FLOAT;
+                ungetChar();
+                lexemEnd = pos;
             }
             break;
 
@@ -134,8 +206,8 @@ std::shared_ptr<ParseNode> GrylangLexer::getNextNode_Priv(bool getNextNode){
             if( c=='\\' ) // Expect special character
                 as = SpecChar;
             if( c=='\'' || c=='\"' ){
-                newNode.code = LexemCode::STRING;
-                newNode.data.pop_back();
+                code = LexemCode::STRING;
+                lexemEnd = pos - 1;
             }
             // If any other, stay on this state.
             break;
@@ -150,17 +222,17 @@ std::shared_ptr<ParseNode> GrylangLexer::getNextNode_Priv(bool getNextNode){
                 as = OneLineComm;
             else if( c=='*' )
                 as = MultiLineComm;
-            else{
-                newNode.code = LexemCode::OPERATOR;
-                newNode.data.pop_back();
-                nextSymbols.push_back(c);
+            else{ // Division operator - continue it in the operator DFA.
+                opState = lexic::operatorNext(0, '/');
+                as = Operator;
+                ungetChar();
             }
             break;
 
         case OneLineComm:
             if( c=='\n' ){
-                newNode.code = LexemCode::COMMENT;
-                newNode.data.pop_back();
+                code = LexemCode::COMMENT;
+                lexemEnd = pos - 1;
             }
             // If not endline, stay on this state.
             break;
@@ -175,84 +247,58 @@ std::shared_ptr<ParseNode> GrylangLexer::getNextNode_Priv(bool getNextNode){
             if( c=='*' )
                 {} // Stay on MultiLineEnd state.
             else if(c=='/'){
-                newNode.code = LexemCode::COMMENT;
-                newNode.data.pop_back();
+                code = LexemCode::COMMENT;
+                lexemEnd = pos - 1;
             }
             else // If any other char, move to main muliline state.
                 as = MultiLineComm; 
             break;
 
-        case AssignableOp:
-            if( c=='=' )
-                as = OperEquals;
-            else{
-                newNode.code = LexemCode::OPERATOR;
-                newNode.data.pop_back();
-                nextSymbols.push_back(c);
+        case Operator:
+            // Operators are matched by the DFA generated from the spec. Every state
+            // is accepting, so the longest operator ends before the first unmatched char.
+            if( (opState = lexic::operatorNext(opState, c)) >= 0 ){
+                if( lexic::operatorFinal(opState) ){
+                    code = LexemCode::OPERATOR;
+                    lexemEnd = pos;
+                }
             }
-            break;
-
-        case OperEquals: ///=, &=, etc
-            // No matter what char, output operator.
-            newNode.code = LexemCode::OPERATOR;
-            newNode.data.pop_back();
-            nextSymbols.push_back(c);
-            break;
-
-        case AssignableRepeatableOp:
-            if( c=='=' || c==newNode.data[0] )
-                as = OperEquals;
             else{
-                newNode.code = LexemCode::OPERATOR;
-                newNode.data.pop_back();
-                nextSymbols.push_back(c);
-            }
-            break;
-
-        case Dash: // We have a '-'. Now, next char can be '-', '=', '>' (corresponding ops are -- -= ->)
-            if( c=='-' || c=='=' || c=='>' )
-                as = OperEquals;
-            else{
-                newNode.code = LexemCode::OPERATOR;
-                newNode.data.pop_back();
-                nextSymbols.push_back(c);
+                code = LexemCode::OPERATOR;
+                ungetChar();
+                lexemEnd = pos;
             }
             break;
         }
 
         // After one state switch, check if lexem found, or error occured. If yes, quit loop,
         // If no, get another symbol and continue loop with another iteration of automaton state switch.
-        if(newNode.code != LexemCode::NONE)
+        if(code != LexemCode::NONE)
             break;
     }
 
-    if(newNode.code == LexemCode::NONE){
-        newNode.code = LexemCode::FatalERROR;
-        return nullptr;
+    if(code == LexemCode::NONE){
+        lexemStart = nullptr;
+        return false;
     }
 
-    /*
-    if(getNextNode){
-        this->nextNode = std::make_shared<ParseNode>( std::shared_ptr<ParseData>((ParseData*)(new LexicParseData(newNode))) );
-
-        if(returnNode == nullptr){
-            returnNode = this->nextNode;
-            this->nextNode = nullptr;
-            this->nextNode = this->getNextNode_Priv( false ); 
-            // In this->call we set getNextNode to false, to prevent infinite recursion, 
-            // because we are using this->function to get the next node.
-        }
-    }
+    // Lexem is the saved part from previous blocks, and the part in current block.
+    size_t inBlock = (lexemEnd > lexemStart ? lexemEnd - lexemStart : 0);
+    if(lexemData.empty())
+        lastText = lexemStart;
     else{
-        if(returnNode == nullptr)
-            returnNode = std::make_shared<ParseNode>( std::shared_ptr<ParseData>((ParseData*)(new LexicParseData(newNode))) );
+        lexemData.append(lexemStart, inBlock);
+        lastText = lexemData.data();
     }
-    */
-    returnNode = std::make_shared<ParseNode>( std::shared_ptr<ParseData>((ParseData*)(new LexicParseData(newNode))) );
-
-    return returnNode;
-}
+    lex.length = lexemData.empty() ? inBlock : lexemData.size();
+    lexemStart = nullptr;
 
+    // Check if lexem is a keyword. If not, it's an identifier.
+    if(code == LexemCode::IDENT && lexic::findKeyword(lastText, lex.length) >= 0)
+        code = LexemCode::KEYWORD;
 
+    lex.code = code;
+    return true;
 }
 
+}
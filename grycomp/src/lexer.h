@@ -5,6 +5,7 @@
 #include "gparsenode.h"
 #include <istream>
 #include <string>
+#include <vector>
 
 namespace gpar{
 
@@ -13,19 +14,48 @@ namespace gpar{
 class GrylangLexer : GParser
 {
 private:
-    std::istream& input;
+    std::istream* input = nullptr;
     std::shared_ptr<ParseNode> rootNode;
     std::shared_ptr<ParseNode> nextNode;
     bool storeAllNodes = false;
 
-    std::string nextSymbols;
+    // Block buffer over the input. The automaton reads chars by pointer, and
+    // pushback just moves the pointer back.
+    static const size_t BLOCK_SIZE = 64 * 1024;
 
-    std::shared_ptr<ParseNode> getNextNode_Priv(bool getNxtNode = true);
+    std::vector<char> block;
+    const char* blockBase = nullptr;
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    size_t blockOffset = 0; // Input offset of blockBase.
+    bool inputDone = false;
+    bool memorySource = false; // Whole input is one block in the caller's memory.
+
+    // Start of the current lexem in the block. Parts of a lexem spanning
+    // more blocks are saved to lexemData when the block is refilled.
+    const char* lexemStart = nullptr;
+    std::string lexemData;
+
+    // Text of the last lexem got. Either in the block, or in lexemData.
+    const char* lastText = nullptr;
+
+    // Spaces given after the end of input, to finish the last lexem.
+    int paddingCount = 0;
+    bool lastWasPadding = false;
+
+    bool fillBlock();
+    int getChar();
+    void ungetChar();
+
+    inline size_t offsetOf(const char* p) const { return blockOffset + (p - blockBase); }
 
 public:
     GrylangLexer(std::istream& inputStream);
 
-    // One-node methods
+    // Lexes the source in memory, without copying it. Source must outlive the lexer.
+    GrylangLexer(const char* source, size_t size);
+
+    // One-node methods. ParseNode is an adapter over the lexem stream.
     bool hasNext();
     std::shared_ptr<ParseNode> getNextNode();
     //std::shared_ptr<ParseNode> getNextNode(const& ParseData criteria);
@@ -46,12 +76,32 @@ public:
          OPERATOR = 8
     };
 
-    const std::vector<std::string> GKeywords = {
-        "char" , "int" , "int16" , "int32" , "int64" , "float" , "double" , "void" , "var"
-        , "fun" , "class" , "private" , "protected" , "public" , "extends" , "implements"
-        , "const" , "volatile" , "if" , "else" , "switch" , "case" , "default" , "while"
-        , "for" , "foreach" , "in" , "break" , "goto" , "return"
+    // Keywords, character classes and operators are in lexic_gen.h,
+    // generated from spec/lexic.bnf.
+
+    /*! Lexem - a value, referring to the lexem's text in the input.
+     *  - offset is the position in the input. Strings are without quotes.
+     */
+    struct Lexem{
+        LexemCode code = LexemCode::NONE;
+        size_t offset = 0;
+        size_t length = 0;
     };
+
+    // Lexem stream methods. Don't allocate, except for lexems spanning input blocks.
+    bool nextLexem(Lexem& lex);
+    size_t nextLexems(std::vector<Lexem>& buffer, size_t maxCount);
+
+    // Text of the last lexem got. Valid until the next lexem is got.
+    inline const char* lastLexemText() const { return lastText; }
+
+    // Text of any lexem, if the source is in memory. nullptr otherwise.
+    inline const char* lexemText(const Lexem& lex) const { 
+        return memorySource ? blockBase + lex.offset : nullptr; 
+    }
+
+private:
+    bool scanLexem(Lexem& lex);
 };
 
 // Lexer ParseData class
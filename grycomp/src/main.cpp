@@ -1,8 +1,83 @@
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <string>
 #include "lexer.h"
+#include "grylangparser.h"
+#include "compiler.h"
+#include "vm.h"
+
+/*! Parses the file, and either prints it's AST or bytecode, or runs it.
+ *  Usage: grycomp [--ast | --bytecode] [--switch] <file> [args...]
+ */
+static int runFile(int argc, char** argv){
+    bool dumpAst = false, dumpBytecode = false, switchDispatch = false;
+    int i = 1;
+    for( ; i < argc && argv[i][0] == '-'; i++ ){
+        if( !strcmp(argv[i], "--ast") )
+            dumpAst = true;
+        else if( !strcmp(argv[i], "--bytecode") )
+            dumpBytecode = true;
+        else if( !strcmp(argv[i], "--switch") )
+            switchDispatch = true;
+        else{
+            std::cout<<"Unknown option "<<argv[i]<<"\n";
+            return 1;
+        }
+    }
+    if( i >= argc ){
+        std::cout<<"Usage: grycomp [--ast | --bytecode] [--switch] <file> [args...]\n";
+        return 1;
+    }
+    const char* path = argv[i];
+    std::vector<std::string> args( argv + i, argv + argc );
+
+    std::ifstream file(path, std::ios::binary);
+    if(!file){
+        std::cout<<"Can't open "<<path<<"\n";
+        return 1;
+    }
+    std::ostringstream contents;
+    contents<<file.rdbuf();
+
+    gpar::ast::CompilationUnit unit( contents.str() );
+    gpar::vm::Program program;
+    try{
+        gpar::GrylangParser parser(unit);
+        parser.parse();
+        if( dumpAst ){
+            unit.dump(std::cout);
+            return 0;
+        }
+
+        gpar::vm::BytecodeCompiler(unit, program).compile();
+        if( dumpBytecode ){
+            program.disassemble(std::cout);
+            return 0;
+        }
+    } catch(std::exception& e) {
+        std::cout<<path<<":"<<e.what()<<"\n";
+        return 1;
+    }
+
+    try{
+        gpar::vm::VM vm(program, std::cout);
+        if( switchDispatch )
+            vm.setDispatch( gpar::vm::VM::Dispatch::Switch );
+        return vm.run(args);
+    } catch(std::exception& e) {
+        std::cout.flush();
+        std::cerr<<e.what()<<"\n";
+        return 1;
+    }
+}
 
 int main(int argc, char** argv){
+    if(argc > 1)
+        return runFile(argc, argv);
+
     std::cout<<"Testing.\n";
     std::istringstream stream("string i=\"jjjj\\\"hah\";\\\" const int o = 60;", std::ios::in | std::ios::binary);
     //std::ifstream stream("../spec/program.gg", std::ios::binary);
@@ -0,0 +1,184 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cassert>
+#include <stdexcept>
+#include "../grylangparser.h"
+
+/*! Unit Tests for the Grylang parser and AST.
+ */
+
+static std::string parseAndDump(const std::string& source){
+    gpar::ast::CompilationUnit unit{ std::string(source) };
+    gpar::GrylangParser parser(unit);
+    parser.parse();
+
+    std::ostringstream os;
+    unit.dump(os);
+    return os.str();
+}
+
+static bool parseFails(const std::string& source){
+    try{
+        parseAndDump(source);
+    } catch(std::runtime_error& e){
+        return true;
+    }
+    return false;
+}
+
+static void testProgram(){
+    const char* program = 
+        "#import stdlib\n"
+        "class foo\n"
+        "{\n"
+        "    private const float x = \"3.14\"\n"
+        "    public foo()\n"
+        "    {\n"
+        "        print(\"foo\"+x)\n"
+        "    }\n"
+        "}\n"
+        "fun main(int argc, char[][] argv) : int\n"
+        "{\n"
+        "    char[5] arr = \"hello\"\n"
+        "    foreach ( c in arr )\n"
+        "        print(c)\n"
+        "    println('\\n'+(char)(2+2))\n"
+        "    uuu:\n"
+        "    if(a > 3)\n"
+        "        goto eee;\n"
+        "    a++\n"
+        "    goto uuu\n"
+        "    eee:\n"
+        "    return 0;\n"
+        "}\n";
+
+    assert( parseAndDump( program ) ==
+        "(class foo\n"
+        "  (var :private x (const float) \"3.14\")\n"
+        "  (constructor :public foo ()\n"
+        "    (block\n"
+        "      (print (+ \"foo\" x)))))\n"
+        "(fun main ((var argc int) (var argv char[][])) : int\n"
+        "  (block\n"
+        "    (var arr char[5] \"hello\")\n"
+        "    (foreach c arr\n"
+        "      (print c))\n"
+        "    (println (+ '\\n' (cast char (+ 2 2))))\n"
+        "    (label uuu)\n"
+        "    (if (> a 3)\n"
+        "      (goto eee))\n"
+        "    (post++ a)\n"
+        "    (goto uuu)\n"
+        "    (label eee)\n"
+        "    (return 0)))\n" );
+}
+
+static void testExpressions(){
+    assert( parseAndDump( "var x = a + b * c - d" ) == 
+            "(var x var (- (+ a (* b c)) d))\n" );
+    assert( parseAndDump( "var x = a || b && c == d | e ^ f & g << h" ) == 
+            "(var x var (|| a (&& b (== c (| d (^ e (& f (<< g h))))))))\n" );
+    assert( parseAndDump( "fun f(){ a = b += 1; x <<= 2; v[1].m->n(1, 2)++ }" ) ==
+            "(fun f ()\n"
+            "  (block\n"
+            "    (= a (+= b 1))\n"
+            "    (<<= x 2)\n"
+            "    (post++ (call (-> (. (index v 1) m) n) 1 2))))\n" );
+    assert( parseAndDump( "int[3] a = {1, -2, sizeof b}; var r = 0..10" ) == 
+            "(var a int[3] (init 1 (- 2) (sizeof b)))\n"
+            "(var r var (.. 0 10))\n" );
+}
+
+static void testStatements(){
+    assert( parseAndDump(
+        "fun f(Node* n) : void {\n"
+        "    for(i = 0; i < 10; i++) { if(i == 2) break; else continue_() }\n"
+        "    while() return\n"
+        "    switch(n->v){ case 1: case 2: f(n) default: goto out }\n"
+        "    out:\n"
+        "}" ) ==
+        "(fun f ((var n Node*)) : void\n"
+        "  (block\n"
+        "    (for (= i 0) (< i 10) (post++ i)\n"
+        "      (block\n"
+        "        (if (== i 2)\n"
+        "          (break)\n"
+        "          (call continue_))))\n"
+        "    (while -\n"
+        "      (return))\n"
+        "    (switch (-> n v)\n"
+        "      (case 1)\n"
+        "      (case 2\n"
+        "        (call f n))\n"
+        "      (default\n"
+        "        (goto out)))\n"
+        "    (label out)))\n" );
+}
+
+static void testClasses(){
+    assert( parseAndDump(
+        "class B extends A, C {\n"
+        "    public override fun get() : int { return v }\n"
+        "    B(int v)\n"
+        "    ~B() {}\n"
+        "    final A* next\n"
+        "}" ) ==
+        "(class B extends A C\n"
+        "  (fun :public :override get () : int\n"
+        "    (block\n"
+        "      (return v)))\n"
+        "  (constructor B ((var v int)))\n"
+        "  (destructor B\n"
+        "    (block))\n"
+        "  (var :final next A*))\n" );
+}
+
+static void testErrors(){
+    assert( parseFails( "fun f() { x = (1 + }" ) );
+    assert( parseFails( "class A {" ) );
+    assert( parseFails( "fun f() { foreach(x arr) y }" ) );
+    assert( parseFails( "42" ) );
+
+    try{
+        parseAndDump( "fun f()\n{\n  x = ;\n}" );
+        assert( false );
+    } catch(std::runtime_error& e){
+        assert( std::string( e.what() ).find( "3:7:" ) == 0 );
+    }
+}
+
+static void testPools(){
+    gpar::ast::CompilationUnit unit( "fun f(){ g(1, 2) }" );
+    gpar::GrylangParser parser(unit);
+    parser.parse();
+
+    assert( unit.topLevel.count == 1 );
+    const gpar::ast::Decl& f = unit.decls[ unit.at( unit.topLevel, 0 ) ];
+    assert( unit.textIs( f.name, "f" ) );
+
+    const gpar::ast::Stmt& body = unit.stmts[ f.body ];
+    const gpar::ast::Expr& call = unit.exprs[ unit.stmts[ unit.at( body.list, 0 ) ].a ];
+    assert( call.kind == gpar::ast::ExprKind::Call && call.list.count == 2 );
+    assert( unit.text( unit.exprs[ unit.at( call.list, 1 ) ].text ) == "2" );
+
+    // Reparsing replaces the tree.
+    parser.parse();
+    assert( unit.decls.size() == 1 && unit.exprs.size() == 4 );
+    unit.clearTree();
+    assert( unit.exprs.empty() && unit.topLevel.count == 0 );
+}
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing Grylang parser ] ... ";
+
+    testProgram();
+    testExpressions();
+    testStatements();
+    testClasses();
+    testErrors();
+    testPools();
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
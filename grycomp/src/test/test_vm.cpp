@@ -0,0 +1,223 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdexcept>
+#include "../grylangparser.h"
+#include "../compiler.h"
+#include "../vm.h"
+
+/*! Unit Tests for the Grylang bytecode compiler and VM.
+ *  Every program is run with both dispatch loops, which must print the same.
+ */
+
+using gpar::vm::VM;
+
+static void compileSource(const std::string& source, gpar::ast::CompilationUnit& unit,
+                          gpar::vm::Program& program){
+    unit.source = source;
+    gpar::GrylangParser( unit ).parse();
+    gpar::vm::BytecodeCompiler( unit, program ).compile();
+}
+
+static std::string runSource(const std::string& source, int* exitCode = nullptr,
+                             const std::vector<std::string>& args = std::vector<std::string>()){
+    gpar::ast::CompilationUnit unit;
+    gpar::vm::Program program;
+    compileSource( source, unit, program );
+
+    std::vector<VM::Dispatch> dispatches = { VM::Dispatch::Switch };
+    if( VM::threadedAvailable() )
+        dispatches.push_back( VM::Dispatch::Threaded );
+
+    std::string output;
+    int firstCode = 0;
+    for( size_t i = 0; i < dispatches.size(); i++ ){
+        std::ostringstream os;
+        VM vm( program, os );
+        vm.setDispatch( dispatches[i] );
+        int code = vm.run( args );
+
+        if( i > 0 )
+            assert( os.str() == output && code == firstCode );
+        output = os.str();
+        firstCode = code;
+    }
+    if( exitCode )
+        *exitCode = firstCode;
+    return output;
+}
+
+static bool compileFails(const std::string& source){
+    gpar::ast::CompilationUnit unit;
+    gpar::vm::Program program;
+    try{
+        compileSource( source, unit, program );
+    } catch(std::runtime_error& e){
+        return true;
+    }
+    return false;
+}
+
+static bool runFails(const std::string& source){
+    try{
+        runSource( source );
+    } catch(std::runtime_error& e){
+        return std::string( e.what() ).find( "Runtime error" ) == 0;
+    }
+    return false;
+}
+
+static void testExpressions(){
+    assert( runSource( "fun main(){ println(1 + 2 * 3 - 8 / 4 % 3) }" ) == "5\n" );
+    assert( runSource( "fun main(){ println((1 << 4 | 3) ^ 1 & 7) println(-7 / 2) println(~0) }" ) == 
+            "18\n-3\n-1\n" );
+    assert( runSource( "fun main(){ println(3 > 2 && 2 >= 2 || 1 == 0) println(!5) println(1 != 1) }" ) == 
+            "1\n0\n0\n" );
+    assert( runSource( "fun main(){ println(1.5 * 2) println(7 / 2.0) println(3 < 3.5) }" ) == 
+            "3\n3.5\n1\n" );
+    assert( runSource( "fun main(){ println((int)3.7) println((float)1 / 4) println((char)65) }" ) == 
+            "3\n0.25\nA\n" );
+}
+
+static void testStrings(){
+    assert( runSource( "fun main(){ var x = 42 print(\"foo\" + x) println('!') }" ) == "foo42!\n" );
+    assert( runSource( "fun main(){ println('a' + 'b') println('a' + 1) println(\"x\" + 1.5) }" ) == 
+            "ab\n98\nx1.5\n" );
+    assert( runSource( "fun main(){ char[5] s = \"hello\" s[0] = 'j' println(s) println(len(s)) }" ) == 
+            "jello\n5\n" );
+    assert( runSource( "fun main(){ println(\"abc\" == \"ab\" + 'c') println(\"a\" < \"b\") }" ) == 
+            "1\n1\n" );
+    assert( runSource( "fun main(){ int i = \"12\" float f = \"0.5\" println(i + f) }" ) == "12.5\n" );
+    assert( runSource( "fun main(){ println(\"tab\\there\\\\\") }" ) == "tab\there\\\n" );
+}
+
+static void testStatements(){
+    assert( runSource(
+        "fun main(){\n"
+        "    int i\n"
+        "    for(i = 0; i < 10; i++){ if(i == 3) break; print(i) }\n"
+        "    while(i > 0) i--\n"
+        "    println(i)\n"
+        "}" ) == "0120\n" );
+
+    assert( runSource(
+        "fun main(){\n"
+        "    foreach(i in 0..5){ switch(i){ case 1: print('a') case 2: print('b') break; default: print('-') } }\n"
+        "    println(\"\")\n"
+        "}" ) == "-abb--\n" );
+
+    assert( runSource(
+        "fun main(){\n"
+        "    foreach(c in \"hey\") print(c + 1 - 1)\n"
+        "    foreach(x in {3, 4}) print(x)\n"
+        "    println(\"\")\n"
+        "}" ) == "10410112134\n" );
+
+    // Goto, and the loop variable being a copy.
+    assert( runSource(
+        "fun main(){\n"
+        "    int n = 0\n"
+        "    again:\n"
+        "    n += 2\n"
+        "    if(n < 10) goto again\n"
+        "    foreach(i in 0..3){ print(i) i = 100 }\n"
+        "    println(n)\n"
+        "}" ) == "01210\n" );
+
+    // Shadowing.
+    assert( runSource( "fun main(){ int a = 1 { int a = a + 1 print(a) } println(a) }" ) == "21\n" );
+}
+
+static void testFunctions(){
+    assert( runSource(
+        "fun fib(int n) : int { if(n < 2) return n return fib(n - 1) + fib(n - 2) }\n"
+        "fun main(){ println(fib(20)) }" ) == "6765\n" );
+
+    // Globals, and functions used before their definition.
+    assert( runSource(
+        "int counter = start()\n"
+        "fun bump(int by){ counter += by }\n"
+        "fun start() : int { return 10 }\n"
+        "fun main(){ bump(5) bump(counter) println(counter) }" ) == "30\n" );
+
+    // Short circuit.
+    assert( runSource(
+        "int calls\n"
+        "fun side() : int { calls++ return 1 }\n"
+        "fun main(){ var x = 0 && side() var y = 1 || side() var z = 1 && side() println(calls + x + y + z) }" ) 
+        == "3\n" );
+
+    // Deep recursion grows the register stack.
+    assert( runSource(
+        "fun depth(int n) : int { if(n == 0) return 0 return 1 + depth(n - 1) }\n"
+        "fun main(){ println(depth(20000)) }" ) == "20000\n" );
+
+    int code = 0;
+    assert( runSource( "fun main(int argc, char[][] argv) : int { print(argv[1]) return argc }", &code, 
+                       { "a", "bc" } ) == "bc" && code == 2 );
+}
+
+static void testArrays(){
+    assert( runSource(
+        "fun main(){\n"
+        "    int[4] a\n"
+        "    a[1] = 5 a[2] += 7 a[3]++\n"
+        "    println(a)\n"
+        "    var b = {1, \"two\", {3}}\n"
+        "    println(b)\n"
+        "    println(sizeof b)\n"
+        "}" ) == "[0, 5, 7, 1]\n[1, two, [3]]\n3\n" );
+}
+
+static void testCollector(){
+    gpar::ast::CompilationUnit unit;
+    gpar::vm::Program program;
+    compileSource(
+        "var keep = {\"x\"}\n"
+        "fun main(){\n"
+        "    var s = \"\"\n"
+        "    foreach(i in 0..100000){ s = \"n\" + i if(i % 1000 == 0) keep = {keep, s} }\n"
+        "    println(s)\n"
+        "}", unit, program );
+
+    std::ostringstream os;
+    VM vm( program, os );
+    vm.run();
+    assert( os.str() == "n99999\n" );
+    assert( vm.heapObjects() < 20000 );
+}
+
+static void testErrors(){
+    assert( runFails( "fun main(){ var x = 0 println(1 / x) }" ) );
+    assert( runFails( "fun main(){ int[2] a a[2] = 1 }" ) );
+    assert( runFails( "fun main(){ var s = \"const\" s[0] = 'k' }" ) );
+    assert( runFails( "fun main(){ var a = {1} println(a < 2) }" ) );
+    assert( runFails( "fun f(int n) : int { return f(n + 1) } fun main(){ f(0) }" ) );
+
+    assert( compileFails( "fun main(){ println(y) }" ) );
+    assert( compileFails( "fun main(){ g() }" ) );
+    assert( compileFails( "fun f(int a){} fun main(){ f() }" ) );
+    assert( compileFails( "fun main(){ break }" ) );
+    assert( compileFails( "fun main(){ goto nowhere }" ) );
+    assert( compileFails( "fun main(){ lbl: lbl: }" ) );
+    assert( compileFails( "fun main(){ var o = 1 o.x = 2 }" ) );
+    assert( compileFails( "fun main(){ var r = 0..3 }" ) );
+    assert( compileFails( "fun f() fun main(){ f() }" ) );
+}
+
+int main(int argc, char** argv){
+    std::cout<<"[ Testing Grylang VM ] ... ";
+
+    testExpressions();
+    testStrings();
+    testStatements();
+    testFunctions();
+    testArrays();
+    testCollector();
+    testErrors();
+
+    std::cout<<"[ Success! ]\n";
+    return 0;
+}
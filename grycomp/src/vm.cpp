@@ -0,0 +1,630 @@
+#include "vm.h"
+#include <cstdlib>
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+
+namespace gpar{
+namespace vm{
+
+VM::VM(const Program& prog, std::ostream& output)
+    : program( prog ), out( output ), stack( 1024 )
+{}
+
+VM::~VM(){
+    while(heap){
+        Object* next = heap->next;
+        freeObject(heap);
+        heap = next;
+    }
+}
+
+void VM::setDispatch(Dispatch d){
+    if(d == Dispatch::Threaded && !threadedAvailable())
+        throw std::runtime_error("Threaded dispatch is not available in this build");
+    dispatch = d;
+}
+
+void VM::runtimeError(const std::string& msg) const {
+    throw std::runtime_error("Runtime error in " + (current ? current->name : std::string("?")) +
+                             ": " + msg);
+}
+
+int VM::run(const std::vector<std::string>& args){
+    frames.clear();
+    globals.assign(program.globalNames.size(), Value());
+    current = nullptr;
+
+    if(program.initFunction >= 0)
+        invoke(program.initFunction, 0);
+    if(program.mainFunction < 0)
+        return 0;
+
+    const Function& main = program.functions[ program.mainFunction ];
+    growStack(main.frameSize);
+    if(main.params >= 1)
+        stack[0] = Value::integer((int64_t)args.size());
+    if(main.params >= 2){
+        // Array is made first, so the strings are reachable while they're made.
+        stack[1] = newArray(std::vector<Value>(args.size()));
+        for(size_t i = 0; i < args.size(); i++){
+            Value arg = newString(std::string(args[i]));
+            arrayOf(stack[1])[i] = arg;
+        }
+    }
+
+    Value result = invoke(program.mainFunction, 0);
+    return (result.type == Value::Int ? (int)result.i : 0);
+}
+
+Value VM::invoke(unsigned function, size_t base){
+#if GRYVM_COMPUTED_GOTO
+    if(dispatch == Dispatch::Threaded)
+        return execute<true>(function, base);
+#endif
+    return execute<false>(function, base);
+}
+
+void VM::growStack(size_t size){
+    if(size <= stack.size())
+        return;
+    if(size > MAX_STACK)
+        runtimeError("Stack overflow");
+    stack.resize(std::max(size, stack.size() * 2));
+}
+
+//=========================================//
+// Interpreter loop
+
+/*! Runs the function, with it's registers starting at stack[base].
+ *  - Handlers are the labels op_<NAME>. Both dispatch loops jump to them:
+ *    threaded one directly from the previous handler, switch one through
+ *    the central switch.
+ */
+template<bool Threaded>
+Value VM::execute(unsigned function, size_t entryBase){
+#if GRYVM_COMPUTED_GOTO
+    static void* const jumpTable[] = {
+    #define GRY_OPCODE_LABEL(name) &&op_##name,
+        GRY_OPCODES(GRY_OPCODE_LABEL)
+    #undef GRY_OPCODE_LABEL
+    };
+    #define VM_DISPATCH() \
+        do{ ins = *pc++; if(Threaded) goto *jumpTable[ ins & 0xFF ]; goto switchDispatch; }while(0)
+#else
+    #define VM_DISPATCH() do{ ins = *pc++; goto switchDispatch; }while(0)
+#endif
+
+    #define RA base[ argA(ins) ]
+    #define RB base[ argB(ins) ]
+    #define RC base[ argC(ins) ]
+
+    // Integer fast path, and the slow path for the rest.
+    #define VM_ARITH(name, cond, expr) \
+        op_##name: { \
+            const Value& b = RB; const Value& c = RC; \
+            if(b.type == Value::Int && c.type == Value::Int && (cond)) \
+                RA = Value::integer(expr); \
+            else \
+                RA = arith(Opcode::name, b, c); \
+            VM_DISPATCH(); \
+        }
+    #define VM_COMPARE(name, expr) \
+        op_##name: { \
+            const Value& b = RB; const Value& c = RC; \
+            if(b.type == Value::Int && c.type == Value::Int) \
+                RA = Value::integer(expr); \
+            else \
+                RA = Value::integer(compare(Opcode::name, b, c)); \
+            VM_DISPATCH(); \
+        }
+
+    const size_t entryFrames = frames.size();
+    const Function* fn = &program.functions[ function ];
+    growStack(entryBase + fn->frameSize);
+    Value* base = stack.data() + entryBase;
+    for(unsigned r = fn->params; r < fn->frameSize; r++)
+        base[r] = Value();
+    current = fn;
+
+    const Value* constants = program.constants.data();
+    const Instr* pc = fn->code.data();
+    Instr ins;
+
+    VM_DISPATCH();
+
+switchDispatch:
+    switch(opOf(ins)){
+    #define GRY_OPCODE_CASE(name) case Opcode::name: goto op_##name;
+        GRY_OPCODES(GRY_OPCODE_CASE)
+    #undef GRY_OPCODE_CASE
+    default:
+        runtimeError("Bad opcode " + std::to_string(ins & 0xFF));
+    }
+
+op_NOP:
+    VM_DISPATCH();
+op_MOVE:
+    RA = RB;
+    VM_DISPATCH();
+op_LOADK:
+    RA = constants[ argBx(ins) ];
+    VM_DISPATCH();
+op_LOADI:
+    RA = Value::integer(argSBx(ins));
+    VM_DISPATCH();
+op_LOADNIL:
+    RA = Value();
+    VM_DISPATCH();
+op_GETG:
+    RA = globals[ argBx(ins) ];
+    VM_DISPATCH();
+op_SETG:
+    globals[ argBx(ins) ] = RA;
+    VM_DISPATCH();
+
+    // Wrapping, as in the unsigned arithmetic.
+    VM_ARITH(ADD, true, (int64_t)((uint64_t)b.i + (uint64_t)c.i))
+    VM_ARITH(SUB, true, (int64_t)((uint64_t)b.i - (uint64_t)c.i))
+    VM_ARITH(MUL, true, (int64_t)((uint64_t)b.i * (uint64_t)c.i))
+    VM_ARITH(DIV, c.i > 0, b.i / c.i)
+    VM_ARITH(MOD, c.i > 0, b.i % c.i)
+    VM_ARITH(SHL, (uint64_t)c.i < 64, (int64_t)((uint64_t)b.i << c.i))
+    VM_ARITH(SHR, (uint64_t)c.i < 64, b.i >> c.i)
+    VM_ARITH(BAND, true, b.i & c.i)
+    VM_ARITH(BOR, true, b.i | c.i)
+    VM_ARITH(BXOR, true, b.i ^ c.i)
+
+    VM_COMPARE(EQ, b.i == c.i)
+    VM_COMPARE(NE, b.i != c.i)
+    VM_COMPARE(LT, b.i < c.i)
+    VM_COMPARE(LE, b.i <= c.i)
+
+op_NEG:
+    RA = unary(Opcode::NEG, RB);
+    VM_DISPATCH();
+op_NOT:
+    RA = Value::integer(!truthy(RB));
+    VM_DISPATCH();
+op_BNOT:
+    RA = unary(Opcode::BNOT, RB);
+    VM_DISPATCH();
+op_BOOL:
+    RA = Value::integer(truthy(RB));
+    VM_DISPATCH();
+op_INC:{
+    Value& a = RA;
+    if(a.type == Value::Int)
+        a.i = (int64_t)((uint64_t)a.i + 1);
+    else
+        step(a, 1);
+    VM_DISPATCH();
+}
+op_DEC:{
+    Value& a = RA;
+    if(a.type == Value::Int)
+        a.i = (int64_t)((uint64_t)a.i - 1);
+    else
+        step(a, -1);
+    VM_DISPATCH();
+}
+op_CONV:
+    RA = convert(RB, (Conversion)argC(ins));
+    VM_DISPATCH();
+
+op_JMP:
+    pc += argSBx(ins);
+    VM_DISPATCH();
+op_JMPT:
+    if(truthy(RA))
+        pc += argSBx(ins);
+    VM_DISPATCH();
+op_JMPF:
+    if(!truthy(RA))
+        pc += argSBx(ins);
+    VM_DISPATCH();
+
+op_NEWARR:
+    RA = makeArray(RB, (Conversion)argC(ins));
+    VM_DISPATCH();
+op_INITARR:{
+    Value* first = &RB;
+    RA = newArray(std::vector<Value>(first, first + argC(ins)));
+    VM_DISPATCH();
+}
+op_GETIDX:
+    RA = getIndex(RB, RC);
+    VM_DISPATCH();
+op_SETIDX:
+    setIndex(RA, RB, RC);
+    VM_DISPATCH();
+op_LEN:
+    RA = length(RB);
+    VM_DISPATCH();
+
+op_CALL:{
+    const Function* callee = &program.functions[ argBx(ins) ];
+    size_t calleeBase = (base - stack.data()) + argA(ins);
+    frames.push_back(Frame{ fn, pc, (size_t)(base - stack.data()) });
+
+    growStack(calleeBase + callee->frameSize);
+    base = stack.data() + calleeBase;
+    for(unsigned r = callee->params; r < callee->frameSize; r++)
+        base[r] = Value();
+
+    fn = current = callee;
+    pc = callee->code.data();
+    VM_DISPATCH();
+}
+op_CALLB:
+    RA = builtin((Builtin)argB(ins), &RA);
+    VM_DISPATCH();
+op_RET:
+op_RETNIL:{
+    Value result = (opOf(ins) == Opcode::RET ? RA : Value());
+    if(frames.size() == entryFrames)
+        return result;
+
+    // Result goes to the callee's first register - the caller's R[A] of CALL.
+    base[0] = result;
+    const Frame& caller = frames.back();
+    fn = current = caller.fn;
+    pc = caller.pc;
+    base = stack.data() + caller.base;
+    frames.pop_back();
+    VM_DISPATCH();
+}
+op_PRINT:
+    printValue(out, RA);
+    if(argB(ins))
+        out<<'\n';
+    VM_DISPATCH();
+
+    #undef VM_DISPATCH
+    #undef VM_ARITH
+    #undef VM_COMPARE
+    #undef RA
+    #undef RB
+    #undef RC
+}
+
+template Value VM::execute<false>(unsigned, size_t);
+#if GRYVM_COMPUTED_GOTO
+template Value VM::execute<true>(unsigned, size_t);
+#endif
+
+//=========================================//
+// Slow paths
+
+bool VM::truthy(const Value& v){
+    switch(v.type){
+    case Value::Nil:    return false;
+    case Value::Float:  return v.f != 0;
+    case Value::String: return !stringOf(v).empty();
+    case Value::Array:  return true;
+    default:            return v.i != 0;
+    }
+}
+
+static inline bool isIntegral(const Value& v){
+    return v.type == Value::Int || v.type == Value::Char;
+}
+
+static inline bool isNumber(const Value& v){
+    return isIntegral(v) || v.type == Value::Float;
+}
+
+static inline double toDouble(const Value& v){
+    return (v.type == Value::Float ? v.f : (double)v.i);
+}
+
+static std::string toString(const Value& v){
+    switch(v.type){
+    case Value::Char:   return std::string(1, (char)v.i);
+    case Value::String: return stringOf(v);
+    default:{
+        std::ostringstream os;
+        printValue(os, v);
+        return os.str();
+    }
+    }
+}
+
+/*! Arithmetic of values other than two integers, and the integer errors.
+ *  - "+" with a string, or of two chars, concatenates.
+ *  - Chars are integers otherwise. A float operand makes a float result.
+ */
+Value VM::arith(Opcode op, const Value& b, const Value& c){
+    if(op == Opcode::ADD && (b.type == Value::String || c.type == Value::String ||
+                             (b.type == Value::Char && c.type == Value::Char)))
+        return newString(toString(b) + toString(c));
+
+    if(!isNumber(b) || !isNumber(c))
+        runtimeError(std::string("Bad operands of ") + opcodeName(op));
+
+    if(b.type == Value::Float || c.type == Value::Float){
+        double x = toDouble(b), y = toDouble(c);
+        switch(op){
+        case Opcode::ADD: return Value::floating(x + y);
+        case Opcode::SUB: return Value::floating(x - y);
+        case Opcode::MUL: return Value::floating(x * y);
+        case Opcode::DIV: return Value::floating(x / y);
+        default:
+            runtimeError(std::string("Bad float operands of ") + opcodeName(op));
+        }
+    }
+
+    int64_t x = b.i, y = c.i;
+    switch(op){
+    case Opcode::ADD:  return Value::integer((int64_t)((uint64_t)x + (uint64_t)y));
+    case Opcode::SUB:  return Value::integer((int64_t)((uint64_t)x - (uint64_t)y));
+    case Opcode::MUL:  return Value::integer((int64_t)((uint64_t)x * (uint64_t)y));
+    case Opcode::DIV:
+    case Opcode::MOD:
+        if(y == 0)
+            runtimeError("Division by zero");
+        if(y == -1) // INT64_MIN / -1 overflows.
+            return Value::integer(op == Opcode::DIV ? (int64_t)(0 - (uint64_t)x) : 0);
+        return Value::integer(op == Opcode::DIV ? x / y : x % y);
+    case Opcode::SHL:
+    case Opcode::SHR:
+        if((uint64_t)y >= 64)
+            runtimeError("Bad shift count " + std::to_string(y));
+        return Value::integer(op == Opcode::SHL ? (int64_t)((uint64_t)x << y) : x >> y);
+    case Opcode::BAND: return Value::integer(x & y);
+    case Opcode::BOR:  return Value::integer(x | y);
+    case Opcode::BXOR: return Value::integer(x ^ y);
+    default:
+        runtimeError(std::string("Bad arithmetic opcode ") + opcodeName(op));
+    }
+}
+
+/*! Comparison of values other than two integers.
+ *  - Numbers compare by value, strings by contents. Values of other types are
+ *    not equal, and can't be ordered.
+ */
+bool VM::compare(Opcode op, const Value& b, const Value& c){
+    int order;
+    if(isNumber(b) && isNumber(c)){
+        double x = toDouble(b), y = toDouble(c);
+        if(isIntegral(b) && isIntegral(c))
+            order = (b.i < c.i ? -1 : b.i > c.i);
+        else
+            order = (x < y ? -1 : x > y);
+    }
+    else if(b.type == Value::String && c.type == Value::String)
+        order = stringOf(b).compare(stringOf(c));
+    else if(op == Opcode::EQ || op == Opcode::NE){
+        bool same = (b.type == c.type && (b.type == Value::Nil || b.obj == c.obj));
+        return (op == Opcode::EQ ? same : !same);
+    }
+    else
+        runtimeError("Values can't be ordered");
+
+    switch(op){
+    case Opcode::EQ: return order == 0;
+    case Opcode::NE: return order != 0;
+    case Opcode::LT: return order < 0;
+    default:         return order <= 0;
+    }
+}
+
+Value VM::unary(Opcode op, const Value& v){
+    if(op == Opcode::NEG){
+        if(v.type == Value::Float)
+            return Value::floating(-v.f);
+        if(isIntegral(v))
+            return Value::integer((int64_t)(0 - (uint64_t)v.i));
+    }
+    else if(isIntegral(v))
+        return Value::integer(~v.i);
+    runtimeError(std::string("Bad operand of ") + opcodeName(op));
+}
+
+void VM::step(Value& v, int delta){
+    if(v.type == Value::Float)
+        v.f += delta;
+    else if(v.type == Value::Char)
+        v.i = (unsigned char)(v.i + delta);
+    else
+        runtimeError("Only numbers can be incremented");
+}
+
+Value VM::convert(const Value& v, Conversion conv){
+    switch(conv){
+    case Conversion::ToInt:
+        if(v.type == Value::Float)
+            return Value::integer((int64_t)v.f);
+        if(v.type == Value::String)
+            return Value::integer(std::strtoll(stringOf(v).c_str(), nullptr, 10));
+        if(isIntegral(v))
+            return Value::integer(v.i);
+        break;
+    case Conversion::ToFloat:
+        if(v.type == Value::String)
+            return Value::floating(std::strtod(stringOf(v).c_str(), nullptr));
+        if(isNumber(v))
+            return Value::floating(toDouble(v));
+        break;
+    case Conversion::ToChar:
+        if(v.type == Value::Float)
+            return Value::character((int64_t)v.f);
+        if(v.type == Value::String && stringOf(v).size() == 1)
+            return Value::character(stringOf(v)[0]);
+        if(isIntegral(v))
+            return Value::character(v.i);
+        break;
+    case Conversion::ToString:
+        return newString(toString(v));
+    case Conversion::None:
+        return v;
+    }
+    runtimeError("Bad conversion");
+}
+
+Value VM::getIndex(const Value& container, const Value& index){
+    if(!isIntegral(index))
+        runtimeError("Index must be an integer");
+
+    if(container.type == Value::String){
+        const std::string& str = stringOf(container);
+        if((uint64_t)index.i >= str.size())
+            runtimeError("Index " + std::to_string(index.i) + " is out of bounds");
+        return Value::character(str[ index.i ]);
+    }
+    if(container.type == Value::Array){
+        const std::vector<Value>& elems = arrayOf(container);
+        if((uint64_t)index.i >= elems.size())
+            runtimeError("Index " + std::to_string(index.i) + " is out of bounds");
+        return elems[ index.i ];
+    }
+    runtimeError("Only arrays and strings can be indexed");
+}
+
+void VM::setIndex(Value& container, const Value& index, const Value& v){
+    if(!isIntegral(index))
+        runtimeError("Index must be an integer");
+
+    if(container.type == Value::String){
+        std::string& str = stringOf(container);
+        if(container.obj->constant)
+            runtimeError("String constants can't be changed");
+        if(!isIntegral(v))
+            runtimeError("Only chars can be put into a string");
+        if((uint64_t)index.i >= str.size())
+            runtimeError("Index " + std::to_string(index.i) + " is out of bounds");
+        str[ index.i ] = (char)v.i;
+        return;
+    }
+    if(container.type == Value::Array){
+        std::vector<Value>& elems = arrayOf(container);
+        if((uint64_t)index.i >= elems.size())
+            runtimeError("Index " + std::to_string(index.i) + " is out of bounds");
+        elems[ index.i ] = v;
+        return;
+    }
+    runtimeError("Only arrays and strings can be indexed");
+}
+
+/*! Array of the size, with the default elements of the conversion's type.
+ *  Arrays of chars are strings.
+ */
+Value VM::makeArray(const Value& count, Conversion conv){
+    if(!isIntegral(count) || count.i < 0)
+        runtimeError("Bad array size");
+
+    if(conv == Conversion::ToChar)
+        return newString(std::string((size_t)count.i, '\0'));
+
+    Value elem;
+    if(conv == Conversion::ToInt)
+        elem = Value::integer(0);
+    else if(conv == Conversion::ToFloat)
+        elem = Value::floating(0);
+    return newArray(std::vector<Value>((size_t)count.i, elem));
+}
+
+Value VM::length(const Value& v){
+    if(v.type == Value::String)
+        return Value::integer((int64_t)stringOf(v).size());
+    if(v.type == Value::Array)
+        return Value::integer((int64_t)arrayOf(v).size());
+    runtimeError("Only arrays and strings have a length");
+}
+
+/*! Builtins. rand() is xorshift64, so runs are reproducible.
+ */
+Value VM::builtin(Builtin id, Value* args){
+    switch(id){
+    case Builtin::Rand:
+        randState ^= randState << 13;
+        randState ^= randState >> 7;
+        randState ^= randState << 17;
+        return Value::integer((int64_t)(randState >> 33));
+    case Builtin::SRand:
+        if(!isIntegral(args[0]))
+            runtimeError("srand() takes an integer");
+        randState = (uint64_t)args[0].i * 2654435761u + 1;
+        return Value();
+    case Builtin::Len:
+        return length(args[0]);
+    }
+    runtimeError("Bad builtin");
+}
+
+//=========================================//
+// Heap
+
+Value VM::newString(std::string&& str){
+    StringObject* obj = new StringObject(std::move(str));
+    link(obj);
+    return Value::object(Value::String, obj);
+}
+
+Value VM::newArray(std::vector<Value>&& elems){
+    ArrayObject* obj = new ArrayObject();
+    obj->elems = std::move(elems);
+    link(obj);
+    return Value::object(Value::Array, obj);
+}
+
+/*! Puts the new object on the heap. Collects first, if the heap has grown
+ *  enough - the object is not reachable yet, so it's not on the list during it.
+ */
+void VM::link(Object* obj){
+    if(heapCount >= nextCollection)
+        collect();
+    obj->next = heap;
+    heap = obj;
+    heapCount++;
+}
+
+void VM::freeObject(Object* obj){
+    if(obj->kind == Object::StringObj)
+        delete static_cast<StringObject*>(obj);
+    else
+        delete static_cast<ArrayObject*>(obj);
+}
+
+void VM::collect(){
+    // Mark. Constants are never on the heap, so they're skipped.
+    std::vector<Object*> gray;
+    auto markValue = [&gray](const Value& v){
+        if(v.isObject() && !v.obj->marked && !v.obj->constant){
+            v.obj->marked = true;
+            gray.push_back(v.obj);
+        }
+    };
+
+    for(auto&& v : stack)
+        markValue(v);
+    for(auto&& g : globals)
+        markValue(g);
+    while(!gray.empty()){
+        Object* obj = gray.back();
+        gray.pop_back();
+        if(obj->kind == Object::ArrayObj){
+            for(auto&& v : static_cast<ArrayObject*>(obj)->elems)
+                markValue(v);
+        }
+    }
+
+    // Sweep.
+    Object** link = &heap;
+    while(*link){
+        Object* obj = *link;
+        if(obj->marked){
+            obj->marked = false;
+            link = &obj->next;
+        }
+        else{
+            *link = obj->next;
+            freeObject(obj);
+            heapCount--;
+        }
+    }
+    nextCollection = (heapCount * 2 > MIN_COLLECTION ? heapCount * 2 : MIN_COLLECTION);
+}
+
+}
+}
@@ -0,0 +1,111 @@
+#ifndef VM_H_INCLUDED
+#define VM_H_INCLUDED
+
+#include "bytecode.h"
+#include <vector>
+#include <string>
+#include <ostream>
+
+// Threaded dispatch needs the "labels as values" extension. Define
+// GRYVM_SWITCH_DISPATCH to build with the switch dispatch only.
+#if defined(__GNUC__) && !defined(GRYVM_SWITCH_DISPATCH)
+    #define GRYVM_COMPUTED_GOTO 1
+#else
+    #define GRYVM_COMPUTED_GOTO 0
+#endif
+
+namespace gpar{
+namespace vm{
+
+/*! Grylang bytecode interpreter.
+ *  - Instruction handlers are shared by two dispatch loops: threaded, where
+ *    every handler jumps to the next one through a label table (computed goto),
+ *    and a central switch. Threaded one is used when it's available.
+ *  - Registers of all frames are in one stack. A frame is a window of it.
+ *  - Strings and arrays are collected by mark & sweep. Roots are the globals
+ *    and the whole register stack: registers above the running frame can be
+ *    read again after a return, so they must not point to freed objects.
+ *  - Runtime errors throw std::runtime_error.
+ */
+class VM
+{
+public:
+    enum class Dispatch{ Threaded, Switch };
+
+private:
+    const Program& program;
+    std::ostream& out;
+    Dispatch dispatch = (GRYVM_COMPUTED_GOTO ? Dispatch::Threaded : Dispatch::Switch);
+
+    std::vector<Value> stack;
+    std::vector<Value> globals;
+
+    struct Frame{
+        const Function* fn;
+        const Instr* pc;
+        size_t base;
+    };
+    std::vector<Frame> frames; // Callers of the running function.
+
+    const Function* current = nullptr; // Running function, for errors.
+
+    // Heap.
+    Object* heap = nullptr;
+    size_t heapCount = 0;
+    size_t nextCollection = MIN_COLLECTION;
+    static const size_t MIN_COLLECTION = 4096;
+    static const size_t MAX_STACK = 1 << 22;
+
+    uint64_t randState = 88172645463325252ull;
+
+    template<bool Threaded>
+    Value execute(unsigned function, size_t base);
+    Value invoke(unsigned function, size_t base);
+    void growStack(size_t size);
+
+    // Heap.
+    Value newString(std::string&& str);
+    Value newArray(std::vector<Value>&& elems);
+    void link(Object* obj);
+    void collect();
+    void freeObject(Object* obj);
+
+    // Slow paths of the instructions.
+    Value arith(Opcode op, const Value& b, const Value& c);
+    bool compare(Opcode op, const Value& b, const Value& c);
+    Value convert(const Value& v, Conversion conv);
+    Value unary(Opcode op, const Value& v);
+    void step(Value& v, int delta);
+    Value getIndex(const Value& container, const Value& index);
+    void setIndex(Value& container, const Value& index, const Value& v);
+    Value makeArray(const Value& count, Conversion conv);
+    Value length(const Value& v);
+    Value builtin(Builtin id, Value* args);
+    static bool truthy(const Value& v);
+
+    [[noreturn]] void runtimeError(const std::string& msg) const;
+
+public:
+    VM(const Program& prog, std::ostream& output);
+    ~VM();
+
+    VM(const VM&) = delete;
+    VM& operator=(const VM&) = delete;
+
+    static bool threadedAvailable(){ return GRYVM_COMPUTED_GOTO; }
+    void setDispatch(Dispatch d);
+
+    /*! Runs the init function, and main, if present.
+     *  Main gets argc and argv, if it has the params.
+     *  @return main's result if it's an integer, 0 otherwise.
+     *  @throws runtime_error on a runtime error.
+     */
+    int run(const std::vector<std::string>& args = std::vector<std::string>());
+
+    size_t heapObjects() const { return heapCount; }
+};
+
+}
+}
+
+#endif //VM_H_INCLUDED